@@ -7,6 +7,12 @@
 #include <openssl/pem.h>
 #include <openssl/err.h>
 #include <limits>
+#include <algorithm>
+#include <filesystem>
+#include <sstream>
+#include <fstream>
+#include <iomanip>
+#include <ctime>
 #include "../security/Util.h"
 #include "../security/crypto.h"
 #include "../security/Diffie-Hellman.h"
@@ -14,6 +20,7 @@
 #include "Client.h"
 
 #include "../tools/file.h"
+#include "../tools/compressor.h"
 #include "../packets/upload.h"
 #include "../packets/wrapper.h"
 #include "../packets/download.h"
@@ -21,6 +28,11 @@
 #include "../packets/rename.h"
 #include "../packets/delete.h"
 #include "../packets/logout.h"
+#include "../packets/sync.h"
+#include "../packets/batch.h"
+#include "../packets/archive.h"
+#include "../packets/version.h"
+#include "../tools/fingerprint.h"
 
 using namespace std;
 
@@ -31,6 +43,11 @@ enum class MenuOption
     ListFiles,
     RenameFile,
     DeleteFile,
+    SyncFile,
+    UploadFiles,
+    DownloadFiles,
+    DownloadArchive,
+    FileVersions,
     Logout
 };
 
@@ -493,10 +510,15 @@ int Client::start()
         std::cout << "3. List Files" << std::endl;
         std::cout << "4. Rename File" << std::endl;
         std::cout << "5. Delete File" << std::endl;
-        std::cout << "6. Logout" << std::endl;
+        std::cout << "6. Sync File" << std::endl;
+        std::cout << "7. Upload Files" << std::endl;
+        std::cout << "8. Download Files" << std::endl;
+        std::cout << "9. Download Archive" << std::endl;
+        std::cout << "10. File Versions" << std::endl;
+        std::cout << "11. Logout" << std::endl;
 
         // Get user input
-        std::cout << "[CLIENT] Enter your choice (1-6): ";
+        std::cout << "[CLIENT] Enter your choice (1-11): ";
         std::getline(std::cin, choice);
 
         // Handle menu choice
@@ -562,8 +584,21 @@ int Client::upload_file()
         return 0;
     }
 
+    // fingerprint the content so the server can skip whatever it already stores
+    Fingerprint::Digest file_digest;
+    std::vector<Fingerprint::ChunkRef> chunks;
+    try
+    {
+        file_digest = Fingerprint::scanFile(file_path, chunks);
+    }
+    catch (const std::exception &e)
+    {
+        std::cerr << "[UPLOAD] " << e.what() << std::endl;
+        return 0;
+    }
+
     // Create Upload M1 type packet
-    UploadM1 m1(file.get_file_name(), file.getFileSize());
+    UploadM1 m1(file.get_file_name(), file.getFileSize(), Compression::LZ4, file_digest);
     Buffer serializedPacket = m1.serialize();
     // Create on the M1 message the wrapper packet to be sent
     Wrapper m1_wrapper(session_key, s_counter, serializedPacket);
@@ -619,46 +654,61 @@ int Client::upload_file()
         return 0;
     }
 
-    // -------------- HANDLE SENDING FILE CHUNKS ---------------------
-    size_t chunk_size = MAX::max_file_chunk;
-    int num_file_chunks = file.getFileSize() / chunk_size;
-    int last_chunk_size = file.getFileSize() % chunk_size;
-    UploadM2 m2_packet;
-    Wrapper m2_wrapper;
-
-    // Send chunks to server
-    for (int i = 0; i < num_file_chunks; i++)
+    if (ack.getAckCode() == 4)
     {
-        m2_packet = UploadM2(file.readChunk(chunk_size));
+        std::cerr << "[UPLOAD] Not enough quota left on the cloud for this file!" << endl;
+        return 0;
+    }
 
-        m2_wrapper = Wrapper(session_key, s_counter, m2_packet.serialize());
+    ChunkCompressor compressor(ack.getCompression());
+    uint8_t mode = ack.getAckCode();
+    int result;
 
-        serialized_packet = m2_wrapper.serialize();
-        if (!sendData(communcation_socket, serialized_packet))
+    // -------------- HANDLE THE INSTANT UPLOAD SHORTCUTS ---------------------
+    if (mode == 3)
+    {
+        result = upload_proof(file_path, mode);
+        if (result != 1)
+            return result;
+
+        if (mode == 1)
         {
-            std::cerr << "[UPLOAD] Error sending the serialized packet" << std::endl;
-            return 0;
+            std::cout << "[UPLOAD] " << file.get_file_name() << " uploaded instantly, the cloud already had its content" << std::endl;
+            return 1;
         }
-
-        s_counter = incrementCounter(s_counter);
-        if (s_counter == -1)
+        if (mode != 2)
         {
-            std::cerr << "[UPLOAD] Counter reached maximum value" << std::endl;
-            return -1;
+            std::cerr << "[UPLOAD] Uploading file " << file.get_file_name() << " has failed!" << std::endl;
+            return 0;
         }
+    }
 
-        // Log upload progess
-        cout << "[UPLOAD] Uploaded " << (i + 1) * chunk_size << "/" << file.getFileSize() << "Bytes" << endl;
+    if (mode == 2)
+    {
+        result = upload_manifest(file, chunks, compressor);
+        if (result != 1)
+            return result;
     }
-    // send remaining data in file (if there's any)
-    if (last_chunk_size != 0)
+
+    // -------------- HANDLE SENDING FILE CHUNKS ---------------------
+    size_t chunk_size = MAX::max_file_chunk;
+    uintmax_t sent_size = 0;
+    UploadM2 m2_packet;
+    Wrapper m2_wrapper;
+
+    // Send chunks to server
+    while (mode == 1 && sent_size < file.getFileSize())
     {
-        m2_packet = UploadM2(file.readChunk(last_chunk_size));
+        size_t current_chunk_size = std::min<uintmax_t>(chunk_size, file.getFileSize() - sent_size);
+        uint8_t chunk_flags;
+        Buffer chunk = compressor.encode(file.readChunk(current_chunk_size), chunk_flags);
 
-        Wrapper m2_wrapper(session_key, s_counter, m2_packet.serialize());
+        m2_packet = UploadM2(chunk, chunk_flags);
+
+        m2_wrapper = Wrapper(session_key, s_counter, m2_packet.serialize());
 
         serialized_packet = m2_wrapper.serialize();
-        if (!sendData(communcation_socket, serialized_packet))
+        if (!sendFrame(communcation_socket, serialized_packet))
         {
             std::cerr << "[UPLOAD] Error sending the serialized packet" << std::endl;
             return 0;
@@ -670,9 +720,14 @@ int Client::upload_file()
             std::cerr << "[UPLOAD] Counter reached maximum value" << std::endl;
             return -1;
         }
+
+        sent_size += current_chunk_size;
+
+        // Log upload progess
+        cout << "[UPLOAD] Uploaded " << sent_size << "/" << file.getFileSize() << "Bytes" << endl;
     }
 
-    cout << "[UPLOAD] Uploaded " << file.getFileSize() << "/" << file.getFileSize() << "Bytes" << endl;
+    compressor.printStats("[UPLOAD]");
 
     // -------------- HANDLE ACK PACKET ---------------------
     Buffer final_ack_buffer(Wrapper::getSize(UploadAck::getSize()));
@@ -713,6 +768,227 @@ int Client::upload_file()
     cout << "********************************************" << endl;
     return 1;
 }
+int Client::upload_proof(const std::string &file_path, uint8_t &mode)
+{
+    // -------------- HANDLE RECEIVING THE CHALLENGE ---------------------
+    Buffer challenge_buffer(Wrapper::getSize(UploadProof::getSize()));
+    if (!receiveData(communcation_socket, challenge_buffer))
+    {
+        std::cerr << "[UPLOAD] Error receiving  data" << std::endl;
+        return 0;
+    }
+
+    Wrapper challenge_wrapper(session_key);
+    if (!challenge_wrapper.deserialize(challenge_buffer))
+    {
+        std::cerr << "[UPLOAD] Wrapper packet wasn't deserialized correctly!" << endl;
+        return 0;
+    }
+
+    if (challenge_wrapper.getCounter() != r_counter)
+        return -1;
+
+    r_counter = incrementCounter(r_counter);
+    if (r_counter == -1)
+    {
+        std::cerr << "[UPLOAD] Counter reached maximum value" << std::endl;
+        return -1;
+    }
+
+    UploadProof challenge;
+    challenge.deserialize(challenge_wrapper.getPayload());
+
+    // -------------- HANDLE SENDING THE PROOF ---------------------
+    // the proof covers the whole content under a fresh nonce, a known digest alone is not enough
+    Fingerprint::Digest proof = {};
+    std::ifstream content(file_path, std::ios::binary);
+    try
+    {
+        proof = Fingerprint::possessionProof(challenge.getValue(), content);
+    }
+    catch (const std::exception &e)
+    {
+        std::cerr << "[UPLOAD] " << e.what() << std::endl;
+    }
+
+    UploadProof proof_packet(Buffer(proof.begin(), proof.end()));
+    Wrapper proof_wrapper(session_key, s_counter, proof_packet.serialize());
+
+    Buffer serialized_packet = proof_wrapper.serialize();
+    if (!sendData(communcation_socket, serialized_packet))
+    {
+        std::cerr << "[UPLOAD] Error sending the serialized packet" << std::endl;
+        return 0;
+    }
+
+    s_counter = incrementCounter(s_counter);
+    if (s_counter == -1)
+    {
+        std::cerr << "[UPLOAD] Counter reached maximum value" << std::endl;
+        return -1;
+    }
+
+    // -------------- HANDLE ACK PACKET ---------------------
+    Buffer ack_buffer(Wrapper::getSize(UploadAck::getSize()));
+    if (!receiveData(communcation_socket, ack_buffer))
+    {
+        std::cerr << "[UPLOAD] Error receiving  data" << std::endl;
+        return 0;
+    }
+
+    Wrapper ack_wrapper(session_key);
+    if (!ack_wrapper.deserialize(ack_buffer))
+    {
+        std::cerr << "[UPLOAD] Wrapper packet wasn't deserialized correctly!" << endl;
+        return 0;
+    }
+
+    if (ack_wrapper.getCounter() != r_counter)
+        return -1;
+
+    r_counter = incrementCounter(r_counter);
+    if (r_counter == -1)
+    {
+        std::cerr << "[UPLOAD] Counter reached maximum value" << std::endl;
+        return -1;
+    }
+
+    // 1 means the file is stored, 2 means go on with the chunk manifest
+    UploadAck ack;
+    ack.deserialize(ack_wrapper.getPayload());
+    mode = ack.getAckCode();
+
+    return 1;
+}
+
+int Client::upload_manifest(File &file, const std::vector<Fingerprint::ChunkRef> &chunks, ChunkCompressor &compressor)
+{
+    Buffer serialized_packet;
+    std::vector<bool> have;
+
+    // -------------- HANDLE THE CHUNK MANIFEST ---------------------
+    for (size_t i = 0; i < chunks.size(); i += MAX::manifest_entries_per_frame)
+    {
+        size_t end = std::min(chunks.size(), i + MAX::manifest_entries_per_frame);
+        vector<ManifestEntry> batch;
+
+        for (size_t j = i; j < end; j++)
+            batch.push_back({chunks[j].digest, chunks[j].size});
+
+        UploadManifest manifest(batch);
+        Wrapper manifest_wrapper(session_key, s_counter, manifest.serialize());
+
+        serialized_packet = manifest_wrapper.serialize();
+        if (!sendFrame(communcation_socket, serialized_packet))
+        {
+            std::cerr << "[UPLOAD] Error sending the serialized packet" << std::endl;
+            return 0;
+        }
+
+        s_counter = incrementCounter(s_counter);
+        if (s_counter == -1)
+        {
+            std::cerr << "[UPLOAD] Counter reached maximum value" << std::endl;
+            return -1;
+        }
+
+        Buffer message_buff;
+        if (!receiveFrame(communcation_socket, message_buff, Wrapper::getSize(UploadHave::getSize(MAX::manifest_entries_per_frame))))
+        {
+            std::cerr << "[UPLOAD] Error receiving  data" << std::endl;
+            return 0;
+        }
+
+        Wrapper have_wrapper(session_key);
+        if (!have_wrapper.deserialize(message_buff))
+        {
+            std::cerr << "[UPLOAD] Wrapper packet wasn't deserialized correctly!" << endl;
+            return 0;
+        }
+
+        if (have_wrapper.getCounter() != r_counter)
+            return -1;
+
+        r_counter = incrementCounter(r_counter);
+        if (r_counter == -1)
+        {
+            std::cerr << "[UPLOAD] Counter reached maximum value" << std::endl;
+            return -1;
+        }
+
+        UploadHave have_packet;
+        have_packet.deserialize(have_wrapper.getPayload());
+
+        // the server answers with an empty bitmap when it rejects the manifest
+        if (have_packet.getHave().size() != batch.size())
+        {
+            std::cerr << "[UPLOAD] The cloud rejected the chunk manifest" << std::endl;
+            return 0;
+        }
+
+        have.insert(have.end(), have_packet.getHave().begin(), have_packet.getHave().end());
+    }
+
+    // -------------- HANDLE SENDING THE MISSING CHUNKS ---------------------
+    size_t piece_size = MAX::max_file_chunk;
+    uintmax_t missing_size = 0;
+    uintmax_t sent_size = 0;
+
+    for (size_t i = 0; i < chunks.size(); i++)
+        if (!have[i])
+            missing_size += chunks[i].size;
+
+    cout << "[UPLOAD] The cloud already has " << (file.getFileSize() - missing_size) << "B of " << file.getFileSize() << "B" << endl;
+
+    for (size_t i = 0; i < chunks.size(); i++)
+    {
+        if (have[i])
+            continue;
+
+        try
+        {
+            file.seek(chunks[i].offset);
+        }
+        catch (const std::exception &e)
+        {
+            std::cerr << "[UPLOAD] " << e.what() << std::endl;
+            return 0;
+        }
+
+        // every missing chunk goes in pieces of at most max_file_chunk bytes
+        for (uint32_t chunk_sent = 0; chunk_sent < chunks[i].size;)
+        {
+            size_t current_piece_size = std::min<size_t>(piece_size, chunks[i].size - chunk_sent);
+            uint8_t chunk_flags;
+            Buffer piece = compressor.encode(file.readChunk(current_piece_size), chunk_flags);
+
+            UploadM2 m2_packet(piece, chunk_flags);
+            Wrapper m2_wrapper(session_key, s_counter, m2_packet.serialize());
+
+            serialized_packet = m2_wrapper.serialize();
+            if (!sendFrame(communcation_socket, serialized_packet))
+            {
+                std::cerr << "[UPLOAD] Error sending the serialized packet" << std::endl;
+                return 0;
+            }
+
+            s_counter = incrementCounter(s_counter);
+            if (s_counter == -1)
+            {
+                std::cerr << "[UPLOAD] Counter reached maximum value" << std::endl;
+                return -1;
+            }
+
+            chunk_sent += current_piece_size;
+            sent_size += current_piece_size;
+        }
+
+        cout << "[UPLOAD] Uploaded " << sent_size << "/" << missing_size << "Bytes" << endl;
+    }
+
+    return 1;
+}
+
 int Client::download_file()
 {
     bool file_valid = false;
@@ -735,8 +1011,22 @@ int Client::download_file()
         return 0;
     }
 
+    // a previous download of the file left its entity tag next to it
+    string downloads_path = "../downloads";
+    string local_path = downloads_path + "/" + filename;
+    string etag_path = downloads_path + "/." + filename + ".etag";
+    string partial_path = downloads_path + "/.partial";
+    string temp_path = partial_path + "/" + filename;
+    string local_etag;
+
+    if (File::exists(local_path))
+    {
+        std::ifstream etag_file(etag_path);
+        std::getline(etag_file, local_etag);
+    }
+
     // Create Download M1 type packet
-    DownloadM1 m1(filename);
+    DownloadM1 m1(filename, Compression::LZ4, local_etag);
 
     // Create on the M1 message the wrapper packet to be sent
     Wrapper m1_wrapper(session_key, s_counter, m1.serialize());
@@ -788,6 +1078,15 @@ int Client::download_file()
     DownloadAck ack;
     ack.deserialize(wrapped_packet.getPayload());
 
+    if (ack.getAckCode() == 2)
+    {
+        cout << "[Download] " << local_path << " is up to date, nothing to transfer" << endl;
+        cout << "********************************************" << endl;
+        cout << "**********  End Download File    ***********" << endl;
+        cout << "********************************************" << endl;
+        return 1;
+    }
+
     if (ack.getAckCode())
     {
         std::cerr << "[Download] File does not exist on the cloud!" << endl;
@@ -799,23 +1098,30 @@ int Client::download_file()
 
     File file;
     size_t chunk_size = MAX::max_file_chunk;
-    int num_file_chunks = file_size / chunk_size;
-    int last_chunk_size = file_size % chunk_size;
+    size_t max_frame_size = Wrapper::getSize(DownloadM2::getSize(chunk_size));
+    uintmax_t received_size = 0;
     DownloadM2 m2_packet;
     Wrapper m2_wrapper;
     bool error_occured = false;
 
     // Create "downloads" folder if it doesn't exist
-    string downloads_path = "../downloads";
     if (!(std::filesystem::exists(downloads_path) && std::filesystem::is_directory(downloads_path)))
     {
         if (!std::filesystem::create_directory(downloads_path))
             return 0;
     }
 
+    // an outdated copy we downloaded ourselves is replaced once the new one is complete
+    bool replace = !local_etag.empty();
+
     try
     {
-        file.create(downloads_path + "/" + (string)filename);
+        if (replace)
+        {
+            std::filesystem::create_directory(partial_path);
+            std::filesystem::remove(temp_path);
+        }
+        file.create(replace ? temp_path : local_path);
     }
     catch (const std::exception &e)
     {
@@ -823,17 +1129,18 @@ int Client::download_file()
         error_occured = true;
     }
 
-    // Receive chunks from server
-    for (int i = 0; i < num_file_chunks; i++)
+    // Receive chunks from server, each one is framed since compressed chunks vary in size
+    while (received_size < file_size)
     {
+        size_t expected_size = std::min<uintmax_t>(chunk_size, file_size - received_size);
+
         // receive Wrapper packet message
-        Buffer message_buff(Wrapper::getSize(DownloadM2::getSize(chunk_size)));
+        Buffer message_buff;
 
-        if (!receiveData(communcation_socket, message_buff))
+        if (!receiveFrame(communcation_socket, message_buff, max_frame_size))
         {
             std::cerr << "[Download] Error receiving data" << std::endl;
-            error_occured = true;
-            continue;
+            return 0;
         }
 
         m2_wrapper = Wrapper(session_key);
@@ -841,8 +1148,7 @@ int Client::download_file()
         if (!m2_wrapper.deserialize(message_buff))
         {
             std::cerr << "[Download] Wrapper packet wasn't deserialized correctly!" << endl;
-            error_occured = true;
-            continue;
+            return 0;
         }
 
         // Check counter otherwise exit
@@ -859,57 +1165,39 @@ int Client::download_file()
         m2_packet = DownloadM2();
         m2_packet.deserialize(m2_wrapper.getPayload());
 
-        if (!error_occured)
-            file.writeChunk(m2_packet.getFileChunk());
-
-        // Log receival progess
-        if (!error_occured)
-            cout << "[Download] Downloaded " << (i + 1) * chunk_size << "B/ " << file_size << "B" << endl;
-    }
-
-    // receive remaining data in file (if there's any)
-    if (last_chunk_size != 0)
-    {
-        Buffer message_buff(Wrapper::getSize(DownloadM2::getSize(last_chunk_size)));
-
-        if (!receiveData(communcation_socket, message_buff))
-        {
-            std::cerr << "[Download] Error receiving  data" << std::endl;
-            error_occured = true;
-            return 0;
-        }
-
-        m2_wrapper = Wrapper(session_key);
-
-        if (!m2_wrapper.deserialize(message_buff))
+        Buffer chunk;
+        if (!ChunkCompressor::decode(m2_packet.getFileChunk(), m2_packet.getChunkFlags(), expected_size, chunk))
         {
-            std::cerr << "[Download] Wrapper packet wasn't deserialized correctly!" << endl;
+            std::cerr << "[Download] Malformed file chunk" << std::endl;
             error_occured = true;
-            return 0;
         }
 
-        // Check counter otherwise exit
-        if (m2_wrapper.getCounter() != r_counter)
-            return -1;
-
-        r_counter = incrementCounter(r_counter);
-        if (r_counter == -1)
-        {
-            std::cerr << "[DOWNLOAD] Counter reached maximum value" << std::endl;
-            return -1;
-        }
+        if (!error_occured)
+            file.writeChunk(chunk);
 
-        m2_packet = DownloadM2();
-        m2_packet.deserialize(m2_wrapper.getPayload());
+        received_size += expected_size;
 
+        // Log receival progess
         if (!error_occured)
-            file.writeChunk(m2_packet.getFileChunk());
+            cout << "[Download] Downloaded " << received_size << "B/ " << file_size << "B" << endl;
     }
-    if (!error_occured)
-        cout << "[Download] Downloaded " << file_size << "B/ " << file_size << "B" << endl;
 
     // ----------------------------------------------------------------------------
 
+    file.close();
+    if (!error_occured && replace && rename(temp_path.c_str(), local_path.c_str()) != 0)
+        error_occured = true;
+
+    if (replace && error_occured)
+        std::filesystem::remove(temp_path);
+
+    // remember the version we now hold
+    if (!error_occured && !ack.getEtag().empty())
+    {
+        std::ofstream etag_file(etag_path, std::ios::trunc);
+        etag_file << ack.getEtag() << std::endl;
+    }
+
     if (error_occured)
         std::cerr << "[Download] File wasn't downloaded correctly!" << endl;
     else
@@ -922,123 +1210,144 @@ int Client::download_file()
 }
 int Client::list_files()
 {
-    bool file_valid = false;
-    File file;
-
     cout << "****************************************" << endl;
     cout << "*********     List Files    *********" << endl;
     cout << "****************************************" << endl;
 
-    // Create List M1 type packet
-    ListM1 m1;
-
-    Buffer serializedPacket = m1.serialize();
-    // Create on the M1 message the wrapper packet to be sent
-    Wrapper m1_wrapper(session_key, s_counter, serializedPacket);
-
-    // serialize M1 Wrapper packet
-    Buffer serialized_packet = m1_wrapper.serialize();
+    // an optional filter evaluated by the server: wildcards make it a glob, otherwise a name prefix
+    std::cout << "[LIST] Enter a name prefix or a glob pattern (empty for every file):" << endl;
+    std::string pattern;
+    std::getline(std::cin, pattern);
 
-    // send wrapped packet to server
-    if (!sendData(communcation_socket, serialized_packet))
+    if (!cin || pattern.size() > MAX::list_pattern)
     {
-        std::cerr << "[LIST] Error sending data to the server" << std::endl;
+        cerr << "[LIST] Invalid filter" << endl;
+        std::cin.clear(); // put us back in 'normal' operation mode
         return 0;
     }
-    clear_vec(serialized_packet);
 
-    // increment counter
-    s_counter = incrementCounter(s_counter);
-    if (s_counter == -1)
-    {
-        std::cerr << "[LIST] Counter reached maximum value" << std::endl;
-        return -1;
-    }
-
-    // -------------- HANDLE ACK PACKET ---------------------
-    Buffer ack_buffer(Wrapper::getSize(ListM2::getSize()));
-    if (!receiveData(communcation_socket, ack_buffer))
-    {
-        std::cerr << "[LIST] Error receiving  data" << std::endl;
-        return 0;
-    }
-    // deserialize to extract payload in plaintext
-    Wrapper wrapped_packet(session_key);
-
-    if (!wrapped_packet.deserialize(ack_buffer))
-    {
-        std::cerr << "[LIST] Wrapper packet wasn't deserialized correctly!" << endl;
-        return 0;
-    }
-
-    if (wrapped_packet.getCounter() != r_counter)
-        return -1;
-
-    // increment counter
-    r_counter = incrementCounter(r_counter);
-    if (r_counter == -1)
-    {
-        std::cerr << "[LIST] Counter reached maximum value" << std::endl;
-        return -1;
-    }
-
-    ListM2 ack_size_packet;
-    ack_size_packet.deserialize(wrapped_packet.getPayload());
-
-    if (ack_size_packet.getAckCode() == 1)
-    {
-        std::cerr << "[LIST] Folder doe not exist on the cloud!" << endl;
-        return 0;
-    }
-
-    uint32_t file_list_size = ack_size_packet.getFile_List_Size();
+    uint8_t filter = ListFilter::NONE;
+    if (pattern.find_first_of("*?[") != std::string::npos)
+        filter = ListFilter::GLOB;
+    else if (!pattern.empty())
+        filter = ListFilter::PREFIX;
 
-    // receive the list of files from the server
+    size_t max_frame_size = Wrapper::getSize(ListPage::getMaxSize(MAX::list_entries_per_frame));
+    size_t listed = 0;
+    std::string cursor;
+    // the listing is kept per filter and only re-sent when the folder tag moved
+    ListingCache &cache = listing_cache[pattern];
+    std::ostringstream output;
+    std::string listing_etag;
+    bool consistent = true;
+    bool not_modified = false;
 
-    ListM3 m3(file_list_size);
-
-    Buffer list_buffer(Wrapper::getSize(m3.getSize()));
-    if (!receiveData(communcation_socket, list_buffer))
-    {
-        std::cerr << "[LIST] Error receiving data" << std::endl;
-        return 0;
-    }
-
-    // deserialize to extract payload in plaintext
-    Wrapper m3_wrapper(session_key);
-
-    if (!m3_wrapper.deserialize(list_buffer))
+    // one page per request, pages are chained by the name that closed the previous one
+    do
     {
-        std::cerr << "[LIST] Wrapper packet wasn't deserialized correctly!" << endl;
-        return 0;
-    }
+        ListPageM1 m1(cursor, filter, pattern, MAX::list_page, cursor.empty() ? cache.etag : "");
+        Wrapper m1_wrapper(session_key, s_counter, m1.serialize());
 
-    if (m3_wrapper.getCounter() != r_counter)
-        return -1;
+        Buffer serialized_packet = m1_wrapper.serialize();
+        if (!sendData(communcation_socket, serialized_packet))
+        {
+            std::cerr << "[LIST] Error sending data to the server" << std::endl;
+            return 0;
+        }
 
-    m3.deserialize(m3_wrapper.getPayload());
-    std::string fileListData = m3.getFileListData();
+        s_counter = incrementCounter(s_counter);
+        if (s_counter == -1)
+        {
+            std::cerr << "[LIST] Counter reached maximum value" << std::endl;
+            return -1;
+        }
 
-    // print the file names
-    std::istringstream ss(fileListData);
+        // -------------- HANDLE RECEIVING THE PAGE ---------------------
+        bool last = false;
+        while (!last)
+        {
+            Buffer message_buff;
+
+            if (!receiveFrame(communcation_socket, message_buff, max_frame_size))
+            {
+                std::cerr << "[LIST] Error receiving data" << std::endl;
+                return 0;
+            }
+
+            Wrapper page_wrapper(session_key);
+
+            if (!page_wrapper.deserialize(message_buff))
+            {
+                std::cerr << "[LIST] Wrapper packet wasn't deserialized correctly!" << endl;
+                return 0;
+            }
+
+            if (page_wrapper.getCounter() != r_counter)
+                return -1;
+
+            r_counter = incrementCounter(r_counter);
+            if (r_counter == -1)
+            {
+                std::cerr << "[LIST] Counter reached maximum value" << std::endl;
+                return -1;
+            }
+
+            ListPage page;
+            if (!page.deserialize(page_wrapper.getPayload()))
+            {
+                std::cerr << "[LIST] Malformed page" << std::endl;
+                return 0;
+            }
+
+            // nothing changed since the cached listing, the server sent no entries
+            if (page.getAckCode() == 2)
+            {
+                std::cout << cache.output;
+                listed = cache.count;
+                not_modified = true;
+                break;
+            }
+
+            if (page.getAckCode() != 0)
+            {
+                std::cerr << "[LIST] Folder doe not exist on the cloud!" << endl;
+                return 0;
+            }
+
+            // a listing spanning a change of the folder is shown but never cached
+            if (listing_etag.empty())
+                listing_etag = page.getEtag();
+            else if (listing_etag != page.getEtag())
+                consistent = false;
+
+            // name, size, modification time and the start of the content hash when known
+            for (const ListEntry &entry : page.getEntries())
+            {
+                time_t mtime = entry.mtime;
+                char date[32];
+                strftime(date, sizeof(date), "%Y-%m-%d %H:%M", localtime(&mtime));
+
+                std::ostringstream line;
+                line << std::left << std::setw(22) << entry.file_name << std::right << std::setw(12) << entry.file_size
+                     << "  " << date << "  " << (entry.digest.empty() ? "-" : entry.digest.substr(0, 16)) << std::endl;
+
+                std::cout << line.str();
+                output << line.str();
+            }
+
+            listed += page.getEntries().size();
+            last = page.isLast();
+            cursor = page.getNextCursor();
+        }
+    } while (!not_modified && !cursor.empty());
 
-    // Temporary string to store each element
-    std::string token;
+    std::cout << "[LIST] " << listed << " files" << (not_modified ? " (not modified)" : "") << std::endl;
 
-    // Use std::getline to split the string by commas
-    while (std::getline(ss, token, ','))
-    {
-        // Print the file name
-        std::cout << token << std::endl;
-    }
+    if (!not_modified && consistent)
+        cache = {listing_etag, output.str(), listed};
+    else if (!not_modified)
+        listing_cache.erase(pattern);
 
-    // incrment the counter
-    r_counter = incrementCounter(r_counter);
-    if (r_counter == -1)
-    {
-        std::cerr << "[LIST] Counter reached maximum value" << std::endl;
-        return -1;
-    }
     cout << "****************************************" << endl;
     cout << "*********     End List Files    *********" << endl;
     cout << "****************************************" << endl;
@@ -1258,6 +1567,236 @@ int Client::delete_file()
 
     return 1;
 }
+int Client::sync_file()
+{
+    File file;
+
+    cout << "****************************************" << endl;
+    cout << "*********      SYNC FILE       *********" << endl;
+    cout << "****************************************" << endl;
+
+    // Read file path from console
+    std::cout << "[SYNC] Enter file path:" << endl;
+    std::string file_path;
+    std::getline(std::cin, file_path);
+
+    // make sure input was valid and non null
+    if (!cin || file_path.empty())
+    {
+        cerr << "[SYNC] Invalid file path input" << endl;
+        std::cin.clear(); // put us back in 'normal' operation mode
+        std::cin.ignore(std::numeric_limits<std::streamsize>::max(), '\n');
+        return 0;
+    }
+
+    // open the file denoted in path
+    try
+    {
+        file.read(file_path);
+        file.displayFileInfo();
+    }
+    catch (const std::exception &e)
+    {
+        std::cerr << "[SYNC] " << e.what() << std::endl;
+        return 0;
+    }
+
+    if (file.getFileSize() == 0 || file.getFileSize() >= MAX::max_file_size)
+    {
+        cerr << "[SYNC] File size not supported!" << endl;
+        return 0;
+    }
+
+    // Create Sync M1 type packet
+    SyncM1 m1(file.get_file_name(), file.getFileSize());
+    Wrapper m1_wrapper(session_key, s_counter, m1.serialize());
+    Buffer serialized_packet = m1_wrapper.serialize();
+
+    // Send wrapped packet to server
+    if (!sendData(communcation_socket, serialized_packet))
+    {
+        std::cerr << "[SYNC] Error sending the serialized packet" << std::endl;
+        return 0;
+    }
+
+    clear_vec(serialized_packet);
+    s_counter = incrementCounter(s_counter);
+    if (s_counter == -1)
+    {
+        std::cerr << "[SYNC] Counter reached maximum value" << std::endl;
+        return -1;
+    }
+
+    // -------------- HANDLE ACK PACKET ---------------------
+    Buffer ack_buffer(Wrapper::getSize(SyncAck::getSize()));
+    if (!receiveData(communcation_socket, ack_buffer))
+    {
+        std::cerr << "[SYNC] Error receiving  data" << std::endl;
+        return 0;
+    }
+    // deserialize to extract payload in plaintext
+    Wrapper wrapped_packet(session_key);
+
+    if (!wrapped_packet.deserialize(ack_buffer))
+    {
+        std::cerr << "[SYNC] Wrapper packet wasn't deserialized correctly!" << endl;
+        return 0;
+    }
+
+    if (wrapped_packet.getCounter() != r_counter)
+        return -1;
+
+    r_counter = incrementCounter(r_counter);
+    if (r_counter == -1)
+    {
+        std::cerr << "[SYNC] Counter reached maximum value" << std::endl;
+        return -1;
+    }
+
+    SyncAck ack;
+    ack.deserialize(wrapped_packet.getPayload());
+
+    if (ack.getAckCode() == 2)
+    {
+        std::cerr << "[SYNC] File does not exist on the cloud, upload it first!" << endl;
+        return 0;
+    }
+    else if (ack.getAckCode() != 0)
+    {
+        std::cerr << "[SYNC] The cloud cannot sync this file!" << endl;
+        return 0;
+    }
+
+    // -------------- HANDLE RECEIVING BLOCK SIGNATURES ---------------------
+    vector<Delta::BlockSignature> signatures;
+    size_t max_frame_size = Wrapper::getSize(SyncSignatures::getSize(MAX::signatures_per_frame));
+
+    while (signatures.size() < ack.getBlockCount())
+    {
+        Buffer message_buff;
+
+        if (!receiveFrame(communcation_socket, message_buff, max_frame_size))
+        {
+            std::cerr << "[SYNC] Error receiving  data" << std::endl;
+            return 0;
+        }
+
+        Wrapper signatures_wrapper(session_key);
+
+        if (!signatures_wrapper.deserialize(message_buff))
+        {
+            std::cerr << "[SYNC] Wrapper packet wasn't deserialized correctly!" << endl;
+            return 0;
+        }
+
+        if (signatures_wrapper.getCounter() != r_counter)
+            return -1;
+
+        r_counter = incrementCounter(r_counter);
+        if (r_counter == -1)
+        {
+            std::cerr << "[SYNC] Counter reached maximum value" << std::endl;
+            return -1;
+        }
+
+        SyncSignatures signatures_packet;
+        signatures_packet.deserialize(signatures_wrapper.getPayload());
+
+        if (signatures_packet.getSignatures().empty())
+        {
+            std::cerr << "[SYNC] Malformed block signatures" << std::endl;
+            return 0;
+        }
+
+        signatures.insert(signatures.end(), signatures_packet.getSignatures().begin(), signatures_packet.getSignatures().end());
+    }
+
+    // -------------- HANDLE SENDING THE DELTA ---------------------
+    DeltaEncoder encoder(ack.getBlockSize(), signatures);
+    bool counter_exhausted = false;
+
+    auto send_batch = [&](Buffer &instructions, bool last)
+    {
+        SyncM2 m2_packet(instructions, last);
+        Wrapper m2_wrapper(session_key, s_counter, m2_packet.serialize());
+
+        Buffer serialized_batch = m2_wrapper.serialize();
+        if (!sendFrame(communcation_socket, serialized_batch))
+        {
+            std::cerr << "[SYNC] Error sending the serialized packet" << std::endl;
+            return false;
+        }
+
+        s_counter = incrementCounter(s_counter);
+        if (s_counter == -1)
+        {
+            counter_exhausted = true;
+            return false;
+        }
+
+        return true;
+    };
+
+    try
+    {
+        if (!encoder.encode(file_path, MAX::delta_batch, send_batch))
+        {
+            if (counter_exhausted)
+            {
+                std::cerr << "[SYNC] Counter reached maximum value" << std::endl;
+                return -1;
+            }
+            return 0;
+        }
+    }
+    catch (const std::exception &e)
+    {
+        // the session cannot be recovered once part of the delta went out
+        std::cerr << "[SYNC] " << e.what() << std::endl;
+        return -1;
+    }
+
+    cout << "[SYNC] Sent " << encoder.getLiteralBytes() << "B of new data, reused " << encoder.getMatchedBytes() << "B from the cloud" << endl;
+
+    // -------------- HANDLE FINAL ACK PACKET ---------------------
+    Buffer final_ack_buffer(Wrapper::getSize(SyncAck::getSize()));
+    if (!receiveData(communcation_socket, final_ack_buffer))
+    {
+        std::cerr << "[SYNC] Error receiving  data" << std::endl;
+        return 0;
+    }
+
+    wrapped_packet = Wrapper(session_key);
+
+    if (!wrapped_packet.deserialize(final_ack_buffer))
+    {
+        std::cerr << "[SYNC] Wrapper packet wasn't deserialized correctly!" << endl;
+        return 0;
+    }
+
+    if (wrapped_packet.getCounter() != r_counter)
+        return -1;
+
+    r_counter = incrementCounter(r_counter);
+    if (r_counter == -1)
+    {
+        std::cerr << "[SYNC] Counter reached maximum value" << std::endl;
+        return -1;
+    }
+
+    ack = SyncAck();
+    ack.deserialize(wrapped_packet.getPayload());
+
+    if (ack.getAckCode() != 0)
+        std::cerr << "[SYNC] Syncing file " << file.get_file_name() << " has failed!" << std::endl;
+    else
+        std::cout << "[SYNC] " << file.get_file_name() << " synced successfully" << std::endl;
+
+    cout << "****************************************" << endl;
+    cout << "*********     End Sync File    *********" << endl;
+    cout << "****************************************" << endl;
+    return 1;
+}
 int Client::logout()
 {
     LogoutM1 m1;
@@ -1329,6 +1868,972 @@ int Client::logout()
 
     return 1;
 }
+int Client::send_manifest(uint8_t command_code, const std::vector<BatchEntry> &entries)
+{
+    size_t i = 0;
+    do
+    {
+        size_t end = std::min(entries.size(), i + MAX::batch_entries_per_frame);
+        BatchManifest manifest(command_code, std::vector<BatchEntry>(entries.begin() + i, entries.begin() + end), end == entries.size(), Compression::LZ4);
+
+        Wrapper manifest_wrapper(session_key, s_counter, manifest.serialize());
+
+        Buffer serialized_packet = manifest_wrapper.serialize();
+        if (!sendFrame(communcation_socket, serialized_packet))
+        {
+            std::cerr << "[BATCH] Error sending the serialized packet" << std::endl;
+            return 0;
+        }
+
+        s_counter = incrementCounter(s_counter);
+        if (s_counter == -1)
+        {
+            std::cerr << "[BATCH] Counter reached maximum value" << std::endl;
+            return -1;
+        }
+
+        i = end;
+    } while (i < entries.size());
+
+    return 1;
+}
+
+int Client::receive_manifest(std::vector<BatchEntry> &entries, uint8_t &compression)
+{
+    size_t expected_count = entries.size();
+    size_t max_frame_size = Wrapper::getSize(BatchManifest::getMaxSize(MAX::batch_entries_per_frame));
+    bool last = false;
+
+    entries.clear();
+    while (!last)
+    {
+        Buffer message_buff;
+
+        if (!receiveFrame(communcation_socket, message_buff, max_frame_size))
+        {
+            std::cerr << "[BATCH] Error receiving data" << std::endl;
+            return 0;
+        }
+
+        Wrapper manifest_wrapper(session_key);
+
+        if (!manifest_wrapper.deserialize(message_buff))
+        {
+            std::cerr << "[BATCH] Wrapper packet wasn't deserialized correctly!" << endl;
+            return 0;
+        }
+
+        if (manifest_wrapper.getCounter() != r_counter)
+            return -1;
+
+        r_counter = incrementCounter(r_counter);
+        if (r_counter == -1)
+        {
+            std::cerr << "[BATCH] Counter reached maximum value" << std::endl;
+            return -1;
+        }
+
+        BatchManifest manifest;
+        if (!manifest.deserialize(manifest_wrapper.getPayload()) || entries.size() + manifest.getEntries().size() > expected_count)
+        {
+            std::cerr << "[BATCH] Malformed manifest" << std::endl;
+            return 0;
+        }
+
+        entries.insert(entries.end(), manifest.getEntries().begin(), manifest.getEntries().end());
+        compression = manifest.getCompression();
+        last = manifest.isLast();
+    }
+
+    return entries.size() == expected_count ? 1 : 0;
+}
+
+// prints the files of a batch that did not make it and returns how many did
+static size_t reportBatch(const std::vector<BatchEntry> &entries)
+{
+    size_t succeeded = 0;
+
+    for (const BatchEntry &entry : entries)
+    {
+        switch (entry.status)
+        {
+        case BatchCodes::OK:
+            succeeded++;
+            break;
+        case BatchCodes::INVALID_NAME:
+            std::cerr << "[BATCH] " << entry.file_name << ": invalid file name" << std::endl;
+            break;
+        case BatchCodes::EXISTS:
+            std::cerr << "[BATCH] " << entry.file_name << ": already exists" << std::endl;
+            break;
+        case BatchCodes::NOT_FOUND:
+            std::cerr << "[BATCH] " << entry.file_name << ": does not exist on the cloud" << std::endl;
+            break;
+        case BatchCodes::QUOTA_EXCEEDED:
+            std::cerr << "[BATCH] " << entry.file_name << ": not enough quota left" << std::endl;
+            break;
+        default:
+            std::cerr << "[BATCH] " << entry.file_name << ": transfer failed" << std::endl;
+            break;
+        }
+    }
+
+    return succeeded;
+}
+
+int Client::upload_batch()
+{
+    cout << "****************************************" << endl;
+    cout << "*********     UPLOAD FILES     *********" << endl;
+    cout << "****************************************" << endl;
+
+    std::cout << "[BATCH] Enter a directory or comma separated file paths:" << endl;
+    std::string input;
+    std::getline(std::cin, input);
+
+    if (!cin || input.empty())
+    {
+        cerr << "[BATCH] Invalid input" << endl;
+        std::cin.clear(); // put us back in 'normal' operation mode
+        std::cin.ignore(std::numeric_limits<std::streamsize>::max(), '\n');
+        return 0;
+    }
+
+    // every regular file of a directory, or the listed files
+    std::vector<std::string> paths;
+    if (std::filesystem::is_directory(input))
+    {
+        for (const auto &entry : std::filesystem::directory_iterator(input))
+            if (entry.is_regular_file())
+                paths.push_back(entry.path().string());
+        std::sort(paths.begin(), paths.end());
+    }
+    else
+    {
+        std::stringstream stream(input);
+        std::string path;
+        while (std::getline(stream, path, ','))
+            if (!path.empty())
+                paths.push_back(path);
+    }
+
+    std::vector<BatchEntry> entries;
+    std::vector<std::string> accepted_paths;
+    for (const std::string &path : paths)
+    {
+        std::error_code error;
+        uintmax_t size = std::filesystem::file_size(path, error);
+
+        if (error || size >= std::numeric_limits<uint32_t>::max())
+        {
+            std::cerr << "[BATCH] Skipping " << path << std::endl;
+            continue;
+        }
+
+        entries.push_back({std::filesystem::path(path).filename().string(), static_cast<uint32_t>(size), BatchCodes::OK});
+        accepted_paths.push_back(path);
+    }
+
+    if (entries.empty() || entries.size() > MAX::batch_files)
+    {
+        std::cerr << "[BATCH] Nothing to upload or too many files" << std::endl;
+        return 0;
+    }
+
+    // -------------- HANDLE SENDING THE MANIFEST ---------------------
+    BatchM1 m1(RequestCodes::BATCH_UPLOAD_REQ, Compression::LZ4, entries.size());
+    Wrapper m1_wrapper(session_key, s_counter, m1.serialize());
+    Buffer serialized_packet = m1_wrapper.serialize();
+
+    if (!sendData(communcation_socket, serialized_packet))
+    {
+        std::cerr << "[BATCH] Error sending the serialized packet" << std::endl;
+        return 0;
+    }
+
+    s_counter = incrementCounter(s_counter);
+    if (s_counter == -1)
+    {
+        std::cerr << "[BATCH] Counter reached maximum value" << std::endl;
+        return -1;
+    }
+
+    int result = send_manifest(RequestCodes::BATCH_UPLOAD_REQ, entries);
+    if (result != 1)
+        return result;
+
+    uint8_t compression;
+    result = receive_manifest(entries, compression);
+    if (result != 1)
+        return result;
+
+    // -------------- HANDLE SENDING THE CONTENTS BACK TO BACK ---------------------
+    ChunkCompressor compressor(compression);
+    uintmax_t sent_size = 0;
+    Buffer data;
+    data.reserve(MAX::batch_data);
+
+    for (size_t i = 0; i <= entries.size(); i++)
+    {
+        bool flush = (i == entries.size());
+
+        if (!flush && entries[i].status == BatchCodes::OK)
+        {
+            File file;
+            bool readable = true;
+            uintmax_t file_read = 0;
+
+            try
+            {
+                file.read(accepted_paths[i]);
+            }
+            catch (const std::exception &e)
+            {
+                readable = false;
+            }
+
+            while (file_read < entries[i].file_size)
+            {
+                size_t take = std::min<uintmax_t>(MAX::batch_data - data.size(), entries[i].file_size - file_read);
+
+                try
+                {
+                    if (!readable)
+                        throw std::runtime_error("Unable to read from file.");
+
+                    Buffer piece = file.readChunk(take);
+                    data.insert(data.end(), piece.begin(), piece.end());
+                }
+                catch (const std::exception &e)
+                {
+                    // the announced size is still sent so the stream stays aligned
+                    if (readable)
+                        std::cerr << "[BATCH] " << entries[i].file_name << " changed while uploading" << std::endl;
+                    readable = false;
+                    data.insert(data.end(), take, 0);
+                }
+                file_read += take;
+
+                if (data.size() == MAX::batch_data)
+                {
+                    uint8_t chunk_flags;
+                    Buffer encoded = compressor.encode(data, chunk_flags);
+                    BatchData data_packet(encoded, chunk_flags);
+                    Wrapper data_wrapper(session_key, s_counter, data_packet.serialize());
+
+                    serialized_packet = data_wrapper.serialize();
+                    if (!sendFrame(communcation_socket, serialized_packet))
+                    {
+                        std::cerr << "[BATCH] Error sending the serialized packet" << std::endl;
+                        return 0;
+                    }
+
+                    s_counter = incrementCounter(s_counter);
+                    if (s_counter == -1)
+                    {
+                        std::cerr << "[BATCH] Counter reached maximum value" << std::endl;
+                        return -1;
+                    }
+
+                    sent_size += data.size();
+                    data.clear();
+                }
+            }
+        }
+
+        if (flush && !data.empty())
+        {
+            uint8_t chunk_flags;
+            Buffer encoded = compressor.encode(data, chunk_flags);
+            BatchData data_packet(encoded, chunk_flags);
+            Wrapper data_wrapper(session_key, s_counter, data_packet.serialize());
+
+            serialized_packet = data_wrapper.serialize();
+            if (!sendFrame(communcation_socket, serialized_packet))
+            {
+                std::cerr << "[BATCH] Error sending the serialized packet" << std::endl;
+                return 0;
+            }
+
+            s_counter = incrementCounter(s_counter);
+            if (s_counter == -1)
+            {
+                std::cerr << "[BATCH] Counter reached maximum value" << std::endl;
+                return -1;
+            }
+
+            sent_size += data.size();
+        }
+    }
+
+    compressor.printStats("[BATCH]");
+
+    // ------------------- HANDLE THE AGGREGATED STATUS ---------------------
+    result = receive_manifest(entries, compression);
+    if (result != 1)
+        return result;
+
+    size_t uploaded = reportBatch(entries);
+    std::cout << "[BATCH] Uploaded " << uploaded << "/" << entries.size() << " files (" << sent_size << "B)" << std::endl;
+
+    cout << "********************************************" << endl;
+    cout << "*********     End Upload Files    *********" << endl;
+    cout << "********************************************" << endl;
+    return 1;
+}
+
+int Client::download_batch()
+{
+    cout << "****************************************" << endl;
+    cout << "*********    DOWNLOAD FILES    *********" << endl;
+    cout << "****************************************" << endl;
+
+    std::cout << "[BATCH] Enter comma separated file names:" << endl;
+    std::string input;
+    std::getline(std::cin, input);
+
+    if (!cin || input.empty())
+    {
+        cerr << "[BATCH] Invalid input" << endl;
+        std::cin.clear(); // put us back in 'normal' operation mode
+        std::cin.ignore(std::numeric_limits<std::streamsize>::max(), '\n');
+        return 0;
+    }
+
+    std::vector<BatchEntry> entries;
+    std::stringstream stream(input);
+    std::string name;
+    while (std::getline(stream, name, ','))
+        if (!name.empty())
+            entries.push_back({name, 0, BatchCodes::OK});
+
+    if (entries.empty() || entries.size() > MAX::batch_files)
+    {
+        std::cerr << "[BATCH] Nothing to download or too many files" << std::endl;
+        return 0;
+    }
+
+    std::vector<std::string> names;
+    for (const BatchEntry &entry : entries)
+        names.push_back(entry.file_name);
+
+    // -------------- HANDLE SENDING THE MANIFEST ---------------------
+    BatchM1 m1(RequestCodes::BATCH_DOWNLOAD_REQ, Compression::LZ4, entries.size());
+    Wrapper m1_wrapper(session_key, s_counter, m1.serialize());
+    Buffer serialized_packet = m1_wrapper.serialize();
+
+    if (!sendData(communcation_socket, serialized_packet))
+    {
+        std::cerr << "[BATCH] Error sending the serialized packet" << std::endl;
+        return 0;
+    }
+
+    s_counter = incrementCounter(s_counter);
+    if (s_counter == -1)
+    {
+        std::cerr << "[BATCH] Counter reached maximum value" << std::endl;
+        return -1;
+    }
+
+    int result = send_manifest(RequestCodes::BATCH_DOWNLOAD_REQ, entries);
+    if (result != 1)
+        return result;
+
+    uint8_t compression;
+    result = receive_manifest(entries, compression);
+    if (result != 1)
+        return result;
+
+    // -------------- HANDLE RECEIVING THE CONTENTS BACK TO BACK ---------------------
+    string downloads_path = "../downloads";
+    if (!(std::filesystem::exists(downloads_path) && std::filesystem::is_directory(downloads_path)))
+    {
+        if (!std::filesystem::create_directory(downloads_path))
+            return 0;
+    }
+
+    uintmax_t total_size = 0;
+    for (const BatchEntry &entry : entries)
+        if (entry.status == BatchCodes::OK)
+            total_size += entry.file_size;
+
+    size_t max_frame_size = Wrapper::getSize(BatchData::getSize(MAX::batch_data));
+    uintmax_t received_size = 0;
+    Buffer data;
+    size_t data_position = 0;
+    bool data_corrupt = false;
+    std::vector<bool> written(entries.size(), false);
+
+    for (size_t i = 0; i < entries.size(); i++)
+    {
+        if (entries[i].status != BatchCodes::OK)
+            continue;
+
+        // the names are ours, never trust the ones echoed by the server for local paths
+        string file_path = downloads_path + "/" + names[i];
+        File file;
+        bool writable = true;
+
+        try
+        {
+            file.create(file_path);
+            written[i] = true;
+        }
+        catch (const std::exception &e)
+        {
+            std::cerr << "[BATCH] " << names[i] << ": " << e.what() << std::endl;
+            writable = false;
+        }
+
+        uintmax_t file_written = 0;
+        while (file_written < entries[i].file_size)
+        {
+            if (data_position == data.size())
+            {
+                size_t expected_size = std::min<uintmax_t>(MAX::batch_data, total_size - received_size);
+                Buffer message_buff;
+
+                if (!receiveFrame(communcation_socket, message_buff, max_frame_size))
+                {
+                    std::cerr << "[BATCH] Error receiving data" << std::endl;
+                    return 0;
+                }
+
+                Wrapper data_wrapper(session_key);
+
+                if (!data_wrapper.deserialize(message_buff))
+                {
+                    std::cerr << "[BATCH] Wrapper packet wasn't deserialized correctly!" << endl;
+                    return 0;
+                }
+
+                if (data_wrapper.getCounter() != r_counter)
+                    return -1;
+
+                r_counter = incrementCounter(r_counter);
+                if (r_counter == -1)
+                {
+                    std::cerr << "[BATCH] Counter reached maximum value" << std::endl;
+                    return -1;
+                }
+
+                BatchData data_packet;
+                data_packet.deserialize(data_wrapper.getPayload());
+
+                data_corrupt = !ChunkCompressor::decode(data_packet.getData(), data_packet.getChunkFlags(), expected_size, data);
+                if (data_corrupt)
+                {
+                    std::cerr << "[BATCH] Malformed data frame" << std::endl;
+                    data.assign(expected_size, 0);
+                }
+
+                data_position = 0;
+                received_size += expected_size;
+            }
+
+            size_t take = std::min<uintmax_t>(data.size() - data_position, entries[i].file_size - file_written);
+
+            if (data_corrupt)
+                entries[i].status = BatchCodes::FAILED;
+
+            if (writable)
+                file.writeChunk(Buffer(data.begin() + data_position, data.begin() + data_position + take));
+
+            data_position += take;
+            file_written += take;
+        }
+
+        cout << "[BATCH] Received " << received_size << "/" << total_size << "Bytes" << endl;
+    }
+
+    // ------------------- HANDLE THE AGGREGATED STATUS ---------------------
+    std::vector<BatchEntry> final_entries(entries.size());
+    result = receive_manifest(final_entries, compression);
+    if (result != 1)
+        return result;
+
+    // drop the copies the server could not read completely
+    for (size_t i = 0; i < entries.size(); i++)
+    {
+        if (entries[i].status == BatchCodes::OK)
+            entries[i].status = final_entries[i].status;
+
+        if (written[i] && entries[i].status != BatchCodes::OK)
+            std::filesystem::remove(downloads_path + "/" + names[i]);
+    }
+
+    size_t downloaded = reportBatch(entries);
+    std::cout << "[BATCH] Downloaded " << downloaded << "/" << entries.size() << " files to " << downloads_path << std::endl;
+
+    cout << "********************************************" << endl;
+    cout << "*********    End Download Files   *********" << endl;
+    cout << "********************************************" << endl;
+    return 1;
+}
+int Client::download_archive()
+{
+    cout << "****************************************" << endl;
+    cout << "*********   DOWNLOAD ARCHIVE   *********" << endl;
+    cout << "****************************************" << endl;
+
+    std::cout << "[ARCHIVE] Enter comma separated file names (empty for the whole folder):" << endl;
+    std::string input;
+    std::getline(std::cin, input);
+
+    if (!cin)
+    {
+        cerr << "[ARCHIVE] Invalid input" << endl;
+        std::cin.clear(); // put us back in 'normal' operation mode
+        std::cin.ignore(std::numeric_limits<std::streamsize>::max(), '\n');
+        return 0;
+    }
+
+    std::vector<BatchEntry> entries;
+    std::stringstream stream(input);
+    std::string name;
+    while (std::getline(stream, name, ','))
+        if (!name.empty())
+            entries.push_back({name, 0, BatchCodes::OK});
+
+    if (entries.size() > MAX::batch_files)
+    {
+        std::cerr << "[ARCHIVE] Too many files" << std::endl;
+        return 0;
+    }
+
+    // never overwrite an earlier archive
+    string downloads_path = "../downloads";
+    if (!(std::filesystem::exists(downloads_path) && std::filesystem::is_directory(downloads_path)))
+    {
+        if (!std::filesystem::create_directory(downloads_path))
+            return 0;
+    }
+
+    string archive_path = downloads_path + "/" + username + ".tar";
+    for (int copy = 1; std::filesystem::exists(archive_path); copy++)
+        archive_path = downloads_path + "/" + username + "-" + std::to_string(copy) + ".tar";
+
+    File archive;
+    try
+    {
+        archive.create(archive_path);
+    }
+    catch (const std::exception &e)
+    {
+        std::cerr << "[ARCHIVE] " << e.what() << std::endl;
+        return 0;
+    }
+
+    // -------------- HANDLE SENDING THE REQUEST ---------------------
+    BatchM1 m1(RequestCodes::ARCHIVE_REQ, Compression::LZ4, entries.size());
+    Wrapper m1_wrapper(session_key, s_counter, m1.serialize());
+    Buffer serialized_packet = m1_wrapper.serialize();
+
+    if (!sendData(communcation_socket, serialized_packet))
+    {
+        std::cerr << "[ARCHIVE] Error sending the serialized packet" << std::endl;
+        std::filesystem::remove(archive_path);
+        return 0;
+    }
+
+    s_counter = incrementCounter(s_counter);
+    if (s_counter == -1)
+    {
+        std::cerr << "[ARCHIVE] Counter reached maximum value" << std::endl;
+        return -1;
+    }
+
+    if (!entries.empty())
+    {
+        int result = send_manifest(RequestCodes::ARCHIVE_REQ, entries);
+        if (result != 1)
+        {
+            std::filesystem::remove(archive_path);
+            return result;
+        }
+    }
+
+    // -------------- HANDLE RECEIVING THE STREAM ---------------------
+    size_t max_frame_size = Wrapper::getSize(ArchiveData::getSize(MAX::archive_data));
+    uintmax_t received_size = 0;
+    bool last = false;
+
+    while (!last)
+    {
+        Buffer message_buff;
+
+        if (!receiveFrame(communcation_socket, message_buff, max_frame_size))
+        {
+            std::cerr << "[ARCHIVE] Error receiving data" << std::endl;
+            std::filesystem::remove(archive_path);
+            return 0;
+        }
+
+        Wrapper data_wrapper(session_key);
+
+        if (!data_wrapper.deserialize(message_buff))
+        {
+            std::cerr << "[ARCHIVE] Wrapper packet wasn't deserialized correctly!" << endl;
+            std::filesystem::remove(archive_path);
+            return 0;
+        }
+
+        if (data_wrapper.getCounter() != r_counter)
+            return -1;
+
+        r_counter = incrementCounter(r_counter);
+        if (r_counter == -1)
+        {
+            std::cerr << "[ARCHIVE] Counter reached maximum value" << std::endl;
+            return -1;
+        }
+
+        ArchiveData data_packet;
+        Buffer frame;
+
+        if (!data_packet.deserialize(data_wrapper.getPayload()) ||
+            !ChunkCompressor::decode(data_packet.getData(), data_packet.getChunkFlags(), data_packet.getOriginalSize(), frame))
+        {
+            std::cerr << "[ARCHIVE] Malformed archive frame" << std::endl;
+            std::filesystem::remove(archive_path);
+            return 0;
+        }
+
+        archive.writeChunk(frame);
+        received_size += frame.size();
+        last = data_packet.isLast();
+    }
+
+    // ------------------- HANDLE ACK PACKET ---------------------
+    Buffer message_buff(Wrapper::getSize(ArchiveAck::getSize()));
+
+    if (!receiveData(communcation_socket, message_buff))
+    {
+        std::cerr << "[ARCHIVE] Error receiving data" << std::endl;
+        return 0;
+    }
+
+    Wrapper ack_wrapper(session_key);
+
+    if (!ack_wrapper.deserialize(message_buff))
+    {
+        std::cerr << "[ARCHIVE] Wrapper packet wasn't deserialized correctly!" << endl;
+        return 0;
+    }
+
+    if (ack_wrapper.getCounter() != r_counter)
+        return -1;
+
+    r_counter = incrementCounter(r_counter);
+    if (r_counter == -1)
+    {
+        std::cerr << "[ARCHIVE] Counter reached maximum value" << std::endl;
+        return -1;
+    }
+
+    ArchiveAck ack;
+    ack.deserialize(ack_wrapper.getPayload());
+
+    std::cout << "[ARCHIVE] " << ack.getFileCount() << " files (" << received_size << "B) saved to " << archive_path << std::endl;
+    if (ack.getFailedCount() > 0)
+        std::cerr << "[ARCHIVE] " << ack.getFailedCount() << " files could not be archived" << std::endl;
+
+    cout << "********************************************" << endl;
+    cout << "*********   End Download Archive  *********" << endl;
+    cout << "********************************************" << endl;
+    return 1;
+}
+
+int Client::file_versions()
+{
+    cout << "****************************************" << endl;
+    cout << "*********     File Versions    *********" << endl;
+    cout << "****************************************" << endl;
+
+    // Read file name from console
+    std::cout << "[VERSION] Enter file name:" << endl;
+    std::string filename;
+    std::getline(std::cin, filename);
+
+    // make sure input was valid and non null
+    if (!cin || filename.empty() || !File::isValidFileName(filename) || filename.size() > MAX::file_name)
+    {
+        cerr << "[VERSION] Invalid filename input" << endl;
+        std::cin.clear(); // put us back in 'normal' operation mode
+        std::cin.ignore(std::numeric_limits<std::streamsize>::max(), '\n');
+        return 0;
+    }
+
+    std::cout << "[VERSION] Enter l to list, d to download or r to restore a version:" << endl;
+    std::string action_input;
+    std::getline(std::cin, action_input);
+
+    uint8_t action;
+    if (action_input == "l")
+        action = VersionAction::LIST;
+    else if (action_input == "d")
+        action = VersionAction::DOWNLOAD;
+    else if (action_input == "r")
+        action = VersionAction::RESTORE;
+    else
+    {
+        cerr << "[VERSION] Invalid action input" << endl;
+        return 0;
+    }
+
+    uint64_t version = 0;
+    if (action != VersionAction::LIST)
+    {
+        std::cout << "[VERSION] Enter version number:" << endl;
+        std::string version_input;
+        std::getline(std::cin, version_input);
+
+        try
+        {
+            version = std::stoull(version_input);
+        }
+        catch (const std::exception &e)
+        {
+            cerr << "[VERSION] Invalid version input" << endl;
+            return 0;
+        }
+    }
+
+    if (action == VersionAction::DOWNLOAD)
+        return download_version(filename, version);
+
+    // Create Version M1 type packet
+    VersionM1 m1(action, filename, version, Compression::NONE);
+
+    Wrapper m1_wrapper(session_key, s_counter, m1.serialize());
+
+    Buffer serialized_packet = m1_wrapper.serialize();
+    if (!sendData(communcation_socket, serialized_packet))
+    {
+        std::cerr << "[VERSION] Error sending the serialized packet" << std::endl;
+        return 0;
+    }
+    clear_vec(serialized_packet);
+
+    s_counter = incrementCounter(s_counter);
+    if (s_counter == -1)
+    {
+        std::cerr << "[VERSION] Counter reached maximum value" << std::endl;
+        return -1;
+    }
+
+    // -------------- HANDLE VERSION LIST ---------------------
+    Buffer message_buff;
+    if (!receiveFrame(communcation_socket, message_buff, Wrapper::getSize(VersionList::getSize(MAX::versions_listed))))
+    {
+        std::cerr << "[VERSION] Error receiving data" << std::endl;
+        return 0;
+    }
+
+    Wrapper list_wrapper(session_key);
+    if (!list_wrapper.deserialize(message_buff))
+    {
+        std::cerr << "[VERSION] Wrapper packet wasn't deserialized correctly!" << endl;
+        return 0;
+    }
+
+    if (list_wrapper.getCounter() != r_counter)
+        return -1;
+
+    r_counter = incrementCounter(r_counter);
+    if (r_counter == -1)
+    {
+        std::cerr << "[VERSION] Counter reached maximum value" << std::endl;
+        return -1;
+    }
+
+    VersionList list;
+    if (!list.deserialize(list_wrapper.getPayload()))
+    {
+        std::cerr << "[VERSION] Malformed version list" << std::endl;
+        return 0;
+    }
+
+    if (list.getAckCode() == 2)
+    {
+        std::cerr << "[VERSION] Files are not versioned on the cloud!" << endl;
+        return 0;
+    }
+
+    if (list.getAckCode() != 0)
+    {
+        if (action == VersionAction::RESTORE)
+            std::cerr << "[VERSION] Version " << version << " could not be restored!" << endl;
+        else
+            std::cerr << "[VERSION] No versions of " << filename << " on the cloud!" << endl;
+        return 0;
+    }
+
+    if (action == VersionAction::RESTORE)
+        cout << "[VERSION] " << filename << " restored to version " << version << endl;
+
+    // number, size and the time the version was replaced
+    for (const VersionEntry &entry : list.getEntries())
+    {
+        time_t mtime = entry.mtime;
+        char date[32];
+        strftime(date, sizeof(date), "%Y-%m-%d %H:%M", localtime(&mtime));
+
+        std::cout << std::left << std::setw(10) << ("v" + std::to_string(entry.version)) << std::right << std::setw(12) << entry.file_size
+                  << "  " << date << std::endl;
+    }
+
+    cout << "********************************************" << endl;
+    cout << "**********   End File Versions   ***********" << endl;
+    cout << "********************************************" << endl;
+    return 1;
+}
+int Client::download_version(const std::string &filename, uint64_t version)
+{
+    // versions never change, one already downloaded is kept
+    string version_path = "../downloads/.versions/" + std::to_string(version);
+    string local_path = version_path + "/" + filename;
+
+    if (File::exists(local_path))
+    {
+        cout << "[VERSION] " << local_path << " already downloaded" << endl;
+        return 1;
+    }
+
+    // Create Version M1 type packet
+    VersionM1 m1(VersionAction::DOWNLOAD, filename, version, Compression::LZ4);
+
+    Wrapper m1_wrapper(session_key, s_counter, m1.serialize());
+
+    Buffer serialized_packet = m1_wrapper.serialize();
+    if (!sendData(communcation_socket, serialized_packet))
+    {
+        std::cerr << "[VERSION] Error sending the serialized packet" << std::endl;
+        return 0;
+    }
+    clear_vec(serialized_packet);
+
+    s_counter = incrementCounter(s_counter);
+    if (s_counter == -1)
+    {
+        std::cerr << "[VERSION] Counter reached maximum value" << std::endl;
+        return -1;
+    }
+
+    // -------------- HANDLE ACK PACKET ---------------------
+    Buffer ack_buffer(Wrapper::getSize(DownloadAck::getSize()));
+    if (!receiveData(communcation_socket, ack_buffer))
+    {
+        std::cerr << "[VERSION] Error receiving data" << std::endl;
+        return 0;
+    }
+
+    Wrapper wrapped_packet(session_key);
+    if (!wrapped_packet.deserialize(ack_buffer))
+    {
+        std::cerr << "[VERSION] Wrapper packet wasn't deserialized correctly!" << endl;
+        return 0;
+    }
+
+    if (wrapped_packet.getCounter() != r_counter)
+        return -1;
+
+    r_counter = incrementCounter(r_counter);
+    if (r_counter == -1)
+    {
+        std::cerr << "[VERSION] Counter reached maximum value" << std::endl;
+        return -1;
+    }
+
+    DownloadAck ack;
+    ack.deserialize(wrapped_packet.getPayload());
+
+    if (ack.getAckCode())
+    {
+        std::cerr << "[VERSION] Version " << version << " of " << filename << " does not exist on the cloud!" << endl;
+        return 0;
+    }
+    uint32_t file_size = ack.getFileSize();
+
+    // -------------- HANDLE RECEIVING FILE CHUNKS ---------------------
+    File file;
+    size_t chunk_size = MAX::max_file_chunk;
+    size_t max_frame_size = Wrapper::getSize(DownloadM2::getSize(chunk_size));
+    uintmax_t received_size = 0;
+    bool error_occured = false;
+
+    try
+    {
+        std::filesystem::create_directories(version_path);
+        file.create(local_path);
+    }
+    catch (const std::exception &e)
+    {
+        std::cerr << "[VERSION] " << e.what() << std::endl;
+        error_occured = true;
+    }
+
+    // keep draining the chunks even after an error so the session stays in step
+    while (received_size < file_size)
+    {
+        size_t expected_size = std::min<uintmax_t>(chunk_size, file_size - received_size);
+        Buffer message_buff;
+
+        if (!receiveFrame(communcation_socket, message_buff, max_frame_size))
+        {
+            std::cerr << "[VERSION] Error receiving data" << std::endl;
+            return 0;
+        }
+
+        Wrapper m2_wrapper(session_key);
+        if (!m2_wrapper.deserialize(message_buff))
+        {
+            std::cerr << "[VERSION] Wrapper packet wasn't deserialized correctly!" << endl;
+            return 0;
+        }
+
+        // Check counter otherwise exit
+        if (m2_wrapper.getCounter() != r_counter)
+            return -1;
+
+        r_counter = incrementCounter(r_counter);
+        if (r_counter == -1)
+        {
+            std::cerr << "[VERSION] Counter reached maximum value" << std::endl;
+            return -1;
+        }
+
+        DownloadM2 m2_packet;
+        m2_packet.deserialize(m2_wrapper.getPayload());
+
+        Buffer chunk;
+        if (!ChunkCompressor::decode(m2_packet.getFileChunk(), m2_packet.getChunkFlags(), expected_size, chunk))
+        {
+            std::cerr << "[VERSION] Malformed file chunk" << std::endl;
+            error_occured = true;
+        }
+
+        if (!error_occured)
+            file.writeChunk(chunk);
+
+        received_size += expected_size;
+    }
+
+    file.close();
+
+    if (error_occured)
+    {
+        std::filesystem::remove(local_path);
+        std::cerr << "[VERSION] Version wasn't downloaded correctly!" << endl;
+    }
+    else
+        cout << "[VERSION] Version " << version << " saved to " << local_path << endl;
+
+    cout << "********************************************" << endl;
+    cout << "**********   End File Versions   ***********" << endl;
+    cout << "********************************************" << endl;
+    return 1;
+}
 int Client::handleMenuChoice(const std::string &choice)
 {
     MenuOption option;
@@ -1354,6 +2859,16 @@ int Client::handleMenuChoice(const std::string &choice)
         return rename_file();
     case MenuOption::DeleteFile:
         return delete_file();
+    case MenuOption::SyncFile:
+        return sync_file();
+    case MenuOption::UploadFiles:
+        return upload_batch();
+    case MenuOption::DownloadFiles:
+        return download_batch();
+    case MenuOption::DownloadArchive:
+        return download_archive();
+    case MenuOption::FileVersions:
+        return file_versions();
     case MenuOption::Logout:
         return logout();
     default:
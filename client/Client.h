@@ -7,6 +7,12 @@
 #include <cstring>
 #include <openssl/rand.h>
 #include <vector>
+#include <map>
+#include "../tools/file.h"
+#include "../tools/compressor.h"
+#include "../tools/fingerprint.h"
+
+struct BatchEntry;
 
 const int PORT = 8080;
 const int MAX_CERTIFICATE_SIZE = 4096;
@@ -23,6 +29,27 @@ private:
     int s_counter = 0;
     int r_counter = 0;
 
+    // last listing shown for a filter, with the folder tag it was read at
+    struct ListingCache
+    {
+        std::string etag;
+        std::string output;
+        size_t count;
+    };
+    std::map<std::string, ListingCache> listing_cache;
+
+    // --------- Upload Strategies ---------
+    int upload_proof(const std::string &file_path, uint8_t &mode);
+    int upload_manifest(File &file, const std::vector<Fingerprint::ChunkRef> &chunks, ChunkCompressor &compressor);
+
+    // --------- Batch Manifests ---------
+    int send_manifest(uint8_t command_code, const std::vector<BatchEntry> &entries);
+    // entries must hold as many elements as the manifest expected back
+    int receive_manifest(std::vector<BatchEntry> &entries, uint8_t &compression);
+
+    // --------- File Versions ---------
+    int download_version(const std::string &filename, uint64_t version);
+
 public:
     Client();
     int login();
@@ -37,6 +64,11 @@ public:
     int list_files();
     int rename_file();
     int delete_file();
+    int sync_file();
+    int upload_batch();
+    int download_batch();
+    int download_archive();
+    int file_versions();
     int logout();
     // ----------------------------------------
 
@@ -0,0 +1,144 @@
+#include "archive.h"
+#include <vector>
+#include <arpa/inet.h>
+
+// ----------------------------------- ARCHIVE DATA ------------------------------------
+
+ArchiveData::ArchiveData() {}
+
+ArchiveData::ArchiveData(Buffer data, uint8_t chunk_flags, uint32_t original_size, bool last)
+{
+    this->command_code = RequestCodes::ARCHIVE_DATA;
+    this->chunk_flags = chunk_flags;
+    this->last = last ? 1 : 0;
+    this->original_size = original_size;
+    this->data = data;
+}
+
+Buffer ArchiveData::serialize() const
+{
+    Buffer buff(ArchiveData::getSize(data.size()));
+    size_t position = 0;
+
+    memcpy(buff.data(), &command_code, sizeof(uint8_t));
+    position += sizeof(uint8_t);
+
+    memcpy(buff.data() + position, &chunk_flags, sizeof(uint8_t));
+    position += sizeof(uint8_t);
+
+    memcpy(buff.data() + position, &last, sizeof(uint8_t));
+    position += sizeof(uint8_t);
+
+    uint32_t no_original_size = htonl(original_size);
+    memcpy(buff.data() + position, &no_original_size, sizeof(uint32_t));
+    position += sizeof(uint32_t);
+
+    if (!data.empty())
+        memcpy(buff.data() + position, data.data(), data.size());
+
+    return buff;
+}
+
+bool ArchiveData::deserialize(Buffer input)
+{
+    size_t position = 0;
+
+    if (input.size() < ArchiveData::getSize(0))
+        return false;
+
+    memcpy(&this->command_code, input.data(), sizeof(uint8_t));
+    position += sizeof(uint8_t);
+
+    memcpy(&this->chunk_flags, input.data() + position, sizeof(uint8_t));
+    position += sizeof(uint8_t);
+
+    memcpy(&this->last, input.data() + position, sizeof(uint8_t));
+    position += sizeof(uint8_t);
+
+    uint32_t network_original_size = 0;
+    memcpy(&network_original_size, input.data() + position, sizeof(uint32_t));
+    original_size = ntohl(network_original_size);
+    position += sizeof(uint32_t);
+
+    data.assign(input.begin() + position, input.end());
+
+    return original_size <= MAX::archive_data;
+}
+
+size_t ArchiveData::getSize(size_t data_size)
+{
+    size_t size = 0;
+
+    size += sizeof(uint8_t);
+    size += sizeof(uint8_t);  // chunk_flags
+    size += sizeof(uint8_t);  // last
+    size += sizeof(uint32_t); // original_size
+    size += data_size;
+
+    return size;
+}
+
+// ----------------------------------- ARCHIVE ACKNOWLEDGEMENT ------------------------------------
+
+ArchiveAck::ArchiveAck() {}
+
+ArchiveAck::ArchiveAck(uint32_t file_count, uint32_t failed_count)
+{
+    this->command_code = RequestCodes::ACK_MSG;
+    this->file_count = file_count;
+    this->failed_count = failed_count;
+}
+
+Buffer ArchiveAck::serialize() const
+{
+    Buffer buff(ArchiveAck::getSize());
+    size_t position = 0;
+
+    memcpy(buff.data(), &command_code, sizeof(uint8_t));
+    position += sizeof(uint8_t);
+
+    uint32_t no_file_count = htonl(file_count);
+    memcpy(buff.data() + position, &no_file_count, sizeof(uint32_t));
+    position += sizeof(uint32_t);
+
+    uint32_t no_failed_count = htonl(failed_count);
+    memcpy(buff.data() + position, &no_failed_count, sizeof(uint32_t));
+
+    return buff;
+}
+
+void ArchiveAck::deserialize(Buffer input)
+{
+    size_t position = 0;
+
+    memcpy(&this->command_code, input.data(), sizeof(uint8_t));
+    position += sizeof(uint8_t);
+
+    uint32_t network_file_count = 0;
+    memcpy(&network_file_count, input.data() + position, sizeof(uint32_t));
+    file_count = ntohl(network_file_count);
+    position += sizeof(uint32_t);
+
+    uint32_t network_failed_count = 0;
+    memcpy(&network_failed_count, input.data() + position, sizeof(uint32_t));
+    failed_count = ntohl(network_failed_count);
+}
+
+int ArchiveAck::getSize()
+{
+    int size = 0;
+
+    size += sizeof(uint8_t);
+    size += sizeof(uint32_t); // file_count
+    size += sizeof(uint32_t); // failed_count
+
+    return size;
+}
+
+void ArchiveAck::print() const
+{
+    cout << "---------- ARCHIVE ACKNOWLEDGEMENT ---------" << endl;
+    cout << "FILES: " << file_count << endl;
+    cout << "FAILED: " << failed_count << endl;
+    cout << "--------------------------------------------" << endl;
+}
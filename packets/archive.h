@@ -0,0 +1,63 @@
+#ifndef _ARCHIVE_H
+#define _ARCHIVE_H
+
+#include <iostream>
+#include <string>
+#include <cstdint>
+#include <cstring>
+#include <constants.h>
+#include <vector>
+
+using namespace std;
+
+typedef vector<unsigned char> Buffer;
+
+// An archive download is opened with a BatchM1 carrying RequestCodes::ARCHIVE_REQ:
+// file_count 0 asks for the whole folder, otherwise a batch manifest of names follows.
+
+// ----------------------------------- ARCHIVE DATA ------------------------------------
+
+// A slice of the tar stream, at most MAX::archive_data bytes before compression
+class ArchiveData
+{
+private:
+    uint8_t command_code;
+    uint8_t chunk_flags;
+    uint8_t last;
+    uint32_t original_size;
+    Buffer data;
+
+public:
+    ArchiveData();
+    ArchiveData(Buffer data, uint8_t chunk_flags, uint32_t original_size, bool last);
+    Buffer serialize() const;
+    bool deserialize(Buffer buffer);
+    static size_t getSize(size_t data_size);
+    Buffer &getData() { return data; }
+    uint8_t getChunkFlags() { return chunk_flags; }
+    uint32_t getOriginalSize() { return original_size; }
+    bool isLast() { return last != 0; }
+};
+
+// ----------------------------------- ARCHIVE ACKNOWLEDGEMENT ------------------------------------
+
+// Closes the stream: how many files made it into the archive and how many were left out
+class ArchiveAck
+{
+private:
+    uint8_t command_code;
+    uint32_t file_count;
+    uint32_t failed_count;
+
+public:
+    ArchiveAck();
+    ArchiveAck(uint32_t file_count, uint32_t failed_count);
+    Buffer serialize() const;
+    void deserialize(Buffer buffer);
+    static int getSize();
+    uint32_t getFileCount() { return file_count; }
+    uint32_t getFailedCount() { return failed_count; }
+    void print() const;
+};
+
+#endif // _ARCHIVE_H
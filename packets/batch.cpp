@@ -0,0 +1,242 @@
+#include "batch.h"
+#include <vector>
+#include <arpa/inet.h>
+
+// ----------------------------------- BATCH M1 ------------------------------------
+
+BatchM1::BatchM1() {}
+
+BatchM1::BatchM1(uint8_t command_code, uint8_t compression, uint32_t file_count)
+{
+    this->command_code = command_code;
+    this->compression = compression;
+    this->file_count = file_count;
+}
+
+Buffer BatchM1::serialize() const
+{
+    Buffer buff(MAX::initial_request_length);
+    size_t position = 0;
+
+    // insert the command code uint8_t (one byte) interpreted as unsigned char
+    memcpy(buff.data(), &command_code, sizeof(uint8_t));
+    position += sizeof(uint8_t);
+
+    memcpy(buff.data() + position, &compression, sizeof(uint8_t));
+    position += sizeof(uint8_t);
+
+    // insert the number of files in network byte order
+    uint32_t no_file_count = htonl(file_count);
+    memcpy(buff.data() + position, &no_file_count, sizeof(uint32_t));
+
+    return buff;
+}
+
+void BatchM1::deserialize(Buffer input)
+{
+    size_t position = 0;
+
+    memcpy(&this->command_code, input.data(), sizeof(uint8_t));
+    position += sizeof(uint8_t);
+
+    memcpy(&this->compression, input.data() + position, sizeof(uint8_t));
+    position += sizeof(uint8_t);
+
+    uint32_t network_file_count = 0;
+    memcpy(&network_file_count, input.data() + position, sizeof(uint32_t));
+    file_count = ntohl(network_file_count);
+}
+
+int BatchM1::getSize()
+{
+    int size = 0;
+
+    size += sizeof(uint8_t);
+    size += sizeof(uint8_t); // compression
+    size += sizeof(uint32_t);
+
+    return size;
+}
+
+void BatchM1::print() const
+{
+    cout << "---------- BATCH M1 ---------" << endl;
+    cout << "COMMAND: " << (int)command_code << endl;
+    cout << "FILE COUNT: " << file_count << endl;
+    cout << "COMPRESSION: " << (int)compression << endl;
+    cout << "-----------------------------" << endl;
+}
+
+// ----------------------------------- BATCH MANIFEST ------------------------------------
+
+BatchManifest::BatchManifest() {}
+
+BatchManifest::BatchManifest(uint8_t command_code, vector<BatchEntry> entries, bool last, uint8_t compression)
+{
+    this->command_code = command_code;
+    this->compression = compression;
+    this->last = last ? 1 : 0;
+    this->entries = entries;
+}
+
+Buffer BatchManifest::serialize() const
+{
+    Buffer buff(BatchManifest::getSize(entries));
+    size_t position = 0;
+
+    memcpy(buff.data(), &command_code, sizeof(uint8_t));
+    position += sizeof(uint8_t);
+
+    memcpy(buff.data() + position, &compression, sizeof(uint8_t));
+    position += sizeof(uint8_t);
+
+    memcpy(buff.data() + position, &last, sizeof(uint8_t));
+    position += sizeof(uint8_t);
+
+    uint32_t no_count = htonl(entries.size());
+    memcpy(buff.data() + position, &no_count, sizeof(uint32_t));
+    position += sizeof(uint32_t);
+
+    // every entry is: name length | name | file size | status
+    for (const BatchEntry &entry : entries)
+    {
+        uint8_t name_length = std::min(entry.file_name.size(), MAX::file_name);
+        memcpy(buff.data() + position, &name_length, sizeof(uint8_t));
+        position += sizeof(uint8_t);
+
+        memcpy(buff.data() + position, entry.file_name.data(), name_length);
+        position += name_length;
+
+        uint32_t no_file_size = htonl(entry.file_size);
+        memcpy(buff.data() + position, &no_file_size, sizeof(uint32_t));
+        position += sizeof(uint32_t);
+
+        memcpy(buff.data() + position, &entry.status, sizeof(uint8_t));
+        position += sizeof(uint8_t);
+    }
+
+    return buff;
+}
+
+bool BatchManifest::deserialize(Buffer input)
+{
+    size_t position = 0;
+
+    if (input.size() < 3 * sizeof(uint8_t) + sizeof(uint32_t))
+        return false;
+
+    memcpy(&this->command_code, input.data(), sizeof(uint8_t));
+    position += sizeof(uint8_t);
+
+    memcpy(&this->compression, input.data() + position, sizeof(uint8_t));
+    position += sizeof(uint8_t);
+
+    memcpy(&this->last, input.data() + position, sizeof(uint8_t));
+    position += sizeof(uint8_t);
+
+    uint32_t count = 0;
+    memcpy(&count, input.data() + position, sizeof(uint32_t));
+    count = ntohl(count);
+    position += sizeof(uint32_t);
+
+    // entries have variable length, check every field against the received payload
+    entries.clear();
+    for (uint32_t i = 0; i < count; i++)
+    {
+        BatchEntry entry;
+
+        if (position + sizeof(uint8_t) > input.size())
+            return false;
+        uint8_t name_length = input[position];
+        position += sizeof(uint8_t);
+
+        if (position + name_length + sizeof(uint32_t) + sizeof(uint8_t) > input.size())
+            return false;
+        entry.file_name.assign(reinterpret_cast<const char *>(input.data() + position), name_length);
+        position += name_length;
+
+        uint32_t no_file_size;
+        memcpy(&no_file_size, input.data() + position, sizeof(uint32_t));
+        entry.file_size = ntohl(no_file_size);
+        position += sizeof(uint32_t);
+
+        memcpy(&entry.status, input.data() + position, sizeof(uint8_t));
+        position += sizeof(uint8_t);
+
+        entries.push_back(entry);
+    }
+
+    return true;
+}
+
+size_t BatchManifest::getSize(const vector<BatchEntry> &entries)
+{
+    size_t size = 0;
+
+    size += sizeof(uint8_t);
+    size += sizeof(uint8_t);  // compression
+    size += sizeof(uint8_t);  // last
+    size += sizeof(uint32_t); // count
+
+    for (const BatchEntry &entry : entries)
+        size += sizeof(uint8_t) + std::min(entry.file_name.size(), MAX::file_name) + sizeof(uint32_t) + sizeof(uint8_t);
+
+    return size;
+}
+
+size_t BatchManifest::getMaxSize(size_t entry_count)
+{
+    BatchEntry longest = {string(MAX::file_name, 'x'), 0, 0};
+    return BatchManifest::getSize(vector<BatchEntry>(entry_count, longest));
+}
+
+// ----------------------------------- BATCH DATA ------------------------------------
+
+BatchData::BatchData() {}
+
+BatchData::BatchData(Buffer data, uint8_t chunk_flags)
+{
+    this->command_code = RequestCodes::BATCH_DATA;
+    this->chunk_flags = chunk_flags;
+    this->data = data;
+}
+
+Buffer BatchData::serialize() const
+{
+    Buffer buff(BatchData::getSize(data.size()));
+    size_t position = 0;
+
+    memcpy(buff.data(), &command_code, sizeof(uint8_t));
+    position += sizeof(uint8_t);
+
+    memcpy(buff.data() + position, &chunk_flags, sizeof(uint8_t));
+    position += sizeof(uint8_t);
+
+    memcpy(buff.data() + position, data.data(), data.size());
+
+    return buff;
+}
+
+void BatchData::deserialize(Buffer input)
+{
+    size_t position = 0;
+
+    memcpy(&this->command_code, input.data(), sizeof(uint8_t));
+    position += sizeof(uint8_t);
+
+    memcpy(&this->chunk_flags, input.data() + position, sizeof(uint8_t));
+    position += sizeof(uint8_t);
+
+    data.assign(input.begin() + position, input.end());
+}
+
+size_t BatchData::getSize(size_t data_size)
+{
+    size_t size = 0;
+
+    size += sizeof(uint8_t);
+    size += sizeof(uint8_t); // chunk_flags
+    size += data_size;
+
+    return size;
+}
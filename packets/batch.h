@@ -0,0 +1,88 @@
+#ifndef _BATCH_H
+#define _BATCH_H
+
+#include <iostream>
+#include <string>
+#include <cstdint>
+#include <cstring>
+#include <openssl/rand.h>
+#include <constants.h>
+#include <vector>
+
+using namespace std;
+
+typedef vector<unsigned char> Buffer;
+
+// ----------------------------------- BATCH M1 ------------------------------------
+
+// Opens a batch upload or download of file_count files
+class BatchM1
+{
+private:
+    uint8_t command_code;
+
+public:
+    uint8_t compression; // compression mode proposed by the client
+    uint32_t file_count;
+
+    BatchM1();
+    BatchM1(uint8_t command_code, uint8_t compression, uint32_t file_count);
+    Buffer serialize() const;
+    void deserialize(Buffer buffer);
+    static int getSize();
+    uint8_t getCommandCode() { return command_code; }
+    void print() const;
+};
+
+// ----------------------------------- BATCH MANIFEST ------------------------------------
+
+struct BatchEntry
+{
+    string file_name;
+    uint32_t file_size;
+    uint8_t status; // BatchCodes, meaningful in the answers of the server
+};
+
+// A slice of the list of files of a batch: the client announces the files with it and
+// the server answers with the same list carrying one status per file
+class BatchManifest
+{
+private:
+    uint8_t command_code;
+    uint8_t compression;
+    uint8_t last;
+    vector<BatchEntry> entries;
+
+public:
+    BatchManifest();
+    BatchManifest(uint8_t command_code, vector<BatchEntry> entries, bool last, uint8_t compression);
+    Buffer serialize() const;
+    bool deserialize(Buffer buffer);
+    static size_t getSize(const vector<BatchEntry> &entries);
+    static size_t getMaxSize(size_t entry_count);
+    vector<BatchEntry> &getEntries() { return entries; }
+    uint8_t getCompression() { return compression; }
+    bool isLast() { return last != 0; }
+};
+
+// ----------------------------------- BATCH DATA ------------------------------------
+
+// Contents of the accepted files, back to back, cut in frames of at most MAX::batch_data
+class BatchData
+{
+private:
+    uint8_t command_code;
+    uint8_t chunk_flags;
+    Buffer data;
+
+public:
+    BatchData();
+    BatchData(Buffer data, uint8_t chunk_flags);
+    Buffer serialize() const;
+    void deserialize(Buffer buffer);
+    static size_t getSize(size_t data_size);
+    Buffer &getData() { return data; }
+    uint8_t getChunkFlags() { return chunk_flags; }
+};
+
+#endif // _BATCH_H
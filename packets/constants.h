@@ -2,7 +2,9 @@
 #define _CONSTANTS_H
 #include <array>
 #include <cstddef>
+#include <cstdint>
 #include <limits>
+#include <string>
 #include <openssl/evp.h>
 
 const std::array<std::string, 3> username_list = {"user1", "user2", "user3"};
@@ -24,6 +26,22 @@ namespace RequestCodes
     const size_t RENAME_REQ = 6;
     const size_t DELETE_REQ = 7;
     const size_t LOGOUT_REQ = 8;
+    const size_t SYNC_REQ = 9;
+    const size_t SYNC_SIGNATURES = 10;
+    const size_t SYNC_DELTA = 11;
+    const size_t UPLOAD_PROOF = 12;
+    const size_t UPLOAD_MANIFEST = 13;
+    const size_t UPLOAD_HAVE = 14;
+    const size_t BATCH_UPLOAD_REQ = 15;
+    const size_t BATCH_DOWNLOAD_REQ = 16;
+    const size_t BATCH_STATUS = 17;
+    const size_t BATCH_DATA = 18;
+    const size_t ARCHIVE_REQ = 19;
+    const size_t ARCHIVE_DATA = 20;
+    const size_t LIST_PAGE_REQ = 21;
+    const size_t LIST_PAGE = 22;
+    const size_t VERSION_REQ = 23;
+    const size_t VERSION_LIST = 24;
 }
 
 namespace MAX
@@ -31,12 +49,117 @@ namespace MAX
     const size_t file_name = 255; // linux file name length limit
     const size_t username_length = 50;
     const size_t passowrd_length = 50;
-    const size_t max_file_chunk = 15;                                 // 1KB
+    const size_t max_file_chunk = 1024;                               // 1KB
     const size_t max_file_size = 4ULL * 1024 * 1024 * 1024;           // 4GB in bytes
     const size_t path = 4096;                                         // linux os imposed max absolute path length
     const size_t ack_msg = 50 + 1;                                    // extra char for str terminator
     const size_t counter_max_value = std::numeric_limits<int>::max(); // number of requests before shutting down the session
     const size_t initial_request_length = 520;                        // size of the initial request size to be expected
+    const size_t signatures_per_frame = 1024;                         // block signatures sent per frame during a sync
+    const size_t delta_batch = 64 * 1024;                             // bytes of delta instructions per frame
+    const size_t manifest_entries_per_frame = 1024;                   // chunk digests sent per frame during an upload
+    const size_t batch_files = 100000;                                // files in a single batch request
+    const size_t batch_entries_per_frame = 1024;                      // file entries sent per frame of a batch manifest
+    const size_t batch_data = 64 * 1024;                              // bytes of file contents per frame of a batch
+    const size_t archive_data = 64 * 1024;                            // bytes of tar stream per frame of an archive
+    const size_t list_pattern = 200;                                  // prefix or glob filter of a paginated listing
+    const size_t list_page = 1000;                                    // files in a single page of a listing
+    const size_t list_entries_per_frame = 128;                        // file entries sent per frame of a page
+    const size_t etag = 32;                                           // hex entity tag of a file or of a folder
+    const size_t versions_listed = 256;                               // versions of a file in a single listing, newest first
+}
+
+namespace Compression
+{
+    const uint8_t NONE = 0;
+    const uint8_t LZ4 = 1;
+    const double min_ratio = 0.9;               // a chunk counts as compressible only below 90% of its size
+    const size_t max_incompressible_chunks = 4; // consecutive non shrinking chunks before giving up on a file
+}
+
+namespace ChunkFlags
+{
+    const uint8_t STORED = 0;
+    const uint8_t COMPRESSED = 1;
+}
+
+// when an upload is flushed to the disk before it is renamed into place
+namespace Durability
+{
+    const uint8_t NONE = 0;         // left to the kernel writeback
+    const uint8_t FILE_SYNC = 1;    // fdatasync of every file on commit
+    const uint8_t GROUP_COMMIT = 2; // commits of every session share one flush every group_commit_ms
+}
+
+// where the files of the users are kept
+namespace Backends
+{
+    const uint8_t POSIX = 0;   // one folder per user under Storage::data_root
+    const uint8_t MEMORY = 1;  // in the server memory, lost on exit (benchmarks and tests)
+    const uint8_t SHARDED = 2; // user folders spread over Storage::shard_roots
+}
+
+namespace Storage
+{
+    const uint8_t backend = Backends::POSIX;
+    const std::string data_root = "../data";
+    const std::array<std::string, 4> shard_roots = {"../data/shard0", "../data/shard1", "../data/shard2", "../data/shard3"};
+    const size_t shard_vnodes = 64;                  // points of each shard root on the consistent hash ring
+    const bool deduplicate = false;                  // split uploads in content defined chunks kept once on the server
+    const std::string chunk_store = "../data/.store"; // content addressed store, hidden from every user folder
+    const std::string metadata_index = "../data/.index"; // per user file metadata, one log per user
+    const std::string journal = "../data/.journal";    // write-ahead journal of the metadata index changes of every user
+    const unsigned journal_commit_ms = 10;             // a journaled change is on disk at most this late, changes of the interval share a flush
+    const uint64_t journal_checkpoint = 16 * 1024 * 1024; // journal length that makes the indexes write their snapshots and clear it
+    const size_t min_chunk = 2 * 1024;
+    const size_t avg_chunk = 8 * 1024;
+    const size_t max_chunk = 64 * 1024;
+    const size_t gc_release_threshold = 32; // deleted or replaced recipes before unreferenced chunks get swept
+    const size_t archive_prefetch = 8;      // archive frames read ahead of the socket
+    const uintmax_t direct_io_threshold = 64 * 1024 * 1024; // files from this size on bypass the page cache
+    const size_t direct_io_alignment = 4096;                // O_DIRECT offsets, lengths and buffers are multiples of it
+    const size_t direct_io_block = 1024 * 1024;             // bytes moved per direct read or write
+    const size_t direct_io_pool = 16;                       // idle aligned blocks kept for reuse
+    const bool io_uring = true;                             // queue disk and socket I/O on io_uring when the kernel has it
+    const unsigned io_uring_depth = 16;                     // submission queue entries of every session ring
+    const size_t io_send_batch = 64 * 1024;                 // download frames gathered into a single send
+    const size_t read_ahead_depth = 2;                      // download blocks requested ahead of the one being sent
+    const uintmax_t mmap_threshold = 1024 * 1024;           // downloads from this size up to direct_io_threshold are mapped
+    const size_t mmap_drop_behind = 4 * 1024 * 1024;        // mapped bytes already sent before they are dropped from memory
+    const uintmax_t user_quota = 4ULL * 1024 * 1024 * 1024; // logical bytes a user may store, 0 means no limit
+    const size_t cache_bytes = 256 * 1024 * 1024;           // memory of the download cache, 0 turns it off
+    const size_t cache_shards = 16;                         // independently locked parts of the cache, each with its share of cache_bytes
+    const size_t cache_block = 256 * 1024;                  // file bytes kept per cache entry
+    const uintmax_t cache_max_file = 16 * 1024 * 1024;      // larger downloads are never cached, they would flush everything else
+    const uintmax_t pack_threshold = 0;                     // smaller files go to the pack of their folder instead of a file each, 0 turns packing off
+    const uint64_t pack_compact_min = 4 * 1024 * 1024;      // garbage a pack needs, besides outweighing its live files, before it is rewritten
+    const bool at_rest_compression = true;                  // keep text-like uploads LZ4 compressed on disk, ignored with deduplicate
+    const uintmax_t at_rest_min = 64 * 1024;                // smaller files are stored as they are
+    const size_t at_rest_block = 256 * 1024;                // plaintext bytes per compressed frame, the unit of a seek
+    const std::array<std::string, 20> at_rest_types = {"txt", "log", "csv", "tsv", "json", "xml", "html", "htm", "md", "yaml",
+                                                       "yml", "sql", "c", "cpp", "h", "hpp", "py", "js", "css", "ini"};
+    const std::string cold_root = "../data/.cold";          // cold tier, one folder per user (a slower disk)
+    const int64_t tier_cold_after_s = 30 * 24 * 3600;       // files not read for this long move to the cold tier, 0 turns tiering off
+    const unsigned tier_scan_s = 600;                       // interval between two looks for files to demote
+    const uint64_t tier_rate = 16 * 1024 * 1024;            // bytes a second the mover copies at most, both ways
+    const int64_t access_granularity_s = 60;                // reads closer than this to the recorded one are not recorded
+    const std::string version_root = "../data/.versions";   // earlier versions of the user files, as recipes of their chunks
+    const size_t version_keep = 10;                         // versions kept per file, 0 turns versioning off
+    const int64_t version_max_age_s = 90 * 24 * 3600;       // older versions are dropped, whatever their number
+    const unsigned version_gc_s = 3600;                     // interval between two passes of the retention policy
+    const uint8_t durability = Durability::FILE_SYNC;
+    const unsigned group_commit_ms = 10;                    // interval of Durability::GROUP_COMMIT
+}
+
+// per file status of a batch upload or download
+namespace BatchCodes
+{
+    const uint8_t OK = 0;
+    const uint8_t INVALID_NAME = 1;
+    const uint8_t EXISTS = 2;
+    const uint8_t NOT_FOUND = 3;
+    const uint8_t FAILED = 4;
+    const uint8_t QUOTA_EXCEEDED = 5;
 }
 
 namespace CryptoMaterials
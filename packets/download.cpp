@@ -5,10 +5,17 @@
 
 DownloadM1::DownloadM1() {}
 
-DownloadM1::DownloadM1(string file_name)
+DownloadM1::DownloadM1(string file_name) : DownloadM1(file_name, Compression::NONE) {}
+
+DownloadM1::DownloadM1(string file_name, uint8_t compression) : DownloadM1(file_name, compression, "") {}
+
+DownloadM1::DownloadM1(string file_name, uint8_t compression, string if_none_match)
 {
     this->command_code = RequestCodes::DOWNLOAD_REQ;
+    this->compression = compression;
     strncpy(this->file_name, file_name.c_str(), MAX::file_name + 1);
+    strncpy(this->if_none_match, if_none_match.c_str(), MAX::etag);
+    this->if_none_match[MAX::etag] = '\0';
 }
 
 Buffer DownloadM1::serialize() const
@@ -23,6 +30,14 @@ Buffer DownloadM1::serialize() const
     // insert the file string with a size of max of file name (50) +1
     unsigned char const *file_name_pointer = reinterpret_cast<unsigned char const *>(&file_name);
     memcpy(buff.data() + position, file_name_pointer, ((MAX::file_name + 1) * sizeof(char)));
+    position += (MAX::file_name + 1) * sizeof(char);
+
+    // insert the proposed compression mode
+    memcpy(buff.data() + position, &compression, sizeof(uint8_t));
+    position += sizeof(uint8_t);
+
+    // insert the entity tag of the copy held by the client
+    memcpy(buff.data() + position, if_none_match, (MAX::etag + 1) * sizeof(char));
 
     return buff;
 }
@@ -35,6 +50,13 @@ void DownloadM1::deserialize(Buffer input)
     position += sizeof(uint8_t);
 
     memcpy(&this->file_name, input.data() + position, (MAX::file_name + 1) * sizeof(char));
+    position += (MAX::file_name + 1) * sizeof(char);
+
+    memcpy(&this->compression, input.data() + position, sizeof(uint8_t));
+    position += sizeof(uint8_t);
+
+    memcpy(&this->if_none_match, input.data() + position, (MAX::etag + 1) * sizeof(char));
+    if_none_match[MAX::etag] = '\0';
 }
 
 int DownloadM1::getSize()
@@ -43,6 +65,8 @@ int DownloadM1::getSize()
 
     size += sizeof(uint8_t);
     size += (MAX::file_name + 1) * sizeof(char);
+    size += sizeof(uint8_t);                // compression
+    size += (MAX::etag + 1) * sizeof(char); // if_none_match
 
     return size;
 }
@@ -58,18 +82,20 @@ void DownloadM1::print() const
 
 DownloadAck::DownloadAck() {}
 
-DownloadAck::DownloadAck(uint8_t ack_code)
-{
-    this->command_code = RequestCodes::DOWNLOAD_REQ;
-    this->file_size = 0;
-    this->ack_code = ack_code;
-}
+DownloadAck::DownloadAck(uint8_t ack_code) : DownloadAck(ack_code, 0, Compression::NONE) {}
+
+DownloadAck::DownloadAck(uint8_t ack_code, uint32_t file_size) : DownloadAck(ack_code, file_size, Compression::NONE) {}
+
+DownloadAck::DownloadAck(uint8_t ack_code, uint32_t file_size, uint8_t compression) : DownloadAck(ack_code, file_size, compression, "") {}
 
-DownloadAck::DownloadAck(uint8_t ack_code, uint32_t file_size)
+DownloadAck::DownloadAck(uint8_t ack_code, uint32_t file_size, uint8_t compression, string etag)
 {
     this->command_code = RequestCodes::DOWNLOAD_REQ;
     this->file_size = file_size;
     this->ack_code = ack_code;
+    this->compression = compression;
+    strncpy(this->etag, etag.c_str(), MAX::etag);
+    this->etag[MAX::etag] = '\0';
 }
 
 Buffer DownloadAck::serialize() const
@@ -90,6 +116,14 @@ Buffer DownloadAck::serialize() const
 
     // Insert ack_code into the buffer
     memcpy(buff.data() + position, &ack_code, sizeof(uint8_t));
+    position += sizeof(uint8_t);
+
+    // Insert the negotiated compression mode
+    memcpy(buff.data() + position, &compression, sizeof(uint8_t));
+    position += sizeof(uint8_t);
+
+    // Insert the entity tag of the file
+    memcpy(buff.data() + position, etag, (MAX::etag + 1) * sizeof(char));
 
     return buff;
 }
@@ -111,6 +145,15 @@ void DownloadAck::deserialize(Buffer input)
 
     // Extract ack_code from the buffer
     memcpy(&this->ack_code, input.data() + position, sizeof(uint8_t));
+    position += sizeof(uint8_t);
+
+    // Extract the negotiated compression mode
+    memcpy(&this->compression, input.data() + position, sizeof(uint8_t));
+    position += sizeof(uint8_t);
+
+    // Extract the entity tag of the file
+    memcpy(&this->etag, input.data() + position, (MAX::etag + 1) * sizeof(char));
+    etag[MAX::etag] = '\0';
 }
 
 int DownloadAck::getSize()
@@ -120,6 +163,8 @@ int DownloadAck::getSize()
     size += sizeof(uint8_t);
     size += sizeof(uint32_t); // file_size
     size += sizeof(uint8_t);
+    size += sizeof(uint8_t);                // compression
+    size += (MAX::etag + 1) * sizeof(char); // etag
 
     return size;
 }
@@ -135,9 +180,12 @@ void DownloadAck::print() const
 
 DownloadM2::DownloadM2(){};
 
-DownloadM2::DownloadM2(Buffer file_chunk)
+DownloadM2::DownloadM2(Buffer file_chunk) : DownloadM2(file_chunk, ChunkFlags::STORED) {}
+
+DownloadM2::DownloadM2(Buffer file_chunk, uint8_t chunk_flags)
 {
     command_code = RequestCodes::DOWNLOAD_CHUNK;
+    this->chunk_flags = chunk_flags;
     this->file_chunk = file_chunk;
 }
 
@@ -151,6 +199,9 @@ Buffer DownloadM2::serialize() const
     memcpy(buff.data(), &command_code, sizeof(uint8_t));
     position += sizeof(uint8_t);
 
+    memcpy(buff.data() + position, &chunk_flags, sizeof(uint8_t));
+    position += sizeof(uint8_t);
+
     memcpy(buff.data() + position, file_chunk.data(), chunk_size * sizeof(unsigned char));
     position += chunk_size * sizeof(unsigned char);
 
@@ -159,7 +210,7 @@ Buffer DownloadM2::serialize() const
 
 void DownloadM2::deserialize(Buffer input)
 {
-    size_t chunk_size = input.size() - sizeof(uint8_t);
+    size_t chunk_size = input.size() - 2 * sizeof(uint8_t);
     this->file_chunk = Buffer(chunk_size);
 
     size_t position = 0;
@@ -167,6 +218,9 @@ void DownloadM2::deserialize(Buffer input)
     memcpy(&this->command_code, input.data(), sizeof(uint8_t));
     position += sizeof(uint8_t);
 
+    memcpy(&this->chunk_flags, input.data() + position, sizeof(uint8_t));
+    position += sizeof(uint8_t);
+
     memcpy(this->file_chunk.data(), input.data() + position, chunk_size * sizeof(unsigned char));
 }
 
@@ -175,6 +229,7 @@ size_t DownloadM2::getSize(size_t chunk_size)
     int size = 0;
 
     size += sizeof(uint8_t);
+    size += sizeof(uint8_t); // chunk_flags
     size += chunk_size * sizeof(unsigned char);
 
     return size;
@@ -22,9 +22,13 @@ private:
 
 public:
     char file_name[MAX::file_name + 1];
+    uint8_t compression; // compression mode proposed by the client
+    char if_none_match[MAX::etag + 1]; // entity tag of the copy the client holds, empty for none
 
     DownloadM1();
     DownloadM1(string file_name);
+    DownloadM1(string file_name, uint8_t compression);
+    DownloadM1(string file_name, uint8_t compression, string if_none_match);
     Buffer serialize() const;
     void deserialize(Buffer buffer);
     static int getSize();
@@ -39,16 +43,22 @@ private:
     uint8_t command_code;
     uint8_t ack_code;
     uint32_t file_size;
+    uint8_t compression;
+    char etag[MAX::etag + 1]; // current version of the file
 
 public:
     DownloadAck();
     DownloadAck(uint8_t ack_code);
     DownloadAck(uint8_t ack_code, uint32_t file_size);
+    DownloadAck(uint8_t ack_code, uint32_t file_size, uint8_t compression);
+    DownloadAck(uint8_t ack_code, uint32_t file_size, uint8_t compression, string etag);
     Buffer serialize() const;
     void deserialize(Buffer buffer);
     static int getSize();
     uint8_t getAckCode() { return ack_code; };
     uint32_t getFileSize() { return file_size; };
+    uint8_t getCompression() { return compression; };
+    string getEtag() { return string(etag); };
     void print() const;
 };
 
@@ -58,15 +68,18 @@ class DownloadM2
 {
 private:
     uint8_t command_code;
+    uint8_t chunk_flags; // stored or compressed
     Buffer file_chunk;
 
 public:
     DownloadM2();
     DownloadM2(Buffer file_chunk);
+    DownloadM2(Buffer file_chunk, uint8_t chunk_flags);
     Buffer serialize() const;
     void deserialize(Buffer file_chunk);
     static size_t getSize(size_t chunk_size);
     Buffer getFileChunk() { return file_chunk; }
+    uint8_t getChunkFlags() { return chunk_flags; }
     void print() const;
 };
 
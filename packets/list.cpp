@@ -1,6 +1,7 @@
 #include "list.h"
 #include <vector>
 #include <arpa/inet.h>
+#include <algorithm>
 #include <iostream>
 
 using namespace std;
@@ -145,6 +146,7 @@ void ListM3::deserialize(Buffer input)
     file_list_data = new char[file_list_size + 1];
     // Extract file_list_data from the buffer
     memcpy(file_list_data, input.data() + position, file_list_size);
+    file_list_data[file_list_size] = '\0';
 }
 
 int ListM3::getSize()
@@ -163,9 +165,292 @@ void ListM3::setFileListData(const char *data)
     // Allocate new memory and copy the provided data
     file_list_data = new char[file_list_size + 1];
     std::memcpy(file_list_data, data, file_list_size);
+    file_list_data[file_list_size] = '\0';
 }
 
 const char *ListM3::getFileListData() const
 {
     return file_list_data;
 }
+
+// ----------------------------------- LIST PAGE REQUEST ------------------------------------
+
+namespace
+{
+    void appendUint64(unsigned char *buff, size_t &position, uint64_t value)
+    {
+        uint32_t no_high = htonl(static_cast<uint32_t>(value >> 32));
+        uint32_t no_low = htonl(static_cast<uint32_t>(value));
+        memcpy(buff + position, &no_high, sizeof(uint32_t));
+        memcpy(buff + position + sizeof(uint32_t), &no_low, sizeof(uint32_t));
+        position += sizeof(uint64_t);
+    }
+
+    uint64_t readUint64(const unsigned char *buff, size_t &position)
+    {
+        uint32_t no_high, no_low;
+        memcpy(&no_high, buff + position, sizeof(uint32_t));
+        memcpy(&no_low, buff + position + sizeof(uint32_t), sizeof(uint32_t));
+        position += sizeof(uint64_t);
+        return (static_cast<uint64_t>(ntohl(no_high)) << 32) | ntohl(no_low);
+    }
+}
+
+ListPageM1::ListPageM1() {}
+
+ListPageM1::ListPageM1(string cursor, uint8_t filter, string pattern, uint16_t page_size) : ListPageM1(cursor, filter, pattern, page_size, "") {}
+
+ListPageM1::ListPageM1(string cursor, uint8_t filter, string pattern, uint16_t page_size, string if_none_match)
+{
+    this->command_code = RequestCodes::LIST_PAGE_REQ;
+    this->filter = filter;
+    this->page_size = page_size;
+
+    strncpy(this->cursor, cursor.c_str(), MAX::file_name);
+    this->cursor[MAX::file_name] = '\0';
+    strncpy(this->pattern, pattern.c_str(), MAX::list_pattern);
+    this->pattern[MAX::list_pattern] = '\0';
+    strncpy(this->if_none_match, if_none_match.c_str(), MAX::etag);
+    this->if_none_match[MAX::etag] = '\0';
+}
+
+Buffer ListPageM1::serialize() const
+{
+    Buffer buff(MAX::initial_request_length);
+    size_t position = 0;
+
+    memcpy(buff.data(), &command_code, sizeof(uint8_t));
+    position += sizeof(uint8_t);
+
+    memcpy(buff.data() + position, &filter, sizeof(uint8_t));
+    position += sizeof(uint8_t);
+
+    uint16_t no_page_size = htons(page_size);
+    memcpy(buff.data() + position, &no_page_size, sizeof(uint16_t));
+    position += sizeof(uint16_t);
+
+    memcpy(buff.data() + position, cursor, (MAX::file_name + 1) * sizeof(char));
+    position += (MAX::file_name + 1) * sizeof(char);
+
+    memcpy(buff.data() + position, pattern, (MAX::list_pattern + 1) * sizeof(char));
+    position += (MAX::list_pattern + 1) * sizeof(char);
+
+    memcpy(buff.data() + position, if_none_match, (MAX::etag + 1) * sizeof(char));
+
+    return buff;
+}
+
+void ListPageM1::deserialize(Buffer input)
+{
+    size_t position = 0;
+
+    memcpy(&this->command_code, input.data(), sizeof(uint8_t));
+    position += sizeof(uint8_t);
+
+    memcpy(&this->filter, input.data() + position, sizeof(uint8_t));
+    position += sizeof(uint8_t);
+
+    uint16_t network_page_size = 0;
+    memcpy(&network_page_size, input.data() + position, sizeof(uint16_t));
+    page_size = ntohs(network_page_size);
+    position += sizeof(uint16_t);
+
+    memcpy(cursor, input.data() + position, (MAX::file_name + 1) * sizeof(char));
+    cursor[MAX::file_name] = '\0';
+    position += (MAX::file_name + 1) * sizeof(char);
+
+    memcpy(pattern, input.data() + position, (MAX::list_pattern + 1) * sizeof(char));
+    pattern[MAX::list_pattern] = '\0';
+    position += (MAX::list_pattern + 1) * sizeof(char);
+
+    memcpy(if_none_match, input.data() + position, (MAX::etag + 1) * sizeof(char));
+    if_none_match[MAX::etag] = '\0';
+}
+
+int ListPageM1::getSize()
+{
+    int size = 0;
+
+    size += sizeof(uint8_t);
+    size += sizeof(uint8_t);  // filter
+    size += sizeof(uint16_t); // page_size
+    size += (MAX::file_name + 1) * sizeof(char);
+    size += (MAX::list_pattern + 1) * sizeof(char);
+    size += (MAX::etag + 1) * sizeof(char); // if_none_match
+
+    return size;
+}
+
+void ListPageM1::print() const
+{
+    cout << "---------- LIST PAGE M1 ---------" << endl;
+    cout << "CURSOR: " << cursor << endl;
+    cout << "FILTER: " << (int)filter << " " << pattern << endl;
+    cout << "PAGE SIZE: " << page_size << endl;
+    cout << "---------------------------------" << endl;
+}
+
+// ----------------------------------- LIST PAGE ------------------------------------
+
+ListPage::ListPage() {}
+
+ListPage::ListPage(uint8_t ack_code, vector<ListEntry> entries, bool last, string next_cursor) : ListPage(ack_code, entries, last, next_cursor, "") {}
+
+ListPage::ListPage(uint8_t ack_code, vector<ListEntry> entries, bool last, string next_cursor, string etag)
+{
+    this->command_code = RequestCodes::LIST_PAGE;
+    this->ack_code = ack_code;
+    this->last = last ? 1 : 0;
+    this->entries = entries;
+    this->next_cursor = next_cursor.substr(0, MAX::file_name);
+    this->etag = etag.substr(0, MAX::etag);
+}
+
+Buffer ListPage::serialize() const
+{
+    Buffer buff(ListPage::getSize(entries, next_cursor, etag));
+    size_t position = 0;
+
+    memcpy(buff.data(), &command_code, sizeof(uint8_t));
+    position += sizeof(uint8_t);
+
+    memcpy(buff.data() + position, &ack_code, sizeof(uint8_t));
+    position += sizeof(uint8_t);
+
+    memcpy(buff.data() + position, &last, sizeof(uint8_t));
+    position += sizeof(uint8_t);
+
+    uint16_t no_count = htons(entries.size());
+    memcpy(buff.data() + position, &no_count, sizeof(uint16_t));
+    position += sizeof(uint16_t);
+
+    // every entry is: name length | name | size | mtime | digest (zeros when unknown)
+    for (const ListEntry &entry : entries)
+    {
+        uint8_t name_length = std::min(entry.file_name.size(), MAX::file_name);
+        memcpy(buff.data() + position, &name_length, sizeof(uint8_t));
+        position += sizeof(uint8_t);
+
+        memcpy(buff.data() + position, entry.file_name.data(), name_length);
+        position += name_length;
+
+        appendUint64(buff.data(), position, entry.file_size);
+        appendUint64(buff.data(), position, static_cast<uint64_t>(entry.mtime));
+
+        Fingerprint::Digest digest = {};
+        if (!entry.digest.empty())
+            Fingerprint::fromHex(entry.digest, digest);
+        memcpy(buff.data() + position, digest.data(), digest.size());
+        position += digest.size();
+    }
+
+    uint8_t cursor_length = next_cursor.size();
+    memcpy(buff.data() + position, &cursor_length, sizeof(uint8_t));
+    position += sizeof(uint8_t);
+
+    memcpy(buff.data() + position, next_cursor.data(), cursor_length);
+    position += cursor_length;
+
+    uint8_t etag_length = etag.size();
+    memcpy(buff.data() + position, &etag_length, sizeof(uint8_t));
+    position += sizeof(uint8_t);
+
+    memcpy(buff.data() + position, etag.data(), etag_length);
+
+    return buff;
+}
+
+bool ListPage::deserialize(Buffer input)
+{
+    size_t position = 0;
+    const size_t entry_fixed_size = sizeof(uint8_t) + 2 * sizeof(uint64_t) + Fingerprint::digest_length;
+
+    if (input.size() < 3 * sizeof(uint8_t) + sizeof(uint16_t))
+        return false;
+
+    memcpy(&this->command_code, input.data(), sizeof(uint8_t));
+    position += sizeof(uint8_t);
+
+    memcpy(&this->ack_code, input.data() + position, sizeof(uint8_t));
+    position += sizeof(uint8_t);
+
+    memcpy(&this->last, input.data() + position, sizeof(uint8_t));
+    position += sizeof(uint8_t);
+
+    uint16_t count = 0;
+    memcpy(&count, input.data() + position, sizeof(uint16_t));
+    count = ntohs(count);
+    position += sizeof(uint16_t);
+
+    // entries have variable length, check every field against the received payload
+    entries.clear();
+    for (uint16_t i = 0; i < count; i++)
+    {
+        ListEntry entry;
+
+        if (position + sizeof(uint8_t) > input.size())
+            return false;
+        uint8_t name_length = input[position];
+
+        if (position + name_length + entry_fixed_size > input.size())
+            return false;
+        position += sizeof(uint8_t);
+
+        entry.file_name.assign(reinterpret_cast<const char *>(input.data() + position), name_length);
+        position += name_length;
+
+        entry.file_size = readUint64(input.data(), position);
+        entry.mtime = static_cast<int64_t>(readUint64(input.data(), position));
+
+        Fingerprint::Digest digest;
+        memcpy(digest.data(), input.data() + position, digest.size());
+        position += digest.size();
+
+        Fingerprint::Digest unknown = {};
+        if (digest != unknown)
+            entry.digest = Fingerprint::toHex(digest);
+
+        entries.push_back(entry);
+    }
+
+    if (position + sizeof(uint8_t) > input.size() || position + sizeof(uint8_t) + input[position] > input.size())
+        return false;
+
+    uint8_t cursor_length = input[position];
+    position += sizeof(uint8_t);
+    next_cursor.assign(reinterpret_cast<const char *>(input.data() + position), cursor_length);
+    position += cursor_length;
+
+    if (position + sizeof(uint8_t) > input.size() || position + sizeof(uint8_t) + input[position] > input.size())
+        return false;
+
+    uint8_t etag_length = input[position];
+    position += sizeof(uint8_t);
+    etag.assign(reinterpret_cast<const char *>(input.data() + position), etag_length);
+
+    return true;
+}
+
+size_t ListPage::getSize(const vector<ListEntry> &entries, const string &next_cursor, const string &etag)
+{
+    size_t size = 0;
+
+    size += sizeof(uint8_t);
+    size += sizeof(uint8_t);  // ack_code
+    size += sizeof(uint8_t);  // last
+    size += sizeof(uint16_t); // count
+
+    for (const ListEntry &entry : entries)
+        size += sizeof(uint8_t) + std::min(entry.file_name.size(), MAX::file_name) + 2 * sizeof(uint64_t) + Fingerprint::digest_length;
+
+    size += sizeof(uint8_t) + std::min(next_cursor.size(), MAX::file_name);
+    size += sizeof(uint8_t) + std::min(etag.size(), MAX::etag);
+
+    return size;
+}
+
+size_t ListPage::getMaxSize(size_t entry_count)
+{
+    ListEntry longest = {string(MAX::file_name, 'x'), 0, 0, ""};
+    return ListPage::getSize(vector<ListEntry>(entry_count, longest), string(MAX::file_name, 'x'), string(MAX::etag, 'x'));
+}
@@ -7,6 +7,7 @@
 #include <openssl/rand.h>
 #include <constants.h>
 #include <vector>
+#include "../tools/fingerprint.h"
 
 using namespace std;
 
@@ -67,4 +68,72 @@ public:
     const char *getFileListData() const;
 };
 
+// ----------------------------------- LIST PAGE REQUEST ------------------------------------
+
+namespace ListFilter
+{
+    const uint8_t NONE = 0;
+    const uint8_t PREFIX = 1;
+    const uint8_t GLOB = 2; // shell wildcards: * ? [...]
+}
+
+// Asks for at most page_size files after cursor, the last name of the previous page
+class ListPageM1
+{
+private:
+    uint8_t command_code;
+
+public:
+    uint8_t filter;
+    uint16_t page_size;
+    char cursor[MAX::file_name + 1];
+    char pattern[MAX::list_pattern + 1];
+    char if_none_match[MAX::etag + 1]; // folder tag of the listing the client holds, first page only
+
+    ListPageM1();
+    ListPageM1(string cursor, uint8_t filter, string pattern, uint16_t page_size);
+    ListPageM1(string cursor, uint8_t filter, string pattern, uint16_t page_size, string if_none_match);
+    Buffer serialize() const;
+    void deserialize(Buffer buffer);
+    static int getSize();
+    void print() const;
+};
+
+// ----------------------------------- LIST PAGE ------------------------------------
+
+struct ListEntry
+{
+    string file_name;
+    uint64_t file_size;
+    int64_t mtime;  // seconds since the epoch
+    string digest; // hex SHA-256, empty when the server does not know it yet
+};
+
+// A bounded slice of a page; the last slice carries the cursor of the next page, empty once done.
+// Every slice carries the folder tag the page was read at, ack code 2 means not modified.
+class ListPage
+{
+private:
+    uint8_t command_code;
+    uint8_t ack_code;
+    uint8_t last;
+    vector<ListEntry> entries;
+    string next_cursor;
+    string etag;
+
+public:
+    ListPage();
+    ListPage(uint8_t ack_code, vector<ListEntry> entries, bool last, string next_cursor);
+    ListPage(uint8_t ack_code, vector<ListEntry> entries, bool last, string next_cursor, string etag);
+    Buffer serialize() const;
+    bool deserialize(Buffer buffer);
+    static size_t getSize(const vector<ListEntry> &entries, const string &next_cursor, const string &etag);
+    static size_t getMaxSize(size_t entry_count);
+    uint8_t getAckCode() { return ack_code; }
+    vector<ListEntry> &getEntries() { return entries; }
+    bool isLast() { return last != 0; }
+    const string &getNextCursor() { return next_cursor; }
+    const string &getEtag() { return etag; }
+};
+
 #endif
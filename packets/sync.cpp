@@ -0,0 +1,271 @@
+#include "sync.h"
+#include <vector>
+#include <arpa/inet.h>
+
+// ----------------------------------- SYNC M1 ------------------------------------
+
+SyncM1::SyncM1() {}
+
+SyncM1::SyncM1(string file_name, uint32_t file_size)
+{
+    this->command_code = RequestCodes::SYNC_REQ;
+    this->file_size = file_size;
+    strncpy(this->file_name, file_name.c_str(), MAX::file_name + 1);
+}
+
+Buffer SyncM1::serialize() const
+{
+    Buffer buff(MAX::initial_request_length);
+    size_t position = 0;
+
+    // insert the command code uint8_t (one byte) interpreted as unsigned char
+    memcpy(buff.data(), &command_code, sizeof(uint8_t));
+    position += sizeof(uint8_t);
+
+    // insert the file string which has a size of max of file name (255) +1
+    unsigned char const *file_name_pointer = reinterpret_cast<unsigned char const *>(&file_name);
+    memcpy(buff.data() + position, file_name_pointer, ((MAX::file_name + 1) * sizeof(char)));
+    position += (MAX::file_name + 1) * sizeof(char);
+
+    // insert the new file size in network byte order
+    uint32_t no_file_size = htonl(file_size);
+    memcpy(buff.data() + position, &no_file_size, sizeof(uint32_t));
+
+    return buff;
+}
+
+void SyncM1::deserialize(Buffer input)
+{
+    size_t position = 0;
+
+    memcpy(&this->command_code, input.data(), sizeof(uint8_t));
+    position += sizeof(uint8_t);
+
+    memcpy(&this->file_name, input.data() + position, (MAX::file_name + 1) * sizeof(char));
+    position += (MAX::file_name + 1) * sizeof(char);
+
+    uint32_t network_file_size = 0;
+    memcpy(&network_file_size, input.data() + position, sizeof(uint32_t));
+    file_size = ntohl(network_file_size);
+}
+
+int SyncM1::getSize()
+{
+    int size = 0;
+
+    size += sizeof(uint8_t);
+    size += (MAX::file_name + 1) * sizeof(char);
+    size += sizeof(uint32_t);
+
+    return size;
+}
+
+void SyncM1::print() const
+{
+    cout << "---------- SYNC M1 ---------" << endl;
+    cout << "FILE NAME: " << file_name << endl;
+    cout << "FILE SIZE: " << file_size << endl;
+    cout << "----------------------------" << endl;
+}
+
+// ----------------------------------- SYNC ACK ------------------------------------
+
+SyncAck::SyncAck() {}
+
+SyncAck::SyncAck(uint8_t ack_code) : SyncAck(ack_code, 0, 0) {}
+
+SyncAck::SyncAck(uint8_t ack_code, uint32_t block_size, uint32_t block_count)
+{
+    this->command_code = RequestCodes::SYNC_REQ;
+    this->ack_code = ack_code;
+    this->block_size = block_size;
+    this->block_count = block_count;
+}
+
+Buffer SyncAck::serialize() const
+{
+    Buffer buff(SyncAck::getSize());
+    size_t position = 0;
+
+    memcpy(buff.data(), &command_code, sizeof(uint8_t));
+    position += sizeof(uint8_t);
+
+    memcpy(buff.data() + position, &ack_code, sizeof(uint8_t));
+    position += sizeof(uint8_t);
+
+    uint32_t no_block_size = htonl(block_size);
+    memcpy(buff.data() + position, &no_block_size, sizeof(uint32_t));
+    position += sizeof(uint32_t);
+
+    uint32_t no_block_count = htonl(block_count);
+    memcpy(buff.data() + position, &no_block_count, sizeof(uint32_t));
+
+    return buff;
+}
+
+void SyncAck::deserialize(Buffer input)
+{
+    size_t position = 0;
+
+    memcpy(&this->command_code, input.data(), sizeof(uint8_t));
+    position += sizeof(uint8_t);
+
+    memcpy(&this->ack_code, input.data() + position, sizeof(uint8_t));
+    position += sizeof(uint8_t);
+
+    uint32_t network_value = 0;
+    memcpy(&network_value, input.data() + position, sizeof(uint32_t));
+    block_size = ntohl(network_value);
+    position += sizeof(uint32_t);
+
+    memcpy(&network_value, input.data() + position, sizeof(uint32_t));
+    block_count = ntohl(network_value);
+}
+
+int SyncAck::getSize()
+{
+    int size = 0;
+
+    size += sizeof(uint8_t);
+    size += sizeof(uint8_t);
+    size += sizeof(uint32_t); // block_size
+    size += sizeof(uint32_t); // block_count
+
+    return size;
+}
+
+void SyncAck::print() const
+{
+    cout << "---------- SYNC ACK ---------" << endl;
+    cout << "Acknowledge Code: " << (int)ack_code << endl;
+    cout << "BLOCK SIZE: " << block_size << endl;
+    cout << "BLOCK COUNT: " << block_count << endl;
+    cout << "-----------------------------" << endl;
+}
+
+// ----------------------------------- SYNC SIGNATURES ------------------------------------
+
+SyncSignatures::SyncSignatures() {}
+
+SyncSignatures::SyncSignatures(vector<Delta::BlockSignature> signatures)
+{
+    this->command_code = RequestCodes::SYNC_SIGNATURES;
+    this->signatures = signatures;
+}
+
+Buffer SyncSignatures::serialize() const
+{
+    Buffer buff(SyncSignatures::getSize(signatures.size()));
+    size_t position = 0;
+
+    memcpy(buff.data(), &command_code, sizeof(uint8_t));
+    position += sizeof(uint8_t);
+
+    uint32_t no_count = htonl(signatures.size());
+    memcpy(buff.data() + position, &no_count, sizeof(uint32_t));
+    position += sizeof(uint32_t);
+
+    // every entry is: weak checksum | strong hash
+    for (const Delta::BlockSignature &signature : signatures)
+    {
+        uint32_t no_weak = htonl(signature.weak);
+        memcpy(buff.data() + position, &no_weak, sizeof(uint32_t));
+        position += sizeof(uint32_t);
+
+        memcpy(buff.data() + position, signature.strong.data(), Delta::strong_length);
+        position += Delta::strong_length;
+    }
+
+    return buff;
+}
+
+void SyncSignatures::deserialize(Buffer input)
+{
+    size_t position = 0;
+
+    memcpy(&this->command_code, input.data(), sizeof(uint8_t));
+    position += sizeof(uint8_t);
+
+    uint32_t count = 0;
+    memcpy(&count, input.data() + position, sizeof(uint32_t));
+    count = ntohl(count);
+    position += sizeof(uint32_t);
+
+    // never read past the received payload whatever the announced count is
+    if (SyncSignatures::getSize(count) > input.size())
+        count = 0;
+
+    signatures.resize(count);
+    for (Delta::BlockSignature &signature : signatures)
+    {
+        uint32_t no_weak;
+        memcpy(&no_weak, input.data() + position, sizeof(uint32_t));
+        signature.weak = ntohl(no_weak);
+        position += sizeof(uint32_t);
+
+        memcpy(signature.strong.data(), input.data() + position, Delta::strong_length);
+        position += Delta::strong_length;
+    }
+}
+
+size_t SyncSignatures::getSize(size_t signature_count)
+{
+    size_t size = 0;
+
+    size += sizeof(uint8_t);
+    size += sizeof(uint32_t); // count
+    size += signature_count * (sizeof(uint32_t) + Delta::strong_length);
+
+    return size;
+}
+
+// ----------------------------------- SYNC M2 ------------------------------------
+
+SyncM2::SyncM2() {}
+
+SyncM2::SyncM2(Buffer instructions, bool last)
+{
+    this->command_code = RequestCodes::SYNC_DELTA;
+    this->last = last ? 1 : 0;
+    this->instructions = instructions;
+}
+
+Buffer SyncM2::serialize() const
+{
+    Buffer buff(SyncM2::getSize(instructions.size()));
+    size_t position = 0;
+
+    memcpy(buff.data(), &command_code, sizeof(uint8_t));
+    position += sizeof(uint8_t);
+
+    memcpy(buff.data() + position, &last, sizeof(uint8_t));
+    position += sizeof(uint8_t);
+
+    memcpy(buff.data() + position, instructions.data(), instructions.size());
+
+    return buff;
+}
+
+void SyncM2::deserialize(Buffer input)
+{
+    size_t position = 0;
+
+    memcpy(&this->command_code, input.data(), sizeof(uint8_t));
+    position += sizeof(uint8_t);
+
+    memcpy(&this->last, input.data() + position, sizeof(uint8_t));
+    position += sizeof(uint8_t);
+
+    instructions.assign(input.begin() + position, input.end());
+}
+
+size_t SyncM2::getSize(size_t instructions_size)
+{
+    size_t size = 0;
+
+    size += sizeof(uint8_t);
+    size += sizeof(uint8_t); // last
+    size += instructions_size;
+
+    return size;
+}
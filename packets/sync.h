@@ -0,0 +1,97 @@
+#ifndef _SYNC_H
+#define _SYNC_H
+
+#include <iostream>
+#include <string>
+#include <cstdint>
+#include <cstring>
+#include <openssl/rand.h>
+#include <constants.h>
+#include <vector>
+#include "../tools/delta.h"
+
+using namespace std;
+
+typedef vector<unsigned char> Buffer;
+
+// ----------------------------------- SYNC M1 ------------------------------------
+
+class SyncM1
+{
+private:
+    uint8_t command_code;
+
+public:
+    char file_name[MAX::file_name + 1];
+    uint32_t file_size; // size of the new version of the file
+
+    SyncM1();
+    SyncM1(string file_name, uint32_t file_size);
+    Buffer serialize() const;
+    void deserialize(Buffer buffer);
+    static int getSize();
+    void print() const;
+};
+
+// ----------------------------------- SYNC ACK ------------------------------------
+
+class SyncAck
+{
+private:
+    uint8_t command_code;
+    uint8_t ack_code;
+    uint32_t block_size;
+    uint32_t block_count;
+
+public:
+    SyncAck();
+    SyncAck(uint8_t ack_code);
+    SyncAck(uint8_t ack_code, uint32_t block_size, uint32_t block_count);
+    Buffer serialize() const;
+    void deserialize(Buffer buffer);
+    static int getSize();
+    uint8_t getAckCode() { return ack_code; };
+    uint32_t getBlockSize() { return block_size; };
+    uint32_t getBlockCount() { return block_count; };
+    void print() const;
+};
+
+// ----------------------------------- SYNC SIGNATURES ------------------------------------
+
+class SyncSignatures
+{
+private:
+    uint8_t command_code;
+    vector<Delta::BlockSignature> signatures;
+
+public:
+    SyncSignatures();
+    SyncSignatures(vector<Delta::BlockSignature> signatures);
+    Buffer serialize() const;
+    void deserialize(Buffer buffer);
+    static size_t getSize(size_t signature_count);
+    vector<Delta::BlockSignature> &getSignatures() { return signatures; }
+};
+
+// ----------------------------------- SYNC M2 ------------------------------------
+
+class SyncM2
+{
+private:
+    uint8_t command_code;
+    uint8_t last; // set on the final batch of instructions
+    Buffer instructions;
+
+public:
+    SyncM2();
+    SyncM2(Buffer instructions, bool last);
+    Buffer serialize() const;
+    void deserialize(Buffer buffer);
+    static size_t getSize(size_t instructions_size);
+    Buffer &getInstructions() { return instructions; }
+    bool isLast() { return last != 0; }
+};
+
+// ----------------------------------------------------------------------------------
+
+#endif // _SYNC_H
@@ -5,11 +5,17 @@
 // ----------------------------------- UPLOAD M1 ------------------------------------
 
 UploadM1::UploadM1() {}
-UploadM1::UploadM1(string file_name, uint32_t file_size)
+UploadM1::UploadM1(string file_name, uint32_t file_size) : UploadM1(file_name, file_size, Compression::NONE) {}
+
+UploadM1::UploadM1(string file_name, uint32_t file_size, uint8_t compression) : UploadM1(file_name, file_size, compression, Fingerprint::Digest{}) {}
+
+UploadM1::UploadM1(string file_name, uint32_t file_size, uint8_t compression, const Fingerprint::Digest &file_digest)
 {
 
     this->command_code = RequestCodes::UPLOAD_REQ;
     this->file_size = file_size;
+    this->compression = compression;
+    this->file_digest = file_digest;
     strncpy(this->file_name, file_name.c_str(), MAX::file_name + 1);
 }
 
@@ -38,6 +44,14 @@ Buffer UploadM1::serialize() const
 
     // insert file size into the vector which is on uint32_t
     memcpy(buff.data() + position, file_size_begin, sizeof(uint32_t));
+    position += sizeof(uint32_t);
+
+    // insert the proposed compression mode
+    memcpy(buff.data() + position, &compression, sizeof(uint8_t));
+    position += sizeof(uint8_t);
+
+    // insert the digest of the whole file
+    memcpy(buff.data() + position, file_digest.data(), Fingerprint::digest_length);
 
     return buff;
 }
@@ -56,6 +70,12 @@ void UploadM1::deserialize(Buffer input)
 
     memcpy(&this->file_size, input.data() + position, sizeof(uint32_t));
     file_size = ntohl(file_size);
+    position += sizeof(uint32_t);
+
+    memcpy(&this->compression, input.data() + position, sizeof(uint8_t));
+    position += sizeof(uint8_t);
+
+    memcpy(file_digest.data(), input.data() + position, Fingerprint::digest_length);
 }
 
 int UploadM1::getSize()
@@ -66,6 +86,8 @@ int UploadM1::getSize()
     size += sizeof(uint8_t);
     size += (MAX::file_name + 1) * sizeof(char);
     size += sizeof(uint32_t);
+    size += sizeof(uint8_t); // compression
+    size += Fingerprint::digest_length;
 
     return size;
 }
@@ -75,16 +97,21 @@ void UploadM1::print() const
     cout << "---------- UPLOAD M1 ---------" << endl;
     cout << "FILE NAME: " << file_name << endl;
     cout << "FILE SIZE: " << file_size << endl;
+    cout << "COMPRESSION: " << (int)compression << endl;
+    cout << "FILE DIGEST: " << Fingerprint::toHex(file_digest) << endl;
     cout << "------------------------------" << endl;
 }
 
 // ----------------------------------- UPLOAD ACK ------------------------------------
 
 UploadAck::UploadAck() {}
-UploadAck::UploadAck(uint8_t ack_code)
+UploadAck::UploadAck(uint8_t ack_code) : UploadAck(ack_code, Compression::NONE) {}
+
+UploadAck::UploadAck(uint8_t ack_code, uint8_t compression)
 {
     this->command_code = RequestCodes::UPLOAD_REQ;
     this->ack_code = ack_code;
+    this->compression = compression;
 }
 
 Buffer UploadAck::serialize() const
@@ -98,6 +125,9 @@ Buffer UploadAck::serialize() const
     memcpy(buff.data() + position, &ack_code, sizeof(uint8_t));
     position += sizeof(uint8_t);
 
+    memcpy(buff.data() + position, &compression, sizeof(uint8_t));
+    position += sizeof(uint8_t);
+
     return buff;
 }
 
@@ -110,6 +140,9 @@ void UploadAck::deserialize(Buffer input)
 
     memcpy(&this->ack_code, input.data() + position, sizeof(uint8_t));
     position += sizeof(uint8_t);
+
+    memcpy(&this->compression, input.data() + position, sizeof(uint8_t));
+    position += sizeof(uint8_t);
 }
 
 int UploadAck::getSize()
@@ -118,6 +151,7 @@ int UploadAck::getSize()
 
     size += sizeof(uint8_t);
     size += sizeof(uint8_t);
+    size += sizeof(uint8_t); // compression
 
     return size;
 }
@@ -133,9 +167,12 @@ void UploadAck::print() const
 
 UploadM2::UploadM2() {}
 
-UploadM2::UploadM2(Buffer file_chunk)
+UploadM2::UploadM2(Buffer file_chunk) : UploadM2(file_chunk, ChunkFlags::STORED) {}
+
+UploadM2::UploadM2(Buffer file_chunk, uint8_t chunk_flags)
 {
     command_code = RequestCodes::UPLOAD_CHUNK;
+    this->chunk_flags = chunk_flags;
     this->file_chunk = file_chunk;
 }
 
@@ -149,6 +186,9 @@ Buffer UploadM2::serialize()
     memcpy(buff.data(), &command_code, sizeof(uint8_t));
     position += sizeof(uint8_t);
 
+    memcpy(buff.data() + position, &chunk_flags, sizeof(uint8_t));
+    position += sizeof(uint8_t);
+
     memcpy(buff.data() + position, file_chunk.data(), chunk_size * sizeof(unsigned char));
     position += chunk_size * sizeof(unsigned char);
 
@@ -157,7 +197,7 @@ Buffer UploadM2::serialize()
 
 void UploadM2::deserialize(Buffer input)
 {
-    size_t chunk_size = input.size() - sizeof(uint8_t);
+    size_t chunk_size = input.size() - 2 * sizeof(uint8_t);
     this->file_chunk = Buffer(chunk_size);
 
     size_t position = 0;
@@ -165,6 +205,9 @@ void UploadM2::deserialize(Buffer input)
     memcpy(&this->command_code, input.data(), sizeof(uint8_t));
     position += sizeof(uint8_t);
 
+    memcpy(&this->chunk_flags, input.data() + position, sizeof(uint8_t));
+    position += sizeof(uint8_t);
+
     memcpy(this->file_chunk.data(), input.data() + position, chunk_size * sizeof(unsigned char));
 }
 
@@ -173,6 +216,7 @@ size_t UploadM2::getSize(size_t chunk_size)
     int size = 0;
 
     size += sizeof(uint8_t);
+    size += sizeof(uint8_t); // chunk_flags
     size += chunk_size * sizeof(unsigned char);
 
     return size;
@@ -186,5 +230,187 @@ void UploadM2::print() const
     for (Buffer::const_iterator it = file_chunk.begin(); it < file_chunk.end(); ++it)
         printf("%c", *it);
     cout << "\nCHUNK SIZE: " << file_chunk.size() << endl;
+    cout << "CHUNK FLAGS: " << (int)chunk_flags << endl;
     cout << "------------------------------" << endl;
 }
+
+// --------------------------------- UPLOAD PROOF ----------------------------------
+
+UploadProof::UploadProof() {}
+
+UploadProof::UploadProof(Buffer value)
+{
+    command_code = RequestCodes::UPLOAD_PROOF;
+    this->value = value;
+    this->value.resize(Fingerprint::digest_length);
+}
+
+Buffer UploadProof::serialize() const
+{
+    Buffer buff(UploadProof::getSize());
+    size_t position = 0;
+
+    memcpy(buff.data(), &command_code, sizeof(uint8_t));
+    position += sizeof(uint8_t);
+
+    memcpy(buff.data() + position, value.data(), Fingerprint::digest_length);
+
+    return buff;
+}
+
+void UploadProof::deserialize(Buffer input)
+{
+    size_t position = 0;
+
+    memcpy(&this->command_code, input.data(), sizeof(uint8_t));
+    position += sizeof(uint8_t);
+
+    value.assign(input.begin() + position, input.begin() + position + Fingerprint::digest_length);
+}
+
+int UploadProof::getSize()
+{
+    int size = 0;
+
+    size += sizeof(uint8_t);
+    size += Fingerprint::digest_length; // nonce or proof
+
+    return size;
+}
+
+// -------------------------------- UPLOAD MANIFEST ---------------------------------
+
+UploadManifest::UploadManifest() {}
+
+UploadManifest::UploadManifest(vector<ManifestEntry> chunks)
+{
+    command_code = RequestCodes::UPLOAD_MANIFEST;
+    this->chunks = chunks;
+}
+
+Buffer UploadManifest::serialize() const
+{
+    Buffer buff(UploadManifest::getSize(chunks.size()));
+    size_t position = 0;
+
+    memcpy(buff.data(), &command_code, sizeof(uint8_t));
+    position += sizeof(uint8_t);
+
+    uint32_t no_count = htonl(chunks.size());
+    memcpy(buff.data() + position, &no_count, sizeof(uint32_t));
+    position += sizeof(uint32_t);
+
+    // every entry is: chunk digest | chunk size
+    for (const ManifestEntry &chunk : chunks)
+    {
+        memcpy(buff.data() + position, chunk.digest.data(), Fingerprint::digest_length);
+        position += Fingerprint::digest_length;
+
+        uint32_t no_size = htonl(chunk.size);
+        memcpy(buff.data() + position, &no_size, sizeof(uint32_t));
+        position += sizeof(uint32_t);
+    }
+
+    return buff;
+}
+
+void UploadManifest::deserialize(Buffer input)
+{
+    size_t position = 0;
+
+    memcpy(&this->command_code, input.data(), sizeof(uint8_t));
+    position += sizeof(uint8_t);
+
+    uint32_t count = 0;
+    memcpy(&count, input.data() + position, sizeof(uint32_t));
+    count = ntohl(count);
+    position += sizeof(uint32_t);
+
+    // never read past the received payload whatever the announced count is
+    if (UploadManifest::getSize(count) > input.size())
+        count = 0;
+
+    chunks.resize(count);
+    for (ManifestEntry &chunk : chunks)
+    {
+        memcpy(chunk.digest.data(), input.data() + position, Fingerprint::digest_length);
+        position += Fingerprint::digest_length;
+
+        uint32_t no_size;
+        memcpy(&no_size, input.data() + position, sizeof(uint32_t));
+        chunk.size = ntohl(no_size);
+        position += sizeof(uint32_t);
+    }
+}
+
+size_t UploadManifest::getSize(size_t chunk_count)
+{
+    size_t size = 0;
+
+    size += sizeof(uint8_t);
+    size += sizeof(uint32_t); // count
+    size += chunk_count * (Fingerprint::digest_length + sizeof(uint32_t));
+
+    return size;
+}
+
+// ---------------------------------- UPLOAD HAVE -----------------------------------
+
+UploadHave::UploadHave() {}
+
+UploadHave::UploadHave(vector<bool> have)
+{
+    command_code = RequestCodes::UPLOAD_HAVE;
+    this->have = have;
+}
+
+Buffer UploadHave::serialize() const
+{
+    Buffer buff(UploadHave::getSize(have.size()));
+    size_t position = 0;
+
+    memcpy(buff.data(), &command_code, sizeof(uint8_t));
+    position += sizeof(uint8_t);
+
+    uint32_t no_count = htonl(have.size());
+    memcpy(buff.data() + position, &no_count, sizeof(uint32_t));
+    position += sizeof(uint32_t);
+
+    // bitmap, most significant bit first
+    for (size_t i = 0; i < have.size(); i++)
+        if (have[i])
+            buff[position + i / 8] |= 0x80 >> (i % 8);
+
+    return buff;
+}
+
+void UploadHave::deserialize(Buffer input)
+{
+    size_t position = 0;
+
+    memcpy(&this->command_code, input.data(), sizeof(uint8_t));
+    position += sizeof(uint8_t);
+
+    uint32_t count = 0;
+    memcpy(&count, input.data() + position, sizeof(uint32_t));
+    count = ntohl(count);
+    position += sizeof(uint32_t);
+
+    if (UploadHave::getSize(count) > input.size())
+        count = 0;
+
+    have.assign(count, false);
+    for (size_t i = 0; i < count; i++)
+        have[i] = input[position + i / 8] & (0x80 >> (i % 8));
+}
+
+size_t UploadHave::getSize(size_t chunk_count)
+{
+    size_t size = 0;
+
+    size += sizeof(uint8_t);
+    size += sizeof(uint32_t);      // count
+    size += (chunk_count + 7) / 8; // bitmap
+
+    return size;
+}
@@ -8,11 +8,19 @@
 #include <openssl/rand.h>
 #include <constants.h>
 #include <vector>
+#include "../tools/fingerprint.h"
 
 using namespace std;
 
 typedef vector<unsigned char> Buffer;
 
+// chunk reference exchanged in a manifest: digest and length of the chunk
+struct ManifestEntry
+{
+    Fingerprint::Digest digest;
+    uint32_t size;
+};
+
 // ----------------------------------- UPLOAD M1 ------------------------------------
 
 class UploadM1
@@ -23,9 +31,13 @@ private:
 public:
     uint32_t file_size;                 // 32 bit unsigned that can represent up to 4GB file sizes
     char file_name[MAX::file_name + 1]; // cstyle string to hold file name plus the '\n'
+    uint8_t compression;                // compression mode proposed by the client
+    Fingerprint::Digest file_digest;    // SHA-256 of the whole file, lets the server skip data it has
 
     UploadM1();
     UploadM1(string file_name, uint32_t file_size);
+    UploadM1(string file_name, uint32_t file_size, uint8_t compression);
+    UploadM1(string file_name, uint32_t file_size, uint8_t compression, const Fingerprint::Digest &file_digest);
     Buffer serialize() const;
     void deserialize(Buffer buffer);
     static int getSize();
@@ -39,14 +51,17 @@ class UploadAck
 private:
     uint8_t command_code;
     uint8_t ack_code;
+    uint8_t compression;
 
 public:
     UploadAck();
     UploadAck(uint8_t ack_code);
+    UploadAck(uint8_t ack_code, uint8_t compression);
     Buffer serialize() const;
     void deserialize(Buffer buffer);
     static int getSize();
     uint8_t getAckCode() { return ack_code; };
+    uint8_t getCompression() { return compression; };
     void print() const;
 };
 
@@ -56,18 +71,75 @@ class UploadM2
 {
 private:
     uint8_t command_code;
+    uint8_t chunk_flags; // stored or compressed
     Buffer file_chunk;
 
 public:
     UploadM2();
     UploadM2(Buffer file_chunk);
+    UploadM2(Buffer file_chunk, uint8_t chunk_flags);
     Buffer serialize();
     void deserialize(Buffer file_chunk);
     static size_t getSize(size_t chunk_size);
     Buffer getFileChunk() { return file_chunk; }
+    uint8_t getChunkFlags() { return chunk_flags; }
     void print() const;
 };
 
+// --------------------------------- UPLOAD PROOF ----------------------------------
+
+// Server to client it carries a fresh nonce, client to server the possession proof
+class UploadProof
+{
+private:
+    uint8_t command_code;
+    Buffer value;
+
+public:
+    UploadProof();
+    UploadProof(Buffer value);
+    Buffer serialize() const;
+    void deserialize(Buffer buffer);
+    static int getSize();
+    Buffer getValue() { return value; }
+};
+
+// -------------------------------- UPLOAD MANIFEST ---------------------------------
+
+// A batch of the content defined chunks of the file being uploaded
+class UploadManifest
+{
+private:
+    uint8_t command_code;
+    vector<ManifestEntry> chunks;
+
+public:
+    UploadManifest();
+    UploadManifest(vector<ManifestEntry> chunks);
+    Buffer serialize() const;
+    void deserialize(Buffer buffer);
+    static size_t getSize(size_t chunk_count);
+    vector<ManifestEntry> &getChunks() { return chunks; }
+};
+
+// ---------------------------------- UPLOAD HAVE -----------------------------------
+
+// One bit per chunk of the matching manifest batch, set when the server already has it
+class UploadHave
+{
+private:
+    uint8_t command_code;
+    vector<bool> have;
+
+public:
+    UploadHave();
+    UploadHave(vector<bool> have);
+    Buffer serialize() const;
+    void deserialize(Buffer buffer);
+    static size_t getSize(size_t chunk_count);
+    vector<bool> &getHave() { return have; }
+};
+
 // ----------------------------------------------------------------------------------
 
 #endif // _UPLOAD_H
@@ -0,0 +1,188 @@
+#include "version.h"
+#include <vector>
+#include <arpa/inet.h>
+#include <algorithm>
+
+namespace
+{
+    void appendUint64(unsigned char *buffer, size_t &position, uint64_t value)
+    {
+        for (int shift = 56; shift >= 0; shift -= 8)
+            buffer[position++] = static_cast<unsigned char>(value >> shift);
+    }
+
+    uint64_t readUint64(const unsigned char *buffer, size_t &position)
+    {
+        uint64_t value = 0;
+        for (size_t i = 0; i < sizeof(uint64_t); i++)
+            value = (value << 8) | buffer[position++];
+        return value;
+    }
+}
+
+// ----------------------------------- VERSION M1 ------------------------------------
+
+VersionM1::VersionM1() {}
+
+VersionM1::VersionM1(uint8_t action, string file_name) : VersionM1(action, file_name, 0, Compression::NONE) {}
+
+VersionM1::VersionM1(uint8_t action, string file_name, uint64_t version, uint8_t compression)
+{
+    this->command_code = RequestCodes::VERSION_REQ;
+    this->action = action;
+    this->version = version;
+    this->compression = compression;
+    strncpy(this->file_name, file_name.c_str(), MAX::file_name + 1);
+}
+
+Buffer VersionM1::serialize() const
+{
+    Buffer buff(MAX::initial_request_length);
+    size_t position = 0;
+
+    // insert the command code uint8_t (one byte) interpreted as unsigned char
+    memcpy(buff.data(), &command_code, sizeof(uint8_t));
+    position += sizeof(uint8_t);
+
+    memcpy(buff.data() + position, &action, sizeof(uint8_t));
+    position += sizeof(uint8_t);
+
+    // insert the file string with a size of max of file name (255) +1
+    unsigned char const *file_name_pointer = reinterpret_cast<unsigned char const *>(&file_name);
+    memcpy(buff.data() + position, file_name_pointer, ((MAX::file_name + 1) * sizeof(char)));
+    position += (MAX::file_name + 1) * sizeof(char);
+
+    appendUint64(buff.data(), position, version);
+
+    // insert the proposed compression mode
+    memcpy(buff.data() + position, &compression, sizeof(uint8_t));
+
+    return buff;
+}
+
+void VersionM1::deserialize(Buffer input)
+{
+    size_t position = 0;
+
+    memcpy(&this->command_code, input.data(), sizeof(uint8_t));
+    position += sizeof(uint8_t);
+
+    memcpy(&this->action, input.data() + position, sizeof(uint8_t));
+    position += sizeof(uint8_t);
+
+    memcpy(&this->file_name, input.data() + position, (MAX::file_name + 1) * sizeof(char));
+    file_name[MAX::file_name] = '\0';
+    position += (MAX::file_name + 1) * sizeof(char);
+
+    version = readUint64(input.data(), position);
+
+    memcpy(&this->compression, input.data() + position, sizeof(uint8_t));
+}
+
+int VersionM1::getSize()
+{
+    int size = 0;
+
+    size += sizeof(uint8_t);
+    size += sizeof(uint8_t); // action
+    size += (MAX::file_name + 1) * sizeof(char);
+    size += sizeof(uint64_t); // version
+    size += sizeof(uint8_t);  // compression
+
+    return size;
+}
+
+void VersionM1::print() const
+{
+    cout << "---------- VERSION M1 ---------" << endl;
+    cout << "FILE NAME: " << file_name << endl;
+    cout << "VERSION: " << version << endl;
+    cout << "-------------------------------" << endl;
+}
+
+// ----------------------------------- VERSION LIST ------------------------------------
+
+VersionList::VersionList() {}
+
+VersionList::VersionList(uint8_t ack_code) : VersionList(ack_code, {}) {}
+
+VersionList::VersionList(uint8_t ack_code, vector<VersionEntry> entries)
+{
+    this->command_code = RequestCodes::VERSION_LIST;
+    this->ack_code = ack_code;
+    this->entries = entries;
+    if (this->entries.size() > MAX::versions_listed)
+        this->entries.resize(MAX::versions_listed);
+}
+
+Buffer VersionList::serialize() const
+{
+    Buffer buff(VersionList::getSize(entries.size()));
+    size_t position = 0;
+
+    memcpy(buff.data(), &command_code, sizeof(uint8_t));
+    position += sizeof(uint8_t);
+
+    memcpy(buff.data() + position, &ack_code, sizeof(uint8_t));
+    position += sizeof(uint8_t);
+
+    uint16_t no_count = htons(entries.size());
+    memcpy(buff.data() + position, &no_count, sizeof(uint16_t));
+    position += sizeof(uint16_t);
+
+    // every entry is: version | size | time
+    for (const VersionEntry &entry : entries)
+    {
+        appendUint64(buff.data(), position, entry.version);
+        appendUint64(buff.data(), position, entry.file_size);
+        appendUint64(buff.data(), position, static_cast<uint64_t>(entry.mtime));
+    }
+
+    return buff;
+}
+
+bool VersionList::deserialize(Buffer input)
+{
+    size_t position = 0;
+
+    if (input.size() < 2 * sizeof(uint8_t) + sizeof(uint16_t))
+        return false;
+
+    memcpy(&this->command_code, input.data(), sizeof(uint8_t));
+    position += sizeof(uint8_t);
+
+    memcpy(&this->ack_code, input.data() + position, sizeof(uint8_t));
+    position += sizeof(uint8_t);
+
+    uint16_t count = 0;
+    memcpy(&count, input.data() + position, sizeof(uint16_t));
+    count = ntohs(count);
+    position += sizeof(uint16_t);
+
+    if (count > MAX::versions_listed || input.size() != VersionList::getSize(count))
+        return false;
+
+    entries.clear();
+    for (uint16_t i = 0; i < count; i++)
+    {
+        VersionEntry entry;
+        entry.version = readUint64(input.data(), position);
+        entry.file_size = readUint64(input.data(), position);
+        entry.mtime = static_cast<int64_t>(readUint64(input.data(), position));
+        entries.push_back(entry);
+    }
+
+    return true;
+}
+
+size_t VersionList::getSize(size_t entry_count)
+{
+    size_t size = 0;
+
+    size += sizeof(uint8_t);
+    size += sizeof(uint8_t);  // ack_code
+    size += sizeof(uint16_t); // entry count
+    size += entry_count * 3 * sizeof(uint64_t);
+
+    return size;
+}
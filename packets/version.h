@@ -0,0 +1,73 @@
+#ifndef _VERSION_H
+#define _VERSION_H
+
+#include <iostream>
+#include <string>
+#include <cstdint>
+#include <cstring>
+#include <constants.h>
+#include <vector>
+
+using namespace std;
+
+typedef vector<unsigned char> Buffer;
+
+// ----------------------------------- VERSION REQUEST ------------------------------------
+
+namespace VersionAction
+{
+    const uint8_t LIST = 0;
+    const uint8_t DOWNLOAD = 1; // answered like a download: DownloadAck, then DownloadM2 frames
+    const uint8_t RESTORE = 2;  // the version becomes the current file, which is kept as a version
+}
+
+class VersionM1
+{
+private:
+    uint8_t command_code;
+
+public:
+    uint8_t action;
+    char file_name[MAX::file_name + 1];
+    uint64_t version;
+    uint8_t compression; // compression mode proposed by the client for a download
+
+    VersionM1();
+    VersionM1(uint8_t action, string file_name);
+    VersionM1(uint8_t action, string file_name, uint64_t version, uint8_t compression);
+    Buffer serialize() const;
+    void deserialize(Buffer buffer);
+    static int getSize();
+    void print() const;
+};
+
+// ----------------------------------- VERSION LIST ------------------------------------
+
+struct VersionEntry
+{
+    uint64_t version;
+    uint64_t file_size;
+    int64_t mtime; // seconds since the epoch the version was replaced
+};
+
+// Versions of a file, newest first, at most MAX::versions_listed of them. Answers a list and a
+// restore; ack code 1 means no such file or version, 2 means versioning is off on the server
+class VersionList
+{
+private:
+    uint8_t command_code;
+    uint8_t ack_code;
+    vector<VersionEntry> entries;
+
+public:
+    VersionList();
+    VersionList(uint8_t ack_code);
+    VersionList(uint8_t ack_code, vector<VersionEntry> entries);
+    Buffer serialize() const;
+    bool deserialize(Buffer buffer);
+    static size_t getSize(size_t entry_count);
+    uint8_t getAckCode() { return ack_code; }
+    vector<VersionEntry> &getEntries() { return entries; }
+};
+
+#endif // _VERSION_H
@@ -451,6 +451,34 @@ bool sendSize(int socket, size_t number)
     }
 }
 
+// Variable size messages (e.g. compressed chunks) are preceded by their length
+bool sendFrame(int socket, Buffer &frame)
+{
+    if (!sendSize(socket, frame.size()))
+        return false;
+
+    return sendData(socket, frame);
+}
+
+bool receiveFrame(int socket, Buffer &frame, size_t max_size)
+{
+    size_t frame_size;
+
+    if (!receiveSize(socket, frame_size))
+        return false;
+
+    // the length travels in clear, never trust it beyond the expected maximum
+    if (frame_size == 0 || frame_size > max_size)
+    {
+        std::cerr << "Invalid frame size " << frame_size << std::endl;
+        return false;
+    }
+
+    frame.resize(frame_size);
+
+    return receiveData(socket, frame);
+}
+
 void clear_vec(Buffer &v)
 {
     if (!v.empty())
@@ -42,6 +42,8 @@ bool sendData(int socket, Buffer &data);
 bool receiveData(int socket, Buffer &buffer);
 bool receiveSize(int socket, size_t &number);
 bool sendSize(int socket, size_t number);
+bool sendFrame(int socket, Buffer &frame);
+bool receiveFrame(int socket, Buffer &frame, size_t max_size);
 void clear_vec(Buffer &v);
 int incrementCounter(int counter);
 
@@ -0,0 +1,218 @@
+#include "archive_reader.h"
+#include "chunk_store.h"
+#include "storage_backend.h"
+#include <algorithm>
+#include <cstdio>
+#include <cstring>
+#include <iostream>
+
+namespace
+{
+    const size_t tar_block = 512;
+    const size_t tar_name = 100;
+
+    // writes value as a NUL terminated octal number filling a field of field_size bytes
+    void putOctal(unsigned char *field, size_t field_size, uintmax_t value)
+    {
+        snprintf(reinterpret_cast<char *>(field), field_size, "%0*jo", static_cast<int>(field_size - 1), value);
+    }
+}
+
+ArchiveReader::ArchiveReader(const std::vector<Member> &members, const std::string &owner, size_t frame_size, size_t depth)
+{
+    this->members = members;
+    this->owner = owner;
+    this->frame_size = frame_size;
+    this->depth = std::max<size_t>(depth, 1);
+    this->cancelled = false;
+    this->archived_files = 0;
+    this->failed_files = 0;
+    this->starved_reads = 0;
+
+    pending.reserve(frame_size);
+    producer = std::thread(&ArchiveReader::produce, this);
+}
+
+ArchiveReader::~ArchiveReader()
+{
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        cancelled = true;
+    }
+    not_full.notify_all();
+
+    if (producer.joinable())
+        producer.join();
+}
+
+bool ArchiveReader::next(Buffer &frame)
+{
+    std::unique_lock<std::mutex> lock(mutex);
+
+    if (frames.empty())
+        starved_reads++;
+    not_empty.wait(lock, [this]
+                   { return !frames.empty(); });
+
+    frame = std::move(frames.front().first);
+    bool last = frames.front().second;
+    frames.pop_front();
+
+    lock.unlock();
+    not_full.notify_one();
+    return last;
+}
+
+bool ArchiveReader::push(bool last)
+{
+    std::unique_lock<std::mutex> lock(mutex);
+    not_full.wait(lock, [this]
+                  { return frames.size() < depth || cancelled; });
+
+    if (cancelled)
+        return false;
+
+    frames.emplace_back(std::move(pending), last);
+    pending.clear();
+    pending.reserve(frame_size);
+
+    lock.unlock();
+    not_empty.notify_one();
+    return true;
+}
+
+bool ArchiveReader::append(const unsigned char *data, size_t length)
+{
+    while (length > 0)
+    {
+        // a full frame is only handed over once more data follows, so the final one is never empty
+        if (pending.size() == frame_size && !push(false))
+            return false;
+
+        size_t take = std::min(length, frame_size - pending.size());
+        pending.insert(pending.end(), data, data + take);
+        data += take;
+        length -= take;
+    }
+    return true;
+}
+
+bool ArchiveReader::appendPadding(uintmax_t size)
+{
+    static const unsigned char zeros[tar_block] = {0};
+    size_t padding = (tar_block - size % tar_block) % tar_block;
+    return append(zeros, padding);
+}
+
+bool ArchiveReader::appendHeader(const std::string &name, uintmax_t size, int64_t mtime, char type)
+{
+    unsigned char header[tar_block] = {0};
+
+    // valid file names are far shorter than the ustar name field
+    memcpy(header, name.data(), std::min(name.size(), tar_name - 1));
+    putOctal(header + 100, 8, 0644);                        // mode
+    putOctal(header + 108, 8, 0);                           // uid
+    putOctal(header + 116, 8, 0);                           // gid
+    putOctal(header + 124, 12, size);                       // size
+    putOctal(header + 136, 12, std::max<int64_t>(mtime, 0)); // mtime
+    header[156] = type;
+    memcpy(header + 257, "ustar", 6);
+    memcpy(header + 263, "00", 2);
+    memcpy(header + 265, owner.data(), std::min<size_t>(owner.size(), 31)); // uname
+
+    // the checksum is computed with its own field filled with spaces
+    memset(header + 148, ' ', 8);
+    unsigned int checksum = 0;
+    for (unsigned char byte : header)
+        checksum += byte;
+    snprintf(reinterpret_cast<char *>(header + 148), 8, "%06o", checksum);
+    header[155] = ' ';
+
+    return append(header, tar_block);
+}
+
+void ArchiveReader::produce()
+{
+    for (const Member &member : members)
+    {
+        StoredFile file;
+        FileStat info;
+
+        try
+        {
+            file.open(owner, member.name);
+            if (!StorageBackend::instance().stat(owner, member.name, info))
+                throw std::runtime_error("Unable to stat file.");
+        }
+        catch (const std::exception &e)
+        {
+            std::cerr << "[ARCHIVE] Skipping " << member.name << ": " << e.what() << std::endl;
+            std::lock_guard<std::mutex> lock(mutex);
+            failed_files++;
+            continue;
+        }
+
+        uintmax_t size = file.getFileSize();
+        if (!appendHeader(member.name, size, info.mtime / 1000000000LL, '0'))
+            return;
+
+        // the header already announced the size: a failing read is padded so the stream stays aligned
+        bool readable = true;
+        uintmax_t read = 0;
+        while (read < size)
+        {
+            size_t take = std::min<uintmax_t>(frame_size, size - read);
+            Buffer piece;
+
+            try
+            {
+                if (!readable)
+                    throw std::runtime_error("Unable to read from file.");
+                piece = file.readChunk(take);
+            }
+            catch (const std::exception &e)
+            {
+                if (readable)
+                    std::cerr << "[ARCHIVE] " << member.name << ": " << e.what() << std::endl;
+                readable = false;
+                piece.assign(take, 0);
+            }
+
+            if (!append(piece.data(), piece.size()))
+                return;
+            read += take;
+        }
+
+        if (!appendPadding(size))
+            return;
+
+        std::lock_guard<std::mutex> lock(mutex);
+        if (readable)
+            archived_files++;
+        else
+            failed_files++;
+    }
+
+    // end of archive: two zero blocks
+    static const unsigned char zeros[2 * tar_block] = {0};
+    if (append(zeros, sizeof(zeros)))
+        push(true);
+}
+
+size_t ArchiveReader::getArchivedFiles()
+{
+    std::lock_guard<std::mutex> lock(mutex);
+    return archived_files;
+}
+
+size_t ArchiveReader::getFailedFiles()
+{
+    std::lock_guard<std::mutex> lock(mutex);
+    return failed_files;
+}
+
+size_t ArchiveReader::getStarvedReads()
+{
+    std::lock_guard<std::mutex> lock(mutex);
+    return starved_reads;
+}
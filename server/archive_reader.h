@@ -0,0 +1,62 @@
+#ifndef ARCHIVE_READER_H
+#define ARCHIVE_READER_H
+
+#include <condition_variable>
+#include <cstdint>
+#include <deque>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <utility>
+#include <vector>
+
+typedef std::vector<unsigned char> Buffer;
+
+// Builds a ustar stream of user files on its own thread, a bounded queue of frames
+// ahead of the sender: the next file is already being read while the current one
+// is still on the wire, so many small files cost bandwidth instead of round trips.
+class ArchiveReader
+{
+public:
+    struct Member
+    {
+        std::string name; // in the folder of the owner
+    };
+
+private:
+    std::vector<Member> members;
+    std::string owner;
+    size_t frame_size;
+    size_t depth;
+
+    std::mutex mutex;
+    std::condition_variable not_full;
+    std::condition_variable not_empty;
+    std::deque<std::pair<Buffer, bool>> frames; // frame, last
+    bool cancelled;
+    size_t archived_files;
+    size_t failed_files;
+    size_t starved_reads; // frames the sender had to wait for
+
+    Buffer pending;
+    std::thread producer;
+
+    void produce();
+    bool append(const unsigned char *data, size_t length);
+    bool appendHeader(const std::string &name, uintmax_t size, int64_t mtime, char type);
+    bool appendPadding(uintmax_t size);
+    bool push(bool last);
+
+public:
+    ArchiveReader(const std::vector<Member> &members, const std::string &owner, size_t frame_size, size_t depth);
+    ~ArchiveReader();
+
+    // Blocks until the next frame is ready, returns true with the last frame of the stream
+    bool next(Buffer &frame);
+
+    size_t getArchivedFiles();
+    size_t getFailedFiles();
+    size_t getStarvedReads();
+};
+
+#endif // ARCHIVE_READER_H
@@ -0,0 +1,587 @@
+#include "chunk_store.h"
+#include "compressed_file.h"
+#include "constants.h"
+#include "content_index.h"
+#include "storage_backend.h"
+#include "tier_store.h"
+#include <algorithm>
+#include <arpa/inet.h>
+#include <cstring>
+#include <filesystem>
+#include <fstream>
+#include <iostream>
+#include <stdexcept>
+#include <thread>
+#include <unordered_set>
+#include <openssl/crypto.h>
+#include <openssl/evp.h>
+#include <openssl/hmac.h>
+#include <openssl/rand.h>
+
+namespace fs = std::filesystem;
+
+namespace
+{
+    // the last magic byte is the format version, version 1 recipes carry no file digest
+    const char RECIPE_MAGIC[8] = {'F', 'O', 'C', 'R', 'C', 'P', '0', '2'};
+    const size_t RECIPE_MAGIC_PREFIX = 7;
+    const size_t DIGEST_LENGTH = Fingerprint::digest_length;
+    const size_t MAC_LENGTH = 32; // HMAC-SHA-256
+    const size_t RECIPE_ENTRY_SIZE = DIGEST_LENGTH + sizeof(uint32_t);
+
+    size_t recipeHeaderSize(char version)
+    {
+        size_t size = sizeof(RECIPE_MAGIC) + sizeof(uint64_t) + sizeof(uint32_t);
+        return version == '1' ? size : size + DIGEST_LENGTH;
+    }
+
+    std::string digestToHex(const unsigned char *data)
+    {
+        Fingerprint::Digest digest;
+        memcpy(digest.data(), data, DIGEST_LENGTH);
+        return Fingerprint::toHex(digest);
+    }
+
+    Buffer readWholeFile(const std::string &path)
+    {
+        std::ifstream input(path, std::ios::binary | std::ios::ate);
+        if (!input)
+            throw std::runtime_error("Unable to open file for reading.");
+
+        Buffer data(static_cast<size_t>(input.tellg()));
+        input.seekg(0);
+        if (!input.read(reinterpret_cast<char *>(data.data()), data.size()))
+            throw std::runtime_error("Unable to read from file.");
+
+        return data;
+    }
+
+    // Readers either see the old content or the new one, never a partial write
+    void writeAtomically(const std::string &path, const Buffer &data)
+    {
+        static std::atomic<uint64_t> sequence(0);
+        std::string temp_path = path + ".tmp." + std::to_string(std::hash<std::thread::id>{}(std::this_thread::get_id())) + "." + std::to_string(sequence++);
+
+        std::ofstream output(temp_path, std::ios::binary | std::ios::trunc);
+        if (!output || !output.write(reinterpret_cast<const char *>(data.data()), data.size()))
+        {
+            fs::remove(temp_path);
+            throw std::runtime_error("Unable to write to file.");
+        }
+        output.close();
+
+        if (rename(temp_path.c_str(), path.c_str()) != 0)
+        {
+            fs::remove(temp_path);
+            throw std::runtime_error("Unable to commit file.");
+        }
+    }
+
+    void appendUint32(Buffer &buffer, uint32_t value)
+    {
+        uint32_t network_value = htonl(value);
+        unsigned char const *begin = reinterpret_cast<unsigned char const *>(&network_value);
+        buffer.insert(buffer.end(), begin, begin + sizeof(uint32_t));
+    }
+
+    uint32_t readUint32(const Buffer &buffer, size_t position)
+    {
+        uint32_t network_value;
+        memcpy(&network_value, buffer.data() + position, sizeof(uint32_t));
+        return ntohl(network_value);
+    }
+}
+
+// ----------------------------------- CHUNK STORE ------------------------------------
+
+ChunkStore::ChunkStore(const std::string &root)
+    : root(root), released_recipes(0), gc_running(false), written_bytes(0), deduplicated_bytes(0)
+{
+    fs::create_directories(root);
+
+    // the recipe key never leaves the server, it is created on first start
+    std::string key_path = root + "/recipe.key";
+    if (fs::exists(key_path))
+        recipe_key = readWholeFile(key_path);
+
+    if (recipe_key.size() != MAC_LENGTH)
+    {
+        recipe_key.resize(MAC_LENGTH);
+        if (RAND_bytes(recipe_key.data(), recipe_key.size()) != 1)
+            throw std::runtime_error("Unable to generate the recipe key.");
+
+        writeAtomically(key_path, recipe_key);
+        fs::permissions(key_path, fs::perms::owner_read | fs::perms::owner_write);
+    }
+}
+
+ChunkStore &ChunkStore::instance()
+{
+    static ChunkStore store(Storage::chunk_store);
+    return store;
+}
+
+std::string ChunkStore::chunkPath(const std::string &digest) const
+{
+    // fan out on the first byte to keep directories small
+    return root + "/" + digest.substr(0, 2) + "/" + digest;
+}
+
+std::shared_lock<std::shared_mutex> ChunkStore::pin()
+{
+    return std::shared_lock<std::shared_mutex>(gc_mutex);
+}
+
+std::string ChunkStore::put(const Buffer &chunk)
+{
+    std::string digest = Fingerprint::toHex(Fingerprint::sha256(chunk));
+    std::string path = chunkPath(digest);
+
+    if (fs::exists(path))
+    {
+        deduplicated_bytes += chunk.size();
+        return digest;
+    }
+
+    fs::create_directories(fs::path(path).parent_path());
+    writeAtomically(path, chunk);
+    written_bytes += chunk.size();
+
+    return digest;
+}
+
+Buffer ChunkStore::get(const std::string &digest) const
+{
+    return readWholeFile(chunkPath(digest));
+}
+
+bool ChunkStore::has(const std::string &digest) const
+{
+    return fs::exists(chunkPath(digest));
+}
+
+void ChunkStore::release()
+{
+    if (++released_recipes < Storage::gc_release_threshold || gc_running.exchange(true))
+        return;
+
+    std::thread([this]()
+                {
+                    try
+                    {
+                        collectGarbage();
+                    }
+                    catch (const std::exception &e)
+                    {
+                        std::cerr << "[STORE] Garbage collection failed: " << e.what() << std::endl;
+                    }
+                    gc_running = false; })
+        .detach();
+}
+
+size_t ChunkStore::collectGarbage()
+{
+    std::unique_lock<std::shared_mutex> lock(gc_mutex);
+    released_recipes = 0;
+
+    // mark: every chunk referenced by any recipe below the data folder
+    std::unordered_set<std::string> referenced;
+    forEachRecipe([&referenced](const std::string &, const Recipe &recipe)
+                  {
+                      for (const RecipeEntry &entry : recipe.entries)
+                          referenced.insert(entry.digest); });
+
+    // sweep: nothing can be writing chunks while the exclusive lock is held
+    size_t removed = 0;
+    for (const auto &directory : fs::directory_iterator(root))
+    {
+        if (!directory.is_directory())
+            continue;
+
+        for (const auto &chunk : fs::directory_iterator(directory.path()))
+        {
+            if (referenced.count(chunk.path().filename().string()) == 0)
+            {
+                fs::remove(chunk.path());
+                removed++;
+            }
+        }
+    }
+
+    std::cout << "[STORE] Garbage collection removed " << removed << " chunks" << std::endl;
+    return removed;
+}
+
+void ChunkStore::forEachRecipe(const std::function<void(const std::string &, const Recipe &)> &visit) const
+{
+    fs::path store_path = fs::path(root);
+    fs::path data_path = store_path.parent_path();
+
+    for (auto it = fs::recursive_directory_iterator(data_path); it != fs::recursive_directory_iterator(); ++it)
+    {
+        if (it->is_directory() && fs::equivalent(it->path(), store_path))
+        {
+            it.disable_recursion_pending();
+            continue;
+        }
+
+        if (!it->is_regular_file())
+            continue;
+
+        try
+        {
+            Recipe recipe;
+            if (recipe.load(it->path().string()))
+                visit(it->path().string(), recipe);
+        }
+        catch (const std::exception &e)
+        {
+            std::cerr << "[STORE] Skipping recipe " << it->path() << ": " << e.what() << std::endl;
+        }
+    }
+}
+
+void ChunkStore::printStats() const
+{
+    std::cout << "[STORE] Written " << written_bytes << "B, deduplicated " << deduplicated_bytes << "B" << std::endl;
+}
+
+// ----------------------------------- RECIPE ------------------------------------
+
+Recipe::Recipe() : logical_size(0) {}
+
+void Recipe::add(const std::string &digest, uint32_t size)
+{
+    entries.push_back({digest, size});
+    logical_size += size;
+}
+
+bool Recipe::isRecipe(const std::string &path)
+{
+    Recipe recipe;
+    return recipe.load(path);
+}
+
+bool Recipe::load(const std::string &path)
+{
+    // cheap check first, most plain files are rejected on the magic alone
+    {
+        std::ifstream input(path, std::ios::binary);
+        char magic[sizeof(RECIPE_MAGIC)];
+
+        if (!input.read(magic, sizeof(magic)) || memcmp(magic, RECIPE_MAGIC, RECIPE_MAGIC_PREFIX) != 0)
+            return false;
+    }
+
+    Buffer data = readWholeFile(path);
+    char version = data[RECIPE_MAGIC_PREFIX];
+    size_t header_size = recipeHeaderSize(version);
+
+    if ((version != '1' && version != RECIPE_MAGIC[RECIPE_MAGIC_PREFIX]) || data.size() < header_size + MAC_LENGTH)
+        return false;
+
+    // authenticate before trusting a single field
+    const Buffer &key = ChunkStore::instance().getRecipeKey();
+    size_t body_size = data.size() - MAC_LENGTH;
+    unsigned char mac[EVP_MAX_MD_SIZE];
+    unsigned int mac_length = 0;
+
+    if (!HMAC(EVP_sha256(), key.data(), key.size(), data.data(), body_size, mac, &mac_length) ||
+        CRYPTO_memcmp(mac, data.data() + body_size, MAC_LENGTH) != 0)
+        return false;
+
+    size_t position = sizeof(RECIPE_MAGIC);
+    uint64_t declared_size = ((uint64_t)readUint32(data, position) << 32) | readUint32(data, position + sizeof(uint32_t));
+    position += sizeof(uint64_t);
+
+    file_digest.clear();
+    if (version != '1')
+    {
+        // all zeros when the digest of the whole file was not known
+        if (std::any_of(data.begin() + position, data.begin() + position + DIGEST_LENGTH, [](unsigned char byte)
+                        { return byte != 0; }))
+            file_digest = digestToHex(data.data() + position);
+        position += DIGEST_LENGTH;
+    }
+
+    uint32_t count = readUint32(data, position);
+    position += sizeof(uint32_t);
+
+    if (body_size != header_size + (size_t)count * RECIPE_ENTRY_SIZE)
+        return false;
+
+    entries.clear();
+    logical_size = 0;
+    for (uint32_t i = 0; i < count; i++)
+    {
+        add(digestToHex(data.data() + position), readUint32(data, position + DIGEST_LENGTH));
+        position += RECIPE_ENTRY_SIZE;
+    }
+
+    return logical_size == declared_size;
+}
+
+void Recipe::save(const std::string &path) const
+{
+    // MAGIC | logical size (uint64) | file digest | count (uint32) | [digest | size (uint32)]* | HMAC
+    Buffer data(RECIPE_MAGIC, RECIPE_MAGIC + sizeof(RECIPE_MAGIC));
+    appendUint32(data, static_cast<uint32_t>(logical_size >> 32));
+    appendUint32(data, static_cast<uint32_t>(logical_size));
+
+    Fingerprint::Digest digest = {};
+    if (!file_digest.empty() && !Fingerprint::fromHex(file_digest, digest))
+        throw std::invalid_argument("Invalid file digest.");
+    data.insert(data.end(), digest.begin(), digest.end());
+
+    appendUint32(data, entries.size());
+
+    for (const RecipeEntry &entry : entries)
+    {
+        if (!Fingerprint::fromHex(entry.digest, digest))
+            throw std::invalid_argument("Invalid chunk digest.");
+        data.insert(data.end(), digest.begin(), digest.end());
+        appendUint32(data, entry.size);
+    }
+
+    const Buffer &key = ChunkStore::instance().getRecipeKey();
+    unsigned char mac[EVP_MAX_MD_SIZE];
+    unsigned int mac_length = 0;
+
+    if (!HMAC(EVP_sha256(), key.data(), key.size(), data.data(), data.size(), mac, &mac_length))
+        throw std::runtime_error("Unable to authenticate recipe.");
+
+    data.insert(data.end(), mac, mac + MAC_LENGTH);
+    writeAtomically(path, data);
+}
+
+// ----------------------------------- RECIPE STREAM ------------------------------------
+
+RecipeStreamBuf::RecipeStreamBuf(const Recipe &recipe) : recipe(recipe), current(0), loaded(false)
+{
+    uintmax_t offset = 0;
+    for (const RecipeEntry &entry : recipe.entries)
+    {
+        offsets.push_back(offset);
+        offset += entry.size;
+    }
+
+    setg(nullptr, nullptr, nullptr);
+}
+
+bool RecipeStreamBuf::load(size_t index)
+{
+    if (index >= recipe.entries.size())
+        return false;
+
+    data = ChunkStore::instance().get(recipe.entries[index].digest);
+    if (data.size() != recipe.entries[index].size)
+        throw std::runtime_error("Corrupted chunk " + recipe.entries[index].digest);
+
+    current = index;
+    loaded = true;
+
+    char *begin = reinterpret_cast<char *>(data.data());
+    setg(begin, begin, begin + data.size());
+    return true;
+}
+
+RecipeStreamBuf::int_type RecipeStreamBuf::underflow()
+{
+    if (gptr() < egptr())
+        return traits_type::to_int_type(*gptr());
+
+    if (!load(loaded ? current + 1 : 0))
+        return traits_type::eof();
+
+    return traits_type::to_int_type(*gptr());
+}
+
+RecipeStreamBuf::pos_type RecipeStreamBuf::seekoff(off_type offset, std::ios_base::seekdir direction, std::ios_base::openmode mode)
+{
+    off_type position = 0;
+
+    if (loaded && current < recipe.entries.size())
+        position = offsets[current] + (gptr() - eback());
+    else if (loaded)
+        position = recipe.logical_size;
+
+    if (direction == std::ios_base::beg)
+        position = offset;
+    else if (direction == std::ios_base::cur)
+        position += offset;
+    else
+        position = recipe.logical_size + offset;
+
+    return seekpos(pos_type(position), mode);
+}
+
+RecipeStreamBuf::pos_type RecipeStreamBuf::seekpos(pos_type position, std::ios_base::openmode mode)
+{
+    off_type target = off_type(position);
+
+    if (!(mode & std::ios_base::in) || target < 0 || (uintmax_t)target > recipe.logical_size)
+        return pos_type(off_type(-1));
+
+    // at the very end nothing is loaded and the next read hits eof
+    if ((uintmax_t)target == recipe.logical_size)
+    {
+        data.clear();
+        current = recipe.entries.size();
+        loaded = true;
+        setg(nullptr, nullptr, nullptr);
+        return position;
+    }
+
+    size_t index = std::upper_bound(offsets.begin(), offsets.end(), (uintmax_t)target) - offsets.begin() - 1;
+    if (!(loaded && current == index) && !load(index))
+        return pos_type(off_type(-1));
+
+    setg(eback(), eback() + (target - offsets[index]), egptr());
+    return position;
+}
+
+RecipeStream::RecipeStream(const Recipe &recipe) : std::istream(nullptr), buffer(recipe), size(recipe.logical_size)
+{
+    rdbuf(&buffer);
+}
+
+Buffer RecipeStream::readChunk(size_t chunk_size)
+{
+    Buffer chunk(chunk_size);
+
+    if (!read(reinterpret_cast<char *>(chunk.data()), chunk_size))
+        throw std::runtime_error("Unable to read from file.");
+
+    return chunk;
+}
+
+// ----------------------------------- CHUNKED WRITER ------------------------------------
+
+ChunkedWriter::ChunkedWriter() : store_pin(ChunkStore::instance().pin()) {}
+
+void ChunkedWriter::write(const Buffer &data)
+{
+    hasher.update(data);
+    chunker.push(data, [this](const Buffer &chunk)
+                 { recipe.add(ChunkStore::instance().put(chunk), chunk.size()); });
+}
+
+void ChunkedWriter::commit(const std::string &path)
+{
+    chunker.finish([this](const Buffer &chunk)
+                   { recipe.add(ChunkStore::instance().put(chunk), chunk.size()); });
+
+    recipe.file_digest = Fingerprint::toHex(hasher.finish());
+    recipe.save(path);
+    ContentIndex::instance().add(path, recipe);
+}
+
+void ChunkedWriter::storeFile(const std::string &source_path, const std::string &recipe_path)
+{
+    std::ifstream input(source_path, std::ios::binary);
+    if (!input)
+        throw std::runtime_error("Unable to open file for reading.");
+
+    ChunkedWriter writer;
+    Buffer block(Storage::max_chunk);
+
+    while (input.read(reinterpret_cast<char *>(block.data()), block.size()) || input.gcount() > 0)
+    {
+        block.resize(input.gcount());
+        writer.write(block);
+        block.resize(Storage::max_chunk);
+    }
+
+    if (input.bad())
+        throw std::runtime_error("Unable to read from file.");
+
+    writer.commit(recipe_path);
+}
+
+// ----------------------------------- STORED FILE ------------------------------------
+
+StoredFile::StoredFile() : size(0), recipe(false), compressed(false) {}
+
+void StoredFile::open(const std::string &user, const std::string &name)
+{
+    StorageBackend &backend = StorageBackend::instance();
+    std::string path = backend.path(user, name);
+
+    FileStat info;
+    if (!backend.stat(user, name, info))
+        throw std::invalid_argument("File does not exist.");
+
+    // whichever tier holds the file, it is read from there; a cold one moves back later
+    TierStore::instance().accessed(user, name);
+
+    Recipe stored_recipe;
+    if (backend.isLocal() && stored_recipe.load(path))
+    {
+        stream.reset(new RecipeStream(stored_recipe));
+        size = stored_recipe.logical_size;
+        recipe = true;
+        compressed = false;
+        return;
+    }
+
+    stream = backend.openRead(user, name);
+    size = info.size;
+    recipe = false;
+    compressed = false;
+
+    std::unique_ptr<CompressedStream> plaintext = CompressedStream::open(stream);
+    if (plaintext)
+    {
+        size = plaintext->getFileSize();
+        stream = std::move(plaintext);
+        compressed = true;
+    }
+}
+
+Buffer StoredFile::readChunk(size_t chunk_size)
+{
+    Buffer chunk(chunk_size);
+
+    if (!stream || !stream->read(reinterpret_cast<char *>(chunk.data()), chunk_size))
+        throw std::runtime_error("Unable to read from file.");
+
+    return chunk;
+}
+
+void StoredFileWriter::create(const std::string &user, const std::string &name, uintmax_t size)
+{
+    StorageBackend &backend = StorageBackend::instance();
+    if (backend.exists(user, name))
+        throw std::invalid_argument("File already exists.");
+
+    path = backend.path(user, name);
+
+    if (Storage::deduplicate)
+    {
+        chunked_writer.reset(new ChunkedWriter());
+        return;
+    }
+
+    output = CompressedWriter::open(user, name, size, nullptr);
+}
+
+void StoredFileWriter::write(const Buffer &data)
+{
+    if (chunked_writer)
+        chunked_writer->write(data);
+    else
+        output->write(data);
+}
+
+void StoredFileWriter::commit()
+{
+    if (chunked_writer)
+    {
+        chunked_writer->commit(path);
+        chunked_writer.reset();
+        return;
+    }
+
+    output->commit();
+    output.reset();
+}
@@ -0,0 +1,177 @@
+#ifndef CHUNK_STORE_H
+#define CHUNK_STORE_H
+
+#include <atomic>
+#include <cstdint>
+#include <fstream>
+#include <functional>
+#include <istream>
+#include <memory>
+#include <mutex>
+#include <shared_mutex>
+#include <string>
+#include <vector>
+#include "../tools/chunker.h"
+#include "../tools/fingerprint.h"
+#include "staged_file.h"
+
+typedef std::vector<unsigned char> Buffer;
+
+class Recipe;
+
+// ----------------------------------- CHUNK STORE ------------------------------------
+
+// Content addressed store shared by every user: each chunk lives once under its SHA-256.
+// Chunks are never reference counted, a mark and sweep pass over the recipes reclaims them.
+class ChunkStore
+{
+private:
+    std::string root;
+    Buffer recipe_key;
+    std::shared_mutex gc_mutex;
+    std::atomic<size_t> released_recipes;
+    std::atomic<bool> gc_running;
+    std::atomic<uintmax_t> written_bytes;
+    std::atomic<uintmax_t> deduplicated_bytes;
+
+    ChunkStore(const std::string &root);
+    std::string chunkPath(const std::string &digest) const;
+
+public:
+    static ChunkStore &instance();
+
+    // Keeps the garbage collector away while chunks are referenced by a recipe not yet on disk
+    std::shared_lock<std::shared_mutex> pin();
+
+    std::string put(const Buffer &chunk);
+    Buffer get(const std::string &digest) const;
+    bool has(const std::string &digest) const;
+
+    // A recipe was deleted or replaced, sweep in background once enough of them piled up
+    void release();
+    size_t collectGarbage();
+    // Visits every valid recipe below the data folder
+    void forEachRecipe(const std::function<void(const std::string &, const Recipe &)> &visit) const;
+
+    const Buffer &getRecipeKey() const { return recipe_key; }
+    void printStats() const;
+};
+
+// ----------------------------------- RECIPE ------------------------------------
+
+struct RecipeEntry
+{
+    std::string digest;
+    uint32_t size;
+};
+
+// Stored in place of a deduplicated file: the ordered list of its chunks.
+// Recipes are authenticated with a server key so a user can never forge one, a plain
+// file that merely looks like a recipe fails the check and stays a plain file.
+class Recipe
+{
+public:
+    uintmax_t logical_size;
+    std::string file_digest; // SHA-256 of the whole file, empty when unknown
+    std::vector<RecipeEntry> entries;
+
+    Recipe();
+    void add(const std::string &digest, uint32_t size);
+    static bool isRecipe(const std::string &path);
+    // false when the file is not an authentic recipe
+    bool load(const std::string &path);
+    void save(const std::string &path) const;
+};
+
+// ----------------------------------- RECIPE STREAM ------------------------------------
+
+// Seekable std::streambuf over the chunks of a recipe, loads one chunk at a time
+class RecipeStreamBuf : public std::streambuf
+{
+private:
+    Recipe recipe;
+    std::vector<uintmax_t> offsets; // logical offset of every chunk
+    size_t current;
+    bool loaded;
+    Buffer data;
+
+    bool load(size_t index);
+
+protected:
+    int_type underflow() override;
+    pos_type seekoff(off_type offset, std::ios_base::seekdir direction, std::ios_base::openmode mode) override;
+    pos_type seekpos(pos_type position, std::ios_base::openmode mode) override;
+
+public:
+    RecipeStreamBuf(const Recipe &recipe);
+};
+
+class RecipeStream : public std::istream
+{
+private:
+    RecipeStreamBuf buffer;
+    uintmax_t size;
+
+public:
+    RecipeStream(const Recipe &recipe);
+    Buffer readChunk(size_t chunk_size);
+    uintmax_t getFileSize() const { return size; }
+};
+
+// ----------------------------------- CHUNKED WRITER ------------------------------------
+
+// Splits incoming data in content defined chunks, stores the new ones and writes the recipe
+class ChunkedWriter
+{
+private:
+    ContentChunker chunker;
+    Fingerprint::Hasher hasher;
+    Recipe recipe;
+    std::shared_lock<std::shared_mutex> store_pin;
+
+public:
+    ChunkedWriter();
+    void write(const Buffer &data);
+    void commit(const std::string &path);
+    // Chunks a plain file and writes its recipe at recipe_path
+    static void storeFile(const std::string &source_path, const std::string &recipe_path);
+};
+
+// ----------------------------------- STORED FILE ------------------------------------
+
+// Read side of a user file, whether it is kept as plain bytes, compressed at rest or as a recipe
+class StoredFile
+{
+private:
+    std::unique_ptr<std::istream> stream;
+    uintmax_t size;
+    bool recipe;
+    bool compressed;
+
+public:
+    StoredFile();
+    // Opens name in the folder of user on the storage backend
+    void open(const std::string &user, const std::string &name);
+    Buffer readChunk(size_t chunk_size);
+    uintmax_t getFileSize() const { return size; }
+    bool isRecipe() const { return recipe; }
+    bool isCompressed() const { return compressed; }
+    std::istream &getStream() { return *stream; }
+};
+
+// Write side of a user file: plain bytes (compressed at rest when wanted), or a recipe when
+// deduplication is enabled
+class StoredFileWriter
+{
+private:
+    std::string path;
+    std::unique_ptr<ChunkedWriter> chunked_writer;
+    std::unique_ptr<BackendWriter> output;
+
+public:
+    void create(const std::string &user, const std::string &name, uintmax_t size);
+    void write(const Buffer &data);
+    void commit();
+};
+
+#endif // CHUNK_STORE_H
@@ -0,0 +1,338 @@
+#include "compressed_file.h"
+#include "chunk_store.h"
+#include "constants.h"
+#include "../tools/lz4.h"
+#include <algorithm>
+#include <cctype>
+#include <cstring>
+#include <stdexcept>
+#include <openssl/crypto.h>
+#include <openssl/evp.h>
+#include <openssl/hmac.h>
+
+namespace
+{
+    const char HEADER_MAGIC[8] = {'F', 'O', 'C', 'R', 'S', 'T', '0', '2'};
+    const char INDEX_MAGIC[8] = {'F', 'O', 'C', 'R', 'S', 'T', 'I', 'X'};
+    const size_t HEADER_LENGTH = sizeof(HEADER_MAGIC) + 2 * sizeof(uint64_t); // magic | logical size | block size
+    const size_t MAC_LENGTH = 32;                                             // HMAC-SHA-256 of the header and the frame offsets
+    const uint32_t STORED_FRAME = 0x80000000;                                 // frame length flag: the block is kept as is
+    const uint64_t MAX_BLOCK = 64 * 1024 * 1024;
+
+    void appendUint64(Buffer &data, uint64_t value)
+    {
+        for (int shift = 56; shift >= 0; shift -= 8)
+            data.push_back(static_cast<unsigned char>(value >> shift));
+    }
+
+    uint64_t decodeUint64(const unsigned char *data)
+    {
+        uint64_t value = 0;
+        for (size_t i = 0; i < sizeof(uint64_t); i++)
+            value = (value << 8) | data[i];
+        return value;
+    }
+
+    Buffer encodeHeader(uintmax_t logical_size, uint64_t block_size)
+    {
+        Buffer header(HEADER_MAGIC, HEADER_MAGIC + sizeof(HEADER_MAGIC));
+        appendUint64(header, logical_size);
+        appendUint64(header, block_size);
+        return header;
+    }
+
+    // The bytes of a user file can look like a container too: only the server, with the key of
+    // the recipes, can write a header and offsets that authenticate
+    Buffer authenticate(const Buffer &header, const Buffer &offsets)
+    {
+        Buffer data(header);
+        data.insert(data.end(), offsets.begin(), offsets.end());
+
+        const Buffer &key = ChunkStore::instance().getRecipeKey();
+        unsigned char mac[EVP_MAX_MD_SIZE];
+        unsigned int mac_length = 0;
+        if (!HMAC(EVP_sha256(), key.data(), key.size(), data.data(), data.size(), mac, &mac_length) || mac_length < MAC_LENGTH)
+            throw std::runtime_error("Unable to authenticate file.");
+        return Buffer(mac, mac + MAC_LENGTH);
+    }
+
+    bool readAt(std::istream &source, uint64_t offset, Buffer &data, size_t length)
+    {
+        data.resize(length);
+        source.clear();
+        return source.seekg(offset) && source.read(reinterpret_cast<char *>(data.data()), length);
+    }
+
+    size_t frameCount(uintmax_t logical_size, uint64_t block_size)
+    {
+        return (logical_size + block_size - 1) / block_size;
+    }
+
+    // Layout of a file compressed at rest, with the start of the index closing the offsets;
+    // false for any other file, source is left at its start either way
+    bool readContainer(std::istream &source, uintmax_t &logical_size, uint64_t &block_size, std::vector<uint64_t> &offsets)
+    {
+        Buffer header, index;
+        bool valid = readAt(source, 0, header, HEADER_LENGTH) && memcmp(header.data(), HEADER_MAGIC, sizeof(HEADER_MAGIC)) == 0;
+
+        size_t frames = 0;
+        uint64_t stored_size = 0, index_length = 0;
+        if (valid)
+        {
+            logical_size = decodeUint64(header.data() + sizeof(HEADER_MAGIC));
+            block_size = decodeUint64(header.data() + sizeof(HEADER_MAGIC) + sizeof(uint64_t));
+            valid = block_size > 0 && block_size <= MAX_BLOCK && logical_size <= MAX::max_file_size;
+        }
+
+        if (valid)
+        {
+            frames = frameCount(logical_size, block_size);
+            index_length = frames * sizeof(uint64_t) + MAC_LENGTH + sizeof(INDEX_MAGIC);
+            source.clear();
+            valid = static_cast<bool>(source.seekg(0, std::ios_base::end));
+            stored_size = valid ? static_cast<uint64_t>(source.tellg()) : 0;
+            valid = valid && stored_size >= HEADER_LENGTH + index_length &&
+                    readAt(source, stored_size - index_length, index, index_length) &&
+                    memcmp(index.data() + index.size() - sizeof(INDEX_MAGIC), INDEX_MAGIC, sizeof(INDEX_MAGIC)) == 0;
+        }
+
+        if (valid)
+        {
+            Buffer positions(index.begin(), index.begin() + frames * sizeof(uint64_t));
+            Buffer mac = authenticate(header, positions);
+            valid = CRYPTO_memcmp(mac.data(), index.data() + positions.size(), MAC_LENGTH) == 0;
+        }
+
+        source.clear();
+        source.seekg(0);
+        if (!valid)
+            return false;
+
+        // authentic, anything out of place now is damage on the disk
+        offsets.clear();
+        for (size_t i = 0; i < frames; i++)
+        {
+            offsets.push_back(decodeUint64(index.data() + i * sizeof(uint64_t)));
+            if (offsets.back() < (i == 0 ? HEADER_LENGTH : offsets[i - 1] + sizeof(uint32_t)))
+                throw std::runtime_error("Corrupted file.");
+        }
+        offsets.push_back(stored_size - index_length);
+        if (frames > 0 && offsets[frames] < offsets[frames - 1] + sizeof(uint32_t))
+            throw std::runtime_error("Corrupted file.");
+        return true;
+    }
+}
+
+// ----------------------------------- COMPRESSED WRITER ------------------------------------
+
+CompressedWriter::CompressedWriter(std::unique_ptr<BackendWriter> output, uintmax_t size)
+    : output(std::move(output)), logical_size(size), received(0), stored(0)
+{
+    block.reserve(Storage::at_rest_block);
+    emit(encodeHeader(logical_size, Storage::at_rest_block));
+}
+
+bool CompressedWriter::wanted(const std::string &name, uintmax_t size)
+{
+    // recipes already keep every chunk once, their content must stay as the chunker saw it
+    if (!Storage::at_rest_compression || Storage::deduplicate || size < Storage::at_rest_min)
+        return false;
+
+    size_t dot = name.find_last_of('.');
+    if (dot == std::string::npos)
+        return false;
+
+    std::string extension = name.substr(dot + 1);
+    std::transform(extension.begin(), extension.end(), extension.begin(), [](unsigned char c)
+                   { return std::tolower(c); });
+    return std::find(Storage::at_rest_types.begin(), Storage::at_rest_types.end(), extension) != Storage::at_rest_types.end();
+}
+
+std::unique_ptr<BackendWriter> CompressedWriter::open(const std::string &user, const std::string &name, uintmax_t size, IoEngine *engine)
+{
+    // the stored length is not known yet, the logical one is a close upper bound to reserve
+    std::unique_ptr<BackendWriter> output = StorageBackend::instance().openWrite(user, name, size, engine);
+    if (!wanted(name, size))
+        return output;
+    return std::unique_ptr<BackendWriter>(new CompressedWriter(std::move(output), size));
+}
+
+void CompressedWriter::emit(const Buffer &data)
+{
+    output->write(data);
+    stored += data.size();
+}
+
+void CompressedWriter::flushBlock()
+{
+    offsets.push_back(stored);
+
+    Buffer compressed = lz4::compress(block);
+    bool keep = compressed.size() >= block.size();
+    const Buffer &payload = keep ? block : compressed;
+    uint32_t length = static_cast<uint32_t>(payload.size()) | (keep ? STORED_FRAME : 0);
+
+    Buffer frame;
+    frame.reserve(sizeof(length) + payload.size());
+    for (int shift = 24; shift >= 0; shift -= 8)
+        frame.push_back(static_cast<unsigned char>(length >> shift));
+    frame.insert(frame.end(), payload.begin(), payload.end());
+
+    emit(frame);
+    block.clear();
+}
+
+void CompressedWriter::write(const Buffer &data)
+{
+    if (data.size() > logical_size - received)
+        throw std::runtime_error("Unable to write to file.");
+
+    for (size_t offset = 0; offset < data.size();)
+    {
+        size_t take = std::min(data.size() - offset, Storage::at_rest_block - block.size());
+        block.insert(block.end(), data.begin() + offset, data.begin() + offset + take);
+        offset += take;
+
+        if (block.size() == Storage::at_rest_block)
+            flushBlock();
+    }
+
+    received += data.size();
+}
+
+void CompressedWriter::commit()
+{
+    if (received != logical_size)
+        throw std::runtime_error("Unable to write to file.");
+
+    if (!block.empty())
+        flushBlock();
+
+    // offsets | HMAC | magic, read back from the end of the file
+    Buffer index;
+    for (uint64_t offset : offsets)
+        appendUint64(index, offset);
+    Buffer mac = authenticate(encodeHeader(logical_size, Storage::at_rest_block), index);
+    index.insert(index.end(), mac.begin(), mac.end());
+    index.insert(index.end(), INDEX_MAGIC, INDEX_MAGIC + sizeof(INDEX_MAGIC));
+    emit(index);
+
+    output->commit();
+}
+
+// ----------------------------------- COMPRESSED STREAM ------------------------------------
+
+CompressedStreamBuf::CompressedStreamBuf(std::unique_ptr<std::istream> source, uintmax_t logical_size, uint64_t block_size, std::vector<uint64_t> offsets)
+    : source(std::move(source)), logical_size(logical_size), block_size(block_size), offsets(std::move(offsets)), current(0), loaded(false)
+{
+    setg(nullptr, nullptr, nullptr);
+}
+
+bool CompressedStreamBuf::load(size_t index)
+{
+    // offsets ends with the start of the index, so every frame has an end
+    if (index + 1 >= offsets.size())
+        return false;
+
+    Buffer frame;
+    if (!readAt(*source, offsets[index], frame, offsets[index + 1] - offsets[index]) || frame.size() < sizeof(uint32_t))
+        throw std::runtime_error("Unable to read from file.");
+
+    uint32_t length = (uint32_t(frame[0]) << 24) | (uint32_t(frame[1]) << 16) | (uint32_t(frame[2]) << 8) | frame[3];
+    size_t expected = std::min<uintmax_t>(block_size, logical_size - index * block_size);
+    Buffer payload(frame.begin() + sizeof(length), frame.end());
+
+    if ((length & ~STORED_FRAME) != payload.size())
+        throw std::runtime_error("Corrupted file.");
+    if (length & STORED_FRAME)
+        data.swap(payload);
+    else if (!lz4::decompress(payload, data, expected))
+        throw std::runtime_error("Corrupted file.");
+    if (data.size() != expected)
+        throw std::runtime_error("Corrupted file.");
+
+    current = index;
+    loaded = true;
+
+    char *begin = reinterpret_cast<char *>(data.data());
+    setg(begin, begin, begin + data.size());
+    return true;
+}
+
+CompressedStreamBuf::int_type CompressedStreamBuf::underflow()
+{
+    if (gptr() < egptr())
+        return traits_type::to_int_type(*gptr());
+
+    if (!load(loaded ? current + 1 : 0))
+        return traits_type::eof();
+
+    return traits_type::to_int_type(*gptr());
+}
+
+CompressedStreamBuf::pos_type CompressedStreamBuf::seekoff(off_type offset, std::ios_base::seekdir direction, std::ios_base::openmode mode)
+{
+    off_type position = 0;
+
+    if (loaded && current + 1 < offsets.size())
+        position = current * block_size + (gptr() - eback());
+    else if (loaded)
+        position = logical_size;
+
+    if (direction == std::ios_base::beg)
+        position = offset;
+    else if (direction == std::ios_base::cur)
+        position += offset;
+    else
+        position = logical_size + offset;
+
+    return seekpos(pos_type(position), mode);
+}
+
+CompressedStreamBuf::pos_type CompressedStreamBuf::seekpos(pos_type position, std::ios_base::openmode mode)
+{
+    off_type target = off_type(position);
+
+    if (!(mode & std::ios_base::in) || target < 0 || (uintmax_t)target > logical_size)
+        return pos_type(off_type(-1));
+
+    // at the very end nothing is loaded and the next read hits eof
+    if ((uintmax_t)target == logical_size)
+    {
+        data.clear();
+        current = offsets.size() - 1;
+        loaded = true;
+        setg(nullptr, nullptr, nullptr);
+        return position;
+    }
+
+    size_t index = target / block_size;
+    if (!(loaded && current == index) && !load(index))
+        return pos_type(off_type(-1));
+
+    setg(eback(), eback() + (target - index * block_size), egptr());
+    return position;
+}
+
+CompressedStream::CompressedStream(std::unique_ptr<std::istream> source, uintmax_t logical_size, uint64_t block_size, std::vector<uint64_t> offsets)
+    : std::istream(&buffer), buffer(std::move(source), logical_size, block_size, std::move(offsets)), size(logical_size)
+{
+}
+
+bool CompressedStream::probe(std::istream &source, uintmax_t &logical_size)
+{
+    uint64_t block_size;
+    std::vector<uint64_t> offsets;
+    return readContainer(source, logical_size, block_size, offsets);
+}
+
+std::unique_ptr<CompressedStream> CompressedStream::open(std::unique_ptr<std::istream> &source)
+{
+    uintmax_t logical_size;
+    uint64_t block_size;
+    std::vector<uint64_t> offsets;
+    if (!readContainer(*source, logical_size, block_size, offsets))
+        return nullptr;
+
+    return std::unique_ptr<CompressedStream>(new CompressedStream(std::move(source), logical_size, block_size, std::move(offsets)));
+}
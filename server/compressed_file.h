@@ -0,0 +1,90 @@
+#ifndef COMPRESSED_FILE_H
+#define COMPRESSED_FILE_H
+
+#include <cstdint>
+#include <istream>
+#include <memory>
+#include <string>
+#include <vector>
+#include "storage_backend.h"
+
+typedef std::vector<unsigned char> Buffer;
+
+// ----------------------------------- COMPRESSED WRITER ------------------------------------
+
+// Stores a file compressed at rest: a header with the logical size, the file cut in
+// Storage::at_rest_block sized blocks each kept as an LZ4 frame (or as is when it does not
+// shrink), then the offsets of the frames so a reader can seek and an HMAC of the header and
+// the offsets under the server key, so no uploaded content passes for such a file. The size
+// announced when created must be the exact one.
+class CompressedWriter : public BackendWriter
+{
+private:
+    std::unique_ptr<BackendWriter> output;
+    uintmax_t logical_size;
+    uintmax_t received;
+    uint64_t stored; // bytes handed to output so far
+    Buffer block;
+    std::vector<uint64_t> offsets; // of every frame
+
+    void emit(const Buffer &data);
+    void flushBlock();
+
+public:
+    CompressedWriter(std::unique_ptr<BackendWriter> output, uintmax_t size);
+
+    void write(const Buffer &data) override;
+    void commit() override;
+
+    // Storage::at_rest_types files from Storage::at_rest_min on, while compression at rest is on
+    static bool wanted(const std::string &name, uintmax_t size);
+    // Writer of a new file of user on the storage backend, compressed when wanted()
+    static std::unique_ptr<BackendWriter> open(const std::string &user, const std::string &name, uintmax_t size, IoEngine *engine);
+};
+
+// ----------------------------------- COMPRESSED STREAM ------------------------------------
+
+// Seekable std::streambuf over the plaintext of a file compressed at rest, decompresses one
+// frame at a time while the file is read
+class CompressedStreamBuf : public std::streambuf
+{
+private:
+    std::unique_ptr<std::istream> source;
+    uintmax_t logical_size;
+    uint64_t block_size;
+    std::vector<uint64_t> offsets;
+    size_t current;
+    bool loaded;
+    Buffer data;
+
+    bool load(size_t index);
+
+protected:
+    int_type underflow() override;
+    pos_type seekoff(off_type offset, std::ios_base::seekdir direction, std::ios_base::openmode mode) override;
+    pos_type seekpos(pos_type position, std::ios_base::openmode mode) override;
+
+public:
+    CompressedStreamBuf(std::unique_ptr<std::istream> source, uintmax_t logical_size, uint64_t block_size, std::vector<uint64_t> offsets);
+};
+
+class CompressedStream : public std::istream
+{
+private:
+    CompressedStreamBuf buffer;
+    uintmax_t size;
+
+    CompressedStream(std::unique_ptr<std::istream> source, uintmax_t logical_size, uint64_t block_size, std::vector<uint64_t> offsets);
+
+public:
+    // Logical size of a file compressed at rest read from the header source starts with,
+    // false for any other file, one that merely looks like it included; source is left at
+    // its start either way
+    static bool probe(std::istream &source, uintmax_t &logical_size);
+    // Takes over source when it holds a file compressed at rest, nullptr (and source
+    // untouched) otherwise
+    static std::unique_ptr<CompressedStream> open(std::unique_ptr<std::istream> &source);
+    uintmax_t getFileSize() const { return size; }
+};
+
+#endif // COMPRESSED_FILE_H
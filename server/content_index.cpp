@@ -0,0 +1,112 @@
+#include "content_index.h"
+#include "constants.h"
+#include <algorithm>
+#include <filesystem>
+#include <iostream>
+
+namespace fs = std::filesystem;
+
+namespace
+{
+    // recipes live in ../data/<user>/<name>, the versions of a file in
+    // Storage::version_root/<user>/<name>/<number>
+    std::string ownerOf(const std::string &path)
+    {
+        fs::path version = fs::path(path).lexically_relative(Storage::version_root);
+        if (!version.empty() && *version.begin() != "..")
+            return version.begin()->string();
+        return fs::path(path).parent_path().filename().string();
+    }
+}
+
+ContentIndex::ContentIndex() : loaded(false) {}
+
+ContentIndex &ContentIndex::instance()
+{
+    static ContentIndex index;
+    return index;
+}
+
+void ContentIndex::load()
+{
+    if (loaded)
+        return;
+
+    ChunkStore::instance().forEachRecipe([this](const std::string &path, const Recipe &recipe)
+                                         { addLocked(path, recipe); });
+    loaded = true;
+
+    std::cout << "[INDEX] Indexed " << files.size() << " files and " << chunk_owners.size() << " chunks" << std::endl;
+}
+
+void ContentIndex::addLocked(const std::string &path, const Recipe &recipe)
+{
+    if (!recipe.file_digest.empty())
+    {
+        std::vector<std::string> &paths = files[recipe.file_digest];
+        if (std::find(paths.begin(), paths.end(), path) == paths.end())
+            paths.push_back(path);
+    }
+
+    std::string owner = ownerOf(path);
+    for (const RecipeEntry &entry : recipe.entries)
+        chunk_owners[entry.digest].insert(owner);
+}
+
+void ContentIndex::add(const std::string &path, const Recipe &recipe)
+{
+    std::lock_guard<std::mutex> lock(mutex);
+
+    // before the first lookup the scan will find this recipe on disk anyway
+    if (loaded)
+        addLocked(path, recipe);
+}
+
+bool ContentIndex::findFile(const std::string &user, const std::string &file_digest, std::string &path, Recipe &recipe)
+{
+    std::lock_guard<std::mutex> lock(mutex);
+    load();
+
+    auto found = files.find(file_digest);
+    if (found == files.end())
+        return false;
+
+    std::vector<std::string> &paths = found->second;
+    for (size_t i = paths.size(); i-- > 0;)
+    {
+        // files of other users are never looked at, the answer must not depend on them
+        if (ownerOf(paths[i]) != user)
+            continue;
+
+        Recipe candidate;
+        try
+        {
+            if (candidate.load(paths[i]) && candidate.file_digest == file_digest)
+            {
+                path = paths[i];
+                recipe = candidate;
+                return true;
+            }
+        }
+        catch (const std::exception &e)
+        {
+            std::cerr << "[INDEX] " << e.what() << std::endl;
+        }
+
+        // stale entry, the file was renamed, replaced or deleted
+        paths.erase(paths.begin() + i);
+    }
+
+    if (paths.empty())
+        files.erase(found);
+    return false;
+}
+
+bool ContentIndex::ownsChunk(const std::string &user, const std::string &chunk_digest)
+{
+    std::lock_guard<std::mutex> lock(mutex);
+    load();
+
+    auto found = chunk_owners.find(chunk_digest);
+    return found != chunk_owners.end() && found->second.count(user) > 0 && ChunkStore::instance().has(chunk_digest);
+}
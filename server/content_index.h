@@ -0,0 +1,37 @@
+#ifndef CONTENT_INDEX_H
+#define CONTENT_INDEX_H
+
+#include <mutex>
+#include <string>
+#include <unordered_map>
+#include <unordered_set>
+#include <vector>
+#include "chunk_store.h"
+
+// In memory index over the recipes of the chunk store, built on first use.
+// Entries are only ever added, every lookup re-checks the recipe on disk so
+// renamed, replaced or deleted files simply stop matching.
+class ContentIndex
+{
+private:
+    std::mutex mutex;
+    bool loaded;
+    std::unordered_map<std::string, std::vector<std::string>> files;               // file digest -> recipe paths
+    std::unordered_map<std::string, std::unordered_set<std::string>> chunk_owners; // chunk digest -> users
+
+    ContentIndex();
+    void load();
+    void addLocked(const std::string &path, const Recipe &recipe);
+
+public:
+    static ContentIndex &instance();
+
+    void add(const std::string &path, const Recipe &recipe);
+    // A recipe of user, a file or one of its versions, whose whole content has the given
+    // digest; whether another user stores that content is never disclosed
+    bool findFile(const std::string &user, const std::string &file_digest, std::string &path, Recipe &recipe);
+    // Only chunks of the user's own files are disclosed, never the content of other users
+    bool ownsChunk(const std::string &user, const std::string &chunk_digest);
+};
+
+#endif // CONTENT_INDEX_H
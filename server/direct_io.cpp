@@ -0,0 +1,205 @@
+#include "direct_io.h"
+#include "constants.h"
+#include <cerrno>
+#include <cstdlib>
+#include <fcntl.h>
+#include <new>
+#include <sys/stat.h>
+#include <unistd.h>
+
+// ----------------------------------- ALIGNED BUFFER POOL ------------------------------------
+
+void AlignedBufferPool::Release::operator()(unsigned char *block) const
+{
+    AlignedBufferPool::instance().release(block);
+}
+
+AlignedBufferPool &AlignedBufferPool::instance()
+{
+    static AlignedBufferPool pool;
+    return pool;
+}
+
+AlignedBufferPool::Block AlignedBufferPool::acquire()
+{
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        if (!free_blocks.empty())
+        {
+            unsigned char *block = free_blocks.back();
+            free_blocks.pop_back();
+            return Block(block);
+        }
+    }
+
+    void *block = aligned_alloc(Storage::direct_io_alignment, Storage::direct_io_block);
+    if (!block)
+        throw std::bad_alloc();
+
+    return Block(static_cast<unsigned char *>(block));
+}
+
+void AlignedBufferPool::release(unsigned char *block)
+{
+    std::lock_guard<std::mutex> lock(mutex);
+
+    if (free_blocks.size() < Storage::direct_io_pool)
+        free_blocks.push_back(block);
+    else
+        free(block);
+}
+
+AlignedBufferPool::~AlignedBufferPool()
+{
+    for (unsigned char *block : free_blocks)
+        free(block);
+}
+
+// ----------------------------------- DIRECT DESCRIPTORS ------------------------------------
+
+int openDirect(const std::string &path, int flags, bool &direct, int dir_fd, mode_t mode)
+{
+    int base = dir_fd == -1 ? AT_FDCWD : dir_fd;
+
+    int fd = openat(base, path.c_str(), flags | O_DIRECT, mode);
+    direct = fd != -1;
+
+    // some filesystems create the file before refusing the flag, the name is already ours then
+    if (fd == -1 && errno == EINVAL)
+        fd = openat(base, path.c_str(), flags & ~O_EXCL, mode);
+
+    return fd;
+}
+
+void dropDirect(int fd, bool &direct)
+{
+    int flags = fcntl(fd, F_GETFL);
+    if (flags != -1)
+        fcntl(fd, F_SETFL, flags & ~O_DIRECT);
+    direct = false;
+}
+
+void enableDirect(int fd, bool &direct)
+{
+    int flags = fcntl(fd, F_GETFL);
+    direct = flags != -1 && fcntl(fd, F_SETFL, flags | O_DIRECT) == 0;
+}
+
+// ----------------------------------- DIRECT STREAM ------------------------------------
+
+DirectStreamBuf::DirectStreamBuf() : fd(-1), direct(false), size(0), offset(0) {}
+
+bool DirectStreamBuf::open(const std::string &path)
+{
+    bool opened_direct;
+    int opened = openDirect(path, O_RDONLY | O_CLOEXEC, opened_direct);
+    return opened != -1 && adopt(opened, opened_direct);
+}
+
+bool DirectStreamBuf::adopt(int fd, bool direct)
+{
+    if (this->fd != -1)
+        close(this->fd);
+    this->fd = fd;
+    this->direct = direct;
+
+    struct stat info;
+    if (fstat(fd, &info) != 0)
+        return false;
+
+    size = info.st_size;
+    return true;
+}
+
+uintmax_t DirectStreamBuf::position() const
+{
+    return eback() ? offset + (gptr() - eback()) : offset;
+}
+
+bool DirectStreamBuf::fill(uintmax_t target)
+{
+    // reads start on an aligned offset, the block is then entered where target lies
+    uintmax_t aligned = target - target % Storage::direct_io_alignment;
+
+    setg(nullptr, nullptr, nullptr);
+    offset = target;
+
+    if (fd == -1 || target >= size)
+        return false;
+
+    if (!block)
+        block = AlignedBufferPool::instance().acquire();
+
+    ssize_t count;
+    while ((count = pread(fd, block.get(), Storage::direct_io_block, aligned)) == -1)
+    {
+        if (errno == EINTR)
+            continue;
+        // accepted at open time but refused on the first transfer
+        if (errno == EINVAL && direct)
+        {
+            dropDirect(fd, direct);
+            continue;
+        }
+        return false;
+    }
+
+    if (static_cast<uintmax_t>(count) <= target - aligned)
+        return false;
+
+    char *base = reinterpret_cast<char *>(block.get());
+    setg(base, base + (target - aligned), base + count);
+    offset = aligned;
+    return true;
+}
+
+DirectStreamBuf::int_type DirectStreamBuf::underflow()
+{
+    if (gptr() < egptr())
+        return traits_type::to_int_type(*gptr());
+
+    if (!fill(position()))
+        return traits_type::eof();
+
+    return traits_type::to_int_type(*gptr());
+}
+
+DirectStreamBuf::pos_type DirectStreamBuf::seekoff(off_type distance, std::ios_base::seekdir direction, std::ios_base::openmode mode)
+{
+    if (!(mode & std::ios_base::in))
+        return pos_type(off_type(-1));
+
+    off_type base = direction == std::ios_base::beg ? 0 : direction == std::ios_base::cur ? position() : size;
+    off_type target = base + distance;
+
+    if (target < 0 || static_cast<uintmax_t>(target) > size)
+        return pos_type(off_type(-1));
+
+    // the block is read again on the next access, wherever the new position falls
+    setg(nullptr, nullptr, nullptr);
+    offset = target;
+    return pos_type(target);
+}
+
+DirectStreamBuf::pos_type DirectStreamBuf::seekpos(pos_type target, std::ios_base::openmode mode)
+{
+    return seekoff(off_type(target), std::ios_base::beg, mode);
+}
+
+DirectStreamBuf::~DirectStreamBuf()
+{
+    if (fd != -1)
+        close(fd);
+}
+
+DirectStream::DirectStream(const std::string &path) : std::istream(&buffer)
+{
+    if (!buffer.open(path))
+        setstate(std::ios_base::failbit);
+}
+
+DirectStream::DirectStream(int fd, bool direct) : std::istream(&buffer)
+{
+    if (!buffer.adopt(fd, direct))
+        setstate(std::ios_base::failbit);
+}
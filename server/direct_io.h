@@ -0,0 +1,88 @@
+#ifndef DIRECT_IO_H
+#define DIRECT_IO_H
+
+#include <cstdint>
+#include <istream>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <sys/types.h>
+#include <vector>
+
+// ----------------------------------- ALIGNED BUFFER POOL ------------------------------------
+
+// Page aligned blocks of Storage::direct_io_block bytes as O_DIRECT requires them.
+// Released blocks are kept for the next transfer instead of going back to the allocator.
+class AlignedBufferPool
+{
+public:
+    struct Release
+    {
+        void operator()(unsigned char *block) const;
+    };
+    typedef std::unique_ptr<unsigned char[], Release> Block;
+
+private:
+    std::mutex mutex;
+    std::vector<unsigned char *> free_blocks;
+
+    AlignedBufferPool() = default;
+
+public:
+    static AlignedBufferPool &instance();
+    Block acquire();
+    void release(unsigned char *block);
+    ~AlignedBufferPool();
+};
+
+// ----------------------------------- DIRECT STREAM ------------------------------------
+
+// Opens path with O_DIRECT so large files bypass the page cache. Filesystems refusing
+// the flag (tmpfs, some network mounts) get a plain descriptor and the same interface.
+int openDirect(const std::string &path, int flags, bool &direct, int dir_fd = -1, mode_t mode = 0);
+// Drops O_DIRECT from an open descriptor, for tails that are not a multiple of the alignment
+void dropDirect(int fd, bool &direct);
+// Adds O_DIRECT to a descriptor opened without it, direct tells whether the filesystem took it
+void enableDirect(int fd, bool &direct);
+
+// Seekable std::streambuf reading whole aligned blocks straight from the disk
+class DirectStreamBuf : public std::streambuf
+{
+private:
+    int fd;
+    bool direct;
+    uintmax_t size;
+    uintmax_t offset; // file offset of eback(), or of the next read once the buffer is dropped
+    AlignedBufferPool::Block block;
+
+    bool fill(uintmax_t target);
+    uintmax_t position() const;
+
+protected:
+    int_type underflow() override;
+    pos_type seekoff(off_type distance, std::ios_base::seekdir direction, std::ios_base::openmode mode) override;
+    pos_type seekpos(pos_type target, std::ios_base::openmode mode) override;
+
+public:
+    DirectStreamBuf();
+    DirectStreamBuf(const DirectStreamBuf &) = delete;
+    DirectStreamBuf &operator=(const DirectStreamBuf &) = delete;
+    bool open(const std::string &path);
+    // Takes over fd, opened for reading with or without O_DIRECT
+    bool adopt(int fd, bool direct);
+    bool isDirect() const { return direct; }
+    ~DirectStreamBuf();
+};
+
+class DirectStream : public std::istream
+{
+private:
+    DirectStreamBuf buffer;
+
+public:
+    DirectStream(const std::string &path);
+    DirectStream(int fd, bool direct);
+    bool isDirect() const { return buffer.isDirect(); }
+};
+
+#endif // DIRECT_IO_H
@@ -0,0 +1,195 @@
+#include "file_cache.h"
+#include <algorithm>
+#include <cstring>
+#include <functional>
+#include <iomanip>
+#include <iostream>
+#include <stdexcept>
+
+FileCache::FileCache() : shards(std::max<size_t>(Storage::cache_shards, 1)), hits(0), misses(0), evictions(0), invalidations(0)
+{
+}
+
+FileCache &FileCache::instance()
+{
+    static FileCache cache;
+    return cache;
+}
+
+FileCache::Shard &FileCache::shardOf(const std::string &path)
+{
+    // by path only, so invalidating a file visits a single shard
+    return shards[std::hash<std::string>{}(path) % shards.size()];
+}
+
+std::string FileCache::keyOf(const std::string &path, const std::string &version, uintmax_t block)
+{
+    // file names can't hold a newline, the parts never run into each other
+    return path + "\n" + version + "\n" + std::to_string(block);
+}
+
+FileCache::Block FileCache::lookup(const std::string &path, const std::string &version, uintmax_t block)
+{
+    Shard &shard = shardOf(path);
+    std::lock_guard<std::mutex> lock(shard.mutex);
+
+    auto found = shard.index.find(keyOf(path, version, block));
+    if (found == shard.index.end())
+    {
+        misses++;
+        return nullptr;
+    }
+
+    shard.entries.splice(shard.entries.begin(), shard.entries, found->second);
+    hits++;
+    return found->second->data;
+}
+
+FileCache::Block FileCache::insert(const std::string &path, const std::string &version, uintmax_t block, Buffer data)
+{
+    Block cached = std::make_shared<const Buffer>(std::move(data));
+    size_t budget = Storage::cache_bytes / shards.size();
+    if (cached->size() > budget)
+        return cached;
+
+    std::string key = keyOf(path, version, block);
+    Shard &shard = shardOf(path);
+    std::lock_guard<std::mutex> lock(shard.mutex);
+
+    // two sessions missed the same block at once, the first copy stays
+    auto found = shard.index.find(key);
+    if (found != shard.index.end())
+        return found->second->data;
+
+    shard.entries.push_front(Entry{key, path, cached});
+    shard.index[key] = shard.entries.begin();
+    shard.bytes += cached->size();
+
+    while (shard.bytes > budget)
+    {
+        Entry &oldest = shard.entries.back();
+        shard.bytes -= oldest.data->size();
+        shard.index.erase(oldest.key);
+        shard.entries.pop_back();
+        evictions++;
+    }
+
+    return cached;
+}
+
+void FileCache::invalidate(const std::string &path)
+{
+    if (!enabled())
+        return;
+
+    Shard &shard = shardOf(path);
+    std::lock_guard<std::mutex> lock(shard.mutex);
+
+    for (auto entry = shard.entries.begin(); entry != shard.entries.end();)
+    {
+        if (entry->path != path)
+        {
+            ++entry;
+            continue;
+        }
+
+        shard.bytes -= entry->data->size();
+        shard.index.erase(entry->key);
+        entry = shard.entries.erase(entry);
+        invalidations++;
+    }
+}
+
+FileCache::Stats FileCache::getStats()
+{
+    Stats stats;
+    stats.hits = hits;
+    stats.misses = misses;
+    stats.evictions = evictions;
+    stats.invalidations = invalidations;
+
+    for (Shard &shard : shards)
+    {
+        std::lock_guard<std::mutex> lock(shard.mutex);
+        stats.bytes += shard.bytes;
+        stats.blocks += shard.entries.size();
+    }
+
+    return stats;
+}
+
+void FileCache::printStats(const std::string &tag)
+{
+    Stats stats = getStats();
+    uint64_t lookups = stats.hits + stats.misses;
+
+    std::cout << tag << " Cache: " << stats.hits << " hits, " << stats.misses << " misses";
+    if (lookups > 0)
+        std::cout << " (" << std::fixed << std::setprecision(1) << 100.0 * stats.hits / lookups << "% hit rate)" << std::defaultfloat;
+    std::cout << ", " << stats.blocks << " blocks / " << stats.bytes << "B held, "
+              << stats.evictions << " evicted, " << stats.invalidations << " invalidated" << std::endl;
+}
+
+CachedReader::CachedReader(StoredFile &file, const std::string &path, const std::string &version)
+    : file(file), path(path), version(version), block_index(0), position(0), stream_position(0), hits(0), misses(0)
+{
+}
+
+void CachedReader::load(uintmax_t index)
+{
+    block_index = index;
+    block = FileCache::instance().lookup(path, version, index);
+    if (block)
+    {
+        hits++;
+        return;
+    }
+
+    uintmax_t offset = index * Storage::cache_block;
+    size_t length = std::min<uintmax_t>(Storage::cache_block, file.getFileSize() - offset);
+
+    // hits before this block left the stream behind
+    if (stream_position != offset)
+    {
+        std::istream &stream = file.getStream();
+        stream.clear();
+        if (!stream.seekg(offset))
+            throw std::runtime_error("Unable to read file.");
+    }
+
+    block = FileCache::instance().insert(path, version, index, file.readChunk(length));
+    stream_position = offset + length;
+    misses++;
+}
+
+const unsigned char *CachedReader::next(size_t chunk_size)
+{
+    if (chunk_size > file.getFileSize() - position)
+        throw std::runtime_error("Unable to read file.");
+
+    uintmax_t index = position / Storage::cache_block;
+    size_t offset = position % Storage::cache_block;
+
+    if (!block || block_index != index)
+        load(index);
+
+    position += chunk_size;
+    if (offset + chunk_size <= block->size())
+        return block->data() + offset;
+
+    // the chunk continues in the next block, both parts are copied together
+    straddling.assign(block->begin() + offset, block->end());
+    while (straddling.size() < chunk_size)
+    {
+        load(block_index + 1);
+        size_t take = std::min(chunk_size - straddling.size(), block->size());
+        straddling.insert(straddling.end(), block->begin(), block->begin() + take);
+    }
+    return straddling.data();
+}
+
+void CachedReader::printStats(const std::string &tag) const
+{
+    std::cout << tag << " " << hits << " of " << (hits + misses) << " blocks served from memory" << std::endl;
+    FileCache::instance().printStats(tag);
+}
@@ -0,0 +1,103 @@
+#ifndef FILE_CACHE_H
+#define FILE_CACHE_H
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <list>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <unordered_map>
+#include <vector>
+#include "chunk_store.h"
+#include "constants.h"
+
+typedef std::vector<unsigned char> Buffer;
+
+// ----------------------------------- FILE CACHE ------------------------------------
+
+// Plaintext of recently downloaded files, in Storage::cache_block sized blocks kept in memory
+// up to Storage::cache_bytes. Blocks are keyed by path, version (the entity tag of the file)
+// and index; all blocks of a path land in the same shard, every shard is an LRU list with
+// its own lock and its share of the budget. A block handed out stays valid after eviction.
+class FileCache
+{
+public:
+    typedef std::shared_ptr<const Buffer> Block;
+
+    struct Stats
+    {
+        uint64_t hits = 0;
+        uint64_t misses = 0;
+        uint64_t evictions = 0;
+        uint64_t invalidations = 0;
+        size_t bytes = 0;
+        size_t blocks = 0;
+    };
+
+private:
+    struct Entry
+    {
+        std::string key;
+        std::string path;
+        Block data;
+    };
+
+    struct Shard
+    {
+        std::mutex mutex;
+        std::list<Entry> entries; // most recently used first
+        std::unordered_map<std::string, std::list<Entry>::iterator> index;
+        size_t bytes = 0;
+    };
+
+    std::vector<Shard> shards;
+    std::atomic<uint64_t> hits, misses, evictions, invalidations;
+
+    FileCache();
+    Shard &shardOf(const std::string &path);
+    static std::string keyOf(const std::string &path, const std::string &version, uintmax_t block);
+
+public:
+    static FileCache &instance();
+    static bool enabled() { return Storage::cache_bytes > 0; }
+
+    // nullptr on a miss
+    Block lookup(const std::string &path, const std::string &version, uintmax_t block);
+    Block insert(const std::string &path, const std::string &version, uintmax_t block, Buffer data);
+    // Drops every cached block of path, whatever its version
+    void invalidate(const std::string &path);
+
+    Stats getStats();
+    void printStats(const std::string &tag);
+};
+
+// ----------------------------------- CACHED READER ------------------------------------
+
+// Download source going through the cache: blocks missing from it are read from the
+// opened file and left there for the next download of the same version.
+class CachedReader
+{
+private:
+    StoredFile &file;
+    std::string path;
+    std::string version;
+    FileCache::Block block;
+    uintmax_t block_index;
+    uintmax_t position;        // file offset of the next chunk
+    uintmax_t stream_position; // where the next read of the file starts
+    Buffer straddling;  // a chunk crossing the end of a block
+    size_t hits;
+    size_t misses;
+
+    void load(uintmax_t index);
+
+public:
+    CachedReader(StoredFile &file, const std::string &path, const std::string &version);
+    // Pointer to the next chunk_size bytes, valid until the following call
+    const unsigned char *next(size_t chunk_size);
+    void printStats(const std::string &tag) const;
+};
+
+#endif // FILE_CACHE_H
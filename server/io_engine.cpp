@@ -0,0 +1,541 @@
+#include "io_engine.h"
+#include "constants.h"
+#include <algorithm>
+#include <cerrno>
+#include <chrono>
+#include <climits>
+#include <cstring>
+#include <fcntl.h>
+#include <iomanip>
+#include <iostream>
+#include <linux/io_uring.h>
+#include <stdexcept>
+#include <sys/mman.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+
+// ----------------------------------- IO ENGINE ------------------------------------
+
+namespace
+{
+    // the raw system calls, the ring is driven without liburing
+    int ringSetup(unsigned entries, io_uring_params &params)
+    {
+        return static_cast<int>(syscall(__NR_io_uring_setup, entries, &params));
+    }
+
+    int ringEnter(int ring_fd, unsigned to_submit, unsigned min_complete, unsigned flags)
+    {
+        return static_cast<int>(syscall(__NR_io_uring_enter, ring_fd, to_submit, min_complete, flags, nullptr, 0));
+    }
+
+    int ringRegister(int ring_fd, unsigned opcode, void *arg, unsigned count)
+    {
+        return static_cast<int>(syscall(__NR_io_uring_register, ring_fd, opcode, arg, count));
+    }
+
+    template <typename T>
+    T *ringField(void *ring, unsigned offset)
+    {
+        return reinterpret_cast<T *>(static_cast<unsigned char *>(ring) + offset);
+    }
+}
+
+IoEngine::IoEngine() : ring_fd(-1), entries(0), queued(0), in_flight(0), sq_ring(MAP_FAILED), cq_ring(MAP_FAILED),
+                       sq_ring_size(0), cq_ring_size(0), sqes(MAP_FAILED)
+{
+    if (available() && !setupRing())
+        std::cerr << "[IO] io_uring unavailable, falling back to blocking I/O" << std::endl;
+}
+
+bool IoEngine::available()
+{
+    static const bool supported = []()
+    {
+        if (!Storage::io_uring)
+            return false;
+
+        io_uring_params params;
+        memset(&params, 0, sizeof(params));
+        int fd = ringSetup(2, params);
+        if (fd == -1)
+            return false;
+
+        // sends and receives on the ring need 5.6, older kernels only know the file operations
+        std::vector<unsigned char> storage(sizeof(io_uring_probe) + IORING_OP_LAST * sizeof(io_uring_probe_op), 0);
+        io_uring_probe *probe = reinterpret_cast<io_uring_probe *>(storage.data());
+        bool complete = ringRegister(fd, IORING_REGISTER_PROBE, probe, IORING_OP_LAST) == 0;
+
+        for (uint8_t opcode : {IORING_OP_READ, IORING_OP_WRITE, IORING_OP_SEND, IORING_OP_RECV})
+            complete = complete && opcode < probe->ops_len && (probe->ops[opcode].flags & IO_URING_OP_SUPPORTED);
+
+        close(fd);
+        return complete;
+    }();
+
+    return supported;
+}
+
+bool IoEngine::setupRing()
+{
+    io_uring_params params;
+    memset(&params, 0, sizeof(params));
+
+    ring_fd = ringSetup(Storage::io_uring_depth, params);
+    if (ring_fd == -1)
+        return false;
+
+    entries = params.sq_entries;
+    sq_ring_size = params.sq_off.array + params.sq_entries * sizeof(unsigned);
+    cq_ring_size = params.cq_off.cqes + params.cq_entries * sizeof(io_uring_cqe);
+
+    // recent kernels map both rings with a single call
+    bool single_mmap = params.features & IORING_FEAT_SINGLE_MMAP;
+    if (single_mmap)
+        sq_ring_size = cq_ring_size = std::max(sq_ring_size, cq_ring_size);
+
+    sq_ring = mmap(nullptr, sq_ring_size, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, ring_fd, IORING_OFF_SQ_RING);
+    if (sq_ring != MAP_FAILED)
+        cq_ring = single_mmap ? sq_ring : mmap(nullptr, cq_ring_size, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, ring_fd, IORING_OFF_CQ_RING);
+    if (cq_ring != MAP_FAILED)
+        sqes = mmap(nullptr, params.sq_entries * sizeof(io_uring_sqe), PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, ring_fd, IORING_OFF_SQES);
+
+    if (sq_ring == MAP_FAILED || cq_ring == MAP_FAILED || sqes == MAP_FAILED)
+    {
+        teardown();
+        return false;
+    }
+
+    sq_head = ringField<unsigned>(sq_ring, params.sq_off.head);
+    sq_tail = ringField<unsigned>(sq_ring, params.sq_off.tail);
+    sq_mask = ringField<unsigned>(sq_ring, params.sq_off.ring_mask);
+    sq_array = ringField<unsigned>(sq_ring, params.sq_off.array);
+    cq_head = ringField<unsigned>(cq_ring, params.cq_off.head);
+    cq_tail = ringField<unsigned>(cq_ring, params.cq_off.tail);
+    cq_mask = ringField<unsigned>(cq_ring, params.cq_off.ring_mask);
+    cqes = ringField<void>(cq_ring, params.cq_off.cqes);
+    return true;
+}
+
+void IoEngine::prepare(Request &request)
+{
+    // never more requests in flight than completions fit in the ring
+    while (in_flight == entries)
+    {
+        enter(1);
+        reap();
+    }
+
+    unsigned tail = *sq_tail;
+    if (tail - __atomic_load_n(sq_head, __ATOMIC_ACQUIRE) == entries)
+    {
+        enter(0);
+        tail = *sq_tail;
+    }
+
+    unsigned index = tail & *sq_mask;
+    io_uring_sqe *sqe = static_cast<io_uring_sqe *>(sqes) + index;
+    memset(sqe, 0, sizeof(*sqe));
+
+    sqe->opcode = request.opcode;
+    sqe->fd = request.fd;
+    sqe->addr = reinterpret_cast<uint64_t>(request.data + request.done);
+    sqe->len = static_cast<uint32_t>(std::min<size_t>(request.length - request.done, INT_MAX));
+    sqe->user_data = reinterpret_cast<uint64_t>(&request);
+
+    if (request.opcode == IORING_OP_READ || request.opcode == IORING_OP_WRITE)
+        sqe->off = request.offset + request.done;
+    else
+        sqe->msg_flags = request.opcode == IORING_OP_SEND ? MSG_NOSIGNAL : MSG_WAITALL;
+
+    sq_array[index] = index;
+    __atomic_store_n(sq_tail, tail + 1, __ATOMIC_RELEASE);
+    queued++;
+    in_flight++;
+}
+
+void IoEngine::enter(unsigned min_complete)
+{
+    int submitted;
+    while ((submitted = ringEnter(ring_fd, queued, min_complete, min_complete ? IORING_ENTER_GETEVENTS : 0)) == -1)
+    {
+        if (errno == EINTR)
+            continue;
+        // the completion queue is full, make room and try again
+        if (errno == EBUSY || errno == EAGAIN)
+        {
+            reap();
+            continue;
+        }
+        throw std::runtime_error("io_uring_enter failed.");
+    }
+
+    queued -= std::min<unsigned>(queued, submitted);
+}
+
+void IoEngine::reap()
+{
+    unsigned head = *cq_head;
+    unsigned tail = __atomic_load_n(cq_tail, __ATOMIC_ACQUIRE);
+    std::vector<Request *> unfinished;
+
+    for (; head != tail; head++)
+    {
+        io_uring_cqe *cqe = static_cast<io_uring_cqe *>(cqes) + (head & *cq_mask);
+        Request *request = reinterpret_cast<Request *>(cqe->user_data);
+        int result = cqe->res;
+        in_flight--;
+
+        if (result == -EINTR || result == -EAGAIN)
+            unfinished.push_back(request);
+        else if (result < 0)
+            request->error = -result;
+        else if (result == 0 && request->opcode != IORING_OP_READ)
+            request->error = request->opcode == IORING_OP_RECV ? ECONNRESET : EIO;
+        else
+        {
+            // sockets and files may take less than asked, the rest goes round again
+            request->done += result;
+            if (result > 0 && request->done < request->length)
+                unfinished.push_back(request);
+        }
+
+        if (unfinished.empty() || unfinished.back() != request)
+            request->pending = false;
+    }
+
+    __atomic_store_n(cq_head, head, __ATOMIC_RELEASE);
+
+    for (Request *request : unfinished)
+        prepare(*request);
+}
+
+void IoEngine::runNow(Request &request)
+{
+    while (request.done < request.length)
+    {
+        unsigned char *data = request.data + request.done;
+        size_t length = request.length - request.done;
+        ssize_t count = -1;
+
+        if (request.opcode == IORING_OP_READ)
+            count = pread(request.fd, data, length, request.offset + request.done);
+        else if (request.opcode == IORING_OP_WRITE)
+            count = pwrite(request.fd, data, length, request.offset + request.done);
+        else if (request.opcode == IORING_OP_SEND)
+            count = ::send(request.fd, data, length, MSG_NOSIGNAL);
+        else
+            count = ::recv(request.fd, data, length, MSG_WAITALL);
+
+        if (count == -1 && errno == EINTR)
+            continue;
+        if (count == -1)
+            request.error = errno;
+        else if (count == 0 && request.opcode != IORING_OP_READ)
+            request.error = request.opcode == IORING_OP_RECV ? ECONNRESET : EIO;
+        if (count <= 0)
+            break;
+
+        request.done += count;
+    }
+
+    request.pending = false;
+}
+
+void IoEngine::queue(Request &request, uint8_t opcode, int fd, unsigned char *data, size_t length, uint64_t offset)
+{
+    request.opcode = opcode;
+    request.fd = fd;
+    request.data = data;
+    request.length = length;
+    request.offset = offset;
+    request.done = 0;
+    request.error = 0;
+    request.pending = true;
+
+    if (usesRing())
+        prepare(request);
+    else
+        runNow(request);
+}
+
+void IoEngine::read(Request &request, int fd, void *data, size_t length, uint64_t offset)
+{
+    queue(request, IORING_OP_READ, fd, static_cast<unsigned char *>(data), length, offset);
+}
+
+void IoEngine::write(Request &request, int fd, const void *data, size_t length, uint64_t offset)
+{
+    queue(request, IORING_OP_WRITE, fd, static_cast<unsigned char *>(const_cast<void *>(data)), length, offset);
+}
+
+void IoEngine::send(Request &request, int socket, const void *data, size_t length)
+{
+    queue(request, IORING_OP_SEND, socket, static_cast<unsigned char *>(const_cast<void *>(data)), length, 0);
+}
+
+void IoEngine::recv(Request &request, int socket, void *data, size_t length)
+{
+    queue(request, IORING_OP_RECV, socket, static_cast<unsigned char *>(data), length, 0);
+}
+
+void IoEngine::submit()
+{
+    if (usesRing() && queued > 0)
+        enter(0);
+}
+
+bool IoEngine::wait(Request &request)
+{
+    while (request.pending)
+    {
+        enter(1);
+        reap();
+    }
+
+    return request.error == 0;
+}
+
+void IoEngine::teardown()
+{
+    if (sqes != MAP_FAILED)
+        munmap(sqes, entries * sizeof(io_uring_sqe));
+    if (cq_ring != MAP_FAILED && cq_ring != sq_ring)
+        munmap(cq_ring, cq_ring_size);
+    if (sq_ring != MAP_FAILED)
+        munmap(sq_ring, sq_ring_size);
+    if (ring_fd != -1)
+        close(ring_fd);
+
+    ring_fd = -1;
+    sq_ring = cq_ring = sqes = MAP_FAILED;
+}
+
+IoEngine::~IoEngine()
+{
+    teardown();
+}
+
+// ----------------------------------- FRAME SENDER ------------------------------------
+
+FrameSender::FrameSender(IoEngine &engine, int socket) : engine(engine), socket(socket), current(0), failed(false)
+{
+    batches[0].reserve(Storage::io_send_batch + MAX::max_file_chunk);
+    batches[1].reserve(Storage::io_send_batch + MAX::max_file_chunk);
+}
+
+bool FrameSender::push(const Buffer &frame)
+{
+    if (failed)
+        return false;
+
+    // same layout sendFrame puts on the wire: the size_t length, then the frame
+    Buffer &batch = batches[current];
+    size_t frame_size = frame.size();
+    const unsigned char *length = reinterpret_cast<const unsigned char *>(&frame_size);
+    batch.insert(batch.end(), length, length + sizeof(frame_size));
+    batch.insert(batch.end(), frame.begin(), frame.end());
+
+    if (batch.size() >= Storage::io_send_batch)
+        return sendCurrent();
+
+    return true;
+}
+
+bool FrameSender::sendCurrent()
+{
+    if (failed || batches[current].empty())
+        return !failed;
+
+    engine.send(requests[current], socket, batches[current].data(), batches[current].size());
+    engine.submit();
+    current ^= 1;
+
+    // the other batch is refilled once the socket took it
+    if (!engine.wait(requests[current]))
+    {
+        std::cerr << "[IO] Error sending data: " << strerror(requests[current].error) << std::endl;
+        failed = true;
+    }
+
+    batches[current].clear();
+    return !failed;
+}
+
+bool FrameSender::flush()
+{
+    sendCurrent();
+
+    for (IoEngine::Request &request : requests)
+        if (!engine.wait(request) && !failed)
+        {
+            std::cerr << "[IO] Error sending data: " << strerror(request.error) << std::endl;
+            failed = true;
+        }
+
+    return !failed;
+}
+
+FrameSender::~FrameSender()
+{
+    // the kernel may still be reading from the batches
+    try
+    {
+        for (IoEngine::Request &request : requests)
+            engine.wait(request);
+    }
+    catch (const std::exception &e)
+    {
+    }
+}
+
+// ----------------------------------- BLOCK READER ------------------------------------
+
+BlockReader::BlockReader(IoEngine &engine, size_t depth) : engine(engine), depth(std::max<size_t>(depth, 1)), fd(-1), direct(false), size(0),
+                                                           block_offset(0), current(0), position(0), length(0), started(false)
+{
+    stats.depth = this->depth;
+}
+
+void BlockReader::open(const std::string &path)
+{
+    int opened = ::open(path.c_str(), O_RDONLY | O_CLOEXEC);
+    if (opened == -1)
+        throw std::invalid_argument("File does not exist.");
+
+    adopt(opened);
+}
+
+void BlockReader::adopt(int fd)
+{
+    this->fd = fd;
+
+    struct stat info;
+    if (fstat(fd, &info) != 0 || !S_ISREG(info.st_mode))
+        throw std::invalid_argument("File does not exist.");
+
+    // the descriptor is switched to O_DIRECT once the size is known, no second lookup of the name
+    size = info.st_size;
+    if (size >= Storage::direct_io_threshold)
+        enableDirect(fd, direct);
+
+    if (!direct)
+        posix_fadvise(fd, 0, 0, POSIX_FADV_SEQUENTIAL);
+
+    // the current block and the ones ahead of it are asked for together
+    requests = std::vector<IoEngine::Request>(depth + 1);
+    for (size_t slot = 0; slot <= depth; slot++)
+    {
+        blocks.push_back(AlignedBufferPool::instance().acquire());
+        request(slot, slot * Storage::direct_io_block);
+    }
+    engine.submit();
+}
+
+void BlockReader::request(size_t slot, uintmax_t offset)
+{
+    requests[slot] = IoEngine::Request();
+    if (offset >= size)
+        return;
+
+    if (engine.usesRing())
+        engine.read(requests[slot], fd, blocks[slot].get(), Storage::direct_io_block, offset);
+    else if (!direct)
+        posix_fadvise(fd, offset, Storage::direct_io_block, POSIX_FADV_WILLNEED);
+}
+
+bool BlockReader::advance()
+{
+    // the consumed block makes room for the one depth blocks further
+    if (started)
+    {
+        request(current, block_offset + (depth + 1) * Storage::direct_io_block);
+        engine.submit();
+        current = (current + 1) % (depth + 1);
+        block_offset += Storage::direct_io_block;
+    }
+    started = true;
+
+    if (block_offset >= size)
+        return false;
+
+    IoEngine::Request &block_request = requests[current];
+
+    // a block never queued is read now, one still in flight is waited for
+    if (block_request.length == 0)
+        engine.read(block_request, fd, blocks[current].get(), Storage::direct_io_block, block_offset);
+    else if (block_request.pending)
+    {
+        auto start = std::chrono::steady_clock::now();
+        engine.wait(block_request);
+        stats.wait_ms += std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+        stats.waited++;
+    }
+    else
+        stats.ready++;
+
+    // a filesystem may accept O_DIRECT at open time and refuse the transfer
+    if (!engine.wait(block_request) && block_request.error == EINVAL)
+    {
+        dropDirect(fd, direct);
+        engine.read(block_request, fd, blocks[current].get(), Storage::direct_io_block, block_offset);
+        engine.wait(block_request);
+    }
+
+    if (block_request.error != 0)
+        return false;
+
+    stats.blocks++;
+    position = 0;
+    length = block_request.done;
+    return length > 0;
+}
+
+Buffer BlockReader::readChunk(size_t chunk_size)
+{
+    Buffer chunk;
+    chunk.reserve(chunk_size);
+
+    while (chunk.size() < chunk_size)
+    {
+        if (position == length && !advance())
+            throw std::runtime_error("Unable to read from file.");
+
+        size_t take = std::min(chunk_size - chunk.size(), length - position);
+        chunk.insert(chunk.end(), blocks[current].get() + position, blocks[current].get() + position + take);
+        position += take;
+    }
+
+    return chunk;
+}
+
+void BlockReader::printStats(const std::string &tag) const
+{
+    if (fd == -1)
+        return;
+
+    std::cout << tag << " Read-ahead: depth " << stats.depth << ", " << stats.blocks << " blocks";
+    if (engine.usesRing())
+        std::cout << ", " << stats.ready << " ready, " << stats.waited << " waited for (" << std::fixed << std::setprecision(2) << stats.wait_ms << " ms)" << std::defaultfloat;
+    else
+        std::cout << " (kernel read-ahead)";
+    std::cout << std::endl;
+}
+
+BlockReader::~BlockReader()
+{
+    // the blocks go back to the pool only once the kernel is done with them
+    try
+    {
+        for (IoEngine::Request &request : requests)
+            engine.wait(request);
+    }
+    catch (const std::exception &e)
+    {
+    }
+
+    if (fd != -1)
+        close(fd);
+}
@@ -0,0 +1,154 @@
+#ifndef IO_ENGINE_H
+#define IO_ENGINE_H
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <vector>
+#include "direct_io.h"
+#include "constants.h"
+
+typedef std::vector<unsigned char> Buffer;
+
+// ----------------------------------- IO ENGINE ------------------------------------
+
+// Per session queue of file and socket operations. On kernels offering io_uring the
+// operations are handed over together and run while the worker goes on with its job;
+// otherwise (or with Storage::io_uring off) each one runs synchronously when queued.
+class IoEngine
+{
+public:
+    // Must stay in place until wait() returned for it
+    struct Request
+    {
+        uint8_t opcode = 0;
+        int fd = -1;
+        unsigned char *data = nullptr;
+        size_t length = 0;
+        uint64_t offset = 0;
+        size_t done = 0; // bytes transferred so far
+        int error = 0;   // errno of the failure, 0 on success
+        bool pending = false;
+    };
+
+private:
+    int ring_fd;
+    unsigned entries;
+    unsigned queued; // prepared but not yet handed to the kernel
+    unsigned in_flight;
+
+    void *sq_ring;
+    void *cq_ring;
+    size_t sq_ring_size;
+    size_t cq_ring_size;
+    void *sqes;
+    unsigned *sq_head, *sq_tail, *sq_mask, *sq_array;
+    unsigned *cq_head, *cq_tail, *cq_mask;
+    void *cqes;
+
+    bool setupRing();
+    void teardown();
+    void prepare(Request &request);
+    void enter(unsigned min_complete);
+    void reap();
+    void runNow(Request &request);
+    void queue(Request &request, uint8_t opcode, int fd, unsigned char *data, size_t length, uint64_t offset);
+
+public:
+    IoEngine();
+    IoEngine(const IoEngine &) = delete;
+    IoEngine &operator=(const IoEngine &) = delete;
+
+    // Whether the running kernel offers every operation the engine needs, probed once
+    static bool available();
+    bool usesRing() const { return ring_fd != -1; }
+
+    // a read may come back short at the end of the file
+    void read(Request &request, int fd, void *data, size_t length, uint64_t offset);
+    void write(Request &request, int fd, const void *data, size_t length, uint64_t offset);
+    void send(Request &request, int socket, const void *data, size_t length);
+    void recv(Request &request, int socket, void *data, size_t length);
+
+    // Hands whatever was queued to the kernel without waiting
+    void submit();
+    // Blocks until request completed, true when it did so without error
+    bool wait(Request &request);
+
+    ~IoEngine();
+};
+
+// ----------------------------------- FRAME SENDER ------------------------------------
+
+// Gathers length prefixed frames (the sendFrame format) into large batches and sends
+// them through the engine, the next batch is filled while the previous one is on the wire
+class FrameSender
+{
+private:
+    IoEngine &engine;
+    int socket;
+    Buffer batches[2];
+    IoEngine::Request requests[2];
+    size_t current;
+    bool failed;
+
+    bool sendCurrent();
+
+public:
+    FrameSender(IoEngine &engine, int socket);
+    bool push(const Buffer &frame);
+    // Sends what is left and waits for the socket to take everything
+    bool flush();
+    ~FrameSender();
+};
+
+// ----------------------------------- BLOCK READER ------------------------------------
+
+// Reads a plain file in Storage::direct_io_block sized blocks while the next depth blocks
+// are already requested, so the disk works while the current block is encoded and sent.
+// Without a ring the kernel is asked to prefetch them (posix_fadvise) and they are read
+// when reached.
+class BlockReader
+{
+public:
+    struct Stats
+    {
+        size_t depth = 0;
+        size_t blocks = 0;  // blocks consumed
+        size_t ready = 0;   // already read when they were reached
+        size_t waited = 0;  // still in flight when they were reached
+        double wait_ms = 0; // time spent waiting on those
+    };
+
+private:
+    IoEngine &engine;
+    size_t depth;
+    int fd;
+    bool direct;
+    uintmax_t size;
+    uintmax_t block_offset; // file offset of the current block
+    std::vector<AlignedBufferPool::Block> blocks;
+    std::vector<IoEngine::Request> requests; // one per block, never resized once open
+    size_t current;
+    size_t position; // inside the current block
+    size_t length;   // valid bytes of the current block
+    bool started;
+    Stats stats;
+
+    void request(size_t slot, uintmax_t offset);
+    bool advance();
+
+public:
+    BlockReader(IoEngine &engine, size_t depth = Storage::read_ahead_depth);
+    BlockReader(const BlockReader &) = delete;
+    BlockReader &operator=(const BlockReader &) = delete;
+    void open(const std::string &path);
+    // Reads the file fd is open on, the descriptor is taken over
+    void adopt(int fd);
+    Buffer readChunk(size_t chunk_size);
+    uintmax_t getFileSize() const { return size; }
+    const Stats &getStats() const { return stats; }
+    void printStats(const std::string &tag) const;
+    ~BlockReader();
+};
+
+#endif // IO_ENGINE_H
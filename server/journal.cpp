@@ -0,0 +1,277 @@
+#include "journal.h"
+#include "constants.h"
+#include "../tools/fingerprint.h"
+#include <algorithm>
+#include <cerrno>
+#include <chrono>
+#include <cstdio>
+#include <cstring>
+#include <fcntl.h>
+#include <iostream>
+#include <sys/stat.h>
+#include <thread>
+#include <unistd.h>
+
+namespace
+{
+    const char JOURNAL_MAGIC[8] = {'F', 'O', 'C', 'J', 'R', 'N', 'L', '1'};
+    const size_t CHECKSUM_LENGTH = 4; // truncated SHA-256, only meant to catch torn writes
+
+    void appendUint64(Buffer &data, uint64_t value)
+    {
+        for (int shift = 56; shift >= 0; shift -= 8)
+            data.push_back(static_cast<unsigned char>(value >> shift));
+    }
+
+    uint64_t decodeUint64(const unsigned char *data)
+    {
+        uint64_t value = 0;
+        for (size_t i = 0; i < sizeof(uint64_t); i++)
+            value = (value << 8) | data[i];
+        return value;
+    }
+
+    // seq | length | payload | checksum
+    void encodeEntry(Buffer &output, uint64_t seq, const Buffer &payload)
+    {
+        size_t start = output.size();
+        appendUint64(output, seq);
+        appendUint64(output, payload.size());
+        output.insert(output.end(), payload.begin(), payload.end());
+
+        Fingerprint::Digest checksum = Fingerprint::sha256(Buffer(output.begin() + start, output.end()));
+        output.insert(output.end(), checksum.begin(), checksum.begin() + CHECKSUM_LENGTH);
+    }
+
+    // Complete entry at position, false at a torn or corrupted one
+    bool decodeEntry(const Buffer &data, size_t &position, uint64_t &seq, Buffer &payload)
+    {
+        const size_t header = 2 * sizeof(uint64_t);
+        if (data.size() - position < header + CHECKSUM_LENGTH)
+            return false;
+
+        seq = decodeUint64(data.data() + position);
+        uint64_t length = decodeUint64(data.data() + position + sizeof(uint64_t));
+        if (length > data.size() - position - header - CHECKSUM_LENGTH)
+            return false;
+
+        size_t body = header + length;
+        Fingerprint::Digest checksum = Fingerprint::sha256(Buffer(data.begin() + position, data.begin() + position + body));
+        if (memcmp(checksum.data(), data.data() + position + body, CHECKSUM_LENGTH) != 0)
+            return false;
+
+        payload.assign(data.begin() + position + header, data.begin() + position + body);
+        position += body + CHECKSUM_LENGTH;
+        return true;
+    }
+
+    bool writeAll(int fd, const Buffer &data, uint64_t offset)
+    {
+        for (size_t done = 0; done < data.size();)
+        {
+            ssize_t count = pwrite(fd, data.data() + done, data.size() - done, offset + done);
+            if (count == -1 && errno == EINTR)
+                continue;
+            if (count <= 0)
+                return false;
+            done += count;
+        }
+        return true;
+    }
+
+    bool readAll(int fd, Buffer &data, uint64_t length)
+    {
+        data.resize(length);
+        for (size_t done = 0; done < length;)
+        {
+            ssize_t count = pread(fd, data.data() + done, length - done, done);
+            if (count == -1 && errno == EINTR)
+                continue;
+            if (count <= 0)
+                return false;
+            done += count;
+        }
+        return true;
+    }
+}
+
+Journal::Journal(const std::string &path) : path(path), fd(-1), end(0), commits(0)
+{
+    // numbers drawn from the wall clock keep growing across restarts, even after the journal is lost
+    last_seq = std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::system_clock::now().time_since_epoch()).count();
+
+    fd = open(path.c_str(), O_RDWR | O_CREAT | O_CLOEXEC, 0644);
+    struct stat info;
+    if (fd == -1 || fstat(fd, &info) != 0)
+        std::cerr << "[JOURNAL] Unable to open " << path << ", changes are not journaled" << std::endl;
+    else if (static_cast<uint64_t>(info.st_size) < sizeof(JOURNAL_MAGIC))
+    {
+        Buffer magic(JOURNAL_MAGIC, JOURNAL_MAGIC + sizeof(JOURNAL_MAGIC));
+        if (ftruncate(fd, 0) != 0 || !writeAll(fd, magic, 0) || fdatasync(fd) != 0)
+            std::cerr << "[JOURNAL] Unable to write " << path << std::endl;
+        end = magic.size();
+    }
+    else
+        end = info.st_size;
+
+    std::thread(&Journal::commitGroups, this).detach();
+}
+
+Journal &Journal::instance()
+{
+    // never destroyed, its thread keeps running until the process exits
+    static Journal *journal = new Journal(Storage::journal);
+    return *journal;
+}
+
+uint64_t Journal::append(const Buffer &payload)
+{
+    std::lock_guard<std::mutex> lock(mutex);
+    encodeEntry(pending, ++last_seq, payload);
+    return last_seq;
+}
+
+uint64_t Journal::lastSeq()
+{
+    std::lock_guard<std::mutex> lock(mutex);
+    return last_seq;
+}
+
+uint64_t Journal::size()
+{
+    std::lock_guard<std::mutex> lock(mutex);
+    return end + pending.size();
+}
+
+bool Journal::writePending()
+{
+    std::lock_guard<std::mutex> file_lock(file_mutex);
+
+    Buffer batch;
+    uint64_t offset;
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        batch.swap(pending);
+        offset = end;
+    }
+
+    if (batch.empty())
+        return true;
+
+    // a lost group only costs the indexes it touched a rebuild on the next start
+    bool written = fd != -1 && writeAll(fd, batch, offset) && fdatasync(fd) == 0;
+    if (!written)
+    {
+        std::cerr << "[JOURNAL] Unable to write " << batch.size() << "B to " << path << std::endl;
+        if (fd != -1 && ftruncate(fd, offset) != 0)
+            std::cerr << "[JOURNAL] Unable to truncate " << path << std::endl;
+        return false;
+    }
+
+    std::lock_guard<std::mutex> lock(mutex);
+    end += batch.size();
+    return true;
+}
+
+void Journal::commitGroups()
+{
+    while (true)
+    {
+        std::this_thread::sleep_for(std::chrono::milliseconds(Storage::journal_commit_ms));
+
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            if (pending.empty())
+                continue;
+        }
+
+        writePending();
+
+        // a line every so often is enough to see the journal at work
+        if (++commits % 100 == 0)
+            std::cout << "[JOURNAL] " << commits << " group commits" << std::endl;
+    }
+}
+
+void Journal::replay(const std::function<void(uint64_t, const Buffer &)> &apply)
+{
+    std::lock_guard<std::mutex> file_lock(file_mutex);
+
+    Buffer data;
+    if (fd == -1 || !readAll(fd, data, end) || data.size() < sizeof(JOURNAL_MAGIC) ||
+        memcmp(data.data(), JOURNAL_MAGIC, sizeof(JOURNAL_MAGIC)) != 0)
+        return;
+
+    size_t position = sizeof(JOURNAL_MAGIC);
+    uint64_t seq;
+    Buffer payload;
+    while (decodeEntry(data, position, seq, payload))
+    {
+        apply(seq, payload);
+
+        std::lock_guard<std::mutex> lock(mutex);
+        last_seq = std::max(last_seq, seq);
+    }
+
+    if (position < data.size())
+    {
+        std::cerr << "[JOURNAL] Dropped " << data.size() - position << "B after the last complete entry" << std::endl;
+        if (ftruncate(fd, position) != 0)
+            std::cerr << "[JOURNAL] Unable to truncate " << path << std::endl;
+
+        std::lock_guard<std::mutex> lock(mutex);
+        end = position;
+    }
+}
+
+void Journal::truncate(uint64_t seq)
+{
+    std::lock_guard<std::mutex> file_lock(file_mutex);
+    if (fd == -1)
+        return;
+
+    // what is still pending goes along with the entries kept
+    Buffer data, batch;
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        batch.swap(pending);
+    }
+    if (!readAll(fd, data, end))
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        batch.insert(batch.end(), pending.begin(), pending.end());
+        pending.swap(batch);
+        return;
+    }
+    data.insert(data.end(), batch.begin(), batch.end());
+
+    Buffer kept(JOURNAL_MAGIC, JOURNAL_MAGIC + sizeof(JOURNAL_MAGIC));
+    size_t position = sizeof(JOURNAL_MAGIC);
+    uint64_t entry_seq;
+    Buffer payload;
+    while (decodeEntry(data, position, entry_seq, payload))
+        if (entry_seq > seq)
+            encodeEntry(kept, entry_seq, payload);
+
+    // a journal lost halfway through is only replayed again, the indexes skip what they hold
+    std::string temp_path = path + ".tmp";
+    int temp_fd = open(temp_path.c_str(), O_RDWR | O_CREAT | O_TRUNC | O_CLOEXEC, 0644);
+    if (temp_fd == -1 || !writeAll(temp_fd, kept, 0) || fdatasync(temp_fd) != 0 || std::rename(temp_path.c_str(), path.c_str()) != 0)
+    {
+        std::cerr << "[JOURNAL] Unable to truncate " << path << std::endl;
+        if (temp_fd != -1)
+            close(temp_fd);
+        unlink(temp_path.c_str());
+
+        std::lock_guard<std::mutex> lock(mutex);
+        batch.insert(batch.end(), pending.begin(), pending.end());
+        pending.swap(batch);
+        return;
+    }
+
+    close(fd);
+    fd = temp_fd;
+
+    std::lock_guard<std::mutex> lock(mutex);
+    end = kept.size();
+}
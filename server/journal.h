@@ -0,0 +1,52 @@
+#ifndef JOURNAL_H
+#define JOURNAL_H
+
+#include <cstdint>
+#include <functional>
+#include <mutex>
+#include <string>
+#include <vector>
+
+typedef std::vector<unsigned char> Buffer;
+
+// ----------------------------------- JOURNAL ------------------------------------
+
+// Write-ahead log shared by every session. Appending only copies the entry into memory;
+// a background thread writes whatever gathered every Storage::journal_commit_ms and flushes
+// it with a single fdatasync, so a change is on disk at most one interval later whatever
+// the number of sessions. Entries are numbered in append order, with numbers that keep
+// growing across restarts; each one carries a checksum and a torn tail is dropped on replay.
+class Journal
+{
+private:
+    std::string path;
+    int fd;
+    uint64_t end; // length of the file, pending entries excluded
+
+    std::mutex mutex;
+    Buffer pending;
+    uint64_t last_seq; // of the last entry appended
+    uint64_t commits;
+
+    std::mutex file_mutex; // held while the file is written, so truncate() can replace it
+
+    Journal(const std::string &path);
+    void commitGroups();
+    bool writePending();
+
+public:
+    static Journal &instance();
+
+    // Number of the entry
+    uint64_t append(const Buffer &payload);
+    uint64_t lastSeq();
+    // Bytes in the journal, pending entries included
+    uint64_t size();
+
+    // Hands every complete entry over in order, meant for startup before anything is appended
+    void replay(const std::function<void(uint64_t, const Buffer &)> &apply);
+    // Drops the entries up to seq, once what they describe is durable elsewhere
+    void truncate(uint64_t seq);
+};
+
+#endif // JOURNAL_H
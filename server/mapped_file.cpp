@@ -0,0 +1,108 @@
+#include "mapped_file.h"
+#include "constants.h"
+#include <fcntl.h>
+#include <iostream>
+#include <stdexcept>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+MappedFile::MappedFile() : fd(-1), data(nullptr), size(0), position(0), dropped(0), dropped_bytes(0)
+{
+}
+
+void MappedFile::open(const std::string &path)
+{
+    int opened = ::open(path.c_str(), O_RDONLY | O_CLOEXEC);
+    if (opened == -1)
+        throw std::runtime_error("Unable to open file.");
+
+    adopt(opened);
+}
+
+void MappedFile::adopt(int fd)
+{
+    close();
+    this->fd = fd;
+
+    struct stat info;
+    if (fstat(fd, &info) != 0 || !S_ISREG(info.st_mode))
+    {
+        close();
+        throw std::runtime_error("Unable to open file.");
+    }
+    size = info.st_size;
+
+    // nothing to map, next() is never called for an empty file
+    if (size == 0)
+        return;
+
+    void *mapping = mmap(nullptr, size, PROT_READ, MAP_SHARED, fd, 0);
+    if (mapping == MAP_FAILED)
+    {
+        close();
+        throw std::runtime_error("Unable to map file.");
+    }
+    data = static_cast<unsigned char *>(mapping);
+
+    // the file is read once front to back: aggressive read-ahead, pages freed early
+    madvise(data, size, MADV_SEQUENTIAL);
+}
+
+const unsigned char *MappedFile::next(size_t chunk_size)
+{
+    if (data == nullptr || chunk_size > size - position)
+        throw std::runtime_error("Unable to read file.");
+
+    // everything before position was encoded already
+    if (position - dropped >= Storage::mmap_drop_behind)
+        dropBehind();
+
+    const unsigned char *chunk = data + position;
+    position += chunk_size;
+    return chunk;
+}
+
+void MappedFile::dropBehind()
+{
+    static const uintmax_t page_size = sysconf(_SC_PAGESIZE);
+    uintmax_t end = position / page_size * page_size;
+    if (end <= dropped)
+        return;
+
+    // the mapping lets go of the pages, the page cache follows (both are only hints)
+    madvise(data + dropped, end - dropped, MADV_DONTNEED);
+    posix_fadvise(fd, dropped, end - dropped, POSIX_FADV_DONTNEED);
+
+    dropped_bytes += end - dropped;
+    dropped = end;
+}
+
+void MappedFile::printStats(const std::string &tag) const
+{
+    if (fd == -1)
+        return;
+
+    std::cout << tag << " Mapped " << size << "B, " << dropped_bytes << "B dropped behind the transfer" << std::endl;
+}
+
+void MappedFile::close()
+{
+    if (data != nullptr)
+        munmap(data, size);
+    data = nullptr;
+
+    if (fd != -1)
+        ::close(fd);
+    fd = -1;
+
+    size = 0;
+    position = 0;
+    dropped = 0;
+    dropped_bytes = 0;
+}
+
+MappedFile::~MappedFile()
+{
+    close();
+}
@@ -0,0 +1,42 @@
+#ifndef MAPPED_FILE_H
+#define MAPPED_FILE_H
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+
+// ----------------------------------- MAPPED FILE ------------------------------------
+
+// Read only mapping of a plain file for downloads: chunks are encoded straight from the
+// page cache instead of being copied into a buffer first. The pages the download has moved
+// past are dropped every Storage::mmap_drop_behind bytes so a large file doesn't stay resident.
+class MappedFile
+{
+private:
+    int fd;
+    unsigned char *data;
+    uintmax_t size;
+    uintmax_t position;
+    uintmax_t dropped; // everything below was given back already
+    uintmax_t dropped_bytes;
+
+    void dropBehind();
+
+public:
+    MappedFile();
+    MappedFile(const MappedFile &) = delete;
+    MappedFile &operator=(const MappedFile &) = delete;
+
+    void open(const std::string &path);
+    // Maps the file fd is open on, the descriptor is taken over
+    void adopt(int fd);
+    bool isOpen() const { return data != nullptr; }
+    // Pointer to the next chunk_size bytes, valid until the following call
+    const unsigned char *next(size_t chunk_size);
+    uintmax_t getFileSize() const { return size; }
+    void printStats(const std::string &tag) const;
+    void close();
+    ~MappedFile();
+};
+
+#endif // MAPPED_FILE_H
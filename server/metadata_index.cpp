@@ -0,0 +1,675 @@
+#include "metadata_index.h"
+#include "chunk_store.h"
+#include "compressed_file.h"
+#include "storage_backend.h"
+#include "journal.h"
+#include "version_store.h"
+#include "constants.h"
+#include "../tools/file.h"
+#include "../tools/fingerprint.h"
+#include <algorithm>
+#include <chrono>
+#include <cstring>
+#include <fcntl.h>
+#include <filesystem>
+#include <fstream>
+#include <iostream>
+#include <iterator>
+#include <openssl/rand.h>
+#include <thread>
+#include <unistd.h>
+
+namespace fs = std::filesystem;
+
+namespace
+{
+    const char INDEX_MAGIC[8] = {'F', 'O', 'C', 'I', 'D', 'X', '0', '5'};
+    const uint8_t RECORD_PUT = 1;
+    const uint8_t RECORD_DELETE = 2;
+    const uint8_t RECORD_STAMP = 3;
+    const size_t CHECKSUM_LENGTH = 4; // truncated SHA-256, only meant to catch torn writes
+    const size_t COMPACT_SLACK = 64;  // superseded records tolerated before rewriting the log
+
+    int64_t folderStamp(const std::string &user)
+    {
+        return StorageBackend::instance().stamp(user);
+    }
+
+    bool metadataOf(const std::string &user, const std::string &name, FileMetadata &metadata)
+    {
+        StorageBackend &backend = StorageBackend::instance();
+        FileStat info;
+        if (!backend.stat(user, name, info))
+            return false;
+
+        metadata.size = info.size;
+        metadata.stored = info.size;
+        metadata.mtime = info.mtime;
+        metadata.accessed = info.mtime;
+        metadata.digest.clear();
+        metadata.version = 0;
+
+        std::string path = backend.path(user, name);
+        try
+        {
+            Recipe recipe;
+            if (backend.isLocal() && recipe.load(path))
+            {
+                metadata.size = recipe.logical_size;
+                metadata.digest = recipe.file_digest;
+                return true;
+            }
+
+            // files compressed at rest announce their logical size in the header
+            uintmax_t logical_size;
+            std::unique_ptr<std::istream> stream = backend.openRead(user, name);
+            if (CompressedStream::probe(*stream, logical_size))
+                metadata.size = logical_size;
+        }
+        catch (const std::exception &e)
+        {
+            std::cerr << "[INDEX] " << path << ": " << e.what() << std::endl;
+        }
+        return true;
+    }
+
+    void appendUint64(Buffer &data, uint64_t value)
+    {
+        for (int shift = 56; shift >= 0; shift -= 8)
+            data.push_back(static_cast<unsigned char>(value >> shift));
+    }
+
+    bool readUint64(const Buffer &data, size_t &position, uint64_t &value)
+    {
+        if (data.size() - position < sizeof(uint64_t))
+            return false;
+
+        value = 0;
+        for (size_t i = 0; i < sizeof(uint64_t); i++)
+            value = (value << 8) | data[position++];
+        return true;
+    }
+
+    void appendString(Buffer &data, const std::string &value)
+    {
+        data.push_back(static_cast<unsigned char>(value.size()));
+        data.insert(data.end(), value.begin(), value.end());
+    }
+
+    bool readString(const Buffer &data, size_t &position, std::string &value)
+    {
+        if (position >= data.size() || data.size() - position - 1 < data[position])
+            return false;
+
+        size_t length = data[position++];
+        value.assign(data.begin() + position, data.begin() + position + length);
+        position += length;
+        return true;
+    }
+
+    // type | folder stamp | folder generation | name | size | stored size | mtime | access time | version | digest | checksum
+    Buffer encodeRecord(uint8_t type, int64_t stamp, uint64_t generation, const std::string &name, const FileMetadata *metadata)
+    {
+        Buffer record;
+        record.push_back(type);
+        appendUint64(record, stamp);
+        appendUint64(record, generation);
+        appendString(record, name);
+        appendUint64(record, metadata ? metadata->size : 0);
+        appendUint64(record, metadata ? metadata->stored : 0);
+        appendUint64(record, metadata ? metadata->mtime : 0);
+        appendUint64(record, metadata ? metadata->accessed : 0);
+        appendUint64(record, metadata ? metadata->version : 0);
+        appendString(record, metadata ? metadata->digest : "");
+
+        Fingerprint::Digest checksum = Fingerprint::sha256(record);
+        record.insert(record.end(), checksum.begin(), checksum.begin() + CHECKSUM_LENGTH);
+        return record;
+    }
+}
+
+MetadataIndex::MetadataIndex(const std::string &root) : root(root), checkpointing(false) {}
+
+MetadataIndex &MetadataIndex::instance()
+{
+    static MetadataIndex index(Storage::metadata_index);
+    return index;
+}
+
+MetadataIndex::UserIndex &MetadataIndex::userIndex(const std::string &user)
+{
+    std::lock_guard<std::mutex> lock(mutex);
+
+    std::unique_ptr<UserIndex> &index = users[user];
+    if (!index)
+        index.reset(new UserIndex());
+    return *index;
+}
+
+std::string MetadataIndex::indexPath(const std::string &user) const
+{
+    return root + "/" + user;
+}
+
+void MetadataIndex::load(const std::string &user, UserIndex &index)
+{
+    if (index.loaded)
+        return;
+    index.loaded = true;
+
+    std::ifstream input(indexPath(user), std::ios::binary);
+    Buffer data;
+    if (input)
+        data.assign(std::istreambuf_iterator<char>(input), std::istreambuf_iterator<char>());
+
+    size_t position = sizeof(INDEX_MAGIC);
+    uint64_t epoch = 0, journal_seq = 0;
+
+    if (data.size() < sizeof(INDEX_MAGIC) || memcmp(data.data(), INDEX_MAGIC, sizeof(INDEX_MAGIC)) != 0 ||
+        !readUint64(data, position, epoch) || !readUint64(data, position, journal_seq))
+    {
+        rebuild(user, index);
+        return;
+    }
+
+    // replay the log up to the first torn or corrupted record
+    index.epoch = epoch;
+    index.journal_seq = journal_seq;
+    size_t valid_end = position;
+    int64_t last_stamp = -2;
+    size_t records = 0;
+
+    while (position < data.size())
+    {
+        size_t start = position;
+        uint8_t type = data[position++];
+        uint64_t stamp, generation, size, stored, mtime, accessed, version;
+        std::string name, digest;
+
+        if (!readUint64(data, position, stamp) || !readUint64(data, position, generation) ||
+            !readString(data, position, name) || !readUint64(data, position, size) ||
+            !readUint64(data, position, stored) || !readUint64(data, position, mtime) ||
+            !readUint64(data, position, accessed) || !readUint64(data, position, version) ||
+            !readString(data, position, digest) || data.size() - position < CHECKSUM_LENGTH)
+            break;
+
+        Fingerprint::Digest checksum = Fingerprint::sha256(Buffer(data.begin() + start, data.begin() + position));
+        if (memcmp(checksum.data(), data.data() + position, CHECKSUM_LENGTH) != 0)
+            break;
+        position += CHECKSUM_LENGTH;
+
+        if (type == RECORD_PUT)
+            putFile(index, name, {size, stored, static_cast<int64_t>(mtime), static_cast<int64_t>(accessed), digest, version});
+        else if (type == RECORD_DELETE)
+            eraseFile(index, name);
+
+        index.generation = std::max(index.generation, generation);
+        last_stamp = static_cast<int64_t>(stamp);
+        valid_end = position;
+        records++;
+    }
+
+    // the folder changed after the last record made it to disk
+    if (last_stamp != folderStamp(user))
+    {
+        rebuild(user, index);
+        return;
+    }
+
+    if (valid_end < data.size())
+        fs::resize_file(indexPath(user), valid_end);
+    index.log_records = records;
+}
+
+void MetadataIndex::rebuild(const std::string &user, UserIndex &index)
+{
+    index.files.clear();
+    index.used = 0;
+    index.log_records = 0;
+    index.generation = 1;
+
+    // tags handed out before the rebuild must never match the new versions
+    if (RAND_bytes(reinterpret_cast<unsigned char *>(&index.epoch), sizeof(index.epoch)) != 1)
+        throw std::runtime_error("Unable to draw an index epoch.");
+
+    if (folderStamp(user) < 0)
+        return;
+
+    for (const std::string &name : StorageBackend::instance().list(user))
+    {
+        FileMetadata metadata;
+        if (metadataOf(user, name, metadata))
+        {
+            metadata.version = index.generation;
+            putFile(index, name, metadata);
+        }
+    }
+
+    std::cout << "[INDEX] Rebuilt the metadata of " << user << ": " << index.files.size() << " files" << std::endl;
+    compact(user, index);
+}
+
+bool MetadataIndex::compact(const std::string &user, UserIndex &index)
+{
+    int64_t stamp = folderStamp(user);
+    if (stamp < 0)
+        return true;
+
+    // MAGIC | epoch | last journal entry held | records
+    Buffer data(INDEX_MAGIC, INDEX_MAGIC + sizeof(INDEX_MAGIC));
+    appendUint64(data, index.epoch);
+    appendUint64(data, index.journal_seq);
+
+    for (const auto &file : index.files)
+    {
+        Buffer record = encodeRecord(RECORD_PUT, stamp, index.generation, file.first, &file.second);
+        data.insert(data.end(), record.begin(), record.end());
+    }
+
+    // an empty folder still needs its stamp and generation
+    Buffer record = encodeRecord(RECORD_STAMP, stamp, index.generation, "", nullptr);
+    data.insert(data.end(), record.begin(), record.end());
+
+    std::string path = indexPath(user);
+    std::string temp_path = path + ".tmp";
+    std::error_code error;
+    fs::create_directories(root, error);
+
+    // the journal entries it holds are dropped once it is written, it has to be on disk by then
+    int fd = ::open(temp_path.c_str(), O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0644);
+    bool written = fd != -1 && write(fd, data.data(), data.size()) == static_cast<ssize_t>(data.size()) && fdatasync(fd) == 0;
+    if (fd != -1)
+        close(fd);
+
+    if (!written || rename(temp_path.c_str(), path.c_str()) != 0)
+    {
+        std::cerr << "[INDEX] Unable to write the metadata of " << user << std::endl;
+        fs::remove(temp_path, error);
+        return false;
+    }
+    index.log_records = index.files.size() + 1;
+    index.dirty = false;
+    return true;
+}
+
+void MetadataIndex::record(const std::string &user, UserIndex &index, const Buffer &records, size_t count)
+{
+    if (index.log_records == 0 || index.log_records > 2 * index.files.size() + COMPACT_SLACK)
+    {
+        compact(user, index);
+        return;
+    }
+
+    // user | records; a lost entry only costs a rebuild on the next start
+    Buffer entry;
+    appendString(entry, user);
+    entry.insert(entry.end(), records.begin(), records.end());
+    index.journal_seq = Journal::instance().append(entry);
+    index.dirty = true;
+    index.log_records += count;
+
+    if (Journal::instance().size() > Storage::journal_checkpoint && !checkpointing.exchange(true))
+        std::thread(&MetadataIndex::checkpoint, this).detach();
+}
+
+void MetadataIndex::checkpoint()
+{
+    uint64_t seq = Journal::instance().lastSeq();
+
+    std::vector<std::pair<std::string, UserIndex *>> indexes;
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        for (const auto &user : users)
+            indexes.emplace_back(user.first, user.second.get());
+    }
+
+    // every entry up to seq belongs to an index that is dirty until its snapshot is written
+    bool written = true;
+    for (const auto &user : indexes)
+    {
+        std::lock_guard<std::mutex> lock(user.second->mutex);
+        if (user.second->dirty)
+            written = compact(user.first, *user.second) && written;
+    }
+
+    // the snapshots must be in place before the journal forgets
+    int fd = ::open(root.c_str(), O_RDONLY | O_DIRECTORY | O_CLOEXEC);
+    if (fd == -1 || fsync(fd) != 0)
+        written = false;
+    if (fd != -1)
+        close(fd);
+
+    if (written)
+        Journal::instance().truncate(seq);
+    else
+        std::cerr << "[INDEX] Checkpoint failed, the journal keeps growing" << std::endl;
+
+    checkpointing = false;
+}
+
+uint64_t MetadataIndex::snapshotSeq(const std::string &user) const
+{
+    std::ifstream input(indexPath(user), std::ios::binary);
+    Buffer header(sizeof(INDEX_MAGIC) + 2 * sizeof(uint64_t));
+    size_t position = sizeof(INDEX_MAGIC);
+    uint64_t epoch, seq;
+
+    // without a snapshot the index is rebuilt anyway, the entries are of no use
+    if (!input.read(reinterpret_cast<char *>(header.data()), header.size()) ||
+        memcmp(header.data(), INDEX_MAGIC, sizeof(INDEX_MAGIC)) != 0 ||
+        !readUint64(header, position, epoch) || !readUint64(header, position, seq))
+        return UINT64_MAX;
+    return seq;
+}
+
+void MetadataIndex::recover()
+{
+    std::map<std::string, uint64_t> snapshots;
+    std::map<std::string, Buffer> records;
+    size_t entries = 0;
+
+    Journal::instance().replay([&](uint64_t seq, const Buffer &entry)
+                               {
+        size_t position = 0;
+        std::string user;
+        if (!readString(entry, position, user))
+            return;
+
+        auto snapshot = snapshots.find(user);
+        if (snapshot == snapshots.end())
+            snapshot = snapshots.emplace(user, snapshotSeq(user)).first;
+        if (seq <= snapshot->second)
+            return;
+
+        records[user].insert(records[user].end(), entry.begin() + position, entry.end());
+        entries++; });
+
+    // the records join the log of the snapshot and are replayed from there as usual; should
+    // the server stop before the journal is cleared they are only appended again, which
+    // leaves the index as it was
+    bool written = true;
+    for (const auto &user : records)
+    {
+        int fd = ::open(indexPath(user.first).c_str(), O_WRONLY | O_APPEND | O_CLOEXEC);
+        bool appended = fd != -1 && write(fd, user.second.data(), user.second.size()) == static_cast<ssize_t>(user.second.size()) && fdatasync(fd) == 0;
+        if (fd != -1)
+            close(fd);
+
+        if (!appended)
+            std::cerr << "[INDEX] Unable to recover the metadata of " << user.first << std::endl;
+        written = written && appended;
+    }
+
+    if (written)
+        Journal::instance().truncate(Journal::instance().lastSeq());
+    if (entries > 0)
+        std::cout << "[INDEX] Recovered " << entries << " journal entries of " << records.size() << " users" << std::endl;
+}
+
+void MetadataIndex::open(const std::string &user)
+{
+    UserIndex &index = userIndex(user);
+    std::lock_guard<std::mutex> lock(index.mutex);
+    load(user, index);
+}
+
+void MetadataIndex::refresh(const std::string &user, const std::string &name)
+{
+    refresh(user, std::vector<std::string>{name});
+}
+
+void MetadataIndex::refresh(const std::string &user, const std::vector<std::string> &names)
+{
+    UserIndex &index = userIndex(user);
+    std::lock_guard<std::mutex> lock(index.mutex);
+    load(user, index);
+
+    int64_t stamp = folderStamp(user);
+    Buffer records;
+    size_t count = 0;
+
+    for (const std::string &name : names)
+    {
+        if (!File::isValidFileName(name))
+            continue;
+
+        FileMetadata metadata;
+        auto found = index.files.find(name);
+        bool present = metadataOf(user, name, metadata);
+
+        if (present)
+        {
+            // same size and modification time: same content, same version
+            if (found != index.files.end() && found->second.size == metadata.size && found->second.mtime == metadata.mtime)
+            {
+                metadata.version = found->second.version;
+                metadata.accessed = std::max(metadata.accessed, found->second.accessed);
+                if (metadata.digest.empty())
+                    metadata.digest = found->second.digest;
+            }
+            else
+                metadata.version = ++index.generation;
+
+            putFile(index, name, metadata);
+        }
+        else if (found != index.files.end())
+        {
+            eraseFile(index, name);
+            index.generation++;
+        }
+
+        Buffer record = encodeRecord(present ? RECORD_PUT : RECORD_DELETE, stamp, index.generation, name, present ? &metadata : nullptr);
+        records.insert(records.end(), record.begin(), record.end());
+        count++;
+    }
+
+    if (stamp >= 0 && count > 0)
+        record(user, index, records, count);
+}
+
+bool MetadataIndex::lookup(const std::string &user, const std::string &name, FileMetadata &metadata)
+{
+    UserIndex &index = userIndex(user);
+    std::lock_guard<std::mutex> lock(index.mutex);
+    load(user, index);
+
+    auto found = index.files.find(name);
+    if (found == index.files.end())
+        return false;
+
+    metadata = found->second;
+    return true;
+}
+
+void MetadataIndex::forEach(const std::string &user, const std::string &start, const std::function<bool(const std::string &, const FileMetadata &)> &visit)
+{
+    UserIndex &index = userIndex(user);
+    std::lock_guard<std::mutex> lock(index.mutex);
+    load(user, index);
+
+    for (auto it = index.files.lower_bound(start); it != index.files.end(); ++it)
+        if (!visit(it->first, it->second))
+            break;
+}
+
+void MetadataIndex::touch(const std::string &user, const std::string &name)
+{
+    UserIndex &index = userIndex(user);
+    std::lock_guard<std::mutex> lock(index.mutex);
+    load(user, index);
+
+    auto found = index.files.find(name);
+    int64_t now = std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::system_clock::now().time_since_epoch()).count();
+    if (found == index.files.end() || now - found->second.accessed < Storage::access_granularity_s * 1000000000LL)
+        return;
+
+    // the version stays, reading a file does not change its entity tag
+    found->second.accessed = now;
+    int64_t stamp = folderStamp(user);
+    if (stamp >= 0)
+        record(user, index, encodeRecord(RECORD_PUT, stamp, index.generation, name, &found->second), 1);
+}
+
+bool MetadataIndex::digest(const std::string &user, const std::string &name, std::string &digest)
+{
+    FileMetadata known;
+    if (!lookup(user, name, known))
+        return false;
+
+    if (!known.digest.empty())
+    {
+        digest = known.digest;
+        return true;
+    }
+
+    // hash without holding the index, then keep the result only if the file did not change meanwhile
+    try
+    {
+        StoredFile file;
+        file.open(user, name);
+        digest = Fingerprint::toHex(Fingerprint::sha256(file.getStream()));
+    }
+    catch (const std::exception &e)
+    {
+        std::cerr << "[INDEX] " << name << ": " << e.what() << std::endl;
+        return false;
+    }
+
+    UserIndex &index = userIndex(user);
+    std::lock_guard<std::mutex> lock(index.mutex);
+
+    FileMetadata current;
+    auto found = index.files.find(name);
+    if (found != index.files.end() && found->second.size == known.size && found->second.mtime == known.mtime &&
+        metadataOf(user, name, current) && current.size == known.size && current.mtime == known.mtime)
+    {
+        found->second.digest = digest;
+
+        int64_t stamp = folderStamp(user);
+        if (stamp >= 0)
+            record(user, index, encodeRecord(RECORD_PUT, stamp, index.generation, name, &found->second), 1);
+    }
+    return true;
+}
+
+std::string MetadataIndex::tag(uint64_t epoch, uint64_t version)
+{
+    Buffer bytes;
+    appendUint64(bytes, epoch);
+    appendUint64(bytes, version);
+
+    static const char digits[] = "0123456789abcdef";
+    std::string hex;
+    for (unsigned char byte : bytes)
+    {
+        hex += digits[byte >> 4];
+        hex += digits[byte & 0x0F];
+    }
+    return hex;
+}
+
+void MetadataIndex::putFile(UserIndex &index, const std::string &name, const FileMetadata &metadata)
+{
+    auto found = index.files.find(name);
+    if (found != index.files.end())
+        index.used -= found->second.size;
+
+    index.files[name] = metadata;
+    index.used += metadata.size;
+}
+
+void MetadataIndex::eraseFile(UserIndex &index, const std::string &name)
+{
+    auto found = index.files.find(name);
+    if (found == index.files.end())
+        return;
+
+    index.used -= found->second.size;
+    index.files.erase(found);
+}
+
+bool MetadataIndex::etag(const std::string &user, const std::string &name, std::string &etag)
+{
+    UserIndex &index = userIndex(user);
+    std::lock_guard<std::mutex> lock(index.mutex);
+    load(user, index);
+
+    auto found = index.files.find(name);
+    if (found == index.files.end())
+        return false;
+
+    etag = tag(index.epoch, found->second.version);
+    return true;
+}
+
+std::string MetadataIndex::folderTag(const std::string &user)
+{
+    UserIndex &index = userIndex(user);
+    std::lock_guard<std::mutex> lock(index.mutex);
+    load(user, index);
+
+    return tag(index.epoch, index.generation);
+}
+
+bool MetadataIndex::reserve(const std::string &user, uintmax_t bytes)
+{
+    // taken before the index lock, a version may be kept while the index is busy
+    uintmax_t versions = VersionStore::instance().usage(user);
+
+    UserIndex &index = userIndex(user);
+    std::lock_guard<std::mutex> lock(index.mutex);
+    load(user, index);
+
+    uintmax_t taken = index.used + versions + index.reserved;
+    if (Storage::user_quota > 0 && (taken > Storage::user_quota || bytes > Storage::user_quota - taken))
+        return false;
+
+    index.reserved += bytes;
+    return true;
+}
+
+void MetadataIndex::release(const std::string &user, uintmax_t bytes)
+{
+    UserIndex &index = userIndex(user);
+    std::lock_guard<std::mutex> lock(index.mutex);
+
+    index.reserved -= std::min(bytes, index.reserved);
+}
+
+uintmax_t MetadataIndex::usage(const std::string &user)
+{
+    uintmax_t versions = VersionStore::instance().usage(user);
+
+    UserIndex &index = userIndex(user);
+    std::lock_guard<std::mutex> lock(index.mutex);
+    load(user, index);
+
+    return index.used + versions;
+}
+
+bool QuotaReservation::acquire(const std::string &user, uintmax_t bytes)
+{
+    if (this->bytes > 0 && user != this->user)
+        return false;
+
+    if (!MetadataIndex::instance().reserve(user, bytes))
+        return false;
+
+    this->user = user;
+    this->bytes += bytes;
+    return true;
+}
+
+bool QuotaReservation::acquireReplacement(const std::string &user, uintmax_t old_size, uintmax_t new_size)
+{
+    uintmax_t needed = new_size > old_size ? new_size - old_size : 0;
+    if (VersionStore::enabled())
+        needed += old_size;
+    return needed == 0 || acquire(user, needed);
+}
+
+QuotaReservation::~QuotaReservation()
+{
+    if (bytes > 0)
+        MetadataIndex::instance().release(user, bytes);
+}
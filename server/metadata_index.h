@@ -0,0 +1,128 @@
+#ifndef METADATA_INDEX_H
+#define METADATA_INDEX_H
+
+#include <atomic>
+#include <cstdint>
+#include <functional>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+typedef std::vector<unsigned char> Buffer;
+
+struct FileMetadata
+{
+    uintmax_t size;     // logical size, the original one for a recipe or a file compressed at rest
+    uintmax_t stored;   // bytes taken on the storage backend
+    int64_t mtime;
+    int64_t accessed;   // nanoseconds, last read (within Storage::access_granularity_s) or change
+    std::string digest; // SHA-256 of the content, empty until known
+    uint64_t version;   // folder generation of the last change to the file
+};
+
+// Per user index of the files of a folder, so listing never walks the directory.
+// Every change is recorded together with the stamp of the user folder on the storage backend
+// right after it. Records go to the shared Journal, which flushes the changes of all sessions
+// together; ../data/.index/<user> holds a snapshot of the index, rewritten once the journal
+// grows past Storage::journal_checkpoint, and the journal entries it doesn't hold are moved
+// into it at startup. An index whose last record does not match the folder (crash between
+// a file operation and its record, torn tail, manual edit) is rebuilt from a single scan
+// the first time the user is seen.
+// Every change also advances a folder generation; entity tags pair it with a random
+// epoch drawn at each rebuild, so a tag handed out before a rebuild never matches again.
+class MetadataIndex
+{
+private:
+    struct UserIndex
+    {
+        std::mutex mutex;
+        bool loaded = false;
+        std::map<std::string, FileMetadata> files;
+        size_t log_records = 0;
+        uint64_t journal_seq = 0; // last journal entry of the user
+        bool dirty = false;       // journal entries newer than the snapshot
+        uint64_t epoch = 0;
+        uint64_t generation = 0;
+        uintmax_t used = 0;     // logical bytes of files, follows every change of files
+        uintmax_t reserved = 0; // claimed by transfers still under way
+    };
+
+    std::string root;
+    std::mutex mutex;
+    std::unordered_map<std::string, std::unique_ptr<UserIndex>> users;
+    std::atomic<bool> checkpointing;
+
+    MetadataIndex(const std::string &root);
+    UserIndex &userIndex(const std::string &user);
+    std::string indexPath(const std::string &user) const;
+
+    void load(const std::string &user, UserIndex &index);
+    void rebuild(const std::string &user, UserIndex &index);
+    // records are count encoded records of one change, journaled as a single entry
+    void record(const std::string &user, UserIndex &index, const Buffer &records, size_t count);
+    uint64_t snapshotSeq(const std::string &user) const;
+    void checkpoint();
+    static std::string tag(uint64_t epoch, uint64_t version);
+    static void putFile(UserIndex &index, const std::string &name, const FileMetadata &metadata);
+    static void eraseFile(UserIndex &index, const std::string &name);
+    bool compact(const std::string &user, UserIndex &index);
+
+public:
+    static MetadataIndex &instance();
+
+    // Loads the index of a user ahead of any change, a change seen before the index
+    // was read would look like a crash and cost a rebuild
+    void open(const std::string &user);
+
+    // Brings the entry of name in line with the disk: added, updated or dropped
+    void refresh(const std::string &user, const std::string &name);
+    // Same for several names changed by one operation, recorded together
+    void refresh(const std::string &user, const std::vector<std::string> &names);
+    // Moves the journal entries left by the previous run into the snapshots, before any session starts
+    void recover();
+    bool lookup(const std::string &user, const std::string &name, FileMetadata &metadata);
+    // Visits the files in name order from the first name not below start, until visit returns false
+    void forEach(const std::string &user, const std::string &start, const std::function<bool(const std::string &, const FileMetadata &)> &visit);
+    // Records a read of name, leaving its version alone
+    void touch(const std::string &user, const std::string &name);
+    // Digest of a file, hashed once on first request when it was not known at upload
+    bool digest(const std::string &user, const std::string &name, std::string &digest);
+
+    // Entity tag of a file, it changes whenever the file does
+    bool etag(const std::string &user, const std::string &name, std::string &etag);
+    // Entity tag of the whole folder, it changes with any of its files
+    std::string folderTag(const std::string &user);
+
+    // Claims bytes of the quota of user ahead of a transfer, false when they don't fit next to
+    // the stored files, their versions and the other transfers (Storage::user_quota 0 means no limit)
+    bool reserve(const std::string &user, uintmax_t bytes);
+    void release(const std::string &user, uintmax_t bytes);
+    // Logical bytes stored by user, the versions of the files included
+    uintmax_t usage(const std::string &user);
+};
+
+// Quota claimed for a single transfer, handed back when it goes out of scope; by then the
+// stored file counts in the usage of the user
+class QuotaReservation
+{
+private:
+    std::string user;
+    uintmax_t bytes;
+
+public:
+    QuotaReservation() : bytes(0) {}
+    QuotaReservation(const QuotaReservation &) = delete;
+    QuotaReservation &operator=(const QuotaReservation &) = delete;
+
+    // Adds to what is already held, false (and nothing claimed) when it doesn't fit
+    bool acquire(const std::string &user, uintmax_t bytes);
+    // Room for a file of user replaced in place, going from old_size to new_size bytes: its
+    // growth, and its old content as well when that is kept as a version
+    bool acquireReplacement(const std::string &user, uintmax_t old_size, uintmax_t new_size);
+    ~QuotaReservation();
+};
+
+#endif // METADATA_INDEX_H
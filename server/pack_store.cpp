@@ -0,0 +1,580 @@
+#include "pack_store.h"
+#include "write_behind.h"
+#include "constants.h"
+#include "../tools/fingerprint.h"
+#include <algorithm>
+#include <cerrno>
+#include <chrono>
+#include <cstdio>
+#include <cstring>
+#include <fcntl.h>
+#include <fstream>
+#include <iostream>
+#include <stdexcept>
+#include <sys/stat.h>
+#include <thread>
+#include <unistd.h>
+
+namespace
+{
+    const char PACK_MAGIC[8] = {'F', 'O', 'C', 'P', 'A', 'C', 'K', '1'};
+    const uint64_t HEADER_LENGTH = sizeof(PACK_MAGIC) + sizeof(uint64_t); // magic | stamp when last rewritten
+    const uint8_t RECORD_PUT = 1;
+    const uint8_t RECORD_DELETE = 2;
+    const uint8_t RECORD_RENAME = 3;
+    const size_t CHECKSUM_LENGTH = 4;         // truncated SHA-256, only meant to catch torn writes
+    const size_t COMPACT_BATCH = 1024 * 1024; // bytes gathered before a write while rewriting
+
+    void appendUint64(Buffer &data, uint64_t value)
+    {
+        for (int shift = 56; shift >= 0; shift -= 8)
+            data.push_back(static_cast<unsigned char>(value >> shift));
+    }
+
+    uint64_t decodeUint64(const unsigned char *data)
+    {
+        uint64_t value = 0;
+        for (size_t i = 0; i < sizeof(uint64_t); i++)
+            value = (value << 8) | data[i];
+        return value;
+    }
+
+    void appendString(Buffer &data, const std::string &value)
+    {
+        data.push_back(static_cast<unsigned char>(value.size()));
+        data.insert(data.end(), value.begin(), value.end());
+    }
+
+    // offset of the data inside the put record of name
+    uint64_t dataOffset(const std::string &name)
+    {
+        return 1 + sizeof(uint64_t) + 1 + name.size() + sizeof(uint64_t);
+    }
+
+    // type | time | name | (put) length | data  (rename) new name | checksum
+    Buffer encodeRecord(uint8_t type, int64_t time, const std::string &name, const std::string &to, const Buffer *data)
+    {
+        Buffer record;
+        record.reserve(dataOffset(name) + (data ? data->size() : 0) + CHECKSUM_LENGTH);
+        record.push_back(type);
+        appendUint64(record, time);
+        appendString(record, name);
+        if (type == RECORD_PUT)
+        {
+            appendUint64(record, data->size());
+            record.insert(record.end(), data->begin(), data->end());
+        }
+        else if (type == RECORD_RENAME)
+            appendString(record, to);
+
+        Fingerprint::Digest checksum = Fingerprint::sha256(record);
+        record.insert(record.end(), checksum.begin(), checksum.begin() + CHECKSUM_LENGTH);
+        return record;
+    }
+
+    Buffer encodeHeader(int64_t stamp)
+    {
+        Buffer header(PACK_MAGIC, PACK_MAGIC + sizeof(PACK_MAGIC));
+        appendUint64(header, stamp);
+        return header;
+    }
+
+    bool writeAll(int fd, const unsigned char *data, size_t length, uint64_t offset)
+    {
+        for (size_t done = 0; done < length;)
+        {
+            ssize_t count = pwrite(fd, data + done, length - done, offset + done);
+            if (count == -1 && errno == EINTR)
+                continue;
+            if (count <= 0)
+                return false;
+            done += count;
+        }
+        return true;
+    }
+
+    bool readAll(int fd, unsigned char *data, size_t length, uint64_t offset)
+    {
+        for (size_t done = 0; done < length;)
+        {
+            ssize_t count = pread(fd, data + done, length - done, offset + done);
+            if (count == -1 && errno == EINTR)
+                continue;
+            if (count <= 0)
+                return false;
+            done += count;
+        }
+        return true;
+    }
+
+    // Next record of a pack being replayed, false at its end or at a torn or corrupted record
+    bool readRecord(std::istream &input, uint64_t start, uint64_t file_size, Buffer &record)
+    {
+        record.resize(1 + sizeof(uint64_t) + 1);
+        if (!input.read(reinterpret_cast<char *>(record.data()), record.size()))
+            return false;
+
+        auto readMore = [&](size_t length)
+        {
+            if (length > file_size - start - record.size())
+                return false;
+            size_t old_size = record.size();
+            record.resize(old_size + length);
+            return static_cast<bool>(input.read(reinterpret_cast<char *>(record.data() + old_size), length));
+        };
+
+        uint8_t type = record[0];
+        if (!readMore(record.back()))
+            return false;
+
+        if (type == RECORD_PUT)
+        {
+            if (!readMore(sizeof(uint64_t)))
+                return false;
+            uint64_t length = decodeUint64(record.data() + record.size() - sizeof(uint64_t));
+            if (length > file_size || !readMore(length))
+                return false;
+        }
+        else if (type == RECORD_RENAME)
+        {
+            if (!readMore(1) || !readMore(record.back()))
+                return false;
+        }
+        else if (type != RECORD_DELETE)
+            return false;
+
+        size_t body = record.size();
+        if (!readMore(CHECKSUM_LENGTH))
+            return false;
+
+        Fingerprint::Digest checksum = Fingerprint::sha256(Buffer(record.begin(), record.begin() + body));
+        return memcmp(checksum.data(), record.data() + body, CHECKSUM_LENGTH) == 0;
+    }
+}
+
+PackStore::PackStore() : compactor_running(false) {}
+
+PackStore &PackStore::instance()
+{
+    // never destroyed, the compaction thread keeps running until the process exits
+    static PackStore *store = new PackStore();
+    return *store;
+}
+
+bool PackStore::enabled()
+{
+    // recipes of deduplicated files are read back by path, they must stay plain files
+    return Storage::pack_threshold > 0 && !Storage::deduplicate;
+}
+
+int64_t PackStore::now()
+{
+    // a wall clock stamp never repeats one recorded by an earlier run of the server
+    static std::mutex mutex;
+    static int64_t last = 0;
+
+    std::lock_guard<std::mutex> lock(mutex);
+    int64_t current = std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::system_clock::now().time_since_epoch()).count();
+    last = std::max(last + 1, current);
+    return last;
+}
+
+std::shared_ptr<PackStore::Pack> PackStore::packOf(const std::string &path)
+{
+    std::lock_guard<std::mutex> lock(mutex);
+
+    std::shared_ptr<Pack> &pack = packs[path];
+    if (!pack)
+        pack.reset(new Pack());
+    return pack;
+}
+
+void PackStore::load(const std::string &path, Pack &pack)
+{
+    if (pack.loaded)
+        return;
+    pack.loaded = true;
+
+    int fd = open(path.c_str(), O_RDWR | O_CLOEXEC);
+    if (fd == -1)
+        return; // nothing packed yet
+
+    struct stat info;
+    unsigned char header[HEADER_LENGTH];
+    if (fstat(fd, &info) != 0 || static_cast<uint64_t>(info.st_size) < HEADER_LENGTH ||
+        !readAll(fd, header, HEADER_LENGTH, 0) || memcmp(header, PACK_MAGIC, sizeof(PACK_MAGIC)) != 0)
+    {
+        // never overwritten, whatever it holds is kept aside for inspection
+        close(fd);
+        std::string aside = path + ".corrupt";
+        std::rename(path.c_str(), aside.c_str());
+        std::cerr << "[PACK] " << path << " is not a pack, moved to " << aside << std::endl;
+        return;
+    }
+
+    uint64_t file_size = info.st_size;
+    pack.stamp = decodeUint64(header + sizeof(PACK_MAGIC));
+
+    std::ifstream input(path, std::ios::binary);
+    input.seekg(HEADER_LENGTH);
+
+    // replay the pack up to the first torn or corrupted record
+    uint64_t position = HEADER_LENGTH;
+    Buffer record;
+    while (position < file_size && readRecord(input, position, file_size, record))
+    {
+        uint8_t type = record[0];
+        int64_t time = decodeUint64(record.data() + 1);
+        std::string name(record.begin() + 10, record.begin() + 10 + record[9]);
+
+        auto found = pack.entries.find(name);
+        if (found != pack.entries.end() && type != RECORD_RENAME)
+        {
+            pack.live -= found->second.span;
+            pack.entries.erase(found);
+        }
+
+        if (type == RECORD_PUT)
+        {
+            uint64_t length = decodeUint64(record.data() + dataOffset(name) - sizeof(uint64_t));
+            pack.entries[name] = {position, record.size(), position + dataOffset(name), length, time};
+            pack.live += record.size();
+        }
+        else if (type == RECORD_RENAME && found != pack.entries.end())
+        {
+            size_t to_start = 10 + name.size();
+            std::string to(record.begin() + to_start + 1, record.begin() + to_start + 1 + record[to_start]);
+
+            auto replaced = pack.entries.find(to);
+            if (replaced != pack.entries.end())
+            {
+                pack.live -= replaced->second.span;
+                pack.entries.erase(replaced);
+            }
+
+            Entry entry = found->second;
+            pack.entries.erase(name);
+            pack.entries[to] = entry;
+        }
+
+        pack.stamp = std::max(pack.stamp, time);
+        position += record.size();
+    }
+
+    if (position < file_size)
+    {
+        std::cerr << "[PACK] " << path << ": dropped " << file_size - position << "B after the last complete record" << std::endl;
+        if (ftruncate(fd, position) != 0)
+            std::cerr << "[PACK] Unable to truncate " << path << std::endl;
+    }
+
+    pack.fd = fd;
+    pack.end = position;
+}
+
+void PackStore::append(const std::string &path, Pack &pack, const Buffer &record)
+{
+    if (pack.fd == -1)
+    {
+        pack.fd = open(path.c_str(), O_RDWR | O_CREAT | O_CLOEXEC, 0644);
+        if (pack.fd == -1)
+            throw std::runtime_error("Unable to create file.");
+
+        Buffer header = encodeHeader(0);
+        if (!writeAll(pack.fd, header.data(), header.size(), 0))
+        {
+            close(pack.fd);
+            pack.fd = -1;
+            throw std::runtime_error("Unable to write to file.");
+        }
+        pack.end = HEADER_LENGTH;
+    }
+
+    bool durable = writeAll(pack.fd, record.data(), record.size(), pack.end);
+    if (durable && Storage::durability == Durability::FILE_SYNC)
+        durable = fdatasync(pack.fd) == 0;
+    else if (durable && Storage::durability == Durability::GROUP_COMMIT)
+        durable = WriteBehind::instance().sync(pack.fd);
+
+    // a record that didn't make it must not be replayed either
+    if (!durable)
+    {
+        if (ftruncate(pack.fd, pack.end) != 0)
+            std::cerr << "[PACK] Unable to truncate " << path << std::endl;
+        throw std::runtime_error("Unable to write to file.");
+    }
+
+    pack.end += record.size();
+}
+
+bool PackStore::stat(const std::string &path, const std::string &name, Entry &entry)
+{
+    std::shared_ptr<Pack> pack = packOf(path);
+    std::lock_guard<std::mutex> lock(pack->mutex);
+    load(path, *pack);
+
+    auto found = pack->entries.find(name);
+    if (found == pack->entries.end())
+        return false;
+
+    entry = found->second;
+    return true;
+}
+
+bool PackStore::read(const std::string &path, const std::string &name, Buffer &data)
+{
+    std::shared_ptr<Pack> pack = packOf(path);
+    std::lock_guard<std::mutex> lock(pack->mutex);
+    load(path, *pack);
+
+    auto found = pack->entries.find(name);
+    if (found == pack->entries.end())
+        return false;
+
+    data.resize(found->second.length);
+    return readAll(pack->fd, data.data(), data.size(), found->second.offset);
+}
+
+void PackStore::put(const std::string &path, const std::string &name, const Buffer &data, bool replace)
+{
+    std::shared_ptr<Pack> pack = packOf(path);
+    std::lock_guard<std::mutex> lock(pack->mutex);
+    load(path, *pack);
+
+    auto found = pack->entries.find(name);
+    if (found != pack->entries.end() && !replace)
+        throw std::invalid_argument("File already exists.");
+
+    int64_t time = now();
+    Buffer record = encodeRecord(RECORD_PUT, time, name, "", &data);
+    // the first record of a new pack lands after the header append writes
+    append(path, *pack, record);
+    uint64_t start = pack->end - record.size();
+
+    if (found != pack->entries.end())
+        pack->live -= found->second.span;
+    pack->entries[name] = {start, record.size(), start + dataOffset(name), data.size(), time};
+    pack->live += record.size();
+    pack->stamp = time;
+
+    schedule(path, *pack);
+}
+
+bool PackStore::remove(const std::string &path, const std::string &name)
+{
+    std::shared_ptr<Pack> pack = packOf(path);
+    std::lock_guard<std::mutex> lock(pack->mutex);
+    load(path, *pack);
+
+    auto found = pack->entries.find(name);
+    if (found == pack->entries.end())
+        return false;
+
+    int64_t time = now();
+    try
+    {
+        append(path, *pack, encodeRecord(RECORD_DELETE, time, name, "", nullptr));
+    }
+    catch (const std::exception &e)
+    {
+        std::cerr << "[PACK] " << e.what() << std::endl;
+        return false;
+    }
+
+    pack->live -= found->second.span;
+    pack->entries.erase(found);
+    pack->stamp = time;
+
+    schedule(path, *pack);
+    return true;
+}
+
+bool PackStore::rename(const std::string &path, const std::string &from, const std::string &to)
+{
+    std::shared_ptr<Pack> pack = packOf(path);
+    std::lock_guard<std::mutex> lock(pack->mutex);
+    load(path, *pack);
+
+    auto found = pack->entries.find(from);
+    if (found == pack->entries.end() || pack->entries.count(to) > 0)
+        return false;
+
+    int64_t time = now();
+    try
+    {
+        append(path, *pack, encodeRecord(RECORD_RENAME, time, from, to, nullptr));
+    }
+    catch (const std::exception &e)
+    {
+        std::cerr << "[PACK] " << e.what() << std::endl;
+        return false;
+    }
+
+    // the data stays where it is, the file keeps its modification time as a renamed file does
+    Entry entry = found->second;
+    pack->entries.erase(found);
+    pack->entries[to] = entry;
+    pack->stamp = time;
+
+    schedule(path, *pack);
+    return true;
+}
+
+std::vector<std::string> PackStore::list(const std::string &path)
+{
+    std::shared_ptr<Pack> pack = packOf(path);
+    std::lock_guard<std::mutex> lock(pack->mutex);
+    load(path, *pack);
+
+    std::vector<std::string> names;
+    names.reserve(pack->entries.size());
+    for (const auto &entry : pack->entries)
+        names.push_back(entry.first);
+    return names;
+}
+
+int64_t PackStore::stamp(const std::string &path)
+{
+    std::shared_ptr<Pack> pack = packOf(path);
+    std::lock_guard<std::mutex> lock(pack->mutex);
+    load(path, *pack);
+    return pack->stamp;
+}
+
+void PackStore::schedule(const std::string &path, Pack &pack)
+{
+    uint64_t garbage = pack.end - HEADER_LENGTH - pack.live;
+    if (pack.compacting || garbage < Storage::pack_compact_min || garbage <= pack.live)
+        return;
+    pack.compacting = true;
+
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        compactions.push_back(path);
+        if (!compactor_running)
+        {
+            compactor_running = true;
+            std::thread(&PackStore::compactPacks, this).detach();
+        }
+    }
+    work.notify_one();
+}
+
+void PackStore::compactPacks()
+{
+    std::unique_lock<std::mutex> lock(mutex);
+
+    while (true)
+    {
+        work.wait(lock, [this]()
+                  { return !compactions.empty(); });
+
+        std::string path = compactions.front();
+        compactions.pop_front();
+        lock.unlock();
+
+        compact(path);
+
+        lock.lock();
+    }
+}
+
+void PackStore::compact(const std::string &path)
+{
+    std::shared_ptr<Pack> pack = packOf(path);
+
+    // the live files are copied without holding up the folder, records are never changed
+    // once written and only this thread replaces the pack
+    std::unordered_map<std::string, Entry> snapshot;
+    int fd;
+    {
+        std::lock_guard<std::mutex> lock(pack->mutex);
+        snapshot = pack->entries;
+        fd = pack->fd;
+    }
+
+    std::string temp_path = path + ".compact";
+    int output_fd = open(temp_path.c_str(), O_RDWR | O_CREAT | O_TRUNC | O_CLOEXEC, 0644);
+
+    std::vector<std::pair<std::string, Entry>> ordered(snapshot.begin(), snapshot.end());
+    std::sort(ordered.begin(), ordered.end(), [](const std::pair<std::string, Entry> &a, const std::pair<std::string, Entry> &b)
+              { return a.second.record < b.second.record; });
+
+    std::unordered_map<std::string, Entry> moved;
+    Buffer output = encodeHeader(0);
+    uint64_t written = 0;
+    bool failed = output_fd == -1;
+
+    auto copy = [&](const std::string &name, const Entry &entry)
+    {
+        Buffer data(entry.length);
+        if (!readAll(fd, data.data(), data.size(), entry.offset))
+            return false;
+
+        Buffer record = encodeRecord(RECORD_PUT, entry.mtime, name, "", &data);
+        uint64_t start = written + output.size();
+        moved[name] = {start, record.size(), start + dataOffset(name), entry.length, entry.mtime};
+        output.insert(output.end(), record.begin(), record.end());
+
+        if (output.size() < COMPACT_BATCH)
+            return true;
+        bool done = writeAll(output_fd, output.data(), output.size(), written);
+        written += output.size();
+        output.clear();
+        return done;
+    };
+
+    for (size_t i = 0; i < ordered.size() && !failed; i++)
+        failed = !copy(ordered[i].first, ordered[i].second);
+
+    std::lock_guard<std::mutex> lock(pack->mutex);
+
+    // changes made meanwhile: files deleted, replaced or renamed since the copy are
+    // deleted in the new pack, files put since then are copied now
+    for (const auto &old_entry : snapshot)
+    {
+        if (failed)
+            break;
+
+        auto current = pack->entries.find(old_entry.first);
+        if (current != pack->entries.end() && current->second.record == old_entry.second.record)
+            continue;
+
+        moved.erase(old_entry.first);
+        Buffer record = encodeRecord(RECORD_DELETE, pack->stamp, old_entry.first, "", nullptr);
+        output.insert(output.end(), record.begin(), record.end());
+    }
+
+    for (const auto &entry : pack->entries)
+        if (!failed && moved.count(entry.first) == 0)
+            failed = !copy(entry.first, entry.second);
+
+    // the stamp of the pack must survive the records that carried it
+    Buffer header = encodeHeader(pack->stamp);
+    if (!failed)
+        failed = !writeAll(output_fd, output.data(), output.size(), written) ||
+                 !writeAll(output_fd, header.data(), header.size(), 0) ||
+                 fdatasync(output_fd) != 0 || std::rename(temp_path.c_str(), path.c_str()) != 0;
+    written += output.size();
+
+    pack->compacting = false;
+
+    if (failed)
+    {
+        std::cerr << "[PACK] Unable to compact " << path << std::endl;
+        if (output_fd != -1)
+            close(output_fd);
+        unlink(temp_path.c_str());
+        return;
+    }
+
+    std::cout << "[PACK] Compacted " << path << ": " << pack->entries.size() << " files, " << pack->end << "B -> " << written << "B" << std::endl;
+
+    close(pack->fd);
+    pack->fd = output_fd;
+    pack->end = written;
+    pack->entries.swap(moved);
+    pack->live = 0;
+    for (const auto &entry : pack->entries)
+        pack->live += entry.second.span;
+}
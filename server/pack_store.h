@@ -0,0 +1,80 @@
+#ifndef PACK_STORE_H
+#define PACK_STORE_H
+
+#include <condition_variable>
+#include <cstdint>
+#include <deque>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+typedef std::vector<unsigned char> Buffer;
+
+// ----------------------------------- PACK STORE ------------------------------------
+
+// Small files kept back to back in one log per user folder instead of a file each, so they
+// cost no inode and no open() of their own. Every put, delete and rename is appended to the
+// pack; the offsets of the live files are kept in memory, rebuilt by replaying the pack the
+// first time it is used. Once enough of a pack is garbage (deleted, replaced or renamed
+// files) a background thread rewrites it with the live files only.
+class PackStore
+{
+public:
+    struct Entry
+    {
+        uint64_t record;  // offset of the record holding the data
+        uint64_t span;    // length of that record
+        uint64_t offset;  // offset of the data
+        uint64_t length;
+        int64_t mtime;    // nanoseconds
+    };
+
+private:
+    struct Pack
+    {
+        std::mutex mutex;
+        bool loaded = false;
+        int fd = -1;       // opened when the first file is packed
+        uint64_t end = 0;  // where the next record goes
+        uint64_t live = 0; // bytes of the records of live files
+        int64_t stamp = 0; // time of the last change
+        bool compacting = false;
+        std::unordered_map<std::string, Entry> entries;
+    };
+
+    std::mutex mutex;
+    std::unordered_map<std::string, std::shared_ptr<Pack>> packs; // by path of the pack
+    std::condition_variable work;
+    std::deque<std::string> compactions;
+    bool compactor_running;
+
+    PackStore();
+    std::shared_ptr<Pack> packOf(const std::string &path);
+    void load(const std::string &path, Pack &pack);
+    void append(const std::string &path, Pack &pack, const Buffer &record);
+    void schedule(const std::string &path, Pack &pack);
+    void compactPacks();
+    void compact(const std::string &path);
+    static int64_t now();
+
+public:
+    static PackStore &instance();
+    // Whether new files below Storage::pack_threshold are packed; files already packed are
+    // always found, whatever the setting
+    static bool enabled();
+
+    bool stat(const std::string &path, const std::string &name, Entry &entry);
+    bool read(const std::string &path, const std::string &name, Buffer &data);
+    // Fails with std::invalid_argument when name is packed already, unless replace is set
+    void put(const std::string &path, const std::string &name, const Buffer &data, bool replace);
+    bool remove(const std::string &path, const std::string &name);
+    // Fails when to is packed already
+    bool rename(const std::string &path, const std::string &from, const std::string &to);
+    std::vector<std::string> list(const std::string &path);
+    // Time of the last change of the pack, 0 without one
+    int64_t stamp(const std::string &path);
+};
+
+#endif // PACK_STORE_H
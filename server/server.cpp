@@ -23,9 +23,28 @@
 #include "../packets/delete.h"
 #include <filesystem>
 #include "worker.h"
+#include "storage_backend.h"
+#include "metadata_index.h"
+#include "tier_store.h"
+#include "version_store.h"
 
 int main()
 {
+    // recipes, the chunk store and delta sync temporaries live next to the user files
+    if (Storage::deduplicate && !StorageBackend::instance().isLocal())
+    {
+        std::cerr << "[SERVER] Deduplication needs a local storage backend" << std::endl;
+        return -1;
+    }
+
+    // index changes journaled by the previous run, before a session can look at an index
+    MetadataIndex::instance().recover();
+
+    // the mover of the storage tiers starts with the server, not with the first read
+    TierStore::instance();
+    // ... so does the retention pass of the file versions
+    VersionStore::instance();
+
     // Create socket
     int server_socket = socket(AF_INET, SOCK_STREAM, 0);
     if (server_socket == -1)
@@ -0,0 +1,259 @@
+#include "staged_file.h"
+#include "constants.h"
+#include <algorithm>
+#include <atomic>
+#include <cerrno>
+#include <cstring>
+#include <fcntl.h>
+#include <filesystem>
+#include <functional>
+#include <stdexcept>
+#include <sys/stat.h>
+#include <thread>
+#include <unistd.h>
+
+namespace fs = std::filesystem;
+
+StagedFile::StagedFile(IoEngine *engine) : dir_fd(-1), fd(-1), reserved(0), written(0), flushed(0), direct(false), engine(engine), filled(0), device_queue(0), modified(-1)
+{
+}
+
+void StagedFile::create(const std::string &path, uintmax_t size, int folder_fd)
+{
+    discard();
+
+    // every name is resolved against the folder, the rename can't be redirected halfway
+    if (folder_fd != -1)
+    {
+        final_name = path;
+        dir_fd = fcntl(folder_fd, F_DUPFD_CLOEXEC, 0);
+    }
+    else
+    {
+        fs::path target(path);
+        std::string folder = target.has_parent_path() ? target.parent_path().string() : ".";
+        final_name = target.filename().string();
+        dir_fd = open(folder.c_str(), O_RDONLY | O_DIRECTORY | O_CLOEXEC);
+    }
+
+    if (dir_fd == -1)
+        throw std::runtime_error("Unable to open folder.");
+
+    if (faccessat(dir_fd, final_name.c_str(), F_OK, AT_SYMLINK_NOFOLLOW) == 0)
+    {
+        discard();
+        throw std::invalid_argument("File already exists.");
+    }
+
+    static std::atomic<uint64_t> sequence(0);
+    temp_name = "." + final_name + ".upload." + std::to_string(std::hash<std::thread::id>{}(std::this_thread::get_id())) + "." + std::to_string(sequence++);
+
+    int flags = O_WRONLY | O_CREAT | O_EXCL | O_CLOEXEC;
+    if (size >= Storage::direct_io_threshold)
+        fd = openDirect(temp_name, flags, direct, dir_fd, 0644);
+    else
+        fd = openat(dir_fd, temp_name.c_str(), flags, 0644);
+
+    if (fd == -1)
+    {
+        temp_name.clear();
+        discard();
+        throw std::runtime_error("Unable to create file.");
+    }
+
+    if (!usesRing())
+        device_queue = WriteBehind::instance().queue(fd);
+
+    // reserving the whole length keeps the file contiguous and the size fixed while writing,
+    // filesystems without fallocate just grow the file as usual
+    if (size > 0 && fallocate(fd, 0, 0, size) == 0)
+        reserved = size;
+    else if (size > 0 && errno == ENOSPC)
+    {
+        discard();
+        throw std::runtime_error("Not enough space for the file.");
+    }
+}
+
+void StagedFile::write(const Buffer &data)
+{
+    // chunks arrive a few KB at a time, the file only sees whole blocks (O_DIRECT needs them aligned)
+    for (size_t offset = 0; offset < data.size();)
+    {
+        if (!block)
+            block = AlignedBufferPool::instance().acquire();
+
+        size_t take = std::min(data.size() - offset, Storage::direct_io_block - filled);
+        memcpy(block.get() + filled, data.data() + offset, take);
+        filled += take;
+        offset += take;
+
+        if (filled == Storage::direct_io_block)
+            flushBlock();
+    }
+
+    written += data.size();
+}
+
+void StagedFile::flushBlock()
+{
+    // the previous block must be on the disk before its buffer is reused
+    waitFlush();
+    if (!spare)
+        spare = AlignedBufferPool::instance().acquire();
+    std::swap(block, spare);
+
+    if (usesRing())
+    {
+        engine->write(flushing, fd, spare.get(), filled, flushed);
+        engine->submit();
+    }
+    else
+        WriteBehind::instance().write(behind, device_queue, fd, spare.get(), filled, flushed);
+
+    flushed += filled;
+    filled = 0;
+}
+
+void StagedFile::waitFlush()
+{
+    const unsigned char *data;
+    size_t length;
+    uint64_t offset;
+    int error;
+
+    if (usesRing())
+    {
+        if (engine->wait(flushing))
+            return;
+        data = flushing.data, length = flushing.length, offset = flushing.offset, error = flushing.error;
+        flushing = IoEngine::Request();
+    }
+    else
+    {
+        if (WriteBehind::instance().wait(behind))
+            return;
+        data = behind.data, length = behind.length, offset = behind.offset, error = behind.error;
+        behind = WriteBehind::Job();
+    }
+
+    // accepted at open time but refused on the first transfer
+    if (error != EINVAL || !direct)
+        throw std::runtime_error("Unable to write to file.");
+
+    dropDirect(fd, direct);
+    writeAll(data, length, offset);
+}
+
+void StagedFile::writeAll(const unsigned char *data, size_t length, uintmax_t offset)
+{
+    size_t done = 0;
+
+    while (done < length)
+    {
+        ssize_t count = pwrite(fd, data + done, length - done, offset + done);
+        if (count == -1 && errno == EINTR)
+            continue;
+        // accepted at open time but refused on the first transfer
+        if (count == -1 && errno == EINVAL && direct)
+        {
+            dropDirect(fd, direct);
+            continue;
+        }
+        if (count <= 0)
+            throw std::runtime_error("Unable to write to file.");
+
+        done += count;
+    }
+}
+
+void StagedFile::commit()
+{
+    if (fd == -1)
+        throw std::runtime_error("File stream not open.");
+
+    waitFlush();
+
+    // the tail is rarely a multiple of the alignment, it goes through the page cache
+    if (filled > 0)
+    {
+        dropDirect(fd, direct);
+        writeAll(block.get(), filled, flushed);
+        flushed += filled;
+        filled = 0;
+    }
+
+    // a shorter file than announced gives the unused reservation back
+    if (written < reserved && ftruncate(fd, written) != 0)
+        throw std::runtime_error("Unable to write to file.");
+
+    if (modified >= 0)
+    {
+        struct timespec times[2] = {{0, UTIME_OMIT}, {static_cast<time_t>(modified / 1000000000LL), static_cast<long>(modified % 1000000000LL)}};
+        if (futimens(fd, times) != 0)
+            throw std::runtime_error("Unable to write to file.");
+    }
+
+    bool durable = true;
+    if (Storage::durability == Durability::FILE_SYNC)
+        durable = fdatasync(fd) == 0;
+    else if (Storage::durability == Durability::GROUP_COMMIT)
+        durable = WriteBehind::instance().sync(fd);
+
+    if (!durable)
+        throw std::runtime_error("Unable to write to file.");
+
+    close();
+
+    if (renameat(dir_fd, temp_name.c_str(), dir_fd, final_name.c_str()) != 0)
+        throw std::runtime_error("Unable to move file into place.");
+
+    temp_name.clear();
+    discard();
+}
+
+void StagedFile::close()
+{
+    if (fd != -1)
+        ::close(fd);
+    fd = -1;
+}
+
+void StagedFile::discard()
+{
+    // the spare block may still be in the middle of a write
+    try
+    {
+        if (engine && flushing.pending)
+            engine->wait(flushing);
+    }
+    catch (const std::exception &e)
+    {
+    }
+    if (behind.pending)
+        WriteBehind::instance().wait(behind);
+    flushing = IoEngine::Request();
+    behind = WriteBehind::Job();
+
+    close();
+
+    if (dir_fd != -1 && !temp_name.empty())
+        unlinkat(dir_fd, temp_name.c_str(), 0);
+    temp_name.clear();
+
+    if (dir_fd != -1)
+        ::close(dir_fd);
+    dir_fd = -1;
+    reserved = 0;
+    written = 0;
+    flushed = 0;
+    direct = false;
+    block.reset();
+    spare.reset();
+    filled = 0;
+}
+
+StagedFile::~StagedFile()
+{
+    discard();
+}
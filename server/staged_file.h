@@ -0,0 +1,68 @@
+#ifndef STAGED_FILE_H
+#define STAGED_FILE_H
+
+#include <cstdint>
+#include <string>
+#include <vector>
+#include "direct_io.h"
+#include "io_engine.h"
+#include "write_behind.h"
+#include "storage_backend.h"
+
+typedef std::vector<unsigned char> Buffer;
+
+// ----------------------------------- STAGED FILE ------------------------------------
+
+// Plain file written under a hidden temporary name in its final folder and renamed into
+// place by commit(). Readers see either no file or the complete one, and a file that is
+// never committed is removed when the object goes away.
+class StagedFile : public BackendWriter
+{
+private:
+    int dir_fd;
+    int fd;
+    std::string temp_name;
+    std::string final_name;
+    uintmax_t reserved;
+    uintmax_t written;
+    uintmax_t flushed; // bytes handed to the file so far
+    bool direct;
+    IoEngine *engine;
+    AlignedBufferPool::Block block; // incoming data is gathered here into whole blocks
+    size_t filled;
+    AlignedBufferPool::Block spare; // the block still being written in the background
+    IoEngine::Request flushing;     // ... by the session ring
+    WriteBehind::Job behind;        // ... or by the write behind thread of its device
+    size_t device_queue;
+    int64_t modified; // nanoseconds, -1 leaves the time of the last write
+
+    bool usesRing() const { return engine && engine->usesRing(); }
+    void flushBlock();
+    void waitFlush();
+    void writeAll(const unsigned char *data, size_t length, uintmax_t offset);
+    void close();
+
+public:
+    // full blocks are written in the background while the next one fills, on the ring of
+    // engine when it has one and by the write behind thread of the device otherwise
+    StagedFile(IoEngine *engine = nullptr);
+    StagedFile(const StagedFile &) = delete;
+    StagedFile &operator=(const StagedFile &) = delete;
+
+    // size is the expected length, the blocks are reserved up front when the filesystem allows it.
+    // Files from Storage::direct_io_threshold on are written with O_DIRECT where supported.
+    // With a folder descriptor, path is a name inside that folder.
+    void create(const std::string &path, uintmax_t size, int folder_fd = -1);
+    void write(const Buffer &data) override;
+    // writes the tail, makes the data durable as Storage::durability asks and renames the
+    // temporary file over path
+    void commit() override;
+    // modification time the file gets at commit instead of the time of its last write
+    void setModified(int64_t mtime) { modified = mtime; }
+    void discard();
+    bool isOpen() const { return fd != -1; }
+
+    ~StagedFile();
+};
+
+#endif // STAGED_FILE_H
@@ -0,0 +1,880 @@
+#include "storage_backend.h"
+#include "staged_file.h"
+#include "direct_io.h"
+#include "pack_store.h"
+#include "tier_store.h"
+#include "compressed_file.h"
+#include "constants.h"
+#include "../tools/file.h"
+#include <algorithm>
+#include <cerrno>
+#include <chrono>
+#include <cstdio>
+#include <dirent.h>
+#include <fcntl.h>
+#include <filesystem>
+#include <fstream>
+#include <iostream>
+#include <stdexcept>
+#include <sys/stat.h>
+#include <unistd.h>
+#include <unordered_set>
+
+namespace fs = std::filesystem;
+
+namespace
+{
+    int64_t nanoseconds(const struct timespec &time)
+    {
+        return static_cast<int64_t>(time.tv_sec) * 1000000000LL + time.tv_nsec;
+    }
+
+    // FNV-1a, unlike std::hash it gives the same shard on every build and run
+    uint64_t stableHash(const std::string &value)
+    {
+        uint64_t hash = 14695981039346656037ULL;
+        for (unsigned char byte : value)
+        {
+            hash ^= byte;
+            hash *= 1099511628211ULL;
+        }
+        return hash;
+    }
+
+    // FNV-1a of similar names (root#0, root#1...) differ mostly in the low bits, the
+    // finalizer spreads them over the whole ring
+    uint64_t ringPoint(const std::string &value)
+    {
+        uint64_t hash = stableHash(value);
+        hash = (hash ^ (hash >> 30)) * 0xbf58476d1ce4e5b9ULL;
+        hash = (hash ^ (hash >> 27)) * 0x94d049bb133111ebULL;
+        return hash ^ (hash >> 31);
+    }
+
+    // Seekable read only view of a stored buffer, which it keeps alive
+    class SharedBufferStreamBuf : public std::streambuf
+    {
+    private:
+        std::shared_ptr<const Buffer> data;
+
+    protected:
+        pos_type seekoff(off_type distance, std::ios_base::seekdir direction, std::ios_base::openmode mode) override
+        {
+            off_type base = 0;
+            if (direction == std::ios_base::cur)
+                base = gptr() - eback();
+            else if (direction == std::ios_base::end)
+                base = egptr() - eback();
+            return seekpos(pos_type(base + distance), mode);
+        }
+
+        pos_type seekpos(pos_type target, std::ios_base::openmode mode) override
+        {
+            off_type offset = target;
+            if (!(mode & std::ios_base::in) || offset < 0 || offset > egptr() - eback())
+                return pos_type(off_type(-1));
+
+            setg(eback(), eback() + offset, egptr());
+            return target;
+        }
+
+    public:
+        SharedBufferStreamBuf(const std::shared_ptr<const Buffer> &data) : data(data)
+        {
+            char *begin = const_cast<char *>(reinterpret_cast<const char *>(data->data()));
+            setg(begin, begin, begin + data->size());
+        }
+    };
+
+    class SharedBufferStream : public std::istream
+    {
+    private:
+        SharedBufferStreamBuf buffer;
+
+    public:
+        SharedBufferStream(const std::shared_ptr<const Buffer> &data) : std::istream(&buffer), buffer(data) {}
+    };
+
+    class MemoryWriter : public BackendWriter
+    {
+    private:
+        MemoryBackend &backend;
+        std::string user;
+        std::string name;
+        Buffer data;
+
+    public:
+        MemoryWriter(MemoryBackend &backend, const std::string &user, const std::string &name, uintmax_t size)
+            : backend(backend), user(user), name(name)
+        {
+            data.reserve(size);
+        }
+
+        void write(const Buffer &chunk) override
+        {
+            data.insert(data.end(), chunk.begin(), chunk.end());
+        }
+
+        void commit() override
+        {
+            backend.store(user, name, std::move(data));
+            data.clear();
+        }
+    };
+}
+
+namespace
+{
+    // A small file gathered in memory, appended to the pack of the folder once committed
+    class PackWriter : public BackendWriter
+    {
+    private:
+        StorageBackend &backend;
+        std::string user;
+        std::string name;
+        std::string pack;
+        Buffer data;
+
+    public:
+        PackWriter(StorageBackend &backend, const std::string &user, const std::string &name, const std::string &pack, uintmax_t size)
+            : backend(backend), user(user), name(name), pack(pack)
+        {
+            data.reserve(size);
+        }
+
+        void write(const Buffer &chunk) override
+        {
+            data.insert(data.end(), chunk.begin(), chunk.end());
+        }
+
+        void commit() override
+        {
+            // the pack itself refuses a name it holds already
+            if (backend.exists(user, name))
+                throw std::invalid_argument("File already exists.");
+            PackStore::instance().put(pack, name, data, false);
+        }
+    };
+
+    // Keeps the folder handle of user open for a whole tier move: the mover throttles for long
+    // between locating the folder and its last use, the last session may log out meanwhile
+    class FolderReference
+    {
+    private:
+        PosixBackend &backend;
+        std::string user;
+        bool held;
+
+    public:
+        FolderReference(PosixBackend &backend, const std::string &user) : backend(backend), user(user), held(backend.hold(user)) {}
+        ~FolderReference()
+        {
+            if (held)
+                backend.detach(user);
+        }
+    };
+
+    bool sameFile(const struct stat &first, const struct stat &second)
+    {
+        return first.st_dev == second.st_dev && first.st_ino == second.st_ino && first.st_size == second.st_size &&
+               nanoseconds(first.st_mtim) == nanoseconds(second.st_mtim);
+    }
+
+    // Moves from (in from_fd) to to (in to_fd) through a staged copy paced by the tier mover;
+    // the copy keeps the modification time, so the entity tag of the file stays. It is put in
+    // place, and the source removed, only if the source did not change meanwhile. The copy
+    // is compressed at rest when compress is set and plain otherwise, whatever the source.
+    bool moveFile(int from_fd, const std::string &from, int to_fd, const std::string &to, bool compress)
+    {
+        int fd = openat(from_fd, from.c_str(), O_RDONLY | O_CLOEXEC | O_NOFOLLOW);
+        struct stat before;
+        if (fd == -1 || fstat(fd, &before) != 0 || !S_ISREG(before.st_mode))
+        {
+            if (fd != -1)
+                close(fd);
+            return false;
+        }
+
+        // past the page cache like any large read, a cold file is not worth caching
+        bool direct = false;
+        if (static_cast<uintmax_t>(before.st_size) >= Storage::direct_io_threshold)
+            enableDirect(fd, direct);
+        std::unique_ptr<std::istream> source(new DirectStream(fd, direct));
+
+        try
+        {
+            uintmax_t size = before.st_size;
+            bool compressed = CompressedStream::probe(*source, size);
+            if (compressed && !compress)
+            {
+                std::unique_ptr<std::istream> plaintext = CompressedStream::open(source);
+                source = std::move(plaintext);
+            }
+            else if (compressed)
+                size = before.st_size;
+
+            std::unique_ptr<StagedFile> staged(new StagedFile());
+            staged->create(to, size, to_fd);
+            staged->setModified(nanoseconds(before.st_mtim));
+
+            std::unique_ptr<BackendWriter> output = std::move(staged);
+            if (compress && !compressed)
+            {
+                std::unique_ptr<BackendWriter> writer(new CompressedWriter(std::move(output), size));
+                output = std::move(writer);
+            }
+
+            Buffer block;
+            for (uintmax_t done = 0; done < size;)
+            {
+                block.resize(std::min<uintmax_t>(Storage::direct_io_block, size - done));
+                if (!source->read(reinterpret_cast<char *>(block.data()), block.size()))
+                    throw std::runtime_error("Unable to read from file.");
+
+                output->write(block);
+                done += block.size();
+                TierStore::instance().throttle(block.size());
+            }
+
+            std::lock_guard<std::mutex> lock(TierStore::instance().switching());
+            struct stat after;
+            if (fstatat(from_fd, from.c_str(), &after, AT_SYMLINK_NOFOLLOW) != 0 || !sameFile(before, after))
+                return false;
+
+            output->commit();
+            return unlinkat(from_fd, from.c_str(), 0) == 0;
+        }
+        catch (const std::exception &e)
+        {
+            std::cerr << "[TIER] " << to << ": " << e.what() << std::endl;
+            return false;
+        }
+    }
+}
+
+StorageBackend &StorageBackend::instance()
+{
+    static std::unique_ptr<StorageBackend> backend(
+        Storage::backend == Backends::MEMORY    ? static_cast<StorageBackend *>(new MemoryBackend())
+        : Storage::backend == Backends::SHARDED ? new ShardedBackend(std::vector<std::string>(Storage::shard_roots.begin(), Storage::shard_roots.end()))
+                                                : new PosixBackend(Storage::data_root));
+    return *backend;
+}
+
+bool StorageBackend::exists(const std::string &user, const std::string &name)
+{
+    FileStat info;
+    return stat(user, name, info);
+}
+
+// ----------------------------------- POSIX ------------------------------------
+
+PosixBackend::PosixBackend(const std::string &root) : root(root) {}
+
+PosixBackend::~PosixBackend()
+{
+    for (const auto &handle : handles)
+        close(handle.second.fd);
+}
+
+void PosixBackend::attach(const std::string &user)
+{
+    hold(user);
+}
+
+bool PosixBackend::hold(const std::string &user)
+{
+    std::lock_guard<std::mutex> lock(mutex);
+
+    auto found = handles.find(user);
+    if (found != handles.end())
+    {
+        found->second.sessions++;
+        return true;
+    }
+
+    // the folders of registered users are created together with their accounts,
+    // without one every operation fails as it would on the path
+    int fd = open(folder(user).c_str(), O_RDONLY | O_DIRECTORY | O_CLOEXEC);
+    if (fd == -1)
+        return false;
+    handles[user] = {fd, 1};
+    return true;
+}
+
+void PosixBackend::detach(const std::string &user)
+{
+    std::lock_guard<std::mutex> lock(mutex);
+
+    auto found = handles.find(user);
+    if (found == handles.end() || --found->second.sessions > 0)
+        return;
+
+    close(found->second.fd);
+    handles.erase(found);
+}
+
+int PosixBackend::locate(const std::string &user, const std::string &name, std::string &relative)
+{
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        auto found = handles.find(user);
+        if (found != handles.end())
+        {
+            relative = name;
+            return found->second.fd;
+        }
+    }
+
+    relative = path(user, name);
+    return AT_FDCWD;
+}
+
+std::string PosixBackend::folder(const std::string &user) const
+{
+    return root + "/" + user;
+}
+
+std::string PosixBackend::coldFolder(const std::string &user) const
+{
+    return Storage::cold_root + "/" + user;
+}
+
+std::string PosixBackend::packPath(const std::string &user) const
+{
+    // outside the folder: rewriting the pack leaves the folder stamp alone
+    std::string folder_path = folder(user);
+    return folder_path.substr(0, folder_path.size() - user.size()) + "." + user + ".pack";
+}
+
+int64_t PosixBackend::stamp(const std::string &user)
+{
+    std::string relative;
+    int dir_fd = locate(user, ".", relative);
+
+    struct stat info, cold_info;
+    if (fstatat(dir_fd, relative.c_str(), &info, 0) != 0 || !S_ISDIR(info.st_mode))
+        return -1;
+
+    int64_t stamp = std::max<int64_t>(nanoseconds(info.st_mtim), PackStore::instance().stamp(packPath(user)));
+    if (::stat(coldFolder(user).c_str(), &cold_info) == 0)
+        stamp = std::max<int64_t>(stamp, nanoseconds(cold_info.st_mtim));
+    return stamp;
+}
+
+int PosixBackend::openDescriptor(const std::string &user, const std::string &name)
+{
+    if (!File::isValidFileName(name))
+        return -1;
+
+    std::string relative;
+    int dir_fd = locate(user, name, relative);
+    return openat(dir_fd, relative.c_str(), O_RDONLY | O_CLOEXEC | O_NOFOLLOW);
+}
+
+std::unique_ptr<std::istream> PosixBackend::openRead(const std::string &user, const std::string &name)
+{
+    std::shared_ptr<Buffer> packed(new Buffer());
+    if (File::isValidFileName(name) && PackStore::instance().read(packPath(user), name, *packed))
+        return std::unique_ptr<std::istream>(new SharedBufferStream(packed));
+
+    // cold files have no descriptor for the zero copy paths, they are only ever streamed
+    int fd = openDescriptor(user, name);
+    if (fd == -1 && File::isValidFileName(name))
+        fd = open((coldFolder(user) + "/" + name).c_str(), O_RDONLY | O_CLOEXEC | O_NOFOLLOW);
+    if (fd == -1)
+        throw std::invalid_argument("File does not exist.");
+
+    struct stat info;
+    if (fstat(fd, &info) != 0 || !S_ISREG(info.st_mode))
+    {
+        close(fd);
+        throw std::invalid_argument("File does not exist.");
+    }
+
+    // large files are streamed past the page cache so they don't evict everybody's hot data
+    bool direct = false;
+    if (static_cast<uintmax_t>(info.st_size) >= Storage::direct_io_threshold)
+        enableDirect(fd, direct);
+
+    std::unique_ptr<std::istream> stream(new DirectStream(fd, direct));
+    if (!*stream)
+        throw std::runtime_error("Unable to open file for reading.");
+    return stream;
+}
+
+std::unique_ptr<BackendWriter> PosixBackend::openWrite(const std::string &user, const std::string &name, uintmax_t size, IoEngine *engine)
+{
+    if (!File::isValidFileName(name))
+        throw std::invalid_argument("Invalid file name.");
+
+    if (PackStore::enabled() && size < Storage::pack_threshold)
+    {
+        if (exists(user, name))
+            throw std::invalid_argument("File already exists.");
+        return std::unique_ptr<BackendWriter>(new PackWriter(*this, user, name, packPath(user), size));
+    }
+
+    PackStore::Entry entry;
+    FileStat info;
+    if (PackStore::instance().stat(packPath(user), name, entry) || coldStat(user, name, info))
+        throw std::invalid_argument("File already exists.");
+
+    std::string relative;
+    int dir_fd = locate(user, name, relative);
+
+    std::unique_ptr<StagedFile> file(new StagedFile(engine));
+    file->create(relative, size, dir_fd == AT_FDCWD ? -1 : dir_fd);
+    return file;
+}
+
+std::vector<std::string> PosixBackend::list(const std::string &user)
+{
+    std::vector<std::string> names;
+    std::string relative;
+    int dir_fd = locate(user, ".", relative);
+
+    // a descriptor of its own, the directory stream owns it and keeps its own offset
+    int fd = openat(dir_fd, relative.c_str(), O_RDONLY | O_DIRECTORY | O_CLOEXEC);
+    if (fd == -1)
+        return names;
+
+    DIR *directory = fdopendir(fd);
+    if (!directory)
+    {
+        close(fd);
+        return names;
+    }
+
+    // hidden entries are server side temporaries, they can never be valid user file names
+    while (struct dirent *entry = readdir(directory))
+    {
+        std::string name = entry->d_name;
+        if (!File::isValidFileName(name))
+            continue;
+
+        bool regular = entry->d_type == DT_REG;
+        if (entry->d_type == DT_UNKNOWN)
+        {
+            struct stat info;
+            regular = fstatat(fd, entry->d_name, &info, AT_SYMLINK_NOFOLLOW) == 0 && S_ISREG(info.st_mode);
+        }
+
+        if (regular)
+            names.push_back(name);
+    }
+
+    closedir(directory);
+
+    // a name both packed and on its own was on its way out of the pack when the server
+    // stopped (see install), the file of its own is the newer version
+    std::string pack = packPath(user);
+    std::unordered_set<std::string> files(names.begin(), names.end());
+    for (const std::string &name : PackStore::instance().list(pack))
+    {
+        if (files.count(name) == 0)
+            names.push_back(name);
+        else if (PackStore::instance().remove(pack, name))
+            std::cerr << "[PACK] " << name << " of " << user << " left the pack" << std::endl;
+    }
+
+    // same for a name both in the folder and in the cold tier, a move stopped halfway
+    std::string cold_folder = coldFolder(user);
+    std::error_code error;
+    for (fs::directory_iterator it(cold_folder, error), end; !error && it != end; it.increment(error))
+    {
+        std::string name = it->path().filename().string();
+        if (!File::isValidFileName(name) || !it->is_regular_file(error))
+            continue;
+
+        if (files.count(name) == 0)
+            names.push_back(name);
+        else if (unlink((cold_folder + "/" + name).c_str()) == 0)
+            std::cerr << "[TIER] Dropped the cold copy of " << name << " of " << user << std::endl;
+    }
+    return names;
+}
+
+bool PosixBackend::rename(const std::string &user, const std::string &from, const std::string &to)
+{
+    if (!File::isValidFileName(from) || !File::isValidFileName(to))
+        return false;
+
+    // a packed file is renamed inside the pack, a cold one inside the cold tier, as long as
+    // no other tier has the new name
+    std::lock_guard<std::mutex> lock(TierStore::instance().switching());
+    std::string pack = packPath(user);
+    PackStore::Entry entry;
+    FileStat info;
+    if (PackStore::instance().stat(pack, from, entry))
+        return !fileStat(user, to, info) && !coldStat(user, to, info) && PackStore::instance().rename(pack, from, to);
+    if (PackStore::instance().stat(pack, to, entry) || coldStat(user, to, info))
+        return false;
+
+    if (!fileStat(user, from, info) && coldStat(user, from, info))
+    {
+        std::string cold_folder = coldFolder(user);
+        return renameat2(AT_FDCWD, (cold_folder + "/" + from).c_str(), AT_FDCWD, (cold_folder + "/" + to).c_str(), RENAME_NOREPLACE) == 0 ||
+               ((errno == EINVAL || errno == ENOSYS) && std::rename((cold_folder + "/" + from).c_str(), (cold_folder + "/" + to).c_str()) == 0);
+    }
+
+    std::string from_relative, to_relative;
+    int dir_fd = locate(user, from, from_relative);
+    locate(user, to, to_relative);
+
+    // refuses to replace to atomically, a check beforehand could race another session
+    if (renameat2(dir_fd, from_relative.c_str(), dir_fd, to_relative.c_str(), RENAME_NOREPLACE) == 0)
+        return true;
+    if (errno != EINVAL && errno != ENOSYS)
+        return false;
+
+    // filesystems without RENAME_NOREPLACE
+    return faccessat(dir_fd, to_relative.c_str(), F_OK, AT_SYMLINK_NOFOLLOW) != 0 &&
+           renameat(dir_fd, from_relative.c_str(), dir_fd, to_relative.c_str()) == 0;
+}
+
+bool PosixBackend::remove(const std::string &user, const std::string &name)
+{
+    if (!File::isValidFileName(name))
+        return false;
+
+    std::lock_guard<std::mutex> lock(TierStore::instance().switching());
+    if (PackStore::instance().remove(packPath(user), name))
+        return true;
+
+    std::string relative;
+    int dir_fd = locate(user, name, relative);
+    if (unlinkat(dir_fd, relative.c_str(), 0) == 0)
+        return true;
+    return unlink((coldFolder(user) + "/" + name).c_str()) == 0;
+}
+
+bool PosixBackend::stat(const std::string &user, const std::string &name, FileStat &info)
+{
+    if (!File::isValidFileName(name))
+        return false;
+
+    PackStore::Entry entry;
+    if (PackStore::instance().stat(packPath(user), name, entry))
+    {
+        info.size = entry.length;
+        info.mtime = entry.mtime;
+        return true;
+    }
+
+    return fileStat(user, name, info) || coldStat(user, name, info);
+}
+
+bool PosixBackend::fileStat(const std::string &user, const std::string &name, FileStat &info)
+{
+    std::string relative;
+    int dir_fd = locate(user, name, relative);
+
+    struct stat file_info;
+    if (fstatat(dir_fd, relative.c_str(), &file_info, AT_SYMLINK_NOFOLLOW) != 0 || !S_ISREG(file_info.st_mode))
+        return false;
+
+    info.size = file_info.st_size;
+    info.mtime = nanoseconds(file_info.st_mtim);
+    return true;
+}
+
+bool PosixBackend::coldStat(const std::string &user, const std::string &name, FileStat &info)
+{
+    struct stat file_info;
+    if (::stat((coldFolder(user) + "/" + name).c_str(), &file_info) != 0 || !S_ISREG(file_info.st_mode))
+        return false;
+
+    info.size = file_info.st_size;
+    info.mtime = nanoseconds(file_info.st_mtim);
+    return true;
+}
+
+bool PosixBackend::install(const std::string &user, const std::string &name, const std::string &temp_name)
+{
+    if (!File::isValidFileName(name))
+        return false;
+
+    // the new version always lands in the folder, a cold old one goes once it is in place
+    std::lock_guard<std::mutex> lock(TierStore::instance().switching());
+    FileStat cold_info;
+    if (coldStat(user, name, cold_info))
+    {
+        std::string relative, temp_relative;
+        int dir_fd = locate(user, name, relative);
+        locate(user, temp_name, temp_relative);
+        return renameat(dir_fd, temp_relative.c_str(), dir_fd, relative.c_str()) == 0 &&
+               unlink((coldFolder(user) + "/" + name).c_str()) == 0;
+    }
+
+    std::string pack = packPath(user);
+    std::string relative, temp_relative;
+    int dir_fd = locate(user, name, relative);
+    locate(user, temp_name, temp_relative);
+
+    PackStore::Entry entry;
+    if (!PackStore::instance().stat(pack, name, entry))
+        return renameat(dir_fd, temp_relative.c_str(), dir_fd, relative.c_str()) == 0;
+
+    // a packed file stays packed while it is small enough, otherwise it moves out of the pack;
+    // the folder changes first, so a server stopping in between rebuilds the metadata index,
+    // whose listing drops the stale packed copy
+    FileStat info;
+    if (!fileStat(user, temp_name, info))
+        return false;
+
+    if (PackStore::enabled() && info.size < Storage::pack_threshold)
+    {
+        int fd = openat(dir_fd, temp_relative.c_str(), O_RDONLY | O_CLOEXEC | O_NOFOLLOW);
+        if (fd == -1)
+            return false;
+
+        Buffer data(info.size);
+        bool complete = true;
+        for (size_t done = 0; done < data.size() && complete;)
+        {
+            ssize_t count = read(fd, data.data() + done, data.size() - done);
+            complete = count > 0 || (count == -1 && errno == EINTR);
+            done += count > 0 ? count : 0;
+        }
+        close(fd);
+
+        if (!complete)
+            return false;
+        PackStore::instance().put(pack, name, data, true);
+        unlinkat(dir_fd, temp_relative.c_str(), 0);
+        return true;
+    }
+
+    return renameat(dir_fd, temp_relative.c_str(), dir_fd, relative.c_str()) == 0 && PackStore::instance().remove(pack, name);
+}
+
+bool PosixBackend::demote(const std::string &user, const std::string &name)
+{
+    if (!File::isValidFileName(name))
+        return false;
+
+    FolderReference reference(*this, user);
+    std::string relative;
+    int dir_fd = locate(user, name, relative);
+    struct stat info;
+    if (fstatat(dir_fd, relative.c_str(), &info, AT_SYMLINK_NOFOLLOW) != 0 || !S_ISREG(info.st_mode))
+        return false;
+
+    std::string cold_folder = coldFolder(user);
+    std::error_code error;
+    fs::create_directories(cold_folder, error);
+    int cold_fd = open(cold_folder.c_str(), O_RDONLY | O_DIRECTORY | O_CLOEXEC);
+    if (cold_fd == -1)
+    {
+        std::cerr << "[TIER] Unable to open " << cold_folder << std::endl;
+        return false;
+    }
+
+    // a copy left by a move stopped halfway, the file in the folder is the one that counts
+    unlinkat(cold_fd, name.c_str(), 0);
+
+    bool moved = moveFile(dir_fd, relative, cold_fd, name, true);
+    close(cold_fd);
+    return moved;
+}
+
+bool PosixBackend::promote(const std::string &user, const std::string &name)
+{
+    if (!File::isValidFileName(name))
+        return false;
+
+    std::string cold_folder = coldFolder(user);
+    int cold_fd = open(cold_folder.c_str(), O_RDONLY | O_DIRECTORY | O_CLOEXEC);
+    if (cold_fd == -1)
+        return false;
+
+    FolderReference reference(*this, user);
+    std::string relative;
+    int dir_fd = locate(user, name, relative);
+
+    FileStat info;
+    bool moved = false;
+    if (fileStat(user, name, info))
+    {
+        std::lock_guard<std::mutex> lock(TierStore::instance().switching());
+        unlinkat(cold_fd, name.c_str(), 0);
+    }
+    else
+    {
+        // back in the folder the file takes the form an upload of it would have
+        int fd = openat(cold_fd, name.c_str(), O_RDONLY | O_CLOEXEC | O_NOFOLLOW);
+        DirectStream stream(fd, false);
+        uintmax_t logical_size = 0;
+        if (coldStat(user, name, info) && !CompressedStream::probe(stream, logical_size))
+            logical_size = info.size;
+        moved = fd != -1 && moveFile(cold_fd, name, dir_fd == AT_FDCWD ? -1 : dir_fd, relative, CompressedWriter::wanted(name, logical_size));
+    }
+
+    close(cold_fd);
+    return moved;
+}
+
+bool PosixBackend::isCold(const std::string &user, const std::string &name)
+{
+    FileStat info;
+    return File::isValidFileName(name) && !fileStat(user, name, info) && coldStat(user, name, info);
+}
+
+// ----------------------------------- SHARDED ------------------------------------
+
+ShardedBackend::ShardedBackend(const std::vector<std::string> &roots) : PosixBackend(roots.front()), roots(roots)
+{
+    // the points of a root come from its path, so they stay put whatever the order of the roots
+    for (size_t index = 0; index < roots.size(); index++)
+        for (size_t point = 0; point < Storage::shard_vnodes; point++)
+            ring.emplace_back(ringPoint(roots[index] + "#" + std::to_string(point)), index);
+
+    std::sort(ring.begin(), ring.end());
+}
+
+void ShardedBackend::attach(const std::string &user)
+{
+    std::error_code error;
+    fs::create_directories(folder(user), error);
+    PosixBackend::attach(user);
+}
+
+std::string ShardedBackend::folder(const std::string &user) const
+{
+    auto next = std::lower_bound(ring.begin(), ring.end(), std::make_pair(ringPoint(user), size_t(0)));
+    if (next == ring.end())
+        next = ring.begin();
+
+    return roots[next->second] + "/" + user;
+}
+
+// ----------------------------------- MEMORY ------------------------------------
+
+int64_t MemoryBackend::now()
+{
+    // a wall clock stamp never repeats one recorded by an earlier run of the server
+    static std::mutex mutex;
+    static int64_t last = 0;
+
+    std::lock_guard<std::mutex> lock(mutex);
+    int64_t current = std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::system_clock::now().time_since_epoch()).count();
+    last = std::max(last + 1, current);
+    return last;
+}
+
+void MemoryBackend::attach(const std::string &user)
+{
+    std::lock_guard<std::mutex> lock(mutex);
+    Folder &user_folder = folders[user];
+    if (user_folder.stamp == 0)
+        user_folder.stamp = now();
+}
+
+std::string MemoryBackend::folder(const std::string &user) const
+{
+    // only a name for logs and cache keys, nothing exists there
+    return "memory:" + user;
+}
+
+int64_t MemoryBackend::stamp(const std::string &user)
+{
+    std::lock_guard<std::mutex> lock(mutex);
+    auto found = folders.find(user);
+    return found == folders.end() ? -1 : found->second.stamp;
+}
+
+std::unique_ptr<std::istream> MemoryBackend::openRead(const std::string &user, const std::string &name)
+{
+    std::shared_ptr<const Buffer> data;
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        auto found = folders.find(user);
+        if (found == folders.end() || found->second.files.count(name) == 0)
+            throw std::invalid_argument("File does not exist.");
+        data = found->second.files[name].data;
+    }
+
+    return std::unique_ptr<std::istream>(new SharedBufferStream(data));
+}
+
+std::unique_ptr<BackendWriter> MemoryBackend::openWrite(const std::string &user, const std::string &name, uintmax_t size, IoEngine *)
+{
+    if (!File::isValidFileName(name))
+        throw std::invalid_argument("Invalid file name.");
+    if (exists(user, name))
+        throw std::invalid_argument("File already exists.");
+
+    return std::unique_ptr<BackendWriter>(new MemoryWriter(*this, user, name, size));
+}
+
+void MemoryBackend::store(const std::string &user, const std::string &name, Buffer data)
+{
+    std::shared_ptr<const Buffer> stored = std::make_shared<const Buffer>(std::move(data));
+
+    std::lock_guard<std::mutex> lock(mutex);
+    Folder &user_folder = folders[user];
+    int64_t stamp = now();
+    user_folder.files[name] = {stored, stamp};
+    user_folder.stamp = stamp;
+}
+
+std::vector<std::string> MemoryBackend::list(const std::string &user)
+{
+    std::vector<std::string> names;
+
+    std::lock_guard<std::mutex> lock(mutex);
+    auto found = folders.find(user);
+    if (found != folders.end())
+        for (const auto &file : found->second.files)
+            names.push_back(file.first);
+    return names;
+}
+
+bool MemoryBackend::rename(const std::string &user, const std::string &from, const std::string &to)
+{
+    if (!File::isValidFileName(to))
+        return false;
+
+    std::lock_guard<std::mutex> lock(mutex);
+    auto found = folders.find(user);
+    if (found == folders.end())
+        return false;
+
+    std::map<std::string, StoredData> &files = found->second.files;
+    auto source = files.find(from);
+    if (source == files.end() || files.count(to) > 0)
+        return false;
+
+    files[to] = source->second;
+    files.erase(from);
+    found->second.stamp = now();
+    return true;
+}
+
+bool MemoryBackend::remove(const std::string &user, const std::string &name)
+{
+    std::lock_guard<std::mutex> lock(mutex);
+    auto found = folders.find(user);
+    if (found == folders.end() || found->second.files.erase(name) == 0)
+        return false;
+
+    found->second.stamp = now();
+    return true;
+}
+
+bool MemoryBackend::stat(const std::string &user, const std::string &name, FileStat &info)
+{
+    std::lock_guard<std::mutex> lock(mutex);
+    auto found = folders.find(user);
+    if (found == folders.end())
+        return false;
+
+    auto file = found->second.files.find(name);
+    if (file == found->second.files.end())
+        return false;
+
+    info.size = file->second.data->size();
+    info.mtime = file->second.mtime;
+    return true;
+}
@@ -0,0 +1,196 @@
+#ifndef STORAGE_BACKEND_H
+#define STORAGE_BACKEND_H
+
+#include <cstdint>
+#include <istream>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+typedef std::vector<unsigned char> Buffer;
+
+class IoEngine;
+
+struct FileStat
+{
+    uintmax_t size;
+    int64_t mtime; // nanoseconds
+};
+
+// ----------------------------------- BACKEND WRITER ------------------------------------
+
+// A file being written; it shows up under its name only once committed and is discarded
+// when dropped before
+class BackendWriter
+{
+public:
+    virtual void write(const Buffer &data) = 0;
+    virtual void commit() = 0;
+    virtual ~BackendWriter() = default;
+};
+
+// ----------------------------------- STORAGE BACKEND ------------------------------------
+
+// Where the files of the users live, chosen once by Storage::backend. Names are user file
+// names, the backend refuses any other. Files of a local backend are plain files reachable
+// through path(): only those take the zero copy paths (mapping, O_DIRECT, io_uring) and
+// support deduplication and delta sync, which keep recipes and temporaries next to them.
+class StorageBackend
+{
+public:
+    static StorageBackend &instance();
+    virtual ~StorageBackend() = default;
+
+    virtual bool isLocal() const = 0;
+    // Makes sure user has a folder and keeps it at hand, called at login; every attach is
+    // paired with a detach once the session ends
+    virtual void attach(const std::string &user) = 0;
+    virtual void detach(const std::string &user) = 0;
+    virtual std::string folder(const std::string &user) const = 0;
+    std::string path(const std::string &user, const std::string &name) const { return folder(user) + "/" + name; }
+    // Changes with every file added, replaced or removed in the folder of user, -1 without a folder
+    virtual int64_t stamp(const std::string &user) = 0;
+
+    virtual std::unique_ptr<std::istream> openRead(const std::string &user, const std::string &name) = 0;
+    // Read only descriptor of a file of a local backend for the zero copy paths, -1 when missing
+    virtual int openDescriptor(const std::string &user, const std::string &name) = 0;
+    // size is the expected length; engine queues the writes of a local backend (see StagedFile)
+    virtual std::unique_ptr<BackendWriter> openWrite(const std::string &user, const std::string &name, uintmax_t size, IoEngine *engine) = 0;
+    // Names of the files of user, in no particular order
+    virtual std::vector<std::string> list(const std::string &user) = 0;
+    // Fails when to already exists
+    virtual bool rename(const std::string &user, const std::string &from, const std::string &to) = 0;
+    virtual bool remove(const std::string &user, const std::string &name) = 0;
+    virtual bool stat(const std::string &user, const std::string &name, FileStat &info) = 0;
+    // Puts the finished file temp_name, written in the folder of user by path (local
+    // backends only), in place of name
+    virtual bool install(const std::string &user, const std::string &name, const std::string &temp_name) = 0;
+    // Moves a file of its own to the cold tier and back (see TierStore), false when there is
+    // nothing to move or the file changed while it was copied
+    virtual bool demote(const std::string &user, const std::string &name) = 0;
+    virtual bool promote(const std::string &user, const std::string &name) = 0;
+    virtual bool isCold(const std::string &user, const std::string &name) = 0;
+
+    bool exists(const std::string &user, const std::string &name);
+};
+
+// One folder per user under root, the original layout. The folder of an attached user is
+// opened once as a directory descriptor shared by its sessions, and every operation resolves
+// the bare file name against it with the *at() calls: no path walk per request, and no
+// name can lead out of the folder. Files below Storage::pack_threshold go to the pack of
+// the folder instead (see PackStore), kept next to it as .<user>.pack; a name is either
+// packed or a file of its own, never both. Files of their own may be demoted to
+// Storage::cold_root/<user> (see TierStore); the folder wins over the cold tier when a move
+// stopped halfway left a name in both.
+class PosixBackend : public StorageBackend
+{
+private:
+    struct Handle
+    {
+        int fd;
+        size_t sessions;
+    };
+
+    std::string root;
+    std::mutex mutex;
+    std::unordered_map<std::string, Handle> handles;
+
+    // Directory to resolve against and the name relative to it: the handle of an attached
+    // user, or the working directory and the whole path otherwise
+    int locate(const std::string &user, const std::string &name, std::string &relative);
+    std::string packPath(const std::string &user) const;
+    std::string coldFolder(const std::string &user) const;
+    bool fileStat(const std::string &user, const std::string &name, FileStat &info);
+    bool coldStat(const std::string &user, const std::string &name, FileStat &info);
+
+public:
+    PosixBackend(const std::string &root);
+    ~PosixBackend();
+
+    bool isLocal() const override { return true; }
+    void attach(const std::string &user) override;
+    void detach(const std::string &user) override;
+    // Reference on the folder handle of user, as a session takes at attach, for work that
+    // outlives no session of its own; false (and nothing to detach) without a folder
+    bool hold(const std::string &user);
+    std::string folder(const std::string &user) const override;
+    int64_t stamp(const std::string &user) override;
+
+    std::unique_ptr<std::istream> openRead(const std::string &user, const std::string &name) override;
+    int openDescriptor(const std::string &user, const std::string &name) override;
+    std::unique_ptr<BackendWriter> openWrite(const std::string &user, const std::string &name, uintmax_t size, IoEngine *engine) override;
+    std::vector<std::string> list(const std::string &user) override;
+    bool rename(const std::string &user, const std::string &from, const std::string &to) override;
+    bool remove(const std::string &user, const std::string &name) override;
+    bool stat(const std::string &user, const std::string &name, FileStat &info) override;
+    bool install(const std::string &user, const std::string &name, const std::string &temp_name) override;
+    bool demote(const std::string &user, const std::string &name) override;
+    bool promote(const std::string &user, const std::string &name) override;
+    bool isCold(const std::string &user, const std::string &name) override;
+};
+
+// User folders spread over several roots (one per disk) by consistent hashing of the user
+// name: each root owns Storage::shard_vnodes points of a hash ring and a user goes to the
+// root of the next point, so adding or dropping a root only moves the users of its share.
+// A folder is never split, so everything working on a whole folder still does.
+class ShardedBackend : public PosixBackend
+{
+private:
+    std::vector<std::string> roots;
+    std::vector<std::pair<uint64_t, size_t>> ring; // point and root, sorted by point
+
+public:
+    ShardedBackend(const std::vector<std::string> &roots);
+
+    void attach(const std::string &user) override;
+    std::string folder(const std::string &user) const override;
+};
+
+// Files kept in the server memory, nothing touches the disk
+class MemoryBackend : public StorageBackend
+{
+private:
+    struct StoredData
+    {
+        std::shared_ptr<const Buffer> data;
+        int64_t mtime;
+    };
+
+    struct Folder
+    {
+        std::map<std::string, StoredData> files;
+        int64_t stamp = 0;
+    };
+
+    std::mutex mutex;
+    std::map<std::string, Folder> folders;
+
+    static int64_t now();
+
+public:
+    bool isLocal() const override { return false; }
+    void attach(const std::string &user) override;
+    void detach(const std::string &) override {}
+    std::string folder(const std::string &user) const override;
+    int64_t stamp(const std::string &user) override;
+
+    std::unique_ptr<std::istream> openRead(const std::string &user, const std::string &name) override;
+    int openDescriptor(const std::string &, const std::string &) override { return -1; }
+    std::unique_ptr<BackendWriter> openWrite(const std::string &user, const std::string &name, uintmax_t size, IoEngine *engine) override;
+    std::vector<std::string> list(const std::string &user) override;
+    bool rename(const std::string &user, const std::string &from, const std::string &to) override;
+    bool remove(const std::string &user, const std::string &name) override;
+    bool stat(const std::string &user, const std::string &name, FileStat &info) override;
+    bool install(const std::string &, const std::string &, const std::string &) override { return false; }
+    bool demote(const std::string &, const std::string &) override { return false; }
+    bool promote(const std::string &, const std::string &) override { return false; }
+    bool isCold(const std::string &, const std::string &) override { return false; }
+
+    // Stores a committed file, replacing an older one
+    void store(const std::string &user, const std::string &name, Buffer data);
+};
+
+#endif // STORAGE_BACKEND_H
@@ -0,0 +1,137 @@
+#include "tier_store.h"
+#include "chunk_store.h"
+#include "metadata_index.h"
+#include "storage_backend.h"
+#include "constants.h"
+#include <iostream>
+#include <thread>
+#include <vector>
+
+TierStore::TierStore() : next_copy(std::chrono::steady_clock::now())
+{
+    if (enabled())
+        std::thread(&TierStore::moveFiles, this).detach();
+}
+
+TierStore &TierStore::instance()
+{
+    // never destroyed, its thread keeps running until the process exits
+    static TierStore *store = new TierStore();
+    return *store;
+}
+
+bool TierStore::enabled()
+{
+    return Storage::tier_cold_after_s > 0 && StorageBackend::instance().isLocal();
+}
+
+void TierStore::accessed(const std::string &user, const std::string &name)
+{
+    if (!enabled())
+        return;
+
+    MetadataIndex::instance().touch(user, name);
+    if (!StorageBackend::instance().isCold(user, name))
+        return;
+
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        if (!queued.insert({user, name}).second)
+            return;
+        promotions.push_back({user, name});
+    }
+    work.notify_one();
+}
+
+void TierStore::throttle(size_t bytes)
+{
+    // only the mover copies, so the pace needs no lock; idle time is not saved up for later
+    std::chrono::steady_clock::time_point now = std::chrono::steady_clock::now();
+    next_copy = std::max(next_copy, now) + std::chrono::microseconds(bytes * 1000000 / Storage::tier_rate);
+    if (next_copy > now)
+        std::this_thread::sleep_until(next_copy);
+}
+
+bool TierStore::nextPromotion(FileKey &file)
+{
+    std::lock_guard<std::mutex> lock(mutex);
+    if (promotions.empty())
+        return false;
+
+    file = promotions.front();
+    promotions.pop_front();
+    queued.erase(file);
+    return true;
+}
+
+void TierStore::promotePending()
+{
+    FileKey file;
+    while (nextPromotion(file))
+    {
+        if (!StorageBackend::instance().promote(file.first, file.second))
+            continue;
+
+        // same content and modification time: the entity tag stays, only the stored size follows
+        MetadataIndex::instance().refresh(file.first, file.second);
+        std::cout << "[TIER] Promoted " << file.second << " of " << file.first << std::endl;
+    }
+}
+
+void TierStore::demoteIdle(const std::string &user)
+{
+    int64_t now = std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::system_clock::now().time_since_epoch()).count();
+    int64_t cutoff = now - Storage::tier_cold_after_s * 1000000000LL;
+
+    std::vector<std::string> idle;
+    MetadataIndex::instance().forEach(user, "", [&idle, cutoff](const std::string &name, const FileMetadata &metadata)
+                                      {
+                                          if (metadata.accessed < cutoff)
+                                              idle.push_back(name);
+                                          return true; });
+
+    StorageBackend &backend = StorageBackend::instance();
+    size_t demoted = 0;
+    for (const std::string &name : idle)
+    {
+        // a recipe is looked up at its path in the user folder, its chunks are shared anyway
+        if (Recipe::isRecipe(backend.path(user, name)))
+            continue;
+
+        // files already cold or packed have no file of their own in the folder, nothing moves
+        if (backend.demote(user, name))
+        {
+            MetadataIndex::instance().refresh(user, name);
+            demoted++;
+        }
+
+        // a reader waiting for its file goes first
+        promotePending();
+    }
+
+    if (demoted > 0)
+        std::cout << "[TIER] Demoted " << demoted << " files of " << user << std::endl;
+}
+
+void TierStore::moveFiles()
+{
+    std::chrono::steady_clock::time_point next_scan = std::chrono::steady_clock::now() + std::chrono::seconds(Storage::tier_scan_s);
+
+    while (true)
+    {
+        {
+            std::unique_lock<std::mutex> lock(mutex);
+            work.wait_until(lock, next_scan, [this]()
+                            { return !promotions.empty(); });
+        }
+
+        promotePending();
+
+        if (std::chrono::steady_clock::now() < next_scan)
+            continue;
+
+        for (const std::string &user : username_list)
+            demoteIdle(user);
+        next_scan = std::chrono::steady_clock::now() + std::chrono::seconds(Storage::tier_scan_s);
+    }
+}
@@ -0,0 +1,54 @@
+#ifndef TIER_STORE_H
+#define TIER_STORE_H
+
+#include <chrono>
+#include <condition_variable>
+#include <deque>
+#include <mutex>
+#include <set>
+#include <string>
+#include <utility>
+
+// ----------------------------------- TIER STORE ------------------------------------
+
+// Two tiers for the files of a local backend: the user folders are the hot one, the folders
+// below Storage::cold_root the cold one (meant for a slower disk, files are kept there
+// compressed at rest). A background mover demotes the files not read for
+// Storage::tier_cold_after_s, going by the access time of the metadata index, and promotes
+// a cold file once it is read again. Readers never wait for a move, the backend serves a
+// file from whichever tier holds it. Moves copy at most Storage::tier_rate bytes a second so
+// foreground transfers keep the disks, and the source only goes once the copy is in place.
+class TierStore
+{
+private:
+    typedef std::pair<std::string, std::string> FileKey; // user, name
+
+    std::mutex mutex;
+    std::condition_variable work;
+    std::deque<FileKey> promotions;
+    std::set<FileKey> queued;
+
+    std::mutex switch_mutex;
+    std::chrono::steady_clock::time_point next_copy; // earliest time the next copy may start
+
+    TierStore();
+    void moveFiles();
+    void demoteIdle(const std::string &user);
+    void promotePending();
+    bool nextPromotion(FileKey &file);
+
+public:
+    static TierStore &instance();
+    // Whether files move between tiers; cold files are always found, whatever the setting
+    static bool enabled();
+
+    // A file of user was opened for reading: its access time goes to the metadata index and
+    // a cold file is queued for promotion
+    void accessed(const std::string &user, const std::string &name);
+    // Held while a move puts its copy in place, and by every change of a name on the backend
+    std::mutex &switching() { return switch_mutex; }
+    // Paces the copies of the mover, called after each block of bytes copied
+    void throttle(size_t bytes);
+};
+
+#endif // TIER_STORE_H
@@ -0,0 +1,468 @@
+#include "version_store.h"
+#include "chunk_store.h"
+#include "compressed_file.h"
+#include "storage_backend.h"
+#include "constants.h"
+#include <fcntl.h>
+#include <sys/stat.h>
+#include <algorithm>
+#include <cctype>
+#include <chrono>
+#include <filesystem>
+#include <fstream>
+#include <iostream>
+#include <thread>
+
+namespace fs = std::filesystem;
+
+namespace
+{
+    // a replaced file waiting to be chunked is linked into the version folder as
+    // <number>.<replaced>.linked: its own modification time is the one of the content, and
+    // the change time moves with every rename, so the time it was replaced is in the name
+    const std::string LINKED = ".linked";
+
+    bool digits(const std::string &text)
+    {
+        bool number = !text.empty() && text.size() < 20;
+        for (size_t i = 0; number && i < text.size(); i++)
+            number = std::isdigit(static_cast<unsigned char>(text[i]));
+        return number;
+    }
+
+    // Splits the name of a linked file, false for any other name
+    bool parseLinked(const std::string &name, std::string &number, std::string &replaced)
+    {
+        size_t dot = name.find('.');
+        if (dot == std::string::npos || name.size() < dot + 1 + LINKED.size() ||
+            name.compare(name.size() - LINKED.size(), LINKED.size(), LINKED) != 0)
+            return false;
+
+        number = name.substr(0, dot);
+        replaced = name.substr(dot + 1, name.size() - LINKED.size() - dot - 1);
+        return digits(number) && digits(replaced);
+    }
+
+    // Number of the version a file of a version folder holds, false for staging files of a
+    // recipe being written
+    bool versionNumber(const std::string &name, uint64_t &number)
+    {
+        std::string linked_number, replaced;
+        std::string text = parseLinked(name, linked_number, replaced) ? linked_number : name;
+        if (!digits(text))
+            return false;
+        number = std::stoull(text);
+        return true;
+    }
+
+    // Numbers of the versions in a folder, oldest first, chunked or still linked
+    std::vector<uint64_t> versionNumbers(const std::string &folder)
+    {
+        std::vector<uint64_t> numbers;
+        std::error_code error;
+        for (const auto &entry : fs::directory_iterator(folder, error))
+        {
+            uint64_t number;
+            if (versionNumber(entry.path().filename().string(), number))
+                numbers.push_back(number);
+        }
+
+        std::sort(numbers.begin(), numbers.end());
+        numbers.erase(std::unique(numbers.begin(), numbers.end()), numbers.end());
+        return numbers;
+    }
+
+    // The linked file of the version whose recipe goes to path, empty when there is none
+    std::string linkedPath(const std::string &path)
+    {
+        std::string wanted = fs::path(path).filename().string();
+        std::error_code error;
+        for (const auto &entry : fs::directory_iterator(fs::path(path).parent_path(), error))
+        {
+            std::string number, replaced;
+            if (parseLinked(entry.path().filename().string(), number, replaced) && number == wanted)
+                return entry.path().string();
+        }
+        return "";
+    }
+
+    // When the version was replaced, from the name of a linked file or the time of a recipe
+    int64_t replacedAt(const std::string &path)
+    {
+        std::string number, replaced;
+        if (parseLinked(fs::path(linkedPath(path)).filename().string(), number, replaced))
+            return std::stoll(replaced);
+
+        struct stat info;
+        if (::stat(path.c_str(), &info) != 0)
+            return 0;
+        return info.st_mtime;
+    }
+
+    // Logical size of a linked file, which may be compressed at rest
+    uintmax_t linkedSize(const std::string &linked)
+    {
+        std::unique_ptr<std::istream> input(new std::ifstream(linked, std::ios::binary));
+        std::unique_ptr<CompressedStream> plaintext = CompressedStream::open(input);
+        if (plaintext)
+            return plaintext->getFileSize();
+
+        std::error_code error;
+        uintmax_t size = fs::file_size(linked, error);
+        return error ? 0 : size;
+    }
+
+    // Logical size of the version whose recipe goes to path, 0 when there is none
+    uintmax_t versionSize(const std::string &path)
+    {
+        std::string linked = linkedPath(path);
+        if (!linked.empty())
+            return linkedSize(linked);
+
+        Recipe recipe;
+        return recipe.load(path) ? recipe.logical_size : 0;
+    }
+
+    // Chunks the whole content of input into the store and writes its recipe to path
+    void chunkInto(std::istream &input, const std::string &path)
+    {
+        ChunkedWriter writer;
+        Buffer block(Storage::max_chunk);
+        while (input.read(reinterpret_cast<char *>(block.data()), block.size()) || input.gcount() > 0)
+            writer.write(Buffer(block.begin(), block.begin() + input.gcount()));
+
+        if (!input.eof())
+            throw std::runtime_error("Unable to read file.");
+        writer.commit(path);
+    }
+
+    // Linked files of every version folder, those an earlier run or a failed chunking left
+    std::vector<std::string> linkedFiles()
+    {
+        std::vector<std::string> linked;
+        std::error_code error;
+        for (const auto &user : fs::directory_iterator(Storage::version_root, error))
+            for (const auto &file : fs::directory_iterator(user.path(), error))
+                for (const auto &version : fs::directory_iterator(file.path(), error))
+                {
+                    std::string number, replaced;
+                    if (parseLinked(version.path().filename().string(), number, replaced))
+                        linked.push_back(version.path().string());
+                }
+        return linked;
+    }
+}
+
+VersionStore::VersionStore()
+{
+    if (enabled())
+    {
+        waiting = linkedFiles();
+        std::thread(&VersionStore::collectOld, this).detach();
+    }
+}
+
+VersionStore &VersionStore::instance()
+{
+    // never destroyed, its thread keeps running until the process exits
+    static VersionStore *store = new VersionStore();
+    return *store;
+}
+
+bool VersionStore::enabled()
+{
+    return Storage::version_keep > 0 && StorageBackend::instance().isLocal();
+}
+
+std::string VersionStore::folder(const std::string &user, const std::string &name) const
+{
+    return Storage::version_root + "/" + user + "/" + name;
+}
+
+std::string VersionStore::versionPath(const std::string &user, const std::string &name, uint64_t number) const
+{
+    return folder(user, name) + "/" + std::to_string(number);
+}
+
+bool VersionStore::preserve(const std::string &user, const std::string &name)
+{
+    StorageBackend &backend = StorageBackend::instance();
+    if (!enabled() || !backend.exists(user, name))
+        return false;
+
+    std::lock_guard<std::mutex> lock(mutex);
+    uintmax_t &user_usage = usageLocked(user);
+    fs::create_directories(folder(user, name));
+    std::vector<uint64_t> numbers = versionNumbers(folder(user, name));
+    std::string path = versionPath(user, name, numbers.empty() ? 1 : numbers.back() + 1);
+
+    // a deduplicated file already is a list of chunks, its version costs a copy of the recipe
+    std::string file_path = backend.path(user, name);
+    Recipe recipe;
+    if (Recipe::isRecipe(file_path) && recipe.load(file_path))
+    {
+        std::shared_lock<std::shared_mutex> pin = ChunkStore::instance().pin();
+        recipe.save(path);
+        user_usage += recipe.logical_size;
+        return true;
+    }
+
+    // other files keep their content through a link, the background pass chunks it into the
+    // store where it shares what it has in common with the rest
+    int64_t now = std::chrono::duration_cast<std::chrono::seconds>(std::chrono::system_clock::now().time_since_epoch()).count();
+    std::string linked = path + "." + std::to_string(now) + LINKED;
+    std::error_code error;
+    fs::create_hard_link(file_path, linked, error);
+    if (!error)
+    {
+        user_usage += linkedSize(linked);
+        waiting.push_back(linked);
+        kept.notify_one();
+        return true;
+    }
+
+    // a packed file, or one on another filesystem (a shard or the cold tier), is chunked now
+    StoredFile file;
+    file.open(user, name);
+    chunkInto(file.getStream(), path);
+    user_usage += file.getFileSize();
+    return true;
+}
+
+bool VersionStore::chunkLinked(const std::string &linked)
+{
+    std::string number, replaced;
+    if (!parseLinked(fs::path(linked).filename().string(), number, replaced))
+        return false;
+    std::string path = (fs::path(linked).parent_path() / number).string();
+    std::string staging = path + ".chunking";
+
+    struct stat before;
+    if (::stat(linked.c_str(), &before) != 0)
+        return false;
+
+    // without the lock: sessions keep versioning files while this one is read
+    {
+        std::unique_ptr<std::istream> input(new std::ifstream(linked, std::ios::binary));
+        std::unique_ptr<CompressedStream> plaintext = CompressedStream::open(input);
+        if (plaintext)
+            input = std::move(plaintext);
+        chunkInto(*input, staging);
+    }
+
+    std::lock_guard<std::mutex> lock(mutex);
+    std::error_code error;
+    struct stat after;
+    if (::stat(linked.c_str(), &after) != 0 || after.st_ino != before.st_ino || after.st_dev != before.st_dev)
+    {
+        // renamed or dropped meanwhile, the chunks of the staged recipe may be unreferenced
+        fs::remove(staging, error);
+        ChunkStore::instance().release();
+        return false;
+    }
+
+    // the version is as old as the replacement of the file, not as its chunking
+    struct timespec times[2] = {{std::stoll(replaced), 0}, {std::stoll(replaced), 0}};
+    ::utimensat(AT_FDCWD, staging.c_str(), times, 0);
+    fs::rename(staging, path);
+    fs::remove(linked, error);
+    return true;
+}
+
+std::vector<FileVersion> VersionStore::list(const std::string &user, const std::string &name)
+{
+    std::vector<FileVersion> versions;
+    if (!enabled())
+        return versions;
+
+    std::lock_guard<std::mutex> lock(mutex);
+    std::vector<uint64_t> numbers = versionNumbers(folder(user, name));
+    for (auto it = numbers.rbegin(); it != numbers.rend() && versions.size() < MAX::versions_listed; ++it)
+    {
+        std::string path = versionPath(user, name, *it);
+        std::string linked = linkedPath(path);
+        Recipe recipe;
+        if (!linked.empty())
+            versions.push_back({*it, linkedSize(linked), replacedAt(path)});
+        else if (recipe.load(path))
+            versions.push_back({*it, recipe.logical_size, replacedAt(path)});
+    }
+    return versions;
+}
+
+bool VersionStore::open(const std::string &user, const std::string &name, uint64_t number, Recipe &recipe)
+{
+    if (!enabled())
+        return false;
+
+    std::string path = versionPath(user, name, number);
+    std::string linked;
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        linked = linkedPath(path);
+        if (linked.empty())
+            return fs::is_regular_file(path) && recipe.load(path);
+    }
+
+    // not reached by the background pass yet, the download or restore chunks it now
+    chunkLinked(linked);
+
+    std::lock_guard<std::mutex> lock(mutex);
+    return fs::is_regular_file(path) && recipe.load(path);
+}
+
+void VersionStore::rename(const std::string &user, const std::string &from, const std::string &to)
+{
+    if (!enabled())
+        return;
+
+    std::lock_guard<std::mutex> lock(mutex);
+    std::vector<uint64_t> moving = versionNumbers(folder(user, from));
+    if (moving.empty())
+        return;
+
+    // renames keep the modification time, so does the age of every version
+    fs::create_directories(folder(user, to));
+    std::vector<uint64_t> existing = versionNumbers(folder(user, to));
+    uint64_t next = existing.empty() ? 1 : existing.back() + 1;
+    for (uint64_t number : moving)
+    {
+        std::string source = versionPath(user, from, number);
+        std::string target = versionPath(user, to, next++);
+        if (fs::exists(source))
+            fs::rename(source, target);
+
+        // a linked file keeps the time it was replaced in its name
+        std::string linked = linkedPath(source), linked_number, replaced;
+        if (parseLinked(fs::path(linked).filename().string(), linked_number, replaced))
+        {
+            fs::rename(linked, target + "." + replaced + LINKED);
+            waiting.push_back(target + "." + replaced + LINKED);
+        }
+    }
+    kept.notify_one();
+
+    std::error_code error;
+    fs::remove(folder(user, from), error);
+}
+
+size_t VersionStore::collect()
+{
+    int64_t cutoff = std::chrono::duration_cast<std::chrono::seconds>(std::chrono::system_clock::now().time_since_epoch()).count() - Storage::version_max_age_s;
+    size_t removed = 0;
+
+    std::lock_guard<std::mutex> lock(mutex);
+    std::error_code error;
+    for (const auto &user : fs::directory_iterator(Storage::version_root, error))
+    {
+        if (!user.is_directory())
+            continue;
+        auto counted = used.find(user.path().filename().string());
+
+        for (const auto &file : fs::directory_iterator(user.path(), error))
+        {
+            if (!file.is_directory())
+                continue;
+
+            std::vector<uint64_t> numbers = versionNumbers(file.path().string());
+            for (size_t i = 0; i < numbers.size(); i++)
+            {
+                std::string path = file.path().string() + "/" + std::to_string(numbers[i]);
+                if (numbers.size() - i <= Storage::version_keep && replacedAt(path) >= cutoff)
+                    continue;
+
+                // the chunks only this version used may now be unreferenced
+                uintmax_t size = versionSize(path);
+                std::string linked = linkedPath(path);
+                bool dropped = !linked.empty() && fs::remove(linked, error);
+                if (!dropped && fs::remove(path, error))
+                {
+                    ChunkStore::instance().release();
+                    dropped = true;
+                }
+
+                if (dropped)
+                    removed++;
+                if (dropped && counted != used.end())
+                    counted->second -= std::min(size, counted->second);
+            }
+
+            // only empty folders go
+            fs::remove(file.path(), error);
+        }
+    }
+
+    return removed;
+}
+
+uintmax_t &VersionStore::usageLocked(const std::string &user)
+{
+    auto counted = used.find(user);
+    if (counted != used.end())
+        return counted->second;
+
+    uintmax_t total = 0;
+    std::error_code error;
+    for (const auto &file : fs::directory_iterator(Storage::version_root + "/" + user, error))
+        for (uint64_t number : versionNumbers(file.path().string()))
+            total += versionSize(file.path().string() + "/" + std::to_string(number));
+    return used[user] = total;
+}
+
+uintmax_t VersionStore::usage(const std::string &user)
+{
+    if (!enabled())
+        return 0;
+
+    std::lock_guard<std::mutex> lock(mutex);
+    return usageLocked(user);
+}
+
+void VersionStore::collectOld()
+{
+    auto next_pass = std::chrono::steady_clock::now() + std::chrono::seconds(Storage::version_gc_s);
+    while (true)
+    {
+        std::vector<std::string> linked;
+        {
+            std::unique_lock<std::mutex> lock(mutex);
+            kept.wait_until(lock, next_pass, [this]()
+                            { return !waiting.empty(); });
+            linked.swap(waiting);
+        }
+
+        for (const std::string &path : linked)
+        {
+            try
+            {
+                chunkLinked(path);
+            }
+            catch (const std::exception &e)
+            {
+                std::cerr << "[VERSION] Unable to chunk " << path << ": " << e.what() << std::endl;
+            }
+        }
+
+        if (std::chrono::steady_clock::now() < next_pass)
+            continue;
+        next_pass = std::chrono::steady_clock::now() + std::chrono::seconds(Storage::version_gc_s);
+
+        // files whose chunking failed are tried again with each pass
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            std::vector<std::string> left = linkedFiles();
+            waiting.insert(waiting.end(), left.begin(), left.end());
+        }
+
+        try
+        {
+            size_t removed = collect();
+            if (removed > 0)
+                std::cout << "[VERSION] Retention dropped " << removed << " versions" << std::endl;
+        }
+        catch (const std::exception &e)
+        {
+            std::cerr << "[VERSION] Retention pass failed: " << e.what() << std::endl;
+        }
+    }
+}
@@ -0,0 +1,68 @@
+#ifndef VERSION_STORE_H
+#define VERSION_STORE_H
+
+#include <condition_variable>
+#include <cstdint>
+#include <mutex>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+class Recipe;
+
+// ----------------------------------- VERSION STORE ------------------------------------
+
+struct FileVersion
+{
+    uint64_t number;
+    uintmax_t size;
+    int64_t mtime; // seconds, when the version was replaced
+};
+
+// Earlier versions of the files of a local backend, kept below Storage::version_root as
+// recipes of their chunks: a version is a list of references to immutable chunks, so keeping
+// one only stores the chunks no other file or version has yet. A file is versioned each time
+// a sync, a restore or a delete replaces it. A plain file is only hard linked into the version
+// folder then, a background pass chunks it into its recipe off the session. The same pass
+// enforces the retention policy (Storage::version_keep versions a file, none older than
+// Storage::version_max_age_s) and hands the chunks nobody references anymore to the garbage
+// collector of the chunk store. The logical size of the versions counts in the quota of the
+// user, as the files do.
+class VersionStore
+{
+private:
+    std::mutex mutex;                 // held by every change of the version folders
+    std::condition_variable kept;     // signaled when a file waits to be chunked
+    std::vector<std::string> waiting; // linked files not chunked yet
+    std::unordered_map<std::string, uintmax_t> used; // logical bytes of the versions of a user, counted on first use
+
+    VersionStore();
+    std::string folder(const std::string &user, const std::string &name) const;
+    std::string versionPath(const std::string &user, const std::string &name, uint64_t number) const;
+    uintmax_t &usageLocked(const std::string &user);
+    // Turns a linked file into the recipe of its version, false when it was renamed or
+    // dropped meanwhile
+    bool chunkLinked(const std::string &linked);
+    void collectOld();
+
+public:
+    static VersionStore &instance();
+    // Whether files are versioned; needs a local backend, the recipes are files of their own
+    static bool enabled();
+
+    // Keeps the current content of name as its newest version, false when there is no such
+    // file. Throws when the version cannot be stored.
+    bool preserve(const std::string &user, const std::string &name);
+    // Versions of name, newest first; those of a deleted file are kept
+    std::vector<FileVersion> list(const std::string &user, const std::string &name);
+    // false when there is no such version
+    bool open(const std::string &user, const std::string &name, uint64_t number, Recipe &recipe);
+    // The versions follow a renamed file, after those a former file named to left behind
+    void rename(const std::string &user, const std::string &from, const std::string &to);
+    // Drops the versions beyond the retention policy, returns how many went
+    size_t collect();
+    // Logical bytes of the versions of user, they count in the quota like the files do
+    uintmax_t usage(const std::string &user);
+};
+
+#endif // VERSION_STORE_H
@@ -9,26 +9,79 @@
 #include <openssl/bio.h>
 #include <openssl/ssl.h>
 #include <openssl/err.h>
+#include <openssl/crypto.h>
 #include <algorithm>
+#include <atomic>
+#include <memory>
+#include <limits>
+#include <unordered_set>
+#include <fnmatch.h>
 
 #include "../security/Util.h"
 #include "../security/crypto.h"
 #include "../packets/upload.h"
 #include "../packets/wrapper.h"
 #include "../tools/file.h"
+#include "../tools/compressor.h"
+#include "chunk_store.h"
+#include "compressed_file.h"
+#include "content_index.h"
+#include "metadata_index.h"
+#include "archive_reader.h"
+#include "staged_file.h"
+#include "io_engine.h"
+#include "mapped_file.h"
+#include "file_cache.h"
+#include "storage_backend.h"
+#include "version_store.h"
+#include "../tools/fingerprint.h"
 #include "download.h"
 #include "list.h"
 #include "rename.h"
 #include "delete.h"
+#include "sync.h"
+#include "batch.h"
+#include "archive.h"
+#include "version.h"
 #include "worker.h"
 #include <filesystem>
+#include <fstream>
 #include "logout.h"
 
 typedef std::vector<unsigned char> Buffer;
 
+namespace
+{
+    // Hidden name of a file rebuilt next to name, never a user file name and never the one of
+    // another session working on the same file
+    string tempName(const string &name, const string &purpose)
+    {
+        static std::atomic<uint64_t> sequence(0);
+        return "." + name + "." + purpose + "." + std::to_string(std::hash<std::thread::id>{}(std::this_thread::get_id())) + "." + std::to_string(sequence++);
+    }
+
+    // Removes a temporary file on every way out of a request; once installed it is gone already
+    class TempFile
+    {
+    private:
+        string path;
+
+    public:
+        explicit TempFile(const string &path) : path(path) {}
+        TempFile(const TempFile &) = delete;
+        TempFile &operator=(const TempFile &) = delete;
+        ~TempFile()
+        {
+            std::error_code error;
+            std::filesystem::remove(path, error);
+        }
+    };
+}
+
 Worker::Worker(int communcation_socket)
 {
     this->communcation_socket = communcation_socket;
+    io_engine.reset(new IoEngine());
     cout << "[WORKER] Worker Initiated" << std::endl;
 }
 int Worker::login()
@@ -293,6 +346,11 @@ int Worker::login()
 
     std::cout << "[LOGIN] Login Success" << std::endl;
 
+    // the index must be read before the session changes the folder
+    StorageBackend::instance().attach(username);
+    attached = true;
+    MetadataIndex::instance().open(username);
+
     // Cleanup OpenSSL (if not done already)
     EVP_cleanup();
     EVP_PKEY_free(client_public_key);
@@ -310,13 +368,26 @@ int Worker::upload_file(Buffer payload)
     Buffer serialized_packet;
 
     // Check if the file exists
-    string file_path = "../data/" + username + "/" + (string)m1.file_name;
+    StorageBackend &backend = StorageBackend::instance();
+    string file_path = backend.path(username, (string)m1.file_name);
     UploadAck ack_packet;
 
-    if (File::exists(file_path))
+    uint8_t compression = ChunkCompressor::negotiate(m1.compression);
+    string known_path;
+    Recipe known_recipe;
+    // held until the file is stored and counted in the usage, or the upload failed
+    QuotaReservation quota;
+
+    if (!File::isValidFileName((string)m1.file_name) || backend.exists(username, (string)m1.file_name))
         ack_packet = UploadAck(0);
+    else if (!quota.acquire(username, m1.file_size))
+        ack_packet = UploadAck(4); // 4 means the file does not fit in the quota of the user
+    else if (Storage::deduplicate && ContentIndex::instance().findFile(username, Fingerprint::toHex(m1.file_digest), known_path, known_recipe))
+        ack_packet = UploadAck(3, compression); // 3 means the user already stores the content, prove you hold it
+    else if (Storage::deduplicate)
+        ack_packet = UploadAck(2, compression); // 2 means send the chunk manifest
     else
-        ack_packet = UploadAck(1);
+        ack_packet = UploadAck(1, compression); // 1 means send the whole file
 
     Wrapper ack_wrapper(session_key, s_counter, ack_packet.serialize());
 
@@ -334,18 +405,97 @@ int Worker::upload_file(Buffer payload)
         std::cerr << "[UPLOAD] Counter reached maximum value" << std::endl;
         return -1;
     }
-    // -------------- HANDLE SENDING FILE CHUNKS ---------------------
+
+    if (ack_packet.getAckCode() == 0)
+        return 0;
+
+    if (ack_packet.getAckCode() == 4)
+    {
+        std::cerr << "[UPLOAD] " << m1.file_name << " exceeds the quota of " << username << " ("
+                  << MetadataIndex::instance().usage(username) << "B used)" << std::endl;
+        return 0;
+    }
+
+    bool error_occured = false;
+    int result;
+
+    // ------------- HANDLE THE INSTANT UPLOAD SHORTCUTS ---------------
+    if (ack_packet.getAckCode() == 3)
+    {
+        bool stored = false;
+
+        result = upload_proof(known_recipe, file_path, compression, stored);
+        if (stored)
+        {
+            MetadataIndex::instance().refresh(username, (string)m1.file_name);
+            FileCache::instance().invalidate(file_path);
+        }
+        if (result != 1 || stored)
+            return result;
+    }
+
+    if (ack_packet.getAckCode() != 1)
+    {
+        result = upload_manifest(m1, file_path, error_occured);
+        if (result != 1)
+            return result;
+    }
+    else
+    {
+        result = upload_chunks(m1, error_occured);
+        if (result != 1)
+            return result;
+    }
+
+    MetadataIndex::instance().refresh(username, (string)m1.file_name);
+    FileCache::instance().invalidate(file_path);
+
+    FileMetadata metadata;
+    if (!error_occured && MetadataIndex::instance().lookup(username, (string)m1.file_name, metadata) && metadata.stored != metadata.size)
+        cout << "[UPLOAD] " << m1.file_name << " stored in " << metadata.stored << "B for " << metadata.size << "B" << endl;
+
+    // ------------------- HANDLE ACK PACKET ---------------------
+
+    if (error_occured)
+        ack_packet = UploadAck(0); // in case of error
+
+    else
+        ack_packet = UploadAck(1);
+
+    ack_wrapper = Wrapper(session_key, s_counter, ack_packet.serialize());
+
+    serialized_packet = ack_wrapper.serialize();
+    if (!sendData(communcation_socket, serialized_packet))
+    {
+        std::cerr << "[UPLOAD] Error sending the serialized packet" << std::endl;
+        return 0;
+    }
+
+    s_counter = incrementCounter(s_counter);
+    if (s_counter == -1)
+    {
+        std::cerr << "[UPLOAD] Counter reached maximum value" << std::endl;
+        return -1;
+    }
+
+    return 1;
+}
+
+int Worker::upload_chunks(UploadM1 &m1, bool &error_occured)
+{
+    // -------------- HANDLE RECEIVING FILE CHUNKS ---------------------
     size_t chunk_size = MAX::max_file_chunk;
-    int num_file_chunks = m1.file_size / chunk_size;
-    int last_chunk_size = m1.file_size % chunk_size;
+    size_t max_frame_size = Wrapper::getSize(UploadM2::getSize(chunk_size));
+    uintmax_t received_size = 0;
     UploadM2 m2_packet;
     Wrapper m2_wrapper;
-    bool error_occured = false;
+    Fingerprint::Hasher hasher;
 
-    File file;
+    // the upload only appears once it is complete (a hidden temporary file on local backends)
+    std::unique_ptr<BackendWriter> file;
     try
     {
-        file.create(file_path);
+        file = CompressedWriter::open(username, (string)m1.file_name, m1.file_size, io_engine.get());
     }
     catch (const std::exception &e)
     {
@@ -353,17 +503,18 @@ int Worker::upload_file(Buffer payload)
         return 0;
     }
 
-    // Receive chunks from client
-    for (int i = 0; i < num_file_chunks; i++)
+    // Receive chunks from client, each one is framed since compressed chunks vary in size
+    while (received_size < m1.file_size)
     {
+        size_t expected_size = std::min<uintmax_t>(chunk_size, m1.file_size - received_size);
+
         // receive Wrapper packet message
-        Buffer message_buff(Wrapper::getSize(UploadM2::getSize(chunk_size)));
+        Buffer message_buff;
 
-        if (!receiveData(communcation_socket, message_buff))
+        if (!receiveFrame(communcation_socket, message_buff, max_frame_size))
         {
             std::cerr << "[UPLOAD] Error receiving  data" << std::endl;
-            error_occured = true;
-            continue;
+            return 0;
         }
 
         m2_wrapper = Wrapper(session_key);
@@ -371,8 +522,7 @@ int Worker::upload_file(Buffer payload)
         if (!m2_wrapper.deserialize(message_buff))
         {
             std::cerr << "[UPLOAD] Wrapper packet wasn't deserialized correctly!" << endl;
-            error_occured = true;
-            continue;
+            return 0;
         }
 
         // Check counter otherwise exit
@@ -390,62 +540,71 @@ int Worker::upload_file(Buffer payload)
         m2_packet = UploadM2();
         m2_packet.deserialize(m2_wrapper.getPayload());
 
-        file.writeChunk(m2_packet.getFileChunk());
+        Buffer chunk;
+        if (!ChunkCompressor::decode(m2_packet.getFileChunk(), m2_packet.getChunkFlags(), expected_size, chunk))
+        {
+            std::cerr << "[UPLOAD] Malformed file chunk" << std::endl;
+            error_occured = true;
+        }
+        else if (!error_occured)
+        {
+            try
+            {
+                file->write(chunk);
+                hasher.update(chunk);
+            }
+            catch (const std::exception &e)
+            {
+                std::cerr << "[UPLOAD] " << e.what() << std::endl;
+                error_occured = true;
+            }
+        }
+
+        received_size += expected_size;
 
         // Log receival progess
-        cout << "[UPLOAD] Received " << (i + 1) * chunk_size << "B/ " << m1.file_size << "B" << endl;
+        cout << "[UPLOAD] Received " << received_size << "B/ " << m1.file_size << "B" << endl;
     }
 
-    // receive remaining data in file (if there's any)
-    if (last_chunk_size != 0)
+    // the content must match the digest announced in M1 before it replaces anything
+    if (!error_occured && hasher.finish() != m1.file_digest)
     {
-        Buffer message_buff(Wrapper::getSize(UploadM2::getSize(last_chunk_size)));
+        std::cerr << "[UPLOAD] " << (string)m1.file_name << " does not match its digest" << std::endl;
+        error_occured = true;
+    }
 
-        if (!receiveData(communcation_socket, message_buff))
+    if (!error_occured)
+    {
+        try
         {
-            std::cerr << "[UPLOAD] Error receiving  data" << std::endl;
-            error_occured = true;
-            return 0;
+            file->commit();
         }
-
-        m2_wrapper = Wrapper(session_key);
-
-        if (!m2_wrapper.deserialize(message_buff))
+        catch (const std::exception &e)
         {
-            std::cerr << "[UPLOAD] Wrapper packet wasn't deserialized correctly!" << endl;
+            std::cerr << "[UPLOAD] " << e.what() << std::endl;
             error_occured = true;
-            return 0;
-        }
-
-        // Check counter otherwise exit
-        if (m2_wrapper.getCounter() != r_counter)
-            return -1;
-
-        r_counter = incrementCounter(r_counter);
-        if (r_counter == -1)
-        {
-            std::cerr << "[UPLOAD] Counter reached maximum value" << std::endl;
-            return -1;
         }
-
-        m2_packet = UploadM2();
-        m2_packet.deserialize(m2_wrapper.getPayload());
-
-        file.writeChunk(m2_packet.getFileChunk());
     }
-    cout << "[UPLOAD] Received " << m1.file_size << "B/ " << m1.file_size << "B" << endl;
 
-    // ------------------- HANDLE ACK PACKET ---------------------
+    return 1;
+}
 
-    if (error_occured)
-        ack_packet = UploadAck(0); // in case of error
+int Worker::upload_proof(const Recipe &known_recipe, const string &file_path, uint8_t compression, bool &stored)
+{
+    Buffer serialized_packet;
 
-    else
-        ack_packet = UploadAck(1);
+    // -------------- HANDLE SENDING THE CHALLENGE ---------------------
+    Buffer nonce(Fingerprint::nonce_length);
+    if (RAND_bytes(nonce.data(), nonce.size()) != 1)
+    {
+        std::cerr << "[UPLOAD] Unable to generate the nonce" << std::endl;
+        return 0;
+    }
 
-    ack_wrapper = Wrapper(session_key, s_counter, ack_packet.serialize());
+    UploadProof challenge(nonce);
+    Wrapper challenge_wrapper(session_key, s_counter, challenge.serialize());
 
-    serialized_packet = ack_wrapper.serialize();
+    serialized_packet = challenge_wrapper.serialize();
     if (!sendData(communcation_socket, serialized_packet))
     {
         std::cerr << "[UPLOAD] Error sending the serialized packet" << std::endl;
@@ -459,300 +618,1720 @@ int Worker::upload_file(Buffer payload)
         return -1;
     }
 
-    return 1;
-}
-int Worker::download_file(Buffer payload)
-{
+    // -------------- HANDLE RECEIVING THE PROOF ---------------------
+    Buffer proof_buffer(Wrapper::getSize(UploadProof::getSize()));
+    if (!receiveData(communcation_socket, proof_buffer))
+    {
+        std::cerr << "[UPLOAD] Error receiving  data" << std::endl;
+        return 0;
+    }
 
-    // Deserialize m1 general packet
-    DownloadM1 m1;
-    m1.deserialize(payload);
-    Buffer serialized_packet;
+    Wrapper proof_wrapper(session_key);
+    if (!proof_wrapper.deserialize(proof_buffer))
+    {
+        std::cerr << "[UPLOAD] Wrapper packet wasn't deserialized correctly!" << endl;
+        return 0;
+    }
 
-    // Check if the file exists
-    string file_path = "../data/" + username + "/" + (string)m1.file_name;
-    File file;
-    bool file_error = false;
+    if (proof_wrapper.getCounter() != r_counter)
+        return -1;
 
-    // Try to open the file denoted in path
-    try
+    r_counter = incrementCounter(r_counter);
+    if (r_counter == -1)
+    {
+        std::cerr << "[UPLOAD] Counter reached maximum value" << std::endl;
+        return -1;
+    }
+
+    UploadProof proof;
+    proof.deserialize(proof_wrapper.getPayload());
+
+    // the chunks of the known file must survive until the new recipe points to them
     {
-        file.read(file_path);
+        auto store_pin = ChunkStore::instance().pin();
 
-        // check if file is not empty
-        if (file.getFileSize() == 0)
+        try
         {
-            cerr << "[DOWNLOAD] Cannot download empty files!" << endl;
-            file_error = true;
+            RecipeStream content(known_recipe);
+            Fingerprint::Digest expected = Fingerprint::possessionProof(nonce, content);
+
+            if (CRYPTO_memcmp(expected.data(), proof.getValue().data(), expected.size()) == 0)
+            {
+                known_recipe.save(file_path);
+                ContentIndex::instance().add(file_path, known_recipe);
+                stored = true;
+            }
+        }
+        catch (const std::exception &e)
+        {
+            std::cerr << "[UPLOAD] " << e.what() << std::endl;
         }
     }
-    catch (const std::exception &e)
-    {
-        std::cerr << "[DOWNLOAD] " << e.what() << std::endl;
-        file_error = true;
-    }
-
-    DownloadAck ack_packet;
 
-    if (!file_error)
-        ack_packet = DownloadAck(0, file.getFileSize());
-    else
-        ack_packet = DownloadAck(1);
+    if (stored)
+        cout << "[UPLOAD] " << file_path << " stored without transferring its content" << endl;
 
+    // 1 means the file is stored, 2 means go on with the chunk manifest
+    UploadAck ack_packet(stored ? 1 : 2, compression);
     Wrapper ack_wrapper(session_key, s_counter, ack_packet.serialize());
 
     serialized_packet = ack_wrapper.serialize();
     if (!sendData(communcation_socket, serialized_packet))
     {
-        std::cerr << "[DOWNLOAD] Error sending the serialized packet" << std::endl;
+        std::cerr << "[UPLOAD] Error sending the serialized packet" << std::endl;
         return 0;
     }
 
     s_counter = incrementCounter(s_counter);
     if (s_counter == -1)
     {
-        std::cerr << "[DOWLOAD] Counter reached maximum value" << std::endl;
+        std::cerr << "[UPLOAD] Counter reached maximum value" << std::endl;
         return -1;
     }
 
-    // -------------- HANDLE SENDING FILE CHUNKS ---------------------
-    size_t chunk_size = MAX::max_file_chunk;
-    int num_file_chunks = file.getFileSize() / chunk_size;
-    int last_chunk_size = file.getFileSize() % chunk_size;
-    DownloadM2 m2_packet;
-    Wrapper m2_wrapper;
+    return 1;
+}
 
-    // Send chunks to client
-    for (int i = 0; i < num_file_chunks; i++)
+int Worker::upload_manifest(UploadM1 &m1, const string &file_path, bool &error_occured)
+{
+    Buffer serialized_packet;
+    // nothing referenced by the manifest may be swept before the recipe is written
+    auto store_pin = ChunkStore::instance().pin();
+
+    // -------------- HANDLE THE CHUNK MANIFEST ---------------------
+    size_t max_frame_size = Wrapper::getSize(UploadManifest::getSize(MAX::manifest_entries_per_frame));
+    Recipe recipe;
+    vector<bool> have;
+
+    while (recipe.logical_size < m1.file_size)
     {
-        m2_packet = DownloadM2(file.readChunk(chunk_size));
+        Buffer message_buff;
 
-        m2_wrapper = Wrapper(session_key, s_counter, m2_packet.serialize());
+        if (!receiveFrame(communcation_socket, message_buff, max_frame_size))
+        {
+            std::cerr << "[UPLOAD] Error receiving  data" << std::endl;
+            return 0;
+        }
 
-        serialized_packet = m2_wrapper.serialize();
-        if (!sendData(communcation_socket, serialized_packet))
+        Wrapper manifest_wrapper(session_key);
+
+        if (!manifest_wrapper.deserialize(message_buff))
+        {
+            std::cerr << "[UPLOAD] Wrapper packet wasn't deserialized correctly!" << endl;
             return 0;
+        }
 
-        s_counter = incrementCounter(s_counter);
-        if (s_counter == -1)
+        if (manifest_wrapper.getCounter() != r_counter)
+            return -1;
+
+        r_counter = incrementCounter(r_counter);
+        if (r_counter == -1)
         {
-            std::cerr << "[DOWNLOAD] Counter reached maximum value" << std::endl;
+            std::cerr << "[UPLOAD] Counter reached maximum value" << std::endl;
             return -1;
         }
 
-        // Log upload progess
-        cout << "[DOWNLOAD] Sent " << (i + 1) * chunk_size << "/" << file.getFileSize() << "Bytes" << endl;
-    }
-    // send remaining data in file (if there's any)
-    if (last_chunk_size != 0)
-    {
-        m2_packet = DownloadM2(file.readChunk(last_chunk_size));
+        UploadManifest manifest;
+        manifest.deserialize(manifest_wrapper.getPayload());
 
-        Wrapper m2_wrapper(session_key, s_counter, m2_packet.serialize());
+        // answer "have it" only for chunks of this user's own files
+        vector<bool> batch_have;
+        for (const ManifestEntry &chunk : manifest.getChunks())
+        {
+            if (chunk.size == 0 || chunk.size > Storage::max_chunk || chunk.size > m1.file_size - recipe.logical_size)
+            {
+                error_occured = true;
+                break;
+            }
+
+            string digest = Fingerprint::toHex(chunk.digest);
+            recipe.add(digest, chunk.size);
+            batch_have.push_back(ContentIndex::instance().ownsChunk(username, digest));
+        }
 
-        serialized_packet = m2_wrapper.serialize();
-        if (!sendData(communcation_socket, serialized_packet))
+        // an empty answer makes the client give up, both sides stay in step
+        if (error_occured || batch_have.empty())
+        {
+            batch_have.clear();
+            error_occured = true;
+        }
+
+        UploadHave have_packet(batch_have);
+        Wrapper have_wrapper(session_key, s_counter, have_packet.serialize());
+
+        serialized_packet = have_wrapper.serialize();
+        if (!sendFrame(communcation_socket, serialized_packet))
+        {
+            std::cerr << "[UPLOAD] Error sending the serialized packet" << std::endl;
             return 0;
+        }
 
         s_counter = incrementCounter(s_counter);
         if (s_counter == -1)
         {
-            std::cerr << "[DOWNLOAD] Counter reached maximum value" << std::endl;
+            std::cerr << "[UPLOAD] Counter reached maximum value" << std::endl;
             return -1;
         }
-    }
 
-    cout << "[DOWNLOAD] Sent " << file.getFileSize() << "/" << file.getFileSize() << "Bytes" << endl;
-    return 1;
-}
-int Worker::list_files(Buffer payload)
-{
+        if (error_occured)
+        {
+            std::cerr << "[UPLOAD] Malformed chunk manifest" << std::endl;
+            return 0;
+        }
 
-    // ------ HERE WE START THE List ROUTINE -----
+        have.insert(have.end(), batch_have.begin(), batch_have.end());
+    }
 
-    // Deserialize m1 general packet
-    ListM1 m1;
-    m1.deserialize(payload);
-    Buffer serialized_packet;
+    // -------------- HANDLE RECEIVING THE MISSING CHUNKS ---------------------
+    size_t piece_size = MAX::max_file_chunk;
+    size_t max_piece_frame_size = Wrapper::getSize(UploadM2::getSize(piece_size));
+    uintmax_t missing_size = 0;
+    uintmax_t received_size = 0;
 
-    ListM2 ack_size_packet;
-    File file;
-    uintmax_t file_size;
-    string folder_path = "../data/" + username;
-    string fileNames;
+    for (size_t i = 0; i < recipe.entries.size(); i++)
+        if (!have[i])
+            missing_size += recipe.entries[i].size;
+
+    cout << "[UPLOAD] Server already has " << (m1.file_size - missing_size) << "B of " << m1.file_size << "B" << endl;
 
-    if (std::filesystem::exists(folder_path) && std::filesystem::is_directory(folder_path))
+    // every missing chunk is sent in pieces of at most max_file_chunk bytes
+    for (size_t i = 0; i < recipe.entries.size(); i++)
     {
+        if (have[i])
+            continue;
+
+        const RecipeEntry &entry = recipe.entries[i];
+        Buffer chunk;
+
+        while (chunk.size() < entry.size)
+        {
+            size_t expected_size = std::min<size_t>(piece_size, entry.size - chunk.size());
+            Buffer message_buff;
+
+            if (!receiveFrame(communcation_socket, message_buff, max_piece_frame_size))
+            {
+                std::cerr << "[UPLOAD] Error receiving  data" << std::endl;
+                return 0;
+            }
+
+            Wrapper m2_wrapper(session_key);
+
+            if (!m2_wrapper.deserialize(message_buff))
+            {
+                std::cerr << "[UPLOAD] Wrapper packet wasn't deserialized correctly!" << endl;
+                return 0;
+            }
+
+            if (m2_wrapper.getCounter() != r_counter)
+                return -1;
+
+            r_counter = incrementCounter(r_counter);
+            if (r_counter == -1)
+            {
+                std::cerr << "[UPLOAD] Counter reached maximum value" << std::endl;
+                return -1;
+            }
+
+            UploadM2 m2_packet;
+            m2_packet.deserialize(m2_wrapper.getPayload());
+
+            Buffer piece;
+            if (!ChunkCompressor::decode(m2_packet.getFileChunk(), m2_packet.getChunkFlags(), expected_size, piece))
+            {
+                std::cerr << "[UPLOAD] Malformed file chunk" << std::endl;
+                error_occured = true;
+                piece.assign(expected_size, 0);
+            }
+
+            chunk.insert(chunk.end(), piece.begin(), piece.end());
+            received_size += expected_size;
+        }
 
+        // the client names every chunk, make sure the bytes really match that name
         try
         {
-            fileNames = file.getFileNames(folder_path);
-            ack_size_packet = ListM2(0, fileNames.length());
+            if (!error_occured && ChunkStore::instance().put(chunk) != entry.digest)
+            {
+                std::cerr << "[UPLOAD] Chunk does not match its digest" << std::endl;
+                error_occured = true;
+            }
         }
         catch (const std::exception &e)
         {
-            std::cerr << "[LIST] " << e.what() << std::endl;
-            ack_size_packet = ListM2(1, 0); // error code : 1
+            std::cerr << "[UPLOAD] " << e.what() << std::endl;
+            error_occured = true;
         }
-    }
-    else
-    {
-        // folder does not exist
-        ack_size_packet = ListM2(1, 0); // error code : 1
+
+        cout << "[UPLOAD] Received " << received_size << "B/ " << missing_size << "B" << endl;
     }
 
-    Wrapper ack_wrapper(session_key, s_counter, ack_size_packet.serialize());
+    if (error_occured)
+        return 1;
 
-    serialized_packet = ack_wrapper.serialize();
-    if (!sendData(communcation_socket, serialized_packet))
+    // the whole content must match the digest announced in M1 before it gets indexed
+    try
     {
-        std::cerr << "[LIST] Error sending the serialized packet" << std::endl;
-        return 0;
-    }
+        RecipeStream content(recipe);
+        recipe.file_digest = Fingerprint::toHex(Fingerprint::sha256(content));
 
-    s_counter = incrementCounter(s_counter);
+        if (recipe.file_digest != Fingerprint::toHex(m1.file_digest))
+        {
+            std::cerr << "[UPLOAD] File does not match its digest" << std::endl;
+            error_occured = true;
+        }
+        else
+        {
+            recipe.save(file_path);
+            ContentIndex::instance().add(file_path, recipe);
+            ChunkStore::instance().printStats();
+        }
+    }
+    catch (const std::exception &e)
+    {
+        std::cerr << "[UPLOAD] " << e.what() << std::endl;
+        error_occured = true;
+    }
+
+    return 1;
+}
+int Worker::download_file(Buffer payload)
+{
+
+    // Deserialize m1 general packet
+    DownloadM1 m1;
+    m1.deserialize(payload);
+    Buffer serialized_packet;
+
+    // Check if the file exists
+    StorageBackend &backend = StorageBackend::instance();
+    string file_path = backend.path(username, (string)m1.file_name);
+    // deduplicated files are read back through the recipe of their chunks
+    StoredFile file;
+    uintmax_t file_size = 0;
+    bool file_error = false;
+    uint8_t compression = ChunkCompressor::negotiate(m1.compression);
+
+    // the tag is taken before the file is opened: a change in between only costs the client a refetch
+    string etag;
+    bool tagged = File::isValidFileName((string)m1.file_name) && MetadataIndex::instance().etag(username, (string)m1.file_name, etag);
+
+    // ------------------- HANDLE NOT MODIFIED ---------------------
+    if (tagged && m1.if_none_match[0] != '\0' && etag == (string)m1.if_none_match)
+    {
+        DownloadAck ack_packet(2, 0, compression, etag); // 2 means the copy of the client is current
+
+        Wrapper ack_wrapper(session_key, s_counter, ack_packet.serialize());
+
+        serialized_packet = ack_wrapper.serialize();
+        if (!sendData(communcation_socket, serialized_packet))
+        {
+            std::cerr << "[DOWNLOAD] Error sending the serialized packet" << std::endl;
+            return 0;
+        }
+
+        s_counter = incrementCounter(s_counter);
+        if (s_counter == -1)
+        {
+            std::cerr << "[DOWLOAD] Counter reached maximum value" << std::endl;
+            return -1;
+        }
+
+        cout << "[DOWNLOAD] " << m1.file_name << " not modified" << endl;
+        return 1;
+    }
+
+    // Try to open the file denoted in path
+    try
+    {
+        if (!File::isValidFileName((string)m1.file_name))
+            throw std::invalid_argument("Invalid file name.");
+
+        file.open(username, (string)m1.file_name);
+        file_size = file.getFileSize();
+
+        // check if file is not empty
+        if (file_size == 0)
+        {
+            cerr << "[DOWNLOAD] Cannot download empty files!" << endl;
+            file_error = true;
+        }
+    }
+    catch (const std::exception &e)
+    {
+        std::cerr << "[DOWNLOAD] " << e.what() << std::endl;
+        file_error = true;
+    }
+
+    DownloadAck ack_packet;
+
+    if (!file_error)
+        ack_packet = DownloadAck(0, file_size, compression, etag);
+    else
+        ack_packet = DownloadAck(1);
+
+    Wrapper ack_wrapper(session_key, s_counter, ack_packet.serialize());
+
+    serialized_packet = ack_wrapper.serialize();
+    if (!sendData(communcation_socket, serialized_packet))
+    {
+        std::cerr << "[DOWNLOAD] Error sending the serialized packet" << std::endl;
+        return 0;
+    }
+
+    s_counter = incrementCounter(s_counter);
+    if (s_counter == -1)
+    {
+        std::cerr << "[DOWLOAD] Counter reached maximum value" << std::endl;
+        return -1;
+    }
+
+    if (file_error)
+        return 0;
+
+    // -------------- HANDLE SENDING FILE CHUNKS ---------------------
+    size_t chunk_size = MAX::max_file_chunk;
+    uintmax_t sent_size = 0;
+    ChunkCompressor compressor(compression);
+    DownloadM2 m2_packet;
+    Wrapper m2_wrapper;
+
+    // files up to Storage::cache_max_file come from the memory cache of their version; other
+    // plain files are mapped, or read in large blocks queued ahead when they are small enough
+    // for a read to be cheaper than the mapping or so large they bypass the page cache;
+    // the frames leave in batches
+    CachedReader cached(file, file_path, etag);
+    BlockReader reader(*io_engine);
+    MappedFile mapped;
+    FrameSender sender(*io_engine, communcation_socket);
+    // only plain files on a local backend can be mapped or read by the ring, the others stream
+    // from the backend (through the decompressor for files compressed at rest)
+    bool use_cache = tagged && FileCache::enabled() && file_size <= Storage::cache_max_file;
+    bool use_stream = !use_cache && (file.isRecipe() || file.isCompressed() || !backend.isLocal());
+    bool use_mapping = !use_cache && !use_stream && file_size >= Storage::mmap_threshold && file_size < Storage::direct_io_threshold;
+    bool use_reader = !use_cache && !use_stream && !use_mapping;
+
+    try
+    {
+        // both take a descriptor resolved against the user folder; packed files have none of
+        // their own, they are already in memory
+        int fd = use_mapping || use_reader ? backend.openDescriptor(username, (string)m1.file_name) : -1;
+        if (fd != -1 && use_mapping)
+            mapped.adopt(fd);
+        else if (fd != -1)
+            reader.adopt(fd);
+        else if (use_mapping || use_reader)
+        {
+            use_mapping = use_reader = false;
+            use_stream = true;
+        }
+    }
+    catch (const std::exception &e)
+    {
+        std::cerr << "[DOWNLOAD] " << e.what() << std::endl;
+        return 0;
+    }
+
+    // Send chunks to client
+    while (sent_size < file_size)
+    {
+        size_t current_chunk_size = std::min<uintmax_t>(chunk_size, file_size - sent_size);
+        uint8_t chunk_flags;
+        Buffer chunk;
+
+        try
+        {
+            if (use_cache)
+                chunk = compressor.encode(cached.next(current_chunk_size), current_chunk_size, chunk_flags);
+            else if (use_mapping)
+                chunk = compressor.encode(mapped.next(current_chunk_size), current_chunk_size, chunk_flags);
+            else
+            {
+                Buffer data = use_reader ? reader.readChunk(current_chunk_size) : file.readChunk(current_chunk_size);
+                chunk = compressor.encode(data, chunk_flags);
+            }
+        }
+        catch (const std::exception &e)
+        {
+            std::cerr << "[DOWNLOAD] " << e.what() << std::endl;
+            return 0;
+        }
+
+        m2_packet = DownloadM2(chunk, chunk_flags);
+
+        m2_wrapper = Wrapper(session_key, s_counter, m2_packet.serialize());
+
+        serialized_packet = m2_wrapper.serialize();
+        if (!sender.push(serialized_packet))
+            return 0;
+
+        s_counter = incrementCounter(s_counter);
+        if (s_counter == -1)
+        {
+            std::cerr << "[DOWNLOAD] Counter reached maximum value" << std::endl;
+            return -1;
+        }
+
+        sent_size += current_chunk_size;
+
+        // Log upload progess
+        cout << "[DOWNLOAD] Sent " << sent_size << "/" << file_size << "Bytes" << endl;
+    }
+
+    if (!sender.flush())
+        return 0;
+
+    compressor.printStats("[DOWNLOAD]");
+    reader.printStats("[DOWNLOAD]");
+    mapped.printStats("[DOWNLOAD]");
+    if (use_cache)
+        cached.printStats("[DOWNLOAD]");
+    return 1;
+}
+int Worker::list_files(Buffer payload)
+{
+
+    // ------ HERE WE START THE List ROUTINE -----
+
+    // Deserialize m1 general packet
+    ListM1 m1;
+    m1.deserialize(payload);
+    Buffer serialized_packet;
+
+    ListM2 ack_size_packet;
+    string fileNames;
+
+    if (StorageBackend::instance().stamp(username) >= 0)
+    {
+
+        try
+        {
+            // names come sorted from the metadata index, joined in a single pass
+            MetadataIndex::instance().forEach(username, "", [&fileNames](const string &name, const FileMetadata &)
+                                              {
+                                                  if (!fileNames.empty())
+                                                      fileNames += ',';
+                                                  fileNames += name;
+                                                  return true; });
+            ack_size_packet = ListM2(0, fileNames.length());
+        }
+        catch (const std::exception &e)
+        {
+            std::cerr << "[LIST] " << e.what() << std::endl;
+            ack_size_packet = ListM2(1, 0); // error code : 1
+        }
+    }
+    else
+    {
+        // folder does not exist
+        ack_size_packet = ListM2(1, 0); // error code : 1
+    }
+
+    Wrapper ack_wrapper(session_key, s_counter, ack_size_packet.serialize());
+
+    serialized_packet = ack_wrapper.serialize();
+    if (!sendData(communcation_socket, serialized_packet))
+    {
+        std::cerr << "[LIST] Error sending the serialized packet" << std::endl;
+        return 0;
+    }
+
+    s_counter = incrementCounter(s_counter);
+    if (s_counter == -1)
+    {
+        std::cerr << "[LIST] Counter reached maximum value" << std::endl;
+        return -1;
+    }
+
+    if (ack_size_packet.getAckCode() == 1)
+    {
+        std::cerr << "[LIST] Folder doe not exist on the cloud!" << endl;
+        return 0;
+    }
+
+    // send the list of files to the client
+    ListM3 m3(fileNames.length());
+    m3.setFileListData(fileNames.c_str());
+
+    Wrapper wrapper(session_key, s_counter, m3.serialize());
+
+    serialized_packet = wrapper.serialize();
+    if (!sendData(communcation_socket, serialized_packet))
+    {
+        std::cerr << "[LIST] Error sending the serialized packet" << std::endl;
+        return 0;
+    }
+
+    s_counter = incrementCounter(s_counter);
+    if (s_counter == -1)
+    {
+        std::cerr << "[LIST] Counter reached maximum value" << std::endl;
+        return -1;
+    }
+    return 1;
+}
+int Worker::list_page(Buffer payload)
+{
+    // ------ HERE WE START THE PAGINATED LIST ROUTINE -----
+    ListPageM1 m1;
+    m1.deserialize(payload);
+
+    string cursor = (string)m1.cursor;
+    string pattern = (string)m1.pattern;
+    size_t page_size = std::min<size_t>(std::max<size_t>(m1.page_size, 1), MAX::list_page);
+    uint8_t ack_code = 0;
+
+    // every match starts with the literal part of the pattern, which bounds the walk over the index
+    string literal;
+    if (m1.filter == ListFilter::PREFIX)
+        literal = pattern;
+    else if (m1.filter == ListFilter::GLOB)
+        literal = pattern.substr(0, pattern.find_first_of("*?[\\"));
+
+    vector<ListEntry> page;
+    bool more = false;
+    string etag;
+
+    if (m1.filter > ListFilter::GLOB || StorageBackend::instance().stamp(username) < 0)
+        ack_code = 1; // error code : 1 means the listing cannot take place
+    else if ((etag = MetadataIndex::instance().folderTag(username)) == (string)m1.if_none_match && cursor.empty())
+        ack_code = 2; // 2 means nothing changed since the listing the client holds
+    else
+    {
+        MetadataIndex::instance().forEach(username, std::max(cursor, literal), [&](const string &name, const FileMetadata &metadata)
+                                          {
+                                              if (name.compare(0, literal.size(), literal) != 0)
+                                                  return false;
+                                              // the cursor itself closed the previous page
+                                              if (name == cursor || (m1.filter == ListFilter::GLOB && fnmatch(pattern.c_str(), name.c_str(), 0) != 0))
+                                                  return true;
+                                              if (page.size() == page_size)
+                                              {
+                                                  more = true;
+                                                  return false;
+                                              }
+                                              page.push_back({name, metadata.size, metadata.mtime / 1000000000, metadata.digest});
+                                              return true; });
+    }
+
+    string next_cursor = more ? page.back().file_name : "";
+
+    // -------------- HANDLE SENDING THE PAGE IN BOUNDED FRAMES ---------------------
+    size_t i = 0;
+    do
+    {
+        size_t end = std::min(page.size(), i + MAX::list_entries_per_frame);
+        bool last = (end == page.size());
+        ListPage page_packet(ack_code, vector<ListEntry>(page.begin() + i, page.begin() + end), last, last ? next_cursor : "", etag);
+
+        Wrapper page_wrapper(session_key, s_counter, page_packet.serialize());
+
+        Buffer serialized_packet = page_wrapper.serialize();
+        if (!sendFrame(communcation_socket, serialized_packet))
+        {
+            std::cerr << "[LIST] Error sending the serialized packet" << std::endl;
+            return 0;
+        }
+
+        s_counter = incrementCounter(s_counter);
+        if (s_counter == -1)
+        {
+            std::cerr << "[LIST] Counter reached maximum value" << std::endl;
+            return -1;
+        }
+
+        i = end;
+    } while (i < page.size());
+
+    return ack_code != 1 ? 1 : 0;
+}
+
+int Worker::rename_file(Buffer payload)
+{
+
+    // Deserialize m1 general packet
+    RenameM1 m1;
+    m1.deserialize(payload);
+    Buffer serialized_packet;
+
+    // Check if the file exists
+    string file_name = (string)m1.file_name;
+    string new_file_name = (string)m1.new_file_name;
+    StorageBackend &backend = StorageBackend::instance();
+    string file_path = backend.path(username, file_name);
+    string new_file_path = backend.path(username, new_file_name);
+
+    RenameAck ack_packet;
+
+    if (backend.exists(username, file_name))
+    {
+        // fails when there is already a file with the same new name
+        if (backend.rename(username, file_name, new_file_name))
+        {
+            // keep the renamed file findable by its content
+            Recipe recipe;
+            if (backend.isLocal() && recipe.load(new_file_path))
+                ContentIndex::instance().add(new_file_path, recipe);
+
+            // the earlier versions follow the file
+            try
+            {
+                VersionStore::instance().rename(username, file_name, new_file_name);
+            }
+            catch (const std::exception &e)
+            {
+                std::cerr << "[RENAME] " << e.what() << std::endl;
+            }
+
+            // both names in one journal entry, a crash can't leave the file under neither
+            MetadataIndex::instance().refresh(username, {file_name, new_file_name});
+            FileCache::instance().invalidate(file_path);
+            FileCache::instance().invalidate(new_file_path);
+
+            ack_packet = RenameAck(0); // 0 means success
+        }
+        else
+        {
+            ack_packet = RenameAck(1); // error code : 1 means file rename failed
+        }
+    }
+    else
+    {
+        // file does not exist
+        ack_packet = RenameAck(2); // error code : 2 means the file does not exist
+    }
+
+    Wrapper ack_wrapper(session_key, s_counter, ack_packet.serialize());
+
+    serialized_packet = ack_wrapper.serialize();
+    if (!sendData(communcation_socket, serialized_packet))
+    {
+        std::cerr << "[RENAME] Error sending the serialized packet" << std::endl;
+        return 0;
+    }
+
+    s_counter = incrementCounter(s_counter);
     if (s_counter == -1)
     {
-        std::cerr << "[LIST] Counter reached maximum value" << std::endl;
-        return -1;
+        std::cerr << "[RENAME] Counter reached maximum value" << std::endl;
+        return -1;
+    }
+    return 1;
+}
+int Worker::delete_file(Buffer payload)
+{
+    // ------ HERE WE START THE DELETE ROUTINE -----
+    // Deserialize m1 general packet
+    DeleteM1 m1;
+    m1.deserialize(payload);
+    Buffer serialized_packet;
+
+    // Check if the file exists
+    string file_name = (string)m1.file_name;
+    StorageBackend &backend = StorageBackend::instance();
+    string file_path = backend.path(username, file_name);
+
+    DeleteAck ack_packet;
+
+    if (backend.exists(username, file_name))
+    {
+        bool is_recipe = backend.isLocal() && Recipe::isRecipe(file_path);
+        bool preserved = true;
+
+        // a deleted file can still be restored from its versions
+        try
+        {
+            VersionStore::instance().preserve(username, file_name);
+        }
+        catch (const std::exception &e)
+        {
+            std::cerr << "[DELETE] " << e.what() << std::endl;
+            preserved = false;
+        }
+
+        if (preserved && backend.remove(username, file_name))
+        {
+            // its chunks may now be unreferenced
+            if (is_recipe)
+                ChunkStore::instance().release();
+
+            MetadataIndex::instance().refresh(username, file_name);
+            FileCache::instance().invalidate(file_path);
+
+            ack_packet = DeleteAck(0); // 0 means success
+        }
+        else
+        {
+            ack_packet = DeleteAck(1); // error code : 1 means file deletion failed
+        }
+    }
+    else
+    {
+        // file does not exist
+        ack_packet = DeleteAck(2); // error code : 2 means the file does not exist
+    }
+
+    Wrapper ack_wrapper(session_key, s_counter, ack_packet.serialize());
+
+    serialized_packet = ack_wrapper.serialize();
+    if (!sendData(communcation_socket, serialized_packet))
+    {
+        std::cerr << "[DELETE] Error sending the serialized packet" << std::endl;
+        return 0;
+    }
+
+    s_counter = incrementCounter(s_counter);
+    if (s_counter == -1)
+    {
+        std::cerr << "[DELETE] Counter reached maximum value" << std::endl;
+        return -1;
+    }
+
+    return 1;
+}
+int Worker::sync_file(Buffer payload)
+{
+    // ------ HERE WE START THE SYNC (DELTA UPLOAD) ROUTINE -----
+
+    // Deserialize m1 general packet
+    SyncM1 m1;
+    m1.deserialize(payload);
+    Buffer serialized_packet;
+
+    string file_name = (string)m1.file_name;
+    StorageBackend &backend = StorageBackend::instance();
+    string file_path = backend.path(username, file_name);
+    // the new version is rebuilt next to the old one, hidden names never clash with user files
+    string temp_name = tempName(file_name, "sync");
+    string temp_path = backend.folder(username) + "/" + temp_name;
+    TempFile temp_file(temp_path);
+
+    SyncAck ack_packet;
+    vector<Delta::BlockSignature> signatures;
+    size_t block_size = 0;
+    // the old version is either a plain file or the recipe of a deduplicated one
+    StoredFile basis;
+    QuotaReservation quota;
+
+    if (!File::isValidFileName(file_name) || !backend.exists(username, file_name))
+    {
+        ack_packet = SyncAck(2); // error code : 2 means the file does not exist
+    }
+    else if (!backend.isLocal())
+    {
+        // the patched version is assembled in a temporary file next to the old one
+        std::cerr << "[SYNC] Delta sync needs a local storage backend" << std::endl;
+        ack_packet = SyncAck(1);
+    }
+    else if (m1.file_size == 0)
+    {
+        ack_packet = SyncAck(1); // error code : 1 means the sync cannot take place
+    }
+    else
+    {
+        try
+        {
+            basis.open(username, file_name);
+
+            // the growth of the file needs room in the quota, and so does the replaced
+            // content once it is kept as a version
+            if (!quota.acquireReplacement(username, basis.getFileSize(), m1.file_size))
+                throw std::runtime_error("The new version exceeds the quota of " + username + ".");
+
+            block_size = Delta::chooseBlockSize(basis.getFileSize());
+            signatures = Delta::computeSignatures(basis.getStream(), block_size);
+            ack_packet = SyncAck(0, block_size, signatures.size());
+        }
+        catch (const std::exception &e)
+        {
+            std::cerr << "[SYNC] " << e.what() << std::endl;
+            ack_packet = SyncAck(1);
+        }
+    }
+
+    Wrapper ack_wrapper(session_key, s_counter, ack_packet.serialize());
+
+    serialized_packet = ack_wrapper.serialize();
+    if (!sendData(communcation_socket, serialized_packet))
+    {
+        std::cerr << "[SYNC] Error sending the serialized packet" << std::endl;
+        return 0;
+    }
+
+    s_counter = incrementCounter(s_counter);
+    if (s_counter == -1)
+    {
+        std::cerr << "[SYNC] Counter reached maximum value" << std::endl;
+        return -1;
+    }
+
+    if (ack_packet.getAckCode() != 0)
+        return 0;
+
+    // -------------- HANDLE SENDING BLOCK SIGNATURES ---------------------
+    for (size_t i = 0; i < signatures.size(); i += MAX::signatures_per_frame)
+    {
+        size_t end = std::min(signatures.size(), i + MAX::signatures_per_frame);
+        SyncSignatures signatures_packet(vector<Delta::BlockSignature>(signatures.begin() + i, signatures.begin() + end));
+
+        Wrapper signatures_wrapper(session_key, s_counter, signatures_packet.serialize());
+
+        serialized_packet = signatures_wrapper.serialize();
+        if (!sendFrame(communcation_socket, serialized_packet))
+        {
+            std::cerr << "[SYNC] Error sending the serialized packet" << std::endl;
+            return 0;
+        }
+
+        s_counter = incrementCounter(s_counter);
+        if (s_counter == -1)
+        {
+            std::cerr << "[SYNC] Counter reached maximum value" << std::endl;
+            return -1;
+        }
+    }
+    cout << "[SYNC] Sent " << signatures.size() << " block signatures of " << block_size << "B" << endl;
+
+    // -------------- HANDLE RECEIVING THE DELTA ---------------------
+    size_t max_frame_size = Wrapper::getSize(SyncM2::getSize(MAX::delta_batch));
+    std::unique_ptr<DeltaPatcher> patcher;
+    bool error_occured = false;
+    bool last = false;
+
+    try
+    {
+        patcher.reset(new DeltaPatcher(basis.getStream(), temp_path, block_size, m1.file_size));
+    }
+    catch (const std::exception &e)
+    {
+        std::cerr << "[SYNC] " << e.what() << std::endl;
+        error_occured = true;
+    }
+
+    // keep draining the instructions even after an error so the session stays in step
+    while (!last)
+    {
+        Buffer message_buff;
+
+        if (!receiveFrame(communcation_socket, message_buff, max_frame_size))
+        {
+            std::cerr << "[SYNC] Error receiving  data" << std::endl;
+            return 0;
+        }
+
+        Wrapper m2_wrapper(session_key);
+
+        if (!m2_wrapper.deserialize(message_buff))
+        {
+            std::cerr << "[SYNC] Wrapper packet wasn't deserialized correctly!" << endl;
+            return 0;
+        }
+
+        // Check counter otherwise exit
+        if (m2_wrapper.getCounter() != r_counter)
+            return -1;
+
+        r_counter = incrementCounter(r_counter);
+        if (r_counter == -1)
+        {
+            std::cerr << "[SYNC] Counter reached maximum value" << std::endl;
+            return -1;
+        }
+
+        SyncM2 m2_packet;
+        m2_packet.deserialize(m2_wrapper.getPayload());
+        last = m2_packet.isLast();
+
+        if (error_occured)
+            continue;
+
+        try
+        {
+            patcher->apply(m2_packet.getInstructions());
+        }
+        catch (const std::exception &e)
+        {
+            std::cerr << "[SYNC] " << e.what() << std::endl;
+            error_occured = true;
+        }
+    }
+
+    // swap the rebuilt file in place of the old one in a single rename
+    if (!error_occured)
+    {
+        try
+        {
+            patcher->close();
+            if (!patcher->isComplete())
+                error_occured = true;
+            else
+            {
+                // the old content stays reachable as the newest version of the file
+                VersionStore::instance().preserve(username, file_name);
+
+                if (Storage::deduplicate)
+                    ChunkedWriter::storeFile(temp_path, file_path);
+                else if (!backend.install(username, file_name, temp_name))
+                    error_occured = true;
+            }
+
+            // the chunks only the old version used may now be unreferenced
+            if (!error_occured && basis.isRecipe())
+                ChunkStore::instance().release();
+        }
+        catch (const std::exception &e)
+        {
+            std::cerr << "[SYNC] " << e.what() << std::endl;
+            error_occured = true;
+        }
+    }
+
+    if (!error_occured)
+    {
+        MetadataIndex::instance().refresh(username, file_name);
+        FileCache::instance().invalidate(file_path);
+    }
+
+    // ------------------- HANDLE ACK PACKET ---------------------
+    ack_packet = SyncAck(error_occured ? 1 : 0);
+
+    ack_wrapper = Wrapper(session_key, s_counter, ack_packet.serialize());
+
+    serialized_packet = ack_wrapper.serialize();
+    if (!sendData(communcation_socket, serialized_packet))
+    {
+        std::cerr << "[SYNC] Error sending the serialized packet" << std::endl;
+        return 0;
+    }
+
+    s_counter = incrementCounter(s_counter);
+    if (s_counter == -1)
+    {
+        std::cerr << "[SYNC] Counter reached maximum value" << std::endl;
+        return -1;
+    }
+
+    if (!error_occured)
+        cout << "[SYNC] " << file_name << " updated to " << m1.file_size << "B" << endl;
+
+    return 1;
+}
+int Worker::receive_manifest(size_t file_count, vector<BatchEntry> &entries)
+{
+    size_t max_frame_size = Wrapper::getSize(BatchManifest::getMaxSize(MAX::batch_entries_per_frame));
+    bool last = false;
+
+    entries.clear();
+    while (!last)
+    {
+        Buffer message_buff;
+
+        if (!receiveFrame(communcation_socket, message_buff, max_frame_size))
+        {
+            std::cerr << "[BATCH] Error receiving  data" << std::endl;
+            return 0;
+        }
+
+        Wrapper manifest_wrapper(session_key);
+
+        if (!manifest_wrapper.deserialize(message_buff))
+        {
+            std::cerr << "[BATCH] Wrapper packet wasn't deserialized correctly!" << endl;
+            return 0;
+        }
+
+        if (manifest_wrapper.getCounter() != r_counter)
+            return -1;
+
+        r_counter = incrementCounter(r_counter);
+        if (r_counter == -1)
+        {
+            std::cerr << "[BATCH] Counter reached maximum value" << std::endl;
+            return -1;
+        }
+
+        BatchManifest manifest;
+        if (!manifest.deserialize(manifest_wrapper.getPayload()) || entries.size() + manifest.getEntries().size() > file_count)
+        {
+            std::cerr << "[BATCH] Malformed manifest" << std::endl;
+            return 0;
+        }
+
+        entries.insert(entries.end(), manifest.getEntries().begin(), manifest.getEntries().end());
+        last = manifest.isLast();
     }
 
-    if (ack_size_packet.getAckCode() == 1)
+    return entries.size() == file_count ? 1 : 0;
+}
+
+int Worker::send_manifest(const vector<BatchEntry> &entries, uint8_t compression)
+{
+    // an empty batch still gets its (empty) last slice
+    size_t i = 0;
+    do
     {
-        std::cerr << "[LIST] Folder doe not exist on the cloud!" << endl;
+        size_t end = std::min(entries.size(), i + MAX::batch_entries_per_frame);
+        BatchManifest manifest(RequestCodes::BATCH_STATUS, vector<BatchEntry>(entries.begin() + i, entries.begin() + end), end == entries.size(), compression);
+
+        Wrapper manifest_wrapper(session_key, s_counter, manifest.serialize());
+
+        Buffer serialized_packet = manifest_wrapper.serialize();
+        if (!sendFrame(communcation_socket, serialized_packet))
+        {
+            std::cerr << "[BATCH] Error sending the serialized packet" << std::endl;
+            return 0;
+        }
+
+        s_counter = incrementCounter(s_counter);
+        if (s_counter == -1)
+        {
+            std::cerr << "[BATCH] Counter reached maximum value" << std::endl;
+            return -1;
+        }
+
+        i = end;
+    } while (i < entries.size());
+
+    return 1;
+}
+
+int Worker::batch_upload(Buffer payload)
+{
+    // ------ HERE WE START THE BATCH UPLOAD ROUTINE -----
+    BatchM1 m1;
+    m1.deserialize(payload);
+
+    if (m1.file_count > MAX::batch_files)
+    {
+        std::cerr << "[BATCH] Too many files in a single batch" << std::endl;
         return 0;
     }
 
-    // send the list of files to the client
-    ListM3 m3(fileNames.length());
-    m3.setFileListData(fileNames.c_str());
+    vector<BatchEntry> entries;
+    int result = receive_manifest(m1.file_count, entries);
+    if (result != 1)
+        return result;
 
-    Wrapper wrapper(session_key, s_counter, m3.serialize());
+    // -------------- VALIDATE THE WHOLE MANIFEST AT ONCE ---------------------
+    uint8_t compression = ChunkCompressor::negotiate(m1.compression);
+    std::unordered_set<string> batch_names;
+    uintmax_t total_size = 0;
+    QuotaReservation quota;
 
-    serialized_packet = wrapper.serialize();
-    if (!sendData(communcation_socket, serialized_packet))
+    for (BatchEntry &entry : entries)
     {
-        std::cerr << "[LIST] Error sending the serialized packet" << std::endl;
-        return 0;
+        if (!File::isValidFileName(entry.file_name))
+            entry.status = BatchCodes::INVALID_NAME;
+        else if (StorageBackend::instance().exists(username, entry.file_name) || !batch_names.insert(entry.file_name).second)
+            entry.status = BatchCodes::EXISTS;
+        else if (!quota.acquire(username, entry.file_size))
+            entry.status = BatchCodes::QUOTA_EXCEEDED;
+        else
+        {
+            entry.status = BatchCodes::OK;
+            total_size += entry.file_size;
+        }
     }
 
-    s_counter = incrementCounter(s_counter);
-    if (s_counter == -1)
+    result = send_manifest(entries, compression);
+    if (result != 1)
+        return result;
+
+    // -------------- HANDLE RECEIVING THE CONTENTS BACK TO BACK ---------------------
+    size_t max_frame_size = Wrapper::getSize(BatchData::getSize(MAX::batch_data));
+    uintmax_t received_size = 0;
+    size_t index = 0;
+    uintmax_t file_written = 0;
+    StoredFileWriter writer;
+    bool writer_open = false;
+    bool file_created = false;
+    Buffer data;
+    size_t data_position = 0;
+    bool data_corrupt = false;
+
+    // walk the accepted files in order, handing each one its share of the stream
+    while (true)
     {
-        std::cerr << "[LIST] Counter reached maximum value" << std::endl;
-        return -1;
+        while (index < entries.size() && entries[index].status != BatchCodes::OK)
+            index++;
+        if (index == entries.size())
+            break;
+
+        BatchEntry &entry = entries[index];
+        string file_path = StorageBackend::instance().path(username, entry.file_name);
+
+        if (!writer_open)
+        {
+            file_created = false;
+            try
+            {
+                writer = StoredFileWriter();
+                writer.create(username, entry.file_name, entry.file_size);
+                file_created = true;
+            }
+            catch (const std::exception &e)
+            {
+                std::cerr << "[BATCH] " << entry.file_name << ": " << e.what() << std::endl;
+                entry.status = BatchCodes::FAILED;
+            }
+            writer_open = true;
+            file_written = 0;
+        }
+
+        // pull the next frame once the current one is used up
+        if (data_position == data.size() && file_written < entry.file_size)
+        {
+            size_t expected_size = std::min<uintmax_t>(MAX::batch_data, total_size - received_size);
+            Buffer message_buff;
+
+            if (!receiveFrame(communcation_socket, message_buff, max_frame_size))
+            {
+                std::cerr << "[BATCH] Error receiving  data" << std::endl;
+                return 0;
+            }
+
+            Wrapper data_wrapper(session_key);
+
+            if (!data_wrapper.deserialize(message_buff))
+            {
+                std::cerr << "[BATCH] Wrapper packet wasn't deserialized correctly!" << endl;
+                return 0;
+            }
+
+            if (data_wrapper.getCounter() != r_counter)
+                return -1;
+
+            r_counter = incrementCounter(r_counter);
+            if (r_counter == -1)
+            {
+                std::cerr << "[BATCH] Counter reached maximum value" << std::endl;
+                return -1;
+            }
+
+            BatchData data_packet;
+            data_packet.deserialize(data_wrapper.getPayload());
+
+            data_corrupt = !ChunkCompressor::decode(data_packet.getData(), data_packet.getChunkFlags(), expected_size, data);
+            if (data_corrupt)
+            {
+                // keep the stream aligned, the files this frame covers are lost
+                std::cerr << "[BATCH] Malformed data frame" << std::endl;
+                data.assign(expected_size, 0);
+            }
+
+            data_position = 0;
+            received_size += expected_size;
+        }
+
+        size_t take = std::min<uintmax_t>(data.size() - data_position, entry.file_size - file_written);
+
+        if (data_corrupt && take > 0)
+            entry.status = BatchCodes::FAILED;
+
+        if (entry.status == BatchCodes::OK && take > 0)
+        {
+            try
+            {
+                writer.write(Buffer(data.begin() + data_position, data.begin() + data_position + take));
+            }
+            catch (const std::exception &e)
+            {
+                std::cerr << "[BATCH] " << entry.file_name << ": " << e.what() << std::endl;
+                entry.status = BatchCodes::FAILED;
+            }
+        }
+
+        data_position += take;
+        file_written += take;
+
+        if (file_written == entry.file_size)
+        {
+            try
+            {
+                if (entry.status == BatchCodes::OK)
+                    writer.commit();
+            }
+            catch (const std::exception &e)
+            {
+                std::cerr << "[BATCH] " << entry.file_name << ": " << e.what() << std::endl;
+                entry.status = BatchCodes::FAILED;
+            }
+
+            // a failed file only ever existed under its temporary name, dropping the writer removes it
+            if (entry.status == BatchCodes::FAILED)
+                writer = StoredFileWriter();
+
+            if (file_created)
+            {
+                MetadataIndex::instance().refresh(username, entry.file_name);
+                FileCache::instance().invalidate(file_path);
+            }
+
+            writer_open = false;
+            index++;
+        }
     }
-    return 1;
+
+    size_t stored = std::count_if(entries.begin(), entries.end(), [](const BatchEntry &entry)
+                                  { return entry.status == BatchCodes::OK; });
+    cout << "[BATCH] Stored " << stored << "/" << entries.size() << " files, " << received_size << "B" << endl;
+
+    // ------------------- HANDLE THE AGGREGATED STATUS ---------------------
+    return send_manifest(entries, compression);
 }
-int Worker::rename_file(Buffer payload)
-{
 
-    // Deserialize m1 general packet
-    RenameM1 m1;
+int Worker::batch_download(Buffer payload)
+{
+    // ------ HERE WE START THE BATCH DOWNLOAD ROUTINE -----
+    BatchM1 m1;
     m1.deserialize(payload);
-    Buffer serialized_packet;
 
-    // Check if the file exists
-    string file_name = (string)m1.file_name;
-    string new_file_name = (string)m1.new_file_name;
-    string file_path = "../data/" + username + "/" + file_name;
-    string new_file_path = "../data/" + username + "/" + new_file_name;
+    if (m1.file_count > MAX::batch_files)
+    {
+        std::cerr << "[BATCH] Too many files in a single batch" << std::endl;
+        return 0;
+    }
 
-    RenameAck ack_packet;
-    File file;
+    vector<BatchEntry> entries;
+    int result = receive_manifest(m1.file_count, entries);
+    if (result != 1)
+        return result;
 
-    uintmax_t file_size;
+    // -------------- RESOLVE THE WHOLE MANIFEST AT ONCE ---------------------
+    uint8_t compression = ChunkCompressor::negotiate(m1.compression);
+    vector<std::unique_ptr<StoredFile>> files(entries.size());
 
-    if (File::exists(file_path))
+    for (size_t i = 0; i < entries.size(); i++)
     {
-        // check if there is already no file with the same new name
-        if (!File::exists(new_file_path) && file.changeFileName(file_path, new_file_path) == 0)
+        BatchEntry &entry = entries[i];
+        entry.file_size = 0;
+
+        if (!File::isValidFileName(entry.file_name))
         {
+            entry.status = BatchCodes::INVALID_NAME;
+            continue;
+        }
 
-            ack_packet = RenameAck(0); // 0 means success
+        try
+        {
+            files[i].reset(new StoredFile());
+            files[i]->open(username, entry.file_name);
+
+            if (files[i]->getFileSize() > std::numeric_limits<uint32_t>::max())
+                throw std::runtime_error("File too large for a batch.");
+
+            entry.file_size = files[i]->getFileSize();
+            entry.status = BatchCodes::OK;
         }
-        else
+        catch (const std::exception &e)
         {
-            ack_packet = RenameAck(1); // error code : 1 means file rename failed
+            files[i].reset();
+            entry.status = BatchCodes::NOT_FOUND;
+        }
+    }
+
+    result = send_manifest(entries, compression);
+    if (result != 1)
+        return result;
+
+    // -------------- HANDLE SENDING THE CONTENTS BACK TO BACK ---------------------
+    ChunkCompressor compressor(compression);
+    uintmax_t sent_size = 0;
+    Buffer data;
+    data.reserve(MAX::batch_data);
+
+    for (size_t i = 0; i <= entries.size(); i++)
+    {
+        bool flush = (i == entries.size());
+
+        if (!flush && entries[i].status == BatchCodes::OK)
+        {
+            uintmax_t file_read = 0;
+
+            while (file_read < entries[i].file_size)
+            {
+                size_t take = std::min<uintmax_t>(MAX::batch_data - data.size(), entries[i].file_size - file_read);
+
+                try
+                {
+                    Buffer piece = files[i]->readChunk(take);
+                    data.insert(data.end(), piece.begin(), piece.end());
+                }
+                catch (const std::exception &e)
+                {
+                    // the announced size is still sent so the client stays aligned
+                    std::cerr << "[BATCH] " << entries[i].file_name << ": " << e.what() << std::endl;
+                    data.insert(data.end(), take, 0);
+                    entries[i].status = BatchCodes::FAILED;
+                }
+                file_read += take;
+
+                if (data.size() == MAX::batch_data)
+                {
+                    uint8_t chunk_flags;
+                    Buffer encoded = compressor.encode(data, chunk_flags);
+                    BatchData data_packet(encoded, chunk_flags);
+                    Wrapper data_wrapper(session_key, s_counter, data_packet.serialize());
+
+                    Buffer serialized_packet = data_wrapper.serialize();
+                    if (!sendFrame(communcation_socket, serialized_packet))
+                    {
+                        std::cerr << "[BATCH] Error sending the serialized packet" << std::endl;
+                        return 0;
+                    }
+
+                    s_counter = incrementCounter(s_counter);
+                    if (s_counter == -1)
+                    {
+                        std::cerr << "[BATCH] Counter reached maximum value" << std::endl;
+                        return -1;
+                    }
+
+                    sent_size += data.size();
+                    data.clear();
+                }
+            }
+
+            // done with this file, release it before opening the next ones
+            files[i].reset();
+        }
+
+        if (flush && !data.empty())
+        {
+            uint8_t chunk_flags;
+            Buffer encoded = compressor.encode(data, chunk_flags);
+            BatchData data_packet(encoded, chunk_flags);
+            Wrapper data_wrapper(session_key, s_counter, data_packet.serialize());
+
+            Buffer serialized_packet = data_wrapper.serialize();
+            if (!sendFrame(communcation_socket, serialized_packet))
+            {
+                std::cerr << "[BATCH] Error sending the serialized packet" << std::endl;
+                return 0;
+            }
+
+            s_counter = incrementCounter(s_counter);
+            if (s_counter == -1)
+            {
+                std::cerr << "[BATCH] Counter reached maximum value" << std::endl;
+                return -1;
+            }
+
+            sent_size += data.size();
         }
     }
+
+    cout << "[BATCH] Sent " << entries.size() << " files, " << sent_size << "B" << endl;
+    compressor.printStats("[BATCH]");
+
+    // ------------------- HANDLE THE AGGREGATED STATUS ---------------------
+    return send_manifest(entries, compression);
+}
+
+int Worker::archive_download(Buffer payload)
+{
+    // ------ HERE WE START THE ARCHIVE DOWNLOAD ROUTINE -----
+    BatchM1 m1;
+    m1.deserialize(payload);
+
+    if (m1.file_count > MAX::batch_files)
+    {
+        std::cerr << "[ARCHIVE] Too many files in a single archive" << std::endl;
+        return 0;
+    }
+
+    // -------------- COLLECT THE MEMBERS OF THE ARCHIVE ---------------------
+    vector<string> names;
+    size_t rejected = 0;
+
+    if (m1.file_count == 0)
+    {
+        // the whole folder, as known to the metadata index
+        MetadataIndex::instance().forEach(username, "", [&names](const string &name, const FileMetadata &)
+                                          {
+                                              names.push_back(name);
+                                              return true; });
+    }
     else
     {
-        // file does not exist
-        ack_packet = RenameAck(2); // error code : 2 means the file does not exist
+        vector<BatchEntry> entries;
+        int result = receive_manifest(m1.file_count, entries);
+        if (result != 1)
+            return result;
+
+        std::unordered_set<string> seen;
+        for (const BatchEntry &entry : entries)
+        {
+            if (!File::isValidFileName(entry.file_name))
+                rejected++;
+            else if (seen.insert(entry.file_name).second)
+                names.push_back(entry.file_name);
+        }
     }
 
-    Wrapper ack_wrapper(session_key, s_counter, ack_packet.serialize());
+    vector<ArchiveReader::Member> members;
+    for (const string &name : names)
+        members.push_back({name});
 
-    serialized_packet = ack_wrapper.serialize();
+    // -------------- HANDLE STREAMING THE ARCHIVE ---------------------
+    ChunkCompressor compressor(ChunkCompressor::negotiate(m1.compression));
+    ArchiveReader reader(members, username, MAX::archive_data, Storage::archive_prefetch);
+    uintmax_t sent_size = 0;
+    bool last = false;
+
+    while (!last)
+    {
+        Buffer frame;
+        last = reader.next(frame);
+
+        uint8_t chunk_flags;
+        Buffer encoded = compressor.encode(frame, chunk_flags);
+        ArchiveData data_packet(encoded, chunk_flags, frame.size(), last);
+        Wrapper data_wrapper(session_key, s_counter, data_packet.serialize());
+
+        Buffer serialized_packet = data_wrapper.serialize();
+        if (!sendFrame(communcation_socket, serialized_packet))
+        {
+            std::cerr << "[ARCHIVE] Error sending the serialized packet" << std::endl;
+            return 0;
+        }
+
+        s_counter = incrementCounter(s_counter);
+        if (s_counter == -1)
+        {
+            std::cerr << "[ARCHIVE] Counter reached maximum value" << std::endl;
+            return -1;
+        }
+
+        sent_size += frame.size();
+    }
+
+    size_t archived = reader.getArchivedFiles();
+    size_t failed = reader.getFailedFiles() + rejected;
+
+    cout << "[ARCHIVE] Sent " << archived << " files, " << sent_size << "B, waited on the disk for "
+         << reader.getStarvedReads() << " frames" << endl;
+    compressor.printStats("[ARCHIVE]");
+
+    // ------------------- HANDLE ACK PACKET ---------------------
+    ArchiveAck ack(archived, failed);
+    Wrapper ack_wrapper(session_key, s_counter, ack.serialize());
+
+    Buffer serialized_packet = ack_wrapper.serialize();
     if (!sendData(communcation_socket, serialized_packet))
     {
-        std::cerr << "[RENAME] Error sending the serialized packet" << std::endl;
+        std::cerr << "[ARCHIVE] Error sending the serialized packet" << std::endl;
         return 0;
     }
 
     s_counter = incrementCounter(s_counter);
     if (s_counter == -1)
     {
-        std::cerr << "[RENAME] Counter reached maximum value" << std::endl;
+        std::cerr << "[ARCHIVE] Counter reached maximum value" << std::endl;
         return -1;
     }
+
     return 1;
 }
-int Worker::delete_file(Buffer payload)
+
+int Worker::version_file(Buffer payload)
 {
-    // ------ HERE WE START THE DELETE ROUTINE -----
+    // ------ HERE WE START THE FILE VERSIONS ROUTINE -----
+
     // Deserialize m1 general packet
-    DeleteM1 m1;
+    VersionM1 m1;
     m1.deserialize(payload);
     Buffer serialized_packet;
 
-    // Check if the file exists
     string file_name = (string)m1.file_name;
-    string file_path = "../data/" + username + "/" + file_name;
 
-    DeleteAck ack_packet;
-    File file;
+    // a version is downloaded like a file
+    if (m1.action == VersionAction::DOWNLOAD)
+        return send_version(file_name, m1.version, m1.compression);
 
-    uintmax_t file_size;
+    VersionList list_packet;
 
-    if (File::exists(file_path))
+    if (!VersionStore::enabled())
+        list_packet = VersionList(2); // error code : 2 means files are not versioned
+    else if (!File::isValidFileName(file_name))
+        list_packet = VersionList(1);
+    else if (m1.action == VersionAction::RESTORE && !restore_version(file_name, m1.version))
+        list_packet = VersionList(1); // error code : 1 means no such version
+    else
     {
-        // check if there is already no file with the same new name
-        if (file.deleteFile(file_path) == 0)
-        {
+        vector<VersionEntry> entries;
+        for (const FileVersion &version : VersionStore::instance().list(username, file_name))
+            entries.push_back({version.number, version.size, version.mtime});
+        list_packet = VersionList(entries.empty() && m1.action == VersionAction::LIST ? 1 : 0, entries);
+    }
 
-            ack_packet = DeleteAck(0); // 0 means success
-        }
-        else
-        {
-            ack_packet = DeleteAck(1); // error code : 1 means file deletion failed
-        }
+    Wrapper list_wrapper(session_key, s_counter, list_packet.serialize());
+
+    serialized_packet = list_wrapper.serialize();
+    if (!sendFrame(communcation_socket, serialized_packet))
+    {
+        std::cerr << "[VERSION] Error sending the serialized packet" << std::endl;
+        return 0;
     }
-    else
+
+    s_counter = incrementCounter(s_counter);
+    if (s_counter == -1)
     {
-        // file does not exist
-        ack_packet = DeleteAck(2); // error code : 2 means the file does not exist
+        std::cerr << "[VERSION] Counter reached maximum value" << std::endl;
+        return -1;
+    }
+
+    return 1;
+}
+int Worker::send_version(const string &file_name, uint64_t number, uint8_t proposed_compression)
+{
+    Buffer serialized_packet;
+    Recipe recipe;
+    uint8_t compression = ChunkCompressor::negotiate(proposed_compression);
+
+    bool found = File::isValidFileName(file_name) && VersionStore::instance().open(username, file_name, number, recipe);
+    if (found && recipe.logical_size == 0)
+    {
+        cerr << "[VERSION] Cannot download empty files!" << endl;
+        found = false;
     }
 
+    // versions have no entity tag, they never change
+    DownloadAck ack_packet = found ? DownloadAck(0, recipe.logical_size, compression) : DownloadAck(1);
+
     Wrapper ack_wrapper(session_key, s_counter, ack_packet.serialize());
 
     serialized_packet = ack_wrapper.serialize();
     if (!sendData(communcation_socket, serialized_packet))
     {
-        std::cerr << "[DELETE] Error sending the serialized packet" << std::endl;
+        std::cerr << "[VERSION] Error sending the serialized packet" << std::endl;
         return 0;
     }
 
     s_counter = incrementCounter(s_counter);
     if (s_counter == -1)
     {
-        std::cerr << "[DELETE] Counter reached maximum value" << std::endl;
+        std::cerr << "[VERSION] Counter reached maximum value" << std::endl;
         return -1;
     }
 
+    if (!found)
+        return 0;
+
+    // -------------- HANDLE SENDING FILE CHUNKS ---------------------
+    uintmax_t file_size = recipe.logical_size;
+    uintmax_t sent_size = 0;
+    RecipeStream stream(recipe);
+    ChunkCompressor compressor(compression);
+    FrameSender sender(*io_engine, communcation_socket);
+
+    while (sent_size < file_size)
+    {
+        size_t current_chunk_size = std::min<uintmax_t>(MAX::max_file_chunk, file_size - sent_size);
+        uint8_t chunk_flags;
+        Buffer chunk;
+
+        try
+        {
+            chunk = compressor.encode(stream.readChunk(current_chunk_size), chunk_flags);
+        }
+        catch (const std::exception &e)
+        {
+            std::cerr << "[VERSION] " << e.what() << std::endl;
+            return 0;
+        }
+
+        DownloadM2 m2_packet(chunk, chunk_flags);
+
+        Wrapper m2_wrapper(session_key, s_counter, m2_packet.serialize());
+
+        serialized_packet = m2_wrapper.serialize();
+        if (!sender.push(serialized_packet))
+            return 0;
+
+        s_counter = incrementCounter(s_counter);
+        if (s_counter == -1)
+        {
+            std::cerr << "[VERSION] Counter reached maximum value" << std::endl;
+            return -1;
+        }
+
+        sent_size += current_chunk_size;
+    }
+
+    if (!sender.flush())
+        return 0;
+
+    cout << "[VERSION] Sent version " << number << " of " << file_name << " (" << file_size << "B)" << endl;
+    compressor.printStats("[VERSION]");
     return 1;
 }
+bool Worker::restore_version(const string &file_name, uint64_t number)
+{
+    StorageBackend &backend = StorageBackend::instance();
+    string file_path = backend.path(username, file_name);
+    // a plain file is rebuilt next to the current one and swapped in, like a synced version
+    string temp_name = tempName(file_name, "restore");
+    string temp_path = backend.folder(username) + "/" + temp_name;
+    TempFile temp_file(temp_path);
+    Recipe recipe;
+    QuotaReservation quota;
+
+    if (!VersionStore::instance().open(username, file_name, number, recipe))
+        return false;
+
+    try
+    {
+        // the growth of the file needs room in the quota, and so does the replaced content,
+        // kept as a version of its own
+        FileMetadata current;
+        uintmax_t current_size = MetadataIndex::instance().lookup(username, file_name, current) ? current.size : 0;
+        if (!quota.acquireReplacement(username, current_size, recipe.logical_size))
+            throw std::runtime_error("The version exceeds the quota of " + username + ".");
+
+        // the content being replaced becomes a version of its own, a restore can be undone
+        VersionStore::instance().preserve(username, file_name);
+
+        if (Storage::deduplicate)
+        {
+            std::shared_lock<std::shared_mutex> pin = ChunkStore::instance().pin();
+            recipe.save(file_path);
+            ContentIndex::instance().add(file_path, recipe);
+        }
+        else
+        {
+            std::unique_ptr<StagedFile> staged(new StagedFile(io_engine.get()));
+            staged->create(temp_path, recipe.logical_size);
+            std::unique_ptr<BackendWriter> output = std::move(staged);
+            if (CompressedWriter::wanted(file_name, recipe.logical_size))
+                output = std::unique_ptr<BackendWriter>(new CompressedWriter(std::move(output), recipe.logical_size));
+
+            RecipeStream stream(recipe);
+            for (uintmax_t written = 0; written < recipe.logical_size;)
+            {
+                Buffer data = stream.readChunk(std::min<uintmax_t>(MAX::max_file_chunk, recipe.logical_size - written));
+                if (data.empty())
+                    throw std::runtime_error("Corrupted version.");
+                output->write(data);
+                written += data.size();
+            }
+            output->commit();
+
+            if (!backend.install(username, file_name, temp_name))
+                throw std::runtime_error("Unable to install the restored file.");
+        }
+    }
+    catch (const std::exception &e)
+    {
+        std::cerr << "[VERSION] " << e.what() << std::endl;
+        return false;
+    }
+
+    MetadataIndex::instance().refresh(username, file_name);
+    FileCache::instance().invalidate(file_path);
+
+    cout << "[VERSION] " << file_name << " restored to version " << number << endl;
+    return true;
+}
 int Worker::logout(Buffer payload)
 {
     LogoutM1 m1;
@@ -855,6 +2434,24 @@ int Worker::start()
         case RequestCodes::DELETE_REQ:
             result = delete_file(payload);
             break;
+        case RequestCodes::SYNC_REQ:
+            result = sync_file(payload);
+            break;
+        case RequestCodes::BATCH_UPLOAD_REQ:
+            result = batch_upload(payload);
+            break;
+        case RequestCodes::BATCH_DOWNLOAD_REQ:
+            result = batch_download(payload);
+            break;
+        case RequestCodes::ARCHIVE_REQ:
+            result = archive_download(payload);
+            break;
+        case RequestCodes::LIST_PAGE_REQ:
+            result = list_page(payload);
+            break;
+        case RequestCodes::VERSION_REQ:
+            result = version_file(payload);
+            break;
         case RequestCodes::LOGOUT_REQ:
             result = logout(payload);
             break;
@@ -879,6 +2476,8 @@ int Worker::start()
 }
 Worker::~Worker()
 {
+    if (attached)
+        StorageBackend::instance().detach(username);
     clear_vec(session_key);
     close(communcation_socket);
     std::cout << "[WORKER] Worker on socket : " << communcation_socket << " closed!" << std::endl;
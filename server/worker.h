@@ -7,10 +7,17 @@
 #include <cstring>
 #include <openssl/rand.h>
 #include <vector>
+#include <memory>
 
 using namespace std;
 
 typedef std::vector<unsigned char> Buffer;
+
+class Recipe;
+class IoEngine;
+class UploadM1;
+struct BatchEntry;
+
 class Worker
 {
 private:
@@ -19,6 +26,23 @@ private:
     Buffer session_key;
     int s_counter = 0;
     int r_counter = 0;
+    // the user folder is held open by the storage backend from login to the end of the session
+    bool attached = false;
+    // queues the disk and socket I/O of the transfer loops of this session
+    std::unique_ptr<IoEngine> io_engine;
+
+    // --------- Upload Strategies ---------
+    int upload_chunks(UploadM1 &m1, bool &error_occured);
+    int upload_proof(const Recipe &known_recipe, const string &file_path, uint8_t compression, bool &stored);
+    int upload_manifest(UploadM1 &m1, const string &file_path, bool &error_occured);
+
+    // --------- Batch Manifests ---------
+    int receive_manifest(size_t file_count, vector<BatchEntry> &entries);
+    int send_manifest(const vector<BatchEntry> &entries, uint8_t compression);
+
+    // --------- File Versions ---------
+    int send_version(const string &file_name, uint64_t number, uint8_t proposed_compression);
+    bool restore_version(const string &file_name, uint64_t number);
 
 public:
     Worker(int communcation_socket);
@@ -30,8 +54,14 @@ public:
     int upload_file(Buffer payload);
     int download_file(Buffer payload);
     int list_files(Buffer payload);
+    int list_page(Buffer payload);
     int rename_file(Buffer payload);
     int delete_file(Buffer payload);
+    int sync_file(Buffer payload);
+    int batch_upload(Buffer payload);
+    int batch_download(Buffer payload);
+    int archive_download(Buffer payload);
+    int version_file(Buffer payload);
     int logout(Buffer payload);
     // ----------------------------------------
 
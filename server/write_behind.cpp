@@ -0,0 +1,160 @@
+#include "write_behind.h"
+#include "constants.h"
+#include <cerrno>
+#include <chrono>
+#include <iostream>
+#include <sys/stat.h>
+#include <sys/sysmacros.h>
+#include <thread>
+#include <unistd.h>
+
+WriteBehind::WriteBehind() : group_commits(0), synced_files(0)
+{
+    if (Storage::durability == Durability::GROUP_COMMIT)
+        std::thread(&WriteBehind::commitGroups, this).detach();
+}
+
+WriteBehind &WriteBehind::instance()
+{
+    // never destroyed, its threads keep running until the process exits
+    static WriteBehind *write_behind = new WriteBehind();
+    return *write_behind;
+}
+
+size_t WriteBehind::queue(int fd)
+{
+    struct stat info;
+    dev_t device = fstat(fd, &info) == 0 ? info.st_dev : 0;
+
+    std::lock_guard<std::mutex> lock(mutex);
+    for (size_t index = 0; index < queues.size(); index++)
+        if (queues[index]->device == device)
+            return index;
+
+    queues.emplace_back(new Queue());
+    queues.back()->device = device;
+    std::thread(&WriteBehind::writeJobs, this, queues.back().get()).detach();
+    std::cout << "[WRITE] Writer thread for device " << major(device) << ":" << minor(device) << std::endl;
+
+    return queues.size() - 1;
+}
+
+void WriteBehind::write(Job &job, size_t queue, int fd, const unsigned char *data, size_t length, uint64_t offset)
+{
+    job.fd = fd;
+    job.data = data;
+    job.length = length;
+    job.offset = offset;
+    job.error = 0;
+    job.pending = true;
+
+    Queue *target;
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        target = queues[queue].get();
+        target->jobs.push_back(&job);
+    }
+    target->work.notify_one();
+}
+
+bool WriteBehind::wait(Job &job)
+{
+    std::unique_lock<std::mutex> lock(mutex);
+    finished.wait(lock, [&job]()
+                  { return !job.pending; });
+
+    return job.error == 0;
+}
+
+void WriteBehind::writeJobs(Queue *queue)
+{
+    std::unique_lock<std::mutex> lock(mutex);
+
+    while (true)
+    {
+        queue->work.wait(lock, [queue]()
+                         { return !queue->jobs.empty(); });
+
+        Job *job = queue->jobs.front();
+        queue->jobs.pop_front();
+        lock.unlock();
+
+        int error = 0;
+        for (size_t done = 0; done < job->length;)
+        {
+            ssize_t count = pwrite(job->fd, job->data + done, job->length - done, job->offset + done);
+            if (count == -1 && errno == EINTR)
+                continue;
+            if (count <= 0)
+            {
+                error = count == -1 ? errno : EIO;
+                break;
+            }
+            done += count;
+        }
+
+        lock.lock();
+        job->error = error;
+        job->pending = false;
+        finished.notify_all();
+    }
+}
+
+bool WriteBehind::sync(int fd)
+{
+    struct stat info;
+    SyncRequest request = {fd, fstat(fd, &info) == 0 ? info.st_dev : 0, 0, false};
+
+    std::unique_lock<std::mutex> lock(mutex);
+    syncs.push_back(&request);
+    finished.wait(lock, [&request]()
+                  { return request.done; });
+
+    return request.error == 0;
+}
+
+void WriteBehind::commitGroups()
+{
+    while (true)
+    {
+        std::this_thread::sleep_for(std::chrono::milliseconds(Storage::group_commit_ms));
+
+        std::vector<SyncRequest *> group;
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            group.swap(syncs);
+        }
+
+        if (group.empty())
+            continue;
+
+        // a single syncfs flushes every file of the group living on the same filesystem;
+        // should it fail each of them is flushed on its own to learn which one is affected
+        std::vector<bool> flushed(group.size(), false);
+        for (size_t first = 0; first < group.size(); first++)
+        {
+            if (flushed[first])
+                continue;
+
+            bool failed = syncfs(group[first]->fd) != 0;
+            for (size_t index = first; index < group.size(); index++)
+                if (!flushed[index] && group[index]->device == group[first]->device)
+                {
+                    flushed[index] = true;
+                    if (failed)
+                        group[index]->error = fdatasync(group[index]->fd) == 0 ? 0 : errno;
+                }
+        }
+
+        std::lock_guard<std::mutex> lock(mutex);
+        for (SyncRequest *request : group)
+            request->done = true;
+        finished.notify_all();
+
+        // a line every so often is enough to see how many files share a flush
+        group_commits++;
+        synced_files += group.size();
+        if (group_commits % 100 == 0)
+            std::cout << "[COMMIT] " << group_commits << " group commits, " << synced_files << " files" << std::endl;
+    }
+}
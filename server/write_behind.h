@@ -0,0 +1,71 @@
+#ifndef WRITE_BEHIND_H
+#define WRITE_BEHIND_H
+
+#include <condition_variable>
+#include <cstddef>
+#include <cstdint>
+#include <deque>
+#include <memory>
+#include <mutex>
+#include <sys/types.h>
+#include <vector>
+
+// ----------------------------------- WRITE BEHIND ------------------------------------
+
+// Background threads shared by every session: one per device writes the blocks handed over
+// by uploads that have no io_uring to do it, so a slow disk only holds up the files on it,
+// and one runs the group commit of Durability::GROUP_COMMIT.
+class WriteBehind
+{
+public:
+    // Must stay in place until wait() returned for it
+    struct Job
+    {
+        int fd = -1;
+        const unsigned char *data = nullptr;
+        size_t length = 0;
+        uint64_t offset = 0;
+        int error = 0; // errno of the failure, 0 on success
+        bool pending = false;
+    };
+
+private:
+    struct Queue
+    {
+        dev_t device;
+        std::condition_variable work;
+        std::deque<Job *> jobs;
+    };
+
+    struct SyncRequest
+    {
+        int fd;
+        dev_t device;
+        int error;
+        bool done;
+    };
+
+    std::mutex mutex;
+    std::condition_variable finished;
+    std::vector<std::unique_ptr<Queue>> queues; // never shrinks, indexes stay valid
+    std::vector<SyncRequest *> syncs;
+    uint64_t group_commits;
+    uint64_t synced_files;
+
+    WriteBehind();
+    void writeJobs(Queue *queue);
+    void commitGroups();
+
+public:
+    static WriteBehind &instance();
+
+    // Queue of the device fd is open on, its thread is started the first time the device shows up
+    size_t queue(int fd);
+    void write(Job &job, size_t queue, int fd, const unsigned char *data, size_t length, uint64_t offset);
+    // Blocks until job was written, true when it was without error
+    bool wait(Job &job);
+    // Joins the next group commit, returns once the data of fd reached the disk
+    bool sync(int fd);
+};
+
+#endif // WRITE_BEHIND_H
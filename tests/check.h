@@ -0,0 +1,50 @@
+#ifndef CHECK_H
+#define CHECK_H
+
+#include <filesystem>
+#include <iostream>
+#include <string>
+#include <unistd.h>
+
+// Minimal assertions for the unit tests: a failed check is reported with its location and
+// makes the test executable exit with a failure, the following checks still run
+namespace Check
+{
+    inline int &failures()
+    {
+        static int count = 0;
+        return count;
+    }
+
+    // Moves the test into a fresh folder of its own: the server keeps its files in ../data,
+    // relative to the working directory, so the data folder of the test is root/data
+    inline std::string enterScratch(const std::string &name)
+    {
+        std::filesystem::path root = std::filesystem::temp_directory_path() / (name + "." + std::to_string(getpid()));
+        std::filesystem::remove_all(root);
+        std::filesystem::create_directories(root / "run");
+        std::filesystem::current_path(root / "run");
+        return root.string();
+    }
+
+    inline void leaveScratch(const std::string &root)
+    {
+        std::error_code error;
+        std::filesystem::current_path(std::filesystem::temp_directory_path());
+        std::filesystem::remove_all(root, error);
+    }
+}
+
+#define CHECK(condition)                                                                        \
+    do                                                                                          \
+    {                                                                                           \
+        if (!(condition))                                                                       \
+        {                                                                                       \
+            std::cerr << __FILE__ << ":" << __LINE__ << ": CHECK(" #condition ") failed" << std::endl; \
+            Check::failures()++;                                                                \
+        }                                                                                       \
+    } while (0)
+
+#define CHECK_RESULT() (Check::failures() == 0 ? 0 : 1)
+
+#endif // CHECK_H
@@ -0,0 +1,218 @@
+#include "check.h"
+#include "chunk_store.h"
+#include "chunker.h"
+#include "content_index.h"
+#include "constants.h"
+#include <fstream>
+#include <random>
+#include <set>
+
+namespace fs = std::filesystem;
+
+namespace
+{
+    Buffer randomBytes(size_t size, unsigned seed)
+    {
+        std::mt19937 generator(seed);
+        Buffer data(size);
+        for (unsigned char &byte : data)
+            byte = static_cast<unsigned char>(generator());
+        return data;
+    }
+
+    std::vector<Buffer> chunk(const Buffer &data, size_t feed_size)
+    {
+        std::vector<Buffer> chunks;
+        ContentChunker chunker;
+        auto collect = [&chunks](const Buffer &piece)
+        { chunks.push_back(piece); };
+
+        for (size_t i = 0; i < data.size(); i += feed_size)
+            chunker.push(Buffer(data.begin() + i, data.begin() + std::min(data.size(), i + feed_size)), collect);
+        chunker.finish(collect);
+        return chunks;
+    }
+
+    std::set<Buffer> asSet(const std::vector<Buffer> &chunks)
+    {
+        return std::set<Buffer>(chunks.begin(), chunks.end());
+    }
+
+    void testChunkBounds()
+    {
+        Buffer data = randomBytes(8 * 1024 * 1024, 1);
+        std::vector<Buffer> chunks = chunk(data, 100000);
+
+        Buffer joined;
+        bool bounded = true;
+        for (size_t i = 0; i < chunks.size(); i++)
+        {
+            joined.insert(joined.end(), chunks[i].begin(), chunks[i].end());
+            bool last = i + 1 == chunks.size();
+            bounded = bounded && chunks[i].size() <= Storage::max_chunk && (last || chunks[i].size() >= Storage::min_chunk);
+        }
+        CHECK(joined == data);
+        CHECK(bounded);
+
+        // normalized chunking keeps the mean close to the target
+        size_t mean = data.size() / chunks.size();
+        CHECK(mean > Storage::avg_chunk / 2 && mean < Storage::avg_chunk * 2);
+
+        // data that never matches the hash is cut at the maximum size
+        std::vector<Buffer> flat = chunk(Buffer(3 * Storage::max_chunk, 0), 4096);
+        CHECK(flat.size() == 3 && flat[0].size() == Storage::max_chunk);
+    }
+
+    void testBoundaryStability()
+    {
+        Buffer data = randomBytes(4 * 1024 * 1024, 2);
+        std::set<Buffer> original = asSet(chunk(data, 65536));
+
+        // the cut points do not depend on how the data is fed
+        CHECK(asSet(chunk(data, 777)) == original);
+
+        // an insertion only changes the chunks around it
+        Buffer edited = data;
+        Buffer extra = randomBytes(100, 3);
+        edited.insert(edited.begin() + data.size() / 2, extra.begin(), extra.end());
+        std::set<Buffer> changed = asSet(chunk(edited, 65536));
+
+        size_t shared = 0;
+        for (const Buffer &piece : changed)
+            shared += original.count(piece);
+        CHECK(shared + 3 >= original.size());
+    }
+
+    void testRecipeAuthentication()
+    {
+        fs::create_directories("../data/user1");
+        std::string path = "../data/user1/file";
+
+        ChunkedWriter writer;
+        writer.write(randomBytes(300000, 4));
+        writer.commit(path);
+
+        Recipe recipe;
+        CHECK(Recipe::isRecipe(path) && recipe.load(path));
+        CHECK(recipe.logical_size == 300000 && !recipe.entries.empty());
+
+        // a single flipped bit anywhere fails the HMAC
+        std::fstream file(path, std::ios::binary | std::ios::in | std::ios::out);
+        file.seekg(20);
+        char byte = 0;
+        file.read(&byte, 1);
+        file.seekp(20);
+        byte ^= 0x01;
+        file.write(&byte, 1);
+        file.close();
+        CHECK(!recipe.load(path));
+
+        // a plain file is never taken for a recipe
+        std::ofstream("../data/user1/plain") << "just some text";
+        CHECK(!Recipe::isRecipe("../data/user1/plain") && !recipe.load("../data/user1/plain"));
+    }
+
+    void testGarbageCollection()
+    {
+        ChunkStore &store = ChunkStore::instance();
+
+        // a version recipe is the only one left referencing its chunks
+        fs::create_directories(Storage::version_root + "/user1/old.txt");
+        std::string version_path = Storage::version_root + "/user1/old.txt/1";
+        {
+            ChunkedWriter writer;
+            writer.write(randomBytes(200000, 5));
+            writer.commit(version_path);
+        }
+        Recipe version;
+        CHECK(version.load(version_path));
+
+        std::string orphan;
+        {
+            std::shared_lock<std::shared_mutex> pin = store.pin();
+            orphan = store.put(randomBytes(5000, 6));
+        }
+        CHECK(store.has(orphan));
+
+        store.collectGarbage();
+
+        bool kept = true;
+        for (const RecipeEntry &entry : version.entries)
+            kept = kept && store.has(entry.digest);
+        CHECK(kept);
+        CHECK(!store.has(orphan));
+
+        // once the version goes, so do its chunks
+        fs::remove(version_path);
+        store.collectGarbage();
+        CHECK(!store.has(version.entries.front().digest));
+    }
+
+    Recipe keepVersion(const std::string &path, unsigned seed)
+    {
+        fs::create_directories(fs::path(path).parent_path());
+        ChunkedWriter writer;
+        writer.write(randomBytes(100000, seed));
+        writer.commit(path);
+
+        Recipe recipe;
+        CHECK(recipe.load(path));
+        return recipe;
+    }
+
+    void testContentOwnership()
+    {
+        ContentIndex &index = ContentIndex::instance();
+
+        // versions of a file user1 named after user2, one found by the first scan, one added later
+        Recipe scanned = keepVersion(Storage::version_root + "/user1/user2/1", 7);
+        CHECK(index.ownsChunk("user1", scanned.entries.front().digest));
+        Recipe added = keepVersion(Storage::version_root + "/user1/user2/2", 8);
+
+        // an upload of user2 is never told it already holds chunks of user1
+        for (const Recipe &version : {scanned, added})
+        {
+            bool owned = true, leaked = false;
+            for (const RecipeEntry &entry : version.entries)
+            {
+                owned = owned && index.ownsChunk("user1", entry.digest);
+                leaked = leaked || index.ownsChunk("user2", entry.digest);
+            }
+            CHECK(owned);
+            CHECK(!leaked);
+        }
+
+        // a whole file is only found among the files of the user asking
+        std::string path;
+        Recipe found;
+        CHECK(index.findFile("user1", added.file_digest, path, found) && path == Storage::version_root + "/user1/user2/2");
+        CHECK(!index.findFile("user2", added.file_digest, path, found));
+        CHECK(!index.findFile("user2", scanned.file_digest, path, found));
+        CHECK(index.findFile("user1", scanned.file_digest, path, found));
+
+        // the files of a folder still belong to its user
+        fs::create_directories("../data/user3");
+        ChunkedWriter writer;
+        writer.write(randomBytes(50000, 9));
+        writer.commit("../data/user3/file.bin");
+        Recipe file;
+        CHECK(file.load("../data/user3/file.bin"));
+        CHECK(index.ownsChunk("user3", file.entries.front().digest));
+        CHECK(!index.ownsChunk("user1", file.entries.front().digest));
+        CHECK(index.findFile("user3", file.file_digest, path, found) && !index.findFile("user1", file.file_digest, path, found));
+    }
+}
+
+int main()
+{
+    std::string root = Check::enterScratch("test_chunk_store");
+
+    testChunkBounds();
+    testBoundaryStability();
+    testRecipeAuthentication();
+    testGarbageCollection();
+    testContentOwnership();
+
+    Check::leaveScratch(root);
+    return CHECK_RESULT();
+}
@@ -0,0 +1,135 @@
+#include "check.h"
+#include "compressed_file.h"
+#include "constants.h"
+#include <random>
+#include <sstream>
+
+namespace
+{
+    // Collects what a CompressedWriter stores
+    class MemoryWriter : public BackendWriter
+    {
+    private:
+        std::string &stored;
+
+    public:
+        explicit MemoryWriter(std::string &stored) : stored(stored) {}
+        void write(const Buffer &data) override { stored.append(data.begin(), data.end()); }
+        void commit() override {}
+    };
+
+    // Text that compresses, with an incompressible stretch across a block boundary
+    Buffer content(size_t size)
+    {
+        std::mt19937 generator(7);
+        Buffer data(size);
+        for (size_t i = 0; i < size; i++)
+        {
+            bool noise = i > Storage::at_rest_block / 2 && i < Storage::at_rest_block * 3 / 2;
+            data[i] = noise ? static_cast<unsigned char>(generator()) : static_cast<unsigned char>("line of text\n"[i % 13]);
+        }
+        return data;
+    }
+
+    std::string compress(const Buffer &data, size_t piece)
+    {
+        std::string stored;
+        CompressedWriter writer(std::unique_ptr<BackendWriter>(new MemoryWriter(stored)), data.size());
+        for (size_t i = 0; i < data.size(); i += piece)
+            writer.write(Buffer(data.begin() + i, data.begin() + std::min(data.size(), i + piece)));
+        writer.commit();
+        return stored;
+    }
+
+    std::unique_ptr<CompressedStream> open(const std::string &stored)
+    {
+        std::unique_ptr<std::istream> source(new std::istringstream(stored));
+        return CompressedStream::open(source);
+    }
+
+    bool isContainer(const std::string &stored)
+    {
+        std::istringstream source(stored);
+        uintmax_t size;
+        bool probed = CompressedStream::probe(source, size);
+        return probed && open(stored) != nullptr;
+    }
+
+    Buffer readAll(std::istream &stream, size_t size)
+    {
+        Buffer data(size);
+        stream.read(reinterpret_cast<char *>(data.data()), size);
+        data.resize(stream.gcount());
+        return data;
+    }
+
+    void testRoundTrip()
+    {
+        Buffer data = content(3 * Storage::at_rest_block + 1234);
+        std::string stored = compress(data, 100000);
+        CHECK(stored.size() < data.size());
+
+        uintmax_t size = 0;
+        std::istringstream probed(stored);
+        CHECK(CompressedStream::probe(probed, size) && size == data.size());
+        CHECK(probed.tellg() == 0);
+
+        std::unique_ptr<CompressedStream> stream = open(stored);
+        CHECK(stream && stream->getFileSize() == data.size());
+        if (!stream)
+            return;
+        CHECK(readAll(*stream, data.size() + 10) == data);
+
+        // seeks land in the right frame, backwards and across a boundary
+        size_t position = 2 * Storage::at_rest_block - 100;
+        stream->clear();
+        CHECK(stream->seekg(position));
+        CHECK(readAll(*stream, 300) == Buffer(data.begin() + position, data.begin() + position + 300));
+        CHECK(stream->seekg(10));
+        CHECK(readAll(*stream, 20) == Buffer(data.begin() + 10, data.begin() + 30));
+        CHECK(stream->seekg(0, std::ios_base::end) && stream->tellg() == static_cast<std::streamoff>(data.size()));
+
+        // an empty file is a container without frames
+        std::unique_ptr<CompressedStream> empty = open(compress(Buffer(), 1));
+        CHECK(empty && empty->getFileSize() == 0 && readAll(*empty, 10).empty());
+    }
+
+    void testPlainFiles()
+    {
+        CHECK(!isContainer(""));
+        CHECK(!isContainer("just some text that is not compressed"));
+
+        // a container cut short, or with any byte of its header or offsets changed, is no
+        // longer one and is served as it is stored
+        std::string stored = compress(content(2 * Storage::at_rest_block + 5), 65536);
+        CHECK(isContainer(stored));
+        CHECK(!isContainer(stored.substr(0, stored.size() - 1)));
+        CHECK(!isContainer(stored.substr(0, stored.size() / 2)));
+
+        std::string resized = stored;
+        resized[15] ^= 1; // logical size
+        CHECK(!isContainer(resized));
+
+        std::string moved = stored;
+        moved[stored.size() - 8 - 32 - 1] ^= 1; // last frame offset
+        CHECK(!isContainer(moved));
+
+        // bytes laid out like a container but written by someone without the server key
+        std::string forged(stored.begin(), stored.begin() + 24);
+        forged += "frames, offsets and a mac that was never computed by the server";
+        forged += stored.substr(stored.size() - 8);
+        std::unique_ptr<std::istream> source(new std::istringstream(forged));
+        CHECK(CompressedStream::open(source) == nullptr && source);
+    }
+}
+
+int main()
+{
+    std::string root = Check::enterScratch("test_compressed_file");
+
+    testRoundTrip();
+    testPlainFiles();
+
+    Check::leaveScratch(root);
+    return CHECK_RESULT();
+}
@@ -0,0 +1,175 @@
+#include "check.h"
+#include "delta.h"
+#include <filesystem>
+#include <random>
+#include <sstream>
+#include <stdexcept>
+#include <unistd.h>
+
+namespace fs = std::filesystem;
+
+namespace
+{
+    const size_t BLOCK = Delta::min_block_size;
+
+    std::string scratch(const std::string &name)
+    {
+        fs::path folder = fs::temp_directory_path() / ("test_delta." + std::to_string(getpid()));
+        fs::create_directories(folder);
+        return (folder / name).string();
+    }
+
+    Buffer randomBytes(size_t size, unsigned seed)
+    {
+        std::mt19937 generator(seed);
+        Buffer data(size);
+        for (unsigned char &byte : data)
+            byte = static_cast<unsigned char>(generator());
+        return data;
+    }
+
+    void writeFile(const std::string &path, const Buffer &data)
+    {
+        std::ofstream output(path, std::ios::binary | std::ios::trunc);
+        output.write(reinterpret_cast<const char *>(data.data()), data.size());
+    }
+
+    Buffer readFile(const std::string &path)
+    {
+        std::ifstream input(path, std::ios::binary);
+        return Buffer(std::istreambuf_iterator<char>(input), std::istreambuf_iterator<char>());
+    }
+
+    std::istringstream streamOf(const Buffer &data)
+    {
+        return std::istringstream(std::string(data.begin(), data.end()));
+    }
+
+    // Syncs new_data against old_data like the server and client do, true when the rebuilt
+    // file is new_data; matched gets the bytes taken from the old copy
+    bool sync(const Buffer &old_data, const Buffer &new_data, uintmax_t &matched)
+    {
+        std::istringstream basis = streamOf(old_data);
+        std::vector<Delta::BlockSignature> signatures = Delta::computeSignatures(basis, BLOCK);
+
+        std::string new_path = scratch("new");
+        std::string rebuilt_path = scratch("rebuilt");
+        writeFile(new_path, new_data);
+
+        DeltaPatcher patcher(basis, rebuilt_path, BLOCK, new_data.size());
+        DeltaEncoder encoder(BLOCK, signatures);
+        bool last_seen = false;
+        bool encoded = encoder.encode(new_path, 4096, [&](Buffer &batch, bool last)
+                                      {
+                                          patcher.apply(batch);
+                                          last_seen = last;
+                                          return true; });
+        patcher.close();
+
+        matched = encoder.getMatchedBytes();
+        return encoded && last_seen && patcher.isComplete() && readFile(rebuilt_path) == new_data;
+    }
+
+    void testRollingChecksum()
+    {
+        Buffer data = randomBytes(4 * BLOCK, 1);
+        RollingChecksum rolling;
+        rolling.init(data.data(), BLOCK);
+
+        // rolling over every position gives the checksum computed from scratch
+        bool same = true;
+        for (size_t position = 1; position + BLOCK <= data.size(); position++)
+        {
+            rolling.roll(data[position - 1], data[position + BLOCK - 1]);
+            same = same && rolling.value() == Delta::weakChecksum(data.data() + position, BLOCK);
+        }
+        CHECK(same);
+    }
+
+    void testSync()
+    {
+        Buffer old_data = randomBytes(64 * BLOCK + 100, 2);
+        uintmax_t matched = 0;
+
+        // identical files travel as block references only
+        CHECK(sync(old_data, old_data, matched));
+        CHECK(matched == 64 * BLOCK);
+
+        // an insert in the middle only costs its own bytes, the blocks after it realign
+        Buffer inserted = old_data;
+        Buffer extra = randomBytes(37, 3);
+        inserted.insert(inserted.begin() + 20 * BLOCK + 11, extra.begin(), extra.end());
+        CHECK(sync(old_data, inserted, matched));
+        CHECK(matched >= 62 * BLOCK);
+
+        // so does a delete
+        Buffer deleted = old_data;
+        deleted.erase(deleted.begin() + 30 * BLOCK + 5, deleted.begin() + 30 * BLOCK + 205);
+        CHECK(sync(old_data, deleted, matched));
+        CHECK(matched >= 62 * BLOCK);
+
+        // a changed tail keeps every block before it
+        Buffer tail = old_data;
+        tail.resize(50 * BLOCK);
+        Buffer new_tail = randomBytes(3 * BLOCK + 7, 4);
+        tail.insert(tail.end(), new_tail.begin(), new_tail.end());
+        CHECK(sync(old_data, tail, matched));
+        CHECK(matched == 50 * BLOCK);
+
+        // an empty basis has no block to offer
+        CHECK(sync(Buffer(), old_data, matched));
+        CHECK(matched == 0);
+    }
+
+    bool refused(const Buffer &basis_data, const Buffer &instructions, uintmax_t expected_size)
+    {
+        std::istringstream basis = streamOf(basis_data);
+        DeltaPatcher patcher(basis, scratch("refused"), BLOCK, expected_size);
+        try
+        {
+            patcher.apply(instructions);
+        }
+        catch (const std::runtime_error &)
+        {
+            return true;
+        }
+        return false;
+    }
+
+    Buffer copyInstruction(uint32_t start, uint32_t count)
+    {
+        Buffer instruction = {Delta::OP_COPY};
+        for (uint32_t value : {start, count})
+            for (int shift = 24; shift >= 0; shift -= 8)
+                instruction.push_back(static_cast<unsigned char>(value >> shift));
+        return instruction;
+    }
+
+    void testMalformedDeltas()
+    {
+        Buffer basis = randomBytes(4 * BLOCK, 5);
+
+        CHECK(!refused(basis, copyInstruction(0, 4), 4 * BLOCK));
+        // blocks past the end of the basis, including a count that wraps around
+        CHECK(refused(basis, copyInstruction(4, 1), 4 * BLOCK));
+        CHECK(refused(basis, copyInstruction(3, 2), 8 * BLOCK));
+        CHECK(refused(basis, copyInstruction(1, 0xFFFFFFFF), 8 * BLOCK));
+        // more bytes than the announced size
+        CHECK(refused(basis, copyInstruction(0, 2), BLOCK));
+        // a literal longer than the instructions carrying it, a truncated one, an unknown op
+        CHECK(refused(basis, {Delta::OP_LITERAL, 0, 0, 0, 10, 'a'}, 4 * BLOCK));
+        CHECK(refused(basis, {Delta::OP_COPY, 0, 0}, 4 * BLOCK));
+        CHECK(refused(basis, {0x7F}, 4 * BLOCK));
+    }
+}
+
+int main()
+{
+    testRollingChecksum();
+    testSync();
+    testMalformedDeltas();
+
+    std::error_code error;
+    fs::remove_all(fs::path(scratch("")).parent_path(), error);
+    return CHECK_RESULT();
+}
@@ -0,0 +1,227 @@
+#include "check.h"
+#include "journal.h"
+#include "metadata_index.h"
+#include "constants.h"
+#include <chrono>
+#include <fstream>
+#include <sys/wait.h>
+#include <thread>
+
+namespace fs = std::filesystem;
+
+// The journal and the indexes are process wide singletons, each run of the server is played
+// by a child process so the next one starts from what is on disk, as after a crash
+namespace
+{
+    bool runServer(void (*run)())
+    {
+        pid_t pid = fork();
+        if (pid == 0)
+        {
+            run();
+            _exit(CHECK_RESULT());
+        }
+
+        int status = 0;
+        return pid > 0 && waitpid(pid, &status, 0) == pid && WIFEXITED(status) && WEXITSTATUS(status) == 0;
+    }
+
+    void waitForCommit()
+    {
+        std::this_thread::sleep_for(std::chrono::milliseconds(20 * Storage::journal_commit_ms));
+    }
+
+    Buffer bytes(const std::string &text)
+    {
+        return Buffer(text.begin(), text.end());
+    }
+
+    Buffer readFile(const std::string &path)
+    {
+        std::ifstream input(path, std::ios::binary);
+        return Buffer(std::istreambuf_iterator<char>(input), std::istreambuf_iterator<char>());
+    }
+
+    void writeFile(const std::string &path, const Buffer &data)
+    {
+        std::ofstream output(path, std::ios::binary | std::ios::trunc);
+        output.write(reinterpret_cast<const char *>(data.data()), data.size());
+    }
+
+    std::vector<std::string> replayed()
+    {
+        std::vector<std::string> payloads;
+        uint64_t last = 0;
+        bool ordered = true;
+        Journal::instance().replay([&](uint64_t seq, const Buffer &payload)
+                                   {
+                                       ordered = ordered && seq > last;
+                                       last = seq;
+                                       payloads.emplace_back(payload.begin(), payload.end()); });
+        CHECK(ordered);
+        CHECK(Journal::instance().lastSeq() >= last);
+        return payloads;
+    }
+
+    // ------------------------------ TORN TAIL ------------------------------
+
+    void appendThree()
+    {
+        for (const char *payload : {"one", "two", "three"})
+            Journal::instance().append(bytes(payload));
+        waitForCommit();
+    }
+
+    void replayAfterTornTail()
+    {
+        CHECK(replayed() == std::vector<std::string>({"one", "two", "three"}));
+    }
+
+    void replayAfterCorruption()
+    {
+        CHECK(replayed() == std::vector<std::string>({"one"}));
+    }
+
+    void testTornTail()
+    {
+        fs::remove(Storage::journal);
+        CHECK(runServer(appendThree));
+        uintmax_t complete = fs::file_size(Storage::journal);
+
+        // the last group commit was cut short: half of an entry header
+        Buffer journal = readFile(Storage::journal);
+        Buffer torn = journal;
+        torn.insert(torn.end(), journal.begin() + 8, journal.begin() + 20);
+        writeFile(Storage::journal, torn);
+
+        CHECK(runServer(replayAfterTornTail));
+        CHECK(fs::file_size(Storage::journal) == complete);
+
+        // a corrupted entry ends the replay, nothing after it is trusted
+        Buffer corrupted = readFile(Storage::journal);
+        size_t second_payload = 8 + (8 + 8 + 3 + 4) + 16;
+        corrupted[second_payload] ^= 0x20;
+        writeFile(Storage::journal, corrupted);
+        CHECK(runServer(replayAfterCorruption));
+        CHECK(fs::file_size(Storage::journal) == 8 + (8 + 8 + 3 + 4));
+    }
+
+    // ------------------------------ TRUNCATE ------------------------------
+
+    void truncateAtCheckpoint()
+    {
+        std::vector<uint64_t> seqs;
+        for (int i = 1; i <= 5; i++)
+            seqs.push_back(Journal::instance().append(bytes("entry" + std::to_string(i))));
+        waitForCommit();
+
+        // entries still waiting for their group commit are kept along with the written ones
+        for (int i = 6; i <= 7; i++)
+            seqs.push_back(Journal::instance().append(bytes("entry" + std::to_string(i))));
+        Journal::instance().truncate(seqs[2]);
+        waitForCommit();
+    }
+
+    void replayAfterTruncate()
+    {
+        CHECK(replayed() == std::vector<std::string>({"entry4", "entry5", "entry6", "entry7"}));
+    }
+
+    void testTruncate()
+    {
+        fs::remove(Storage::journal);
+        CHECK(runServer(truncateAtCheckpoint));
+        CHECK(runServer(replayAfterTruncate));
+    }
+
+    // ------------------------------ SNAPSHOT SKIP ------------------------------
+
+    const std::string USER = "user1";
+
+    uint64_t snapshotSeq()
+    {
+        Buffer header = readFile(Storage::metadata_index + "/" + USER);
+        uint64_t seq = 0;
+        for (size_t i = 16; i < 24 && i < header.size(); i++)
+            seq = (seq << 8) | header[i];
+        return seq;
+    }
+
+    std::string folder()
+    {
+        return "../data/" + USER;
+    }
+
+    void changeUntilSnapshot()
+    {
+        MetadataIndex &index = MetadataIndex::instance();
+        std::ofstream(folder() + "/a.txt") << "first file";
+        index.open(USER);
+
+        // rewriting one file piles up superseded records until the log is rewritten as a
+        // snapshot holding every journal entry so far
+        for (int i = 0; i < 200 && snapshotSeq() == 0; i++)
+        {
+            std::ofstream(folder() + "/f.txt") << std::string(i + 1, 'f');
+            index.refresh(USER, "f.txt");
+        }
+        CHECK(snapshotSeq() != 0);
+
+        // one change the snapshot doesn't hold, then the server stops before any checkpoint
+        std::ofstream(folder() + "/g.txt") << "after the snapshot";
+        index.refresh(USER, "g.txt");
+        waitForCommit();
+    }
+
+    void recoverIndexes()
+    {
+        MetadataIndex::instance().recover();
+    }
+
+    void checkRecovered()
+    {
+        FileMetadata metadata;
+        MetadataIndex &index = MetadataIndex::instance();
+        CHECK(index.lookup(USER, "a.txt", metadata));
+        CHECK(index.lookup(USER, "f.txt", metadata) && metadata.size > 1);
+        CHECK(index.lookup(USER, "g.txt", metadata) && metadata.size == std::string("after the snapshot").size());
+
+        // the journal was cleared once its entries were in the snapshot
+        CHECK(replayed().empty());
+    }
+
+    void testSnapshotSkip()
+    {
+        fs::remove_all("../data");
+        fs::create_directories(folder());
+        CHECK(runServer(changeUntilSnapshot));
+
+        Buffer snapshot = readFile(Storage::metadata_index + "/" + USER);
+        CHECK(runServer(recoverIndexes));
+        Buffer recovered = readFile(Storage::metadata_index + "/" + USER);
+
+        // only the entry after the snapshot joined its log: a single record, not the dozens
+        // of superseded ones the journal still held
+        CHECK(recovered.size() > snapshot.size());
+        CHECK(recovered.size() - snapshot.size() < 2 * (recovered.size() - 24) / 3);
+        CHECK(std::equal(snapshot.begin(), snapshot.end(), recovered.begin()));
+
+        // the index loads without a rebuild, which would draw a new epoch
+        CHECK(runServer(checkRecovered));
+        Buffer loaded = readFile(Storage::metadata_index + "/" + USER);
+        CHECK(loaded.size() >= 16 && std::equal(loaded.begin(), loaded.begin() + 16, snapshot.begin()));
+    }
+}
+
+int main()
+{
+    std::string root = Check::enterScratch("test_journal");
+    fs::create_directories("../data");
+
+    testTornTail();
+    testTruncate();
+    testSnapshotSkip();
+
+    Check::leaveScratch(root);
+    return CHECK_RESULT();
+}
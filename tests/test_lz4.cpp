@@ -0,0 +1,115 @@
+#include "check.h"
+#include "lz4.h"
+#include "compressor.h"
+#include "constants.h"
+#include <random>
+
+namespace
+{
+    Buffer randomBytes(size_t size, unsigned seed)
+    {
+        std::mt19937 generator(seed);
+        Buffer data(size);
+        for (unsigned char &byte : data)
+            byte = static_cast<unsigned char>(generator());
+        return data;
+    }
+
+    bool roundTrip(const Buffer &input)
+    {
+        Buffer compressed = lz4::compress(input);
+        Buffer output;
+        return compressed.size() <= lz4::compressBound(input.size()) &&
+               lz4::decompress(compressed, output, input.size()) && output == input;
+    }
+
+    void testRoundTrips()
+    {
+        CHECK(roundTrip(Buffer()));
+        CHECK(roundTrip(Buffer(1, 'a')));
+        CHECK(roundTrip(randomBytes(100000, 1)));
+
+        // long runs need the extended length bytes of both literals and matches
+        Buffer repetitive(1 << 20, 'x');
+        CHECK(roundTrip(repetitive));
+        CHECK(lz4::compress(repetitive).size() < repetitive.size() / 100);
+
+        Buffer text;
+        std::string line = "the quick brown fox jumps over the lazy dog ";
+        for (int i = 0; i < 5000; i++)
+            text.insert(text.end(), line.begin(), line.end());
+        CHECK(roundTrip(text));
+    }
+
+    void testMalformedBlocks()
+    {
+        Buffer input(64 * 1024, 0);
+        for (size_t i = 0; i < input.size(); i++)
+            input[i] = static_cast<unsigned char>(i % 251);
+        Buffer compressed = lz4::compress(input);
+        Buffer output;
+
+        // every truncation falls short of the size or runs out of input
+        for (size_t length = 0; length < compressed.size(); length += 7)
+            CHECK(!lz4::decompress(Buffer(compressed.begin(), compressed.begin() + length), output, input.size()));
+
+        // a wrong original size is refused rather than overflowed or left half filled
+        CHECK(!lz4::decompress(compressed, output, input.size() - 1));
+        CHECK(!lz4::decompress(compressed, output, input.size() + 1));
+
+        // a match reaching before the start of the output
+        Buffer bad_offset = {0x14, 'a', 0x10, 0x00};
+        CHECK(!lz4::decompress(bad_offset, output, 5));
+        // a zero offset
+        Buffer zero_offset = {0x14, 'a', 0x00, 0x00};
+        CHECK(!lz4::decompress(zero_offset, output, 5));
+        // literals longer than the block
+        Buffer long_literals = {0xF0, 0xFF, 0xFF};
+        CHECK(!lz4::decompress(long_literals, output, 1000));
+
+        // corrupted blocks either fail or stay within the announced size
+        std::mt19937 generator(7);
+        for (int i = 0; i < 200; i++)
+        {
+            Buffer corrupted = compressed;
+            corrupted[generator() % corrupted.size()] ^= static_cast<unsigned char>(1 + generator() % 255);
+            if (lz4::decompress(corrupted, output, input.size()))
+                CHECK(output.size() == input.size());
+        }
+    }
+
+    void testChunkCompressor()
+    {
+        ChunkCompressor compressor(Compression::LZ4);
+        Buffer text(8192, 'z');
+        uint8_t flags;
+        Buffer encoded = compressor.encode(text, flags);
+        Buffer decoded;
+        CHECK(flags == ChunkFlags::COMPRESSED);
+        CHECK(ChunkCompressor::decode(encoded, flags, text.size(), decoded) && decoded == text);
+
+        // incompressible chunks are stored, and the compressor gives up after a streak of them
+        for (size_t i = 0; i < Compression::max_incompressible_chunks; i++)
+        {
+            Buffer noise = randomBytes(8192, 10 + i);
+            encoded = compressor.encode(noise, flags);
+            CHECK(flags == ChunkFlags::STORED);
+            CHECK(ChunkCompressor::decode(encoded, flags, noise.size(), decoded) && decoded == noise);
+        }
+        CHECK(!compressor.isActive());
+
+        // a stored chunk of the wrong size and an unknown flag are refused
+        CHECK(!ChunkCompressor::decode(Buffer(10), ChunkFlags::STORED, 11, decoded));
+        CHECK(!ChunkCompressor::decode(Buffer(10), 0x7F, 10, decoded));
+        CHECK(ChunkCompressor::negotiate(Compression::LZ4) == Compression::LZ4);
+        CHECK(ChunkCompressor::negotiate(42) == Compression::NONE);
+    }
+}
+
+int main()
+{
+    testRoundTrips();
+    testMalformedBlocks();
+    testChunkCompressor();
+    return CHECK_RESULT();
+}
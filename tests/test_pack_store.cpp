@@ -0,0 +1,164 @@
+#include "check.h"
+#include "pack_store.h"
+#include "storage_backend.h"
+#include "constants.h"
+#include <algorithm>
+#include <chrono>
+#include <fstream>
+#include <thread>
+
+namespace fs = std::filesystem;
+
+namespace
+{
+    Buffer bytes(const std::string &text)
+    {
+        return Buffer(text.begin(), text.end());
+    }
+
+    std::string readBack(const std::string &pack, const std::string &name)
+    {
+        Buffer data;
+        if (!PackStore::instance().read(pack, name, data))
+            return "<missing>";
+        return std::string(data.begin(), data.end());
+    }
+
+    std::vector<std::string> sorted(std::vector<std::string> names)
+    {
+        std::sort(names.begin(), names.end());
+        return names;
+    }
+
+    // The store keeps every pack it has loaded, a copy under a new path is replayed from disk
+    std::string replayed(const std::string &pack, const std::string &copy)
+    {
+        fs::copy_file(pack, copy, fs::copy_options::overwrite_existing);
+        return copy;
+    }
+
+    void testLogFormat()
+    {
+        PackStore &store = PackStore::instance();
+        std::string pack = "../data/format.pack";
+
+        store.put(pack, "a.txt", bytes("alpha"), false);
+        store.put(pack, "b.txt", bytes("bravo"), false);
+        store.put(pack, "c.txt", bytes("charlie"), false);
+        store.put(pack, "a.txt", bytes("alpha, again"), true);
+        CHECK(store.rename(pack, "b.txt", "d.txt"));
+        CHECK(store.remove(pack, "c.txt"));
+
+        // a name can't be put twice or renamed onto another packed file
+        bool refused = false;
+        try
+        {
+            store.put(pack, "a.txt", bytes("x"), false);
+        }
+        catch (const std::invalid_argument &)
+        {
+            refused = true;
+        }
+        CHECK(refused);
+        CHECK(!store.rename(pack, "a.txt", "d.txt"));
+
+        // header: magic and stamp
+        std::ifstream header(pack, std::ios::binary);
+        char magic[8];
+        header.read(magic, sizeof(magic));
+        CHECK(std::string(magic, sizeof(magic)) == "FOCPACK1");
+
+        // replaying the log gives back the same files
+        std::string copy = replayed(pack, "../data/format.copy.pack");
+        CHECK(sorted(store.list(copy)) == std::vector<std::string>({"a.txt", "d.txt"}));
+        CHECK(readBack(copy, "a.txt") == "alpha, again");
+        CHECK(readBack(copy, "d.txt") == "bravo");
+        CHECK(store.stamp(copy) == store.stamp(pack));
+
+        // a torn last record is dropped, the records before it stay
+        std::string torn = replayed(pack, "../data/format.torn.pack");
+        uintmax_t size = fs::file_size(torn);
+        store.put(pack, "e.txt", bytes("echo"), false);
+        fs::copy_file(pack, torn, fs::copy_options::overwrite_existing);
+        fs::resize_file(torn, fs::file_size(pack) - 3);
+        CHECK(sorted(store.list(torn)) == std::vector<std::string>({"a.txt", "d.txt"}));
+        CHECK(fs::file_size(torn) == size);
+
+        // something that is not a pack is moved aside, never overwritten
+        std::ofstream("../data/garbage.pack") << "not a pack at all";
+        CHECK(store.list("../data/garbage.pack").empty());
+        CHECK(fs::exists("../data/garbage.pack.corrupt"));
+    }
+
+    void testCompaction()
+    {
+        PackStore &store = PackStore::instance();
+        std::string pack = "../data/compact.pack";
+
+        for (int i = 0; i < 20; i++)
+            store.put(pack, "small" + std::to_string(i), bytes("file number " + std::to_string(i)), false);
+        // the first record of a new pack comes after its header
+        CHECK(readBack(pack, "small0") == "file number 0");
+        store.remove(pack, "small7");
+        store.rename(pack, "small8", "renamed");
+
+        // replacing a large file leaves its old records behind as garbage
+        Buffer large(Storage::pack_compact_min, 'L');
+        for (int i = 0; i < 3; i++)
+        {
+            large[0] = static_cast<unsigned char>('0' + i);
+            store.put(pack, "large", large, true);
+        }
+
+        uintmax_t written = 3 * large.size();
+        for (int i = 0; i < 100 && fs::file_size(pack) >= written; i++)
+            std::this_thread::sleep_for(std::chrono::milliseconds(50));
+        CHECK(fs::file_size(pack) < written);
+
+        // every live file made it to the rewritten pack, whether read now or replayed
+        std::string copy = replayed(pack, "../data/compact.copy.pack");
+        for (const std::string &path : {pack, copy})
+        {
+            CHECK(store.list(path).size() == 20);
+            CHECK(readBack(path, "small0") == "file number 0");
+            CHECK(readBack(path, "renamed") == "file number 8");
+            CHECK(readBack(path, "small7") == "<missing>");
+            CHECK(readBack(path, "small19") == "file number 19");
+
+            Buffer data;
+            CHECK(store.read(path, "large", data) && data.size() == large.size() && data[0] == '2');
+        }
+    }
+
+    void testStaleDuplicates()
+    {
+        StorageBackend &backend = StorageBackend::instance();
+        fs::create_directories(backend.folder("user1"));
+        std::string pack = "../data/.user1.pack";
+
+        // a file left the pack but the server stopped before the packed copy was deleted
+        PackStore::instance().put(pack, "moved.txt", bytes("old packed copy"), false);
+        PackStore::instance().put(pack, "packed.txt", bytes("still packed"), false);
+        std::ofstream(backend.folder("user1") + "/moved.txt") << "newer copy of its own";
+
+        std::vector<std::string> names = sorted(backend.list("user1"));
+        CHECK(names == std::vector<std::string>({"moved.txt", "packed.txt"}));
+        CHECK(sorted(PackStore::instance().list(pack)) == std::vector<std::string>({"packed.txt"}));
+
+        // the deletion was recorded in the pack, a replay agrees
+        CHECK(sorted(PackStore::instance().list(replayed(pack, "../data/user1.copy.pack"))) == std::vector<std::string>({"packed.txt"}));
+    }
+}
+
+int main()
+{
+    std::string root = Check::enterScratch("test_pack_store");
+    fs::create_directories("../data");
+
+    testLogFormat();
+    testCompaction();
+    testStaleDuplicates();
+
+    Check::leaveScratch(root);
+    return CHECK_RESULT();
+}
@@ -0,0 +1,160 @@
+#include "check.h"
+#include "metadata_index.h"
+#include "version_store.h"
+#include "chunk_store.h"
+#include "constants.h"
+
+namespace fs = std::filesystem;
+
+namespace
+{
+    const uintmax_t GiB = 1024ULL * 1024 * 1024;
+    const uintmax_t MiB = 1024 * 1024;
+
+    // A deduplicated file of size logical bytes, one chunk over and over: only its recipe
+    // takes room on the disk, its logical size counts in the quota
+    void storeFile(const std::string &user, const std::string &name, uintmax_t size)
+    {
+        fs::create_directories("../data/" + user);
+        Recipe recipe;
+        {
+            std::shared_lock<std::shared_mutex> pin = ChunkStore::instance().pin();
+            std::string chunk = ChunkStore::instance().put(Buffer(Storage::max_chunk));
+            while (recipe.logical_size < size)
+                recipe.add(chunk, Storage::max_chunk);
+            recipe.save("../data/" + user + "/" + name);
+        }
+
+        MetadataIndex::instance().open(user);
+        MetadataIndex::instance().refresh(user, name);
+    }
+
+    void removeFile(const std::string &user, const std::string &name)
+    {
+        fs::remove("../data/" + user + "/" + name);
+        MetadataIndex::instance().refresh(user, name);
+    }
+
+    void testSingleUpload()
+    {
+        const std::string user = "user1";
+        MetadataIndex::instance().open(user);
+
+        // an upload claims its announced size while it runs, so a concurrent one can't overshoot
+        {
+            QuotaReservation upload;
+            CHECK(upload.acquire(user, Storage::user_quota));
+            QuotaReservation concurrent;
+            CHECK(!concurrent.acquire(user, 1));
+        }
+
+        // handed back at the end of the transfer, refused claims take nothing
+        QuotaReservation after;
+        CHECK(!after.acquire(user, Storage::user_quota + 1));
+        CHECK(after.acquire(user, Storage::user_quota));
+    }
+
+    void testStoredFiles()
+    {
+        const std::string user = "user1";
+        MetadataIndex &index = MetadataIndex::instance();
+        storeFile(user, "big.bin", 3 * GiB);
+        CHECK(index.usage(user) == 3 * GiB);
+
+        // the stored files leave exactly the rest of the quota
+        {
+            QuotaReservation fits;
+            CHECK(fits.acquire(user, Storage::user_quota - 3 * GiB));
+        }
+        {
+            QuotaReservation too_large;
+            CHECK(!too_large.acquire(user, Storage::user_quota - 3 * GiB + 1));
+        }
+
+        // deleting a file gives its share back
+        removeFile(user, "big.bin");
+        CHECK(index.usage(user) == 0);
+        QuotaReservation whole;
+        CHECK(whole.acquire(user, Storage::user_quota));
+    }
+
+    void testBatch()
+    {
+        // the files of a batch claim their room one after the other in a single reservation;
+        // a file that doesn't fit is refused alone and a smaller one after it may still fit
+        const std::string user = "user2";
+        storeFile(user, "stored.bin", GiB);
+
+        std::vector<uintmax_t> sizes = {GiB, GiB, 2 * GiB, 512 * MiB, 768 * MiB};
+        std::vector<uint8_t> statuses;
+        QuotaReservation batch;
+        for (uintmax_t size : sizes)
+            statuses.push_back(batch.acquire(user, size) ? BatchCodes::OK : BatchCodes::QUOTA_EXCEEDED);
+
+        CHECK(statuses == std::vector<uint8_t>({BatchCodes::OK, BatchCodes::OK, BatchCodes::QUOTA_EXCEEDED,
+                                                BatchCodes::OK, BatchCodes::QUOTA_EXCEEDED}));
+
+        // until the batch ends nothing else fits
+        QuotaReservation other;
+        CHECK(!other.acquire(user, 512 * MiB + 1));
+        CHECK(other.acquire(user, 512 * MiB));
+    }
+
+    void testReplacement()
+    {
+        // a sync or a restore needs room for the growth of the file and, with versions kept,
+        // for the replaced content as well
+        const std::string user = "user3";
+        CHECK(VersionStore::enabled());
+        storeFile(user, "doc.bin", GiB);
+
+        {
+            QuotaReservation grow;
+            CHECK(grow.acquireReplacement(user, GiB, 2 * GiB)); // 1 GiB used, 1 more, 1 versioned
+        }
+        {
+            QuotaReservation grow;
+            CHECK(grow.acquireReplacement(user, GiB, 3 * GiB)); // exactly the quota
+        }
+        {
+            QuotaReservation too_much;
+            CHECK(!too_much.acquireReplacement(user, GiB, 3 * GiB + 1));
+        }
+        {
+            QuotaReservation shrink;
+            CHECK(shrink.acquireReplacement(user, GiB, 1)); // the version alone
+        }
+
+        // a restore once a version is kept: the version counts in the usage too
+        CHECK(VersionStore::instance().preserve(user, "doc.bin"));
+        CHECK(MetadataIndex::instance().usage(user) == 2 * GiB);
+        {
+            QuotaReservation restore;
+            CHECK(restore.acquireReplacement(user, GiB, 2 * GiB)); // exactly the quota
+        }
+        {
+            QuotaReservation restore;
+            CHECK(!restore.acquireReplacement(user, GiB, 2 * GiB + 1));
+        }
+
+        // another transfer in flight takes its share of the room left
+        QuotaReservation upload;
+        CHECK(upload.acquire(user, GiB + GiB / 2));
+        QuotaReservation restore;
+        CHECK(!restore.acquireReplacement(user, GiB, GiB));
+    }
+}
+
+int main()
+{
+    std::string root = Check::enterScratch("test_quota");
+    fs::create_directories("../data");
+
+    testSingleUpload();
+    testStoredFiles();
+    testBatch();
+    testReplacement();
+
+    Check::leaveScratch(root);
+    return CHECK_RESULT();
+}
@@ -0,0 +1,101 @@
+#include "check.h"
+#include "storage_backend.h"
+#include "constants.h"
+#include <map>
+
+namespace fs = std::filesystem;
+
+namespace
+{
+    const std::vector<std::string> ROOTS = {"../data/shard0", "../data/shard1", "../data/shard2", "../data/shard3"};
+    const size_t USERS = 20000;
+
+    std::string userName(size_t index) { return "user" + std::to_string(index); }
+
+    std::string rootOf(const ShardedBackend &backend, const std::string &user)
+    {
+        std::string folder = backend.folder(user);
+        CHECK(folder.size() > user.size() + 1 && folder.compare(folder.size() - user.size() - 1, std::string::npos, "/" + user) == 0);
+        return folder.substr(0, folder.size() - user.size() - 1);
+    }
+
+    std::vector<std::string> placement(const std::vector<std::string> &roots)
+    {
+        ShardedBackend backend(roots);
+        std::vector<std::string> result;
+        for (size_t index = 0; index < USERS; index++)
+            result.push_back(rootOf(backend, userName(index)));
+        return result;
+    }
+
+    void testStable()
+    {
+        // a user lands on the same root every time, whichever instance and root order
+        ShardedBackend backend(ROOTS);
+        std::vector<std::string> reversed(ROOTS.rbegin(), ROOTS.rend());
+        ShardedBackend other(reversed);
+        for (size_t index = 0; index < 1000; index++)
+        {
+            std::string user = userName(index);
+            CHECK(backend.folder(user) == backend.folder(user));
+            CHECK(backend.folder(user) == other.folder(user));
+        }
+    }
+
+    void testSpread()
+    {
+        // every root gets a fair share of the users
+        std::map<std::string, size_t> counts;
+        for (const std::string &root : placement(ROOTS))
+            counts[root]++;
+
+        CHECK(counts.size() == ROOTS.size());
+        for (const auto &count : counts)
+            CHECK(count.second > USERS / ROOTS.size() / 2 && count.second < USERS / ROOTS.size() * 2);
+    }
+
+    void testAddRoot()
+    {
+        // a new root only takes users over, the others stay where they were
+        std::vector<std::string> grown = ROOTS;
+        grown.push_back("../data/shard4");
+
+        std::vector<std::string> before = placement(ROOTS), after = placement(grown);
+        size_t moved = 0;
+        for (size_t index = 0; index < USERS; index++)
+            if (before[index] != after[index])
+            {
+                CHECK(after[index] == "../data/shard4");
+                moved++;
+            }
+
+        CHECK(moved > 0 && moved < USERS / grown.size() * 2);
+    }
+
+    void testRemoveRoot()
+    {
+        // dropping a root only moves its own users
+        std::vector<std::string> shrunk = {ROOTS[0], ROOTS[1], ROOTS[3]};
+
+        std::vector<std::string> before = placement(ROOTS), after = placement(shrunk);
+        for (size_t index = 0; index < USERS; index++)
+        {
+            CHECK(after[index] != ROOTS[2]);
+            if (before[index] != ROOTS[2])
+                CHECK(after[index] == before[index]);
+        }
+    }
+}
+
+int main()
+{
+    std::string root = Check::enterScratch("test_sharded_backend");
+
+    testStable();
+    testSpread();
+    testAddRoot();
+    testRemoveRoot();
+
+    Check::leaveScratch(root);
+    return CHECK_RESULT();
+}
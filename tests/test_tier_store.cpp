@@ -0,0 +1,181 @@
+#include "check.h"
+#include "tier_store.h"
+#include "chunk_store.h"
+#include "compressed_file.h"
+#include "storage_backend.h"
+#include "constants.h"
+#include <chrono>
+#include <fstream>
+#include <random>
+#include <sys/stat.h>
+#include <thread>
+
+namespace fs = std::filesystem;
+
+namespace
+{
+    const std::string USER = "user1";
+
+    std::string userPath(const std::string &name)
+    {
+        return "../data/" + USER + "/" + name;
+    }
+
+    std::string coldPath(const std::string &name)
+    {
+        return Storage::cold_root + "/" + USER + "/" + name;
+    }
+
+    Buffer text(size_t size)
+    {
+        Buffer data(size);
+        for (size_t i = 0; i < size; i++)
+            data[i] = "a line of text\n"[i % 15];
+        return data;
+    }
+
+    Buffer randomBytes(size_t size, unsigned seed)
+    {
+        std::mt19937 generator(seed);
+        Buffer data(size);
+        for (unsigned char &byte : data)
+            byte = static_cast<unsigned char>(generator());
+        return data;
+    }
+
+    void writeFile(const std::string &path, const Buffer &data)
+    {
+        std::ofstream output(path, std::ios::binary | std::ios::trunc);
+        output.write(reinterpret_cast<const char *>(data.data()), data.size());
+    }
+
+    Buffer readFile(const std::string &path)
+    {
+        std::ifstream input(path, std::ios::binary);
+        return Buffer(std::istreambuf_iterator<char>(input), std::istreambuf_iterator<char>());
+    }
+
+    // What a download of the file hands out, decompressed from either tier
+    Buffer served(const std::string &name)
+    {
+        StoredFile file;
+        file.open(USER, name);
+        return file.getFileSize() == 0 ? Buffer() : file.readChunk(file.getFileSize());
+    }
+
+    // Content of the cold copy, without the read a download records
+    Buffer coldContent(const std::string &name)
+    {
+        std::unique_ptr<std::istream> input(new std::ifstream(coldPath(name), std::ios::binary));
+        std::unique_ptr<CompressedStream> plaintext = CompressedStream::open(input);
+        if (!plaintext)
+            return Buffer();
+        Buffer data(plaintext->getFileSize());
+        plaintext->read(reinterpret_cast<char *>(data.data()), data.size());
+        return data;
+    }
+
+    int64_t modified(const std::string &path)
+    {
+        struct stat info;
+        return ::stat(path.c_str(), &info) == 0 ? info.st_mtim.tv_sec * 1000000000LL + info.st_mtim.tv_nsec : -1;
+    }
+
+    void testRoundTrip()
+    {
+        StorageBackend &backend = StorageBackend::instance();
+
+        for (const std::string &name : {std::string("notes.txt"), std::string("photo.bin")})
+        {
+            Buffer data = name == "notes.txt" ? text(300000) : randomBytes(100000, 1);
+            writeFile(userPath(name), data);
+            int64_t mtime = modified(userPath(name));
+
+            // demoted: compressed at rest in the cold tier, same modification time
+            CHECK(backend.demote(USER, name));
+            CHECK(!fs::exists(userPath(name)) && fs::exists(coldPath(name)));
+            CHECK(backend.isCold(USER, name));
+            CHECK(modified(coldPath(name)) == mtime);
+            CHECK(coldContent(name) == data);
+            CHECK(!backend.demote(USER, name));
+
+            // promoted: back in the folder, as an upload of it would have stored it
+            CHECK(backend.promote(USER, name));
+            CHECK(fs::exists(userPath(name)) && !fs::exists(coldPath(name)));
+            CHECK(!backend.isCold(USER, name));
+            CHECK(modified(userPath(name)) == mtime);
+            CHECK((readFile(userPath(name)) == data) == (name == "photo.bin"));
+            CHECK(served(name) == data);
+            CHECK(!backend.promote(USER, name));
+        }
+    }
+
+    void testPromoteOnRead()
+    {
+        StorageBackend &backend = StorageBackend::instance();
+        Buffer data = text(200000);
+        writeFile(userPath("read.txt"), data);
+        CHECK(backend.demote(USER, "read.txt"));
+
+        // the reader is served from the cold tier, the mover brings the file back afterwards
+        CHECK(served("read.txt") == data);
+        for (int i = 0; i < 500 && backend.isCold(USER, "read.txt"); i++)
+            std::this_thread::sleep_for(std::chrono::milliseconds(10));
+        CHECK(!backend.isCold(USER, "read.txt") && fs::exists(userPath("read.txt")));
+        CHECK(served("read.txt") == data);
+    }
+
+    void testFolderWins()
+    {
+        StorageBackend &backend = StorageBackend::instance();
+        Buffer stale = randomBytes(5000, 2), current = randomBytes(7000, 3);
+        writeFile(userPath("both.bin"), stale);
+        CHECK(backend.demote(USER, "both.bin"));
+
+        // a copy left in the cold tier never hides the file of the folder
+        writeFile(userPath("both.bin"), current);
+        FileStat info;
+        CHECK(backend.stat(USER, "both.bin", info) && info.size == current.size());
+        CHECK(!backend.isCold(USER, "both.bin"));
+        CHECK(served("both.bin") == current);
+
+        // promoting only drops the stale copy
+        CHECK(!backend.promote(USER, "both.bin"));
+        CHECK(!fs::exists(coldPath("both.bin")));
+        CHECK(served("both.bin") == current);
+    }
+
+    void testSessionsLeave()
+    {
+        // moves keep the folder open for themselves, a session leaving doesn't pull it away,
+        // and they leave no reference behind when they end
+        StorageBackend &backend = StorageBackend::instance();
+        backend.attach(USER);
+        Buffer data = randomBytes(30000, 4);
+        writeFile(userPath("session.bin"), data);
+        CHECK(backend.demote(USER, "session.bin"));
+        backend.detach(USER);
+
+        CHECK(backend.promote(USER, "session.bin"));
+        CHECK(served("session.bin") == data);
+        backend.attach(USER);
+        CHECK(backend.demote(USER, "session.bin") && backend.promote(USER, "session.bin"));
+        backend.detach(USER);
+        CHECK(readFile(userPath("session.bin")) == data);
+    }
+}
+
+int main()
+{
+    std::string root = Check::enterScratch("test_tier_store");
+    fs::create_directories("../data/" + USER);
+    TierStore::instance();
+
+    testRoundTrip();
+    testPromoteOnRead();
+    testFolderWins();
+    testSessionsLeave();
+
+    Check::leaveScratch(root);
+    return CHECK_RESULT();
+}
@@ -0,0 +1,163 @@
+#include "check.h"
+#include "version_store.h"
+#include "chunk_store.h"
+#include "metadata_index.h"
+#include "constants.h"
+#include <chrono>
+#include <fstream>
+#include <random>
+#include <thread>
+
+namespace fs = std::filesystem;
+
+namespace
+{
+    const std::string USER = "user1";
+
+    Buffer randomBytes(size_t size, unsigned seed)
+    {
+        std::mt19937 generator(seed);
+        Buffer data(size);
+        for (unsigned char &byte : data)
+            byte = static_cast<unsigned char>(generator());
+        return data;
+    }
+
+    // Replaces the file the way an upload or a sync does, with a rename over the old one
+    void replaceFile(const std::string &name, const Buffer &data)
+    {
+        std::string path = "../data/" + USER + "/" + name;
+        {
+            std::ofstream output(path + ".new", std::ios::binary);
+            output.write(reinterpret_cast<const char *>(data.data()), data.size());
+        }
+        fs::rename(path + ".new", path);
+    }
+
+    Buffer versionContent(const std::string &name, uint64_t number)
+    {
+        Recipe recipe;
+        if (!VersionStore::instance().open(USER, name, number, recipe))
+            return Buffer();
+        RecipeStream stream(recipe);
+        return stream.readChunk(recipe.logical_size);
+    }
+
+    // Whether every version of name is a recipe, the background pass is done with them
+    bool chunked(const std::string &name)
+    {
+        std::error_code error;
+        for (const auto &entry : fs::directory_iterator(Storage::version_root + "/" + USER + "/" + name, error))
+            if (!Recipe::isRecipe(entry.path().string()))
+                return false;
+        return true;
+    }
+
+    bool waitChunked(const std::string &name)
+    {
+        for (int i = 0; i < 500 && !chunked(name); i++)
+            std::this_thread::sleep_for(std::chrono::milliseconds(10));
+        return chunked(name);
+    }
+
+    int64_t now()
+    {
+        return std::chrono::duration_cast<std::chrono::seconds>(std::chrono::system_clock::now().time_since_epoch()).count();
+    }
+
+    void testPreserve()
+    {
+        VersionStore &versions = VersionStore::instance();
+        Buffer first = randomBytes(300000, 1), second = randomBytes(200000, 2);
+        replaceFile("notes.bin", first);
+
+        // the version is listed with its size right away, chunked or not
+        int64_t replaced = now();
+        CHECK(versions.preserve(USER, "notes.bin"));
+        replaceFile("notes.bin", second);
+        std::vector<FileVersion> listed = versions.list(USER, "notes.bin");
+        CHECK(listed.size() == 1 && listed[0].number == 1 && listed[0].size == first.size());
+        CHECK(listed.size() == 1 && listed[0].mtime >= replaced && listed[0].mtime <= now());
+
+        // the background pass turns it into a recipe as old as the replacement
+        CHECK(waitChunked("notes.bin"));
+        listed = versions.list(USER, "notes.bin");
+        CHECK(listed.size() == 1 && listed[0].size == first.size());
+        CHECK(listed.size() == 1 && listed[0].mtime >= replaced && listed[0].mtime <= now());
+        CHECK(versionContent("notes.bin", 1) == first);
+
+        // a version opened before the pass reached it is chunked on the spot
+        CHECK(versions.preserve(USER, "notes.bin"));
+        replaceFile("notes.bin", randomBytes(1000, 3));
+        CHECK(versionContent("notes.bin", 2) == second);
+        CHECK(!versions.preserve(USER, "missing.bin"));
+    }
+
+    void testRename()
+    {
+        VersionStore &versions = VersionStore::instance();
+        Buffer content = randomBytes(150000, 4);
+        replaceFile("draft.bin", content);
+
+        int64_t replaced = now();
+        CHECK(versions.preserve(USER, "draft.bin"));
+        fs::remove("../data/" + USER + "/draft.bin");
+
+        // the versions follow the rename, after those already kept under the new name
+        versions.rename(USER, "draft.bin", "notes.bin");
+        std::vector<FileVersion> listed = versions.list(USER, "notes.bin");
+        CHECK(listed.size() == 3 && listed[0].number == 3 && listed[0].size == content.size());
+        CHECK(!listed.empty() && listed[0].mtime >= replaced && listed[0].mtime <= now());
+        CHECK(versions.list(USER, "draft.bin").empty());
+
+        CHECK(waitChunked("notes.bin"));
+        CHECK(versionContent("notes.bin", 3) == content);
+        CHECK(versionContent("notes.bin", 1).size() == 300000);
+    }
+
+    void testQuota()
+    {
+        // a deduplicated file of 3 GiB, one chunk over and over: only its recipe takes room
+        const std::string user = "user2";
+        fs::create_directories("../data/" + user);
+        Recipe recipe;
+        {
+            std::shared_lock<std::shared_mutex> pin = ChunkStore::instance().pin();
+            std::string chunk = ChunkStore::instance().put(Buffer(Storage::max_chunk));
+            while (recipe.logical_size < 3ULL * 1024 * 1024 * 1024)
+                recipe.add(chunk, Storage::max_chunk);
+            recipe.save("../data/" + user + "/big.bin");
+        }
+
+        MetadataIndex &index = MetadataIndex::instance();
+        index.open(user);
+        index.refresh(user, "big.bin");
+        CHECK(index.usage(user) == recipe.logical_size);
+
+        // deleting the file keeps it as a version, which still takes its share of the quota
+        CHECK(VersionStore::instance().preserve(user, "big.bin"));
+        fs::remove("../data/" + user + "/big.bin");
+        index.refresh(user, "big.bin");
+        CHECK(VersionStore::instance().usage(user) == recipe.logical_size);
+        CHECK(index.usage(user) == recipe.logical_size);
+
+        // so uploading it again does not fit, where a delete and upload loop used to
+        QuotaReservation again;
+        CHECK(!again.acquire(user, recipe.logical_size));
+        QuotaReservation small;
+        CHECK(small.acquire(user, Storage::user_quota - recipe.logical_size));
+    }
+}
+
+int main()
+{
+    std::string root = Check::enterScratch("test_version_store");
+    fs::create_directories("../data/" + USER);
+
+    testPreserve();
+    testRename();
+    testQuota();
+
+    Check::leaveScratch(root);
+    return CHECK_RESULT();
+}
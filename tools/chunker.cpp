@@ -0,0 +1,120 @@
+#include "chunker.h"
+#include "constants.h"
+#include <array>
+
+namespace
+{
+    // Gear table filled with splitmix64 from a fixed seed so every build cuts identically
+    const std::array<uint64_t, 256> &gearTable()
+    {
+        static const std::array<uint64_t, 256> table = []()
+        {
+            std::array<uint64_t, 256> values;
+            uint64_t state = 0x9E3779B97F4A7C15ULL;
+
+            for (uint64_t &value : values)
+            {
+                uint64_t z = (state += 0x9E3779B97F4A7C15ULL);
+                z = (z ^ (z >> 30)) * 0xBF58476D1CE4E5B9ULL;
+                z = (z ^ (z >> 27)) * 0x94D049BB133111EBULL;
+                value = z ^ (z >> 31);
+            }
+            return values;
+        }();
+
+        return table;
+    }
+
+    // the gear hash shifts left, so only the top bits depend on a full window of bytes
+    uint64_t topBitsMask(unsigned bits)
+    {
+        return ((1ULL << bits) - 1) << (64 - bits);
+    }
+}
+
+ContentChunker::ContentChunker() : ContentChunker(Storage::min_chunk, Storage::avg_chunk, Storage::max_chunk) {}
+
+ContentChunker::ContentChunker(size_t min_size, size_t avg_size, size_t max_size)
+{
+    this->min_size = min_size;
+    this->avg_size = avg_size;
+    this->max_size = max_size;
+    this->scan_position = 0;
+    this->hash = 0;
+
+    unsigned bits = 0;
+    while ((1ULL << (bits + 1)) <= avg_size)
+        bits++;
+
+    // normalized chunking: two bits harder before the average, two bits easier after it
+    mask_small = topBitsMask(bits + 2);
+    mask_large = topBitsMask(bits - 2);
+}
+
+bool ContentChunker::findCut(size_t &cut)
+{
+    const std::array<uint64_t, 256> &gear = gearTable();
+    size_t length = pending.size();
+
+    // no cut can happen below the minimum chunk size, skip hashing it
+    if (scan_position < min_size)
+    {
+        scan_position = min_size;
+        hash = 0;
+    }
+
+    size_t normal_end = std::min(avg_size, length);
+    for (; scan_position < normal_end; scan_position++)
+    {
+        hash = (hash << 1) + gear[pending[scan_position]];
+        if (!(hash & mask_small))
+        {
+            cut = scan_position + 1;
+            return true;
+        }
+    }
+
+    size_t max_end = std::min(max_size, length);
+    for (; scan_position < max_end; scan_position++)
+    {
+        hash = (hash << 1) + gear[pending[scan_position]];
+        if (!(hash & mask_large))
+        {
+            cut = scan_position + 1;
+            return true;
+        }
+    }
+
+    if (scan_position >= max_size)
+    {
+        cut = max_size;
+        return true;
+    }
+
+    // need more data to decide
+    return false;
+}
+
+void ContentChunker::push(const Buffer &data, const std::function<void(const Buffer &)> &on_chunk)
+{
+    pending.insert(pending.end(), data.begin(), data.end());
+
+    size_t cut;
+    while (findCut(cut))
+    {
+        on_chunk(Buffer(pending.begin(), pending.begin() + cut));
+        pending.erase(pending.begin(), pending.begin() + cut);
+        scan_position = 0;
+        hash = 0;
+    }
+}
+
+void ContentChunker::finish(const std::function<void(const Buffer &)> &on_chunk)
+{
+    if (!pending.empty())
+        on_chunk(pending);
+
+    pending.clear();
+    scan_position = 0;
+    hash = 0;
+}
@@ -0,0 +1,36 @@
+#ifndef CHUNKER_H
+#define CHUNKER_H
+
+#include <cstdint>
+#include <functional>
+#include <vector>
+
+typedef std::vector<unsigned char> Buffer;
+
+// Content defined chunking (FastCDC with normalized chunking over a Gear rolling hash).
+// Cut points only depend on the bytes around them, so an insertion in a file only changes
+// the chunks it touches and identical content produces identical chunks on every machine.
+class ContentChunker
+{
+private:
+    size_t min_size;
+    size_t avg_size;
+    size_t max_size;
+    uint64_t mask_small; // harder to match, used below the average size
+    uint64_t mask_large; // easier to match, used above the average size
+    Buffer pending;
+    size_t scan_position;
+    uint64_t hash;
+
+    bool findCut(size_t &cut);
+
+public:
+    ContentChunker();
+    ContentChunker(size_t min_size, size_t avg_size, size_t max_size);
+    // Feed more data, every completed chunk is handed to on_chunk
+    void push(const Buffer &data, const std::function<void(const Buffer &)> &on_chunk);
+    // Flush the last (possibly short) chunk
+    void finish(const std::function<void(const Buffer &)> &on_chunk);
+};
+
+#endif // CHUNKER_H
@@ -0,0 +1,85 @@
+#include "compressor.h"
+#include "lz4.h"
+#include "constants.h"
+#include <iostream>
+
+ChunkCompressor::ChunkCompressor() : ChunkCompressor(Compression::NONE) {}
+
+ChunkCompressor::ChunkCompressor(uint8_t mode)
+{
+    this->mode = mode;
+    this->active = (mode != Compression::NONE);
+    this->incompressible_streak = 0;
+    this->raw_bytes = 0;
+    this->encoded_bytes = 0;
+}
+
+Buffer ChunkCompressor::encode(const Buffer &chunk, uint8_t &chunk_flags)
+{
+    return encode(chunk.data(), chunk.size(), chunk_flags);
+}
+
+Buffer ChunkCompressor::encode(const unsigned char *chunk, size_t chunk_size, uint8_t &chunk_flags)
+{
+    raw_bytes += chunk_size;
+    chunk_flags = ChunkFlags::STORED;
+
+    if (!active)
+    {
+        encoded_bytes += chunk_size;
+        return Buffer(chunk, chunk + chunk_size);
+    }
+
+    Buffer compressed = lz4::compress(chunk, chunk_size);
+
+    // keep the compressed form only if it saves enough to be worth the receiver's CPU
+    if (compressed.size() < chunk_size * Compression::min_ratio)
+    {
+        incompressible_streak = 0;
+        chunk_flags = ChunkFlags::COMPRESSED;
+        encoded_bytes += compressed.size();
+        return compressed;
+    }
+
+    if (++incompressible_streak >= Compression::max_incompressible_chunks)
+        active = false;
+
+    encoded_bytes += chunk_size;
+    return Buffer(chunk, chunk + chunk_size);
+}
+
+bool ChunkCompressor::decode(const Buffer &payload, uint8_t chunk_flags, size_t original_size, Buffer &chunk)
+{
+    switch (chunk_flags)
+    {
+    case ChunkFlags::STORED:
+        if (payload.size() != original_size)
+            return false;
+        chunk = payload;
+        return true;
+    case ChunkFlags::COMPRESSED:
+        return lz4::decompress(payload, chunk, original_size);
+    default:
+        return false;
+    }
+}
+
+uint8_t ChunkCompressor::negotiate(uint8_t requested_mode)
+{
+    // LZ4 is the only codec compiled in, anything else falls back to plain chunks
+    if (requested_mode == Compression::LZ4)
+        return Compression::LZ4;
+
+    return Compression::NONE;
+}
+
+void ChunkCompressor::printStats(const std::string &tag) const
+{
+    if (mode == Compression::NONE)
+        return;
+
+    std::cout << tag << " Compression: " << raw_bytes << "B -> " << encoded_bytes << "B";
+    if (!active)
+        std::cout << " (disabled, data is not compressible)";
+    std::cout << std::endl;
+}
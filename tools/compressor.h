@@ -0,0 +1,34 @@
+#ifndef COMPRESSOR_H
+#define COMPRESSOR_H
+
+#include <cstdint>
+#include <string>
+#include <vector>
+
+typedef std::vector<unsigned char> Buffer;
+
+// Per file chunk compressor, applied on the plaintext before the Wrapper encryption.
+// Every chunk is flagged as compressed or stored, and compression is abandoned for the
+// rest of the file once several consecutive chunks fail to shrink (media, archives, ...).
+class ChunkCompressor
+{
+private:
+    uint8_t mode;
+    bool active;
+    size_t incompressible_streak;
+    uintmax_t raw_bytes;
+    uintmax_t encoded_bytes;
+
+public:
+    ChunkCompressor();
+    ChunkCompressor(uint8_t mode);
+    Buffer encode(const Buffer &chunk, uint8_t &chunk_flags);
+    // same, for a chunk that is not held in a Buffer (e.g. a mapped file)
+    Buffer encode(const unsigned char *chunk, size_t chunk_size, uint8_t &chunk_flags);
+    static bool decode(const Buffer &payload, uint8_t chunk_flags, size_t original_size, Buffer &chunk);
+    static uint8_t negotiate(uint8_t requested_mode);
+    bool isActive() const { return active; }
+    void printStats(const std::string &tag) const;
+};
+
+#endif // COMPRESSOR_H
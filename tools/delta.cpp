@@ -0,0 +1,378 @@
+#include "delta.h"
+#include <arpa/inet.h>
+#include <cmath>
+#include <cstring>
+#include <stdexcept>
+#include <openssl/evp.h>
+
+namespace
+{
+    const size_t READ_SIZE = 256 * 1024; // bytes read from disk at once while encoding
+    const size_t COPY_OP_SIZE = sizeof(uint8_t) + 2 * sizeof(uint32_t);
+    const size_t LITERAL_HEADER_SIZE = sizeof(uint8_t) + sizeof(uint32_t);
+
+    void appendUint32(Buffer &buffer, uint32_t value)
+    {
+        uint32_t network_value = htonl(value);
+        unsigned char const *begin = reinterpret_cast<unsigned char const *>(&network_value);
+        buffer.insert(buffer.end(), begin, begin + sizeof(uint32_t));
+    }
+
+    uint32_t readUint32(const Buffer &buffer, size_t &position)
+    {
+        if (position > buffer.size() || buffer.size() - position < sizeof(uint32_t))
+            throw std::runtime_error("Truncated delta instruction.");
+
+        uint32_t network_value;
+        memcpy(&network_value, buffer.data() + position, sizeof(uint32_t));
+        position += sizeof(uint32_t);
+        return ntohl(network_value);
+    }
+}
+
+// ----------------------------------- SIGNATURES ------------------------------------
+
+size_t Delta::chooseBlockSize(uintmax_t file_size)
+{
+    // same heuristic as rsync: square root of the file size, rounded to a multiple of 8
+    size_t block_size = static_cast<size_t>(std::sqrt(static_cast<double>(file_size))) & ~static_cast<size_t>(7);
+
+    if (block_size < min_block_size)
+        return min_block_size;
+    if (block_size > max_block_size)
+        return max_block_size;
+    return block_size;
+}
+
+uint32_t Delta::weakChecksum(const unsigned char *data, size_t length)
+{
+    RollingChecksum checksum;
+    checksum.init(data, length);
+    return checksum.value();
+}
+
+std::array<unsigned char, Delta::strong_length> Delta::strongHash(const unsigned char *data, size_t length)
+{
+    unsigned char digest[EVP_MAX_MD_SIZE];
+    unsigned int digest_length = 0;
+    std::array<unsigned char, strong_length> strong;
+
+    if (!EVP_Digest(data, length, digest, &digest_length, EVP_sha256(), nullptr))
+        throw std::runtime_error("Unable to hash block.");
+
+    memcpy(strong.data(), digest, strong_length);
+    return strong;
+}
+
+std::vector<Delta::BlockSignature> Delta::computeSignatures(const std::string &file_path, size_t block_size)
+{
+    std::ifstream input(file_path, std::ios::binary);
+    if (!input)
+        throw std::runtime_error("Unable to open file for reading.");
+
+    return computeSignatures(input, block_size);
+}
+
+std::vector<Delta::BlockSignature> Delta::computeSignatures(std::istream &input, size_t block_size)
+{
+    std::vector<BlockSignature> signatures;
+    Buffer block(block_size);
+
+    while (input.read(reinterpret_cast<char *>(block.data()), block_size))
+    {
+        BlockSignature signature;
+        signature.weak = weakChecksum(block.data(), block_size);
+        signature.strong = strongHash(block.data(), block_size);
+        signatures.push_back(signature);
+    }
+
+    return signatures;
+}
+
+// ----------------------------------- ROLLING CHECKSUM ------------------------------------
+
+RollingChecksum::RollingChecksum() : a(0), b(0), window(0) {}
+
+void RollingChecksum::init(const unsigned char *data, size_t length)
+{
+    a = 0;
+    b = 0;
+    window = length;
+
+    for (size_t i = 0; i < length; i++)
+    {
+        a += data[i];
+        b += (length - i) * data[i];
+    }
+
+    a &= 0xFFFF;
+    b &= 0xFFFF;
+}
+
+void RollingChecksum::roll(unsigned char out, unsigned char in)
+{
+    a = (a - out + in) & 0xFFFF;
+    b = (b - window * out + a) & 0xFFFF;
+}
+
+// ----------------------------------- DELTA ENCODER ------------------------------------
+
+DeltaEncoder::DeltaEncoder(size_t block_size, const std::vector<Delta::BlockSignature> &signatures)
+    : block_size(block_size), signatures(signatures)
+{
+    literal_bytes = 0;
+    matched_bytes = 0;
+    last_copy_position = 0;
+    last_is_copy = false;
+    max_batch = 0;
+
+    for (uint32_t i = 0; i < signatures.size(); i++)
+        weak_index.emplace(signatures[i].weak, i);
+}
+
+bool DeltaEncoder::findBlock(const unsigned char *window, uint32_t weak, uint32_t &block_index) const
+{
+    auto candidates = weak_index.equal_range(weak);
+    if (candidates.first == candidates.second)
+        return false;
+
+    // the strong hash is only computed once the cheap checksum matched
+    std::array<unsigned char, Delta::strong_length> strong = Delta::strongHash(window, block_size);
+
+    for (auto it = candidates.first; it != candidates.second; ++it)
+    {
+        if (signatures[it->second].strong == strong)
+        {
+            block_index = it->second;
+            return true;
+        }
+    }
+
+    return false;
+}
+
+bool DeltaEncoder::appendCopy(uint32_t block_index, const std::function<bool(Buffer &, bool)> &emit_batch)
+{
+    matched_bytes += block_size;
+
+    // extend the previous instruction when blocks are contiguous
+    if (last_is_copy)
+    {
+        size_t position = last_copy_position + sizeof(uint8_t);
+        uint32_t start = readUint32(batch, position);
+        uint32_t count = readUint32(batch, position);
+
+        if (start + count == block_index)
+        {
+            uint32_t network_count = htonl(count + 1);
+            memcpy(batch.data() + last_copy_position + sizeof(uint8_t) + sizeof(uint32_t), &network_count, sizeof(uint32_t));
+            return true;
+        }
+    }
+
+    if (batch.size() + COPY_OP_SIZE > max_batch)
+    {
+        if (!emit_batch(batch, false))
+            return false;
+        batch.clear();
+        last_is_copy = false;
+    }
+
+    last_copy_position = batch.size();
+    last_is_copy = true;
+    batch.push_back(Delta::OP_COPY);
+    appendUint32(batch, block_index);
+    appendUint32(batch, 1);
+
+    return true;
+}
+
+bool DeltaEncoder::appendLiteral(const unsigned char *data, size_t length, const std::function<bool(Buffer &, bool)> &emit_batch)
+{
+    literal_bytes += length;
+
+    while (length > 0)
+    {
+        if (batch.size() + LITERAL_HEADER_SIZE >= max_batch)
+        {
+            if (!emit_batch(batch, false))
+                return false;
+            batch.clear();
+            last_is_copy = false;
+        }
+
+        size_t piece = std::min(length, max_batch - batch.size() - LITERAL_HEADER_SIZE);
+
+        last_is_copy = false;
+        batch.push_back(Delta::OP_LITERAL);
+        appendUint32(batch, piece);
+        batch.insert(batch.end(), data, data + piece);
+
+        data += piece;
+        length -= piece;
+    }
+
+    return true;
+}
+
+bool DeltaEncoder::encode(const std::string &file_path, size_t max_batch, const std::function<bool(Buffer &, bool)> &emit_batch)
+{
+    std::ifstream input(file_path, std::ios::binary);
+    if (!input)
+        throw std::runtime_error("Unable to open file for reading.");
+
+    this->max_batch = max_batch;
+    batch.clear();
+    last_is_copy = false;
+
+    Buffer data;
+    size_t position = 0;      // start of the current window in data
+    size_t literal_start = 0; // first byte not yet covered by an instruction
+    bool window_ready = false;
+    RollingChecksum checksum;
+
+    // makes sure data holds at least needed bytes unless the file is over
+    auto fill = [&](size_t needed)
+    {
+        while (data.size() < needed && input)
+        {
+            size_t old_size = data.size();
+            data.resize(old_size + READ_SIZE);
+            input.read(reinterpret_cast<char *>(data.data() + old_size), READ_SIZE);
+            data.resize(old_size + input.gcount());
+        }
+        return data.size() >= needed;
+    };
+
+    while (fill(position + block_size))
+    {
+        if (!window_ready)
+        {
+            checksum.init(data.data() + position, block_size);
+            window_ready = true;
+        }
+
+        uint32_t block_index;
+        if (!weak_index.empty() && findBlock(data.data() + position, checksum.value(), block_index))
+        {
+            if (!appendLiteral(data.data() + literal_start, position - literal_start, emit_batch) ||
+                !appendCopy(block_index, emit_batch))
+                return false;
+
+            position += block_size;
+            literal_start = position;
+            window_ready = false;
+
+            // drop consumed bytes once they pile up
+            if (literal_start >= READ_SIZE)
+            {
+                data.erase(data.begin(), data.begin() + literal_start);
+                position -= literal_start;
+                literal_start = 0;
+            }
+            continue;
+        }
+
+        // bound the pending literal so memory stays flat on files with no match at all
+        if (position - literal_start >= max_batch)
+        {
+            if (!appendLiteral(data.data() + literal_start, position - literal_start, emit_batch))
+                return false;
+
+            data.erase(data.begin(), data.begin() + position);
+            position = 0;
+            literal_start = 0;
+        }
+
+        if (!fill(position + block_size + 1))
+        {
+            position++;
+            break;
+        }
+
+        checksum.roll(data[position], data[position + block_size]);
+        position++;
+    }
+
+    // whatever could not be matched travels as literal bytes
+    if (!appendLiteral(data.data() + literal_start, data.size() - literal_start, emit_batch))
+        return false;
+
+    return emit_batch(batch, true);
+}
+
+// ----------------------------------- DELTA PATCHER ------------------------------------
+
+DeltaPatcher::DeltaPatcher(std::istream &basis, const std::string &output_path, size_t block_size, uintmax_t expected_size)
+    : basis(basis)
+{
+    this->block_size = block_size;
+    this->expected_size = expected_size;
+    this->written = 0;
+
+    // the basis may have been read to its end already (e.g. for the signatures)
+    basis.clear();
+    if (!basis.seekg(0, std::ios::end))
+        throw std::runtime_error("Unable to open file for reading.");
+
+    block_count = static_cast<uintmax_t>(basis.tellg()) / block_size;
+
+    output.open(output_path, std::ios::binary | std::ios::out | std::ios::trunc);
+    if (!output)
+        throw std::runtime_error("Unable to create file.");
+}
+
+void DeltaPatcher::apply(const Buffer &instructions)
+{
+    size_t position = 0;
+    Buffer block(block_size);
+
+    while (position < instructions.size())
+    {
+        uint8_t op = instructions[position++];
+
+        if (op == Delta::OP_COPY)
+        {
+            uint32_t start = readUint32(instructions, position);
+            uint32_t count = readUint32(instructions, position);
+
+            if (start > block_count || count > block_count - start || written + (uintmax_t)count * block_size > expected_size)
+                throw std::runtime_error("Delta references blocks out of range.");
+
+            basis.clear();
+            basis.seekg((uintmax_t)start * block_size);
+
+            for (uint32_t i = 0; i < count; i++)
+            {
+                if (!basis.read(reinterpret_cast<char *>(block.data()), block_size))
+                    throw std::runtime_error("Unable to read from file.");
+                output.write(reinterpret_cast<const char *>(block.data()), block_size);
+            }
+            written += (uintmax_t)count * block_size;
+        }
+        else if (op == Delta::OP_LITERAL)
+        {
+            uint32_t length = readUint32(instructions, position);
+
+            if (length > instructions.size() - position || written + length > expected_size)
+                throw std::runtime_error("Malformed delta literal.");
+
+            output.write(reinterpret_cast<const char *>(instructions.data() + position), length);
+            position += length;
+            written += length;
+        }
+        else
+            throw std::runtime_error("Unknown delta instruction.");
+
+        if (!output)
+            throw std::runtime_error("Unable to write to file.");
+    }
+}
+
+void DeltaPatcher::close()
+{
+    output.close();
+
+    if (!output)
+        throw std::runtime_error("Unable to write to file.");
+}
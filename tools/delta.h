@@ -0,0 +1,102 @@
+#ifndef DELTA_H
+#define DELTA_H
+
+#include <array>
+#include <cstdint>
+#include <fstream>
+#include <functional>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+typedef std::vector<unsigned char> Buffer;
+
+// rsync style delta encoding: the receiver describes its copy of a file with one
+// (weak rolling checksum, strong hash) pair per block, the sender answers with a
+// stream of instructions that either copy blocks of that copy or carry new bytes.
+namespace Delta
+{
+    const size_t strong_length = 16; // truncated SHA-256
+    const size_t min_block_size = 512;
+    const size_t max_block_size = 64 * 1024;
+
+    // instruction types of the delta stream
+    const uint8_t OP_COPY = 0;    // block index (uint32) + block count (uint32)
+    const uint8_t OP_LITERAL = 1; // length (uint32) + bytes
+
+    struct BlockSignature
+    {
+        uint32_t weak;
+        std::array<unsigned char, strong_length> strong;
+    };
+
+    size_t chooseBlockSize(uintmax_t file_size);
+    uint32_t weakChecksum(const unsigned char *data, size_t length);
+    std::array<unsigned char, strong_length> strongHash(const unsigned char *data, size_t length);
+
+    // Signatures of every full block of a file, a trailing partial block is never matched
+    std::vector<BlockSignature> computeSignatures(const std::string &file_path, size_t block_size);
+    std::vector<BlockSignature> computeSignatures(std::istream &input, size_t block_size);
+}
+
+// Adler-32 like checksum that can slide one byte at a time over a window
+class RollingChecksum
+{
+private:
+    uint32_t a;
+    uint32_t b;
+    size_t window;
+
+public:
+    RollingChecksum();
+    void init(const unsigned char *data, size_t length);
+    void roll(unsigned char out, unsigned char in);
+    uint32_t value() const { return (b << 16) | (a & 0xFFFF); }
+};
+
+// Produces the delta stream of a new file against the signatures of the receiver's copy.
+// Instructions are handed out in batches of at most max_batch bytes, the last one flagged.
+class DeltaEncoder
+{
+private:
+    size_t block_size;
+    const std::vector<Delta::BlockSignature> &signatures;
+    std::unordered_multimap<uint32_t, uint32_t> weak_index;
+    uintmax_t literal_bytes;
+    uintmax_t matched_bytes;
+    Buffer batch;
+    size_t last_copy_position; // offset in batch of the last COPY instruction, to extend runs
+    bool last_is_copy;
+    size_t max_batch;
+
+    bool findBlock(const unsigned char *window, uint32_t weak, uint32_t &block_index) const;
+    bool appendCopy(uint32_t block_index, const std::function<bool(Buffer &, bool)> &emit_batch);
+    bool appendLiteral(const unsigned char *data, size_t length, const std::function<bool(Buffer &, bool)> &emit_batch);
+
+public:
+    DeltaEncoder(size_t block_size, const std::vector<Delta::BlockSignature> &signatures);
+    bool encode(const std::string &file_path, size_t max_batch, const std::function<bool(Buffer &, bool)> &emit_batch);
+    uintmax_t getLiteralBytes() const { return literal_bytes; }
+    uintmax_t getMatchedBytes() const { return matched_bytes; }
+};
+
+// Rebuilds the new version of a file from the old copy and a delta stream
+class DeltaPatcher
+{
+private:
+    size_t block_size;
+    uintmax_t block_count;
+    uintmax_t written;
+    uintmax_t expected_size;
+    std::istream &basis;
+    std::ofstream output;
+
+public:
+    // The basis can be any seekable stream, not only a plain file
+    DeltaPatcher(std::istream &basis, const std::string &output_path, size_t block_size, uintmax_t expected_size);
+    void apply(const Buffer &instructions);
+    bool isComplete() const { return written == expected_size; }
+    void close();
+};
+
+#endif // DELTA_H
@@ -5,7 +5,6 @@
 #include <iostream>
 #include <string>
 #include <vector>
-#include <numeric>
 #include "constants.h"
 
 using namespace std;
@@ -71,20 +70,27 @@ std::vector<unsigned char> File::readChunk(std::size_t chunkSize)
     return buffer;
 }
 
-bool File::exists(std::string filePath)
+void File::seek(uintmax_t position)
 {
-
-    if (!fs::exists(filePath))
+    if (!input_fs)
     {
-        return false;
+        throw std::runtime_error("File stream not open.");
     }
 
-    if (!fs::is_regular_file(filePath))
+    input_fs.clear();
+    input_fs.seekg(position);
+
+    if (!input_fs)
     {
-        return false;
+        throw std::runtime_error("Unable to seek in file.");
     }
+}
 
-    return true;
+bool File::exists(std::string filePath)
+{
+    // a single stat answers both, a missing file is simply not a regular one
+    std::error_code error;
+    return fs::is_regular_file(filePath, error);
 }
 
 void File::create(const std::string &filePath)
@@ -128,6 +134,15 @@ void File::writeChunk(const std::vector<unsigned char> &chunk)
     }
 }
 
+void File::close()
+{
+    if (input_fs.is_open())
+        input_fs.close();
+
+    if (output_fs.is_open())
+        output_fs.close();
+}
+
 File::~File()
 {
     if (input_fs.is_open())
@@ -145,7 +160,8 @@ std::string File::getFileNames(const std::string &folderPath)
     {
         for (const auto &entry : std::filesystem::directory_iterator(folderPath))
         {
-            if (entry.is_regular_file())
+            // hidden entries are server side temporaries, they can never be valid user file names
+            if (entry.is_regular_file() && isValidFileName(entry.path().filename().string()))
             {
                 fileNames.push_back(entry.path().filename().string());
             }
@@ -157,12 +173,15 @@ std::string File::getFileNames(const std::string &folderPath)
         return ""; // Return an empty string to indicate an error
     }
 
-    // Join the file names using commas
-    return std::accumulate(fileNames.begin(), fileNames.end(), std::string(),
-                           [](const std::string &a, const std::string &b) -> std::string
-                           {
-                               return a + (a.length() > 0 ? "," : "") + b;
-                           });
+    // Join the file names using commas, appending in place keeps it linear
+    std::string joined;
+    for (const std::string &name : fileNames)
+    {
+        if (!joined.empty())
+            joined += ',';
+        joined += name;
+    }
+    return joined;
 }
 
 int File::changeFileName(const std::string &filePath, const std::string &newFilePath)
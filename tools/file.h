@@ -6,6 +6,7 @@
 #include <string>
 #include <stdexcept>
 #include <fstream>
+#include <vector>
 
 namespace fs = std::filesystem;
 
@@ -22,9 +23,11 @@ public:
     void read(const std::string &filePath);
     void writeChunk(const std::vector<unsigned char> &chunk);
     void create(const std::string &filePath);
+    void close();
     static bool isValidFileName(const std::string &name);
     void displayFileInfo() const;
     std::vector<unsigned char> readChunk(std::size_t chunkSize);
+    void seek(uintmax_t position);
     uintmax_t getFileSize() { return file_size; }
     std::string get_file_name() { return file_name; };
     static bool exists(std::string filePath);
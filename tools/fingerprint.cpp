@@ -0,0 +1,135 @@
+#include "fingerprint.h"
+#include "chunker.h"
+#include "constants.h"
+#include <fstream>
+#include <stdexcept>
+
+// ----------------------------------- HASHER ------------------------------------
+
+Fingerprint::Hasher::Hasher() : context(EVP_MD_CTX_new(), EVP_MD_CTX_free)
+{
+    if (!context || EVP_DigestInit_ex(context.get(), EVP_sha256(), nullptr) != 1)
+        throw std::runtime_error("Unable to initialize SHA-256.");
+}
+
+void Fingerprint::Hasher::update(const unsigned char *data, size_t length)
+{
+    if (EVP_DigestUpdate(context.get(), data, length) != 1)
+        throw std::runtime_error("Unable to hash data.");
+}
+
+void Fingerprint::Hasher::update(std::istream &input)
+{
+    Buffer block(Storage::max_chunk);
+
+    while (input.read(reinterpret_cast<char *>(block.data()), block.size()) || input.gcount() > 0)
+        update(block.data(), input.gcount());
+
+    if (input.bad())
+        throw std::runtime_error("Unable to read from file.");
+}
+
+Fingerprint::Digest Fingerprint::Hasher::finish()
+{
+    Digest digest;
+    unsigned int digest_length = 0;
+
+    if (EVP_DigestFinal_ex(context.get(), digest.data(), &digest_length) != 1)
+        throw std::runtime_error("Unable to hash data.");
+
+    return digest;
+}
+
+// ----------------------------------- FINGERPRINTS ------------------------------------
+
+Fingerprint::Digest Fingerprint::sha256(const Buffer &data)
+{
+    Hasher hasher;
+    hasher.update(data);
+    return hasher.finish();
+}
+
+Fingerprint::Digest Fingerprint::sha256(std::istream &input)
+{
+    Hasher hasher;
+    hasher.update(input);
+    return hasher.finish();
+}
+
+Fingerprint::Digest Fingerprint::scanFile(const std::string &file_path, std::vector<ChunkRef> &chunks)
+{
+    std::ifstream input(file_path, std::ios::binary);
+    if (!input)
+        throw std::runtime_error("Unable to open file for reading.");
+
+    Hasher hasher;
+    ContentChunker chunker;
+    uintmax_t offset = 0;
+    Buffer block(Storage::max_chunk);
+
+    auto add_chunk = [&](const Buffer &chunk)
+    {
+        chunks.push_back({sha256(chunk), static_cast<uint32_t>(chunk.size()), offset});
+        offset += chunk.size();
+    };
+
+    chunks.clear();
+    while (input.read(reinterpret_cast<char *>(block.data()), block.size()) || input.gcount() > 0)
+    {
+        block.resize(input.gcount());
+        hasher.update(block);
+        chunker.push(block, add_chunk);
+        block.resize(Storage::max_chunk);
+    }
+
+    if (input.bad())
+        throw std::runtime_error("Unable to read from file.");
+
+    chunker.finish(add_chunk);
+    return hasher.finish();
+}
+
+Fingerprint::Digest Fingerprint::possessionProof(const Buffer &nonce, std::istream &input)
+{
+    Hasher hasher;
+    hasher.update(nonce);
+    hasher.update(input);
+    return hasher.finish();
+}
+
+std::string Fingerprint::toHex(const Digest &digest)
+{
+    static const char digits[] = "0123456789abcdef";
+    std::string hex(digest.size() * 2, '0');
+
+    for (size_t i = 0; i < digest.size(); i++)
+    {
+        hex[2 * i] = digits[digest[i] >> 4];
+        hex[2 * i + 1] = digits[digest[i] & 0x0F];
+    }
+    return hex;
+}
+
+bool Fingerprint::fromHex(const std::string &hex, Digest &digest)
+{
+    if (hex.size() != 2 * digest.size())
+        return false;
+
+    for (size_t i = 0; i < digest.size(); i++)
+    {
+        unsigned value = 0;
+        for (size_t j = 0; j < 2; j++)
+        {
+            char c = hex[2 * i + j];
+            value <<= 4;
+            if (c >= '0' && c <= '9')
+                value |= c - '0';
+            else if (c >= 'a' && c <= 'f')
+                value |= c - 'a' + 10;
+            else
+                return false;
+        }
+        digest[i] = static_cast<unsigned char>(value);
+    }
+    return true;
+}
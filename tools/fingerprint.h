@@ -0,0 +1,57 @@
+#ifndef FINGERPRINT_H
+#define FINGERPRINT_H
+
+#include <array>
+#include <cstdint>
+#include <istream>
+#include <memory>
+#include <string>
+#include <vector>
+#include <openssl/evp.h>
+
+typedef std::vector<unsigned char> Buffer;
+
+// Content fingerprints used to skip uploading data the server already stores
+namespace Fingerprint
+{
+    const size_t digest_length = 32; // SHA-256
+    const size_t nonce_length = 32;
+
+    typedef std::array<unsigned char, digest_length> Digest;
+
+    // One content defined chunk of a file, cut exactly as the server chunk store does
+    struct ChunkRef
+    {
+        Digest digest;
+        uint32_t size;
+        uintmax_t offset;
+    };
+
+    // Incremental SHA-256 for data that arrives in pieces
+    class Hasher
+    {
+    private:
+        std::unique_ptr<EVP_MD_CTX, void (*)(EVP_MD_CTX *)> context;
+
+    public:
+        Hasher();
+        void update(const unsigned char *data, size_t length);
+        void update(const Buffer &data) { update(data.data(), data.size()); }
+        void update(std::istream &input);
+        Digest finish();
+    };
+
+    Digest sha256(const Buffer &data);
+    Digest sha256(std::istream &input);
+
+    // Whole file digest and chunk list in a single read of the file
+    Digest scanFile(const std::string &file_path, std::vector<ChunkRef> &chunks);
+
+    // SHA-256(nonce | content): only someone holding the whole content can answer a fresh nonce
+    Digest possessionProof(const Buffer &nonce, std::istream &input);
+
+    std::string toHex(const Digest &digest);
+    bool fromHex(const std::string &hex, Digest &digest);
+}
+
+#endif // FINGERPRINT_H
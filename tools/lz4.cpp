@@ -0,0 +1,181 @@
+#include "lz4.h"
+#include <cstdint>
+#include <cstring>
+
+namespace
+{
+    const size_t MIN_MATCH = 4;
+    const size_t LAST_LITERALS = 5; // the last 5 bytes of a block are always literals
+    const size_t MF_LIMIT = 12;     // the last match must start at least 12 bytes before the end
+    const size_t MAX_OFFSET = 65535;
+    const int HASH_LOG = 12;
+
+    uint32_t read32(const unsigned char *p)
+    {
+        uint32_t value;
+        memcpy(&value, p, sizeof(uint32_t));
+        return value;
+    }
+
+    uint32_t hash32(uint32_t sequence)
+    {
+        return (sequence * 2654435761U) >> (32 - HASH_LOG);
+    }
+
+    // writes a length continuation (255, 255, ..., remainder) after a nibble saturated at 15
+    void writeLength(unsigned char *&op, size_t length)
+    {
+        while (length >= 255)
+        {
+            *op++ = 255;
+            length -= 255;
+        }
+        *op++ = static_cast<unsigned char>(length);
+    }
+
+    bool readLength(const std::vector<unsigned char> &input, size_t &ip, size_t &length)
+    {
+        unsigned char byte;
+        do
+        {
+            if (ip >= input.size())
+                return false;
+            byte = input[ip++];
+            length += byte;
+        } while (byte == 255);
+
+        return true;
+    }
+
+    void writeSequence(unsigned char *&op, const unsigned char *literals, size_t literal_length, size_t offset, size_t match_length)
+    {
+        unsigned char *token = op++;
+        *token = static_cast<unsigned char>((literal_length < 15 ? literal_length : 15) << 4);
+        if (literal_length >= 15)
+            writeLength(op, literal_length - 15);
+
+        if (literal_length > 0)
+            memcpy(op, literals, literal_length);
+        op += literal_length;
+
+        // the final sequence of a block only carries literals
+        if (match_length == 0)
+            return;
+
+        *op++ = static_cast<unsigned char>(offset & 0xFF);
+        *op++ = static_cast<unsigned char>(offset >> 8);
+
+        size_t encoded_match = match_length - MIN_MATCH;
+        *token |= static_cast<unsigned char>(encoded_match < 15 ? encoded_match : 15);
+        if (encoded_match >= 15)
+            writeLength(op, encoded_match - 15);
+    }
+}
+
+size_t lz4::compressBound(size_t input_size)
+{
+    return input_size + input_size / 255 + 16;
+}
+
+std::vector<unsigned char> lz4::compress(const std::vector<unsigned char> &input)
+{
+    return compress(input.data(), input.size());
+}
+
+std::vector<unsigned char> lz4::compress(const unsigned char *input, size_t input_size)
+{
+    std::vector<unsigned char> output(compressBound(input_size));
+    const unsigned char *in = input;
+    unsigned char *op = output.data();
+    size_t n = input_size;
+    size_t anchor = 0;
+
+    if (n > MF_LIMIT)
+    {
+        // positions are stored shifted by one so that zero means "empty slot"
+        std::vector<uint32_t> table(1 << HASH_LOG, 0);
+        size_t match_limit = n - MF_LIMIT;
+        size_t ip = 0;
+
+        while (ip < match_limit)
+        {
+            uint32_t sequence = read32(in + ip);
+            uint32_t h = hash32(sequence);
+            size_t candidate = table[h];
+            table[h] = static_cast<uint32_t>(ip + 1);
+
+            if (candidate == 0 || ip - (candidate - 1) > MAX_OFFSET || read32(in + candidate - 1) != sequence)
+            {
+                ip++;
+                continue;
+            }
+
+            size_t reference = candidate - 1;
+            size_t match_length = MIN_MATCH;
+            while (ip + match_length < n - LAST_LITERALS && in[reference + match_length] == in[ip + match_length])
+                match_length++;
+
+            writeSequence(op, in + anchor, ip - anchor, ip - reference, match_length);
+            ip += match_length;
+            anchor = ip;
+        }
+    }
+
+    writeSequence(op, in + anchor, n - anchor, 0, 0);
+    output.resize(op - output.data());
+
+    return output;
+}
+
+bool lz4::decompress(const std::vector<unsigned char> &input, std::vector<unsigned char> &output, size_t original_size)
+{
+    output.resize(original_size);
+    size_t ip = 0;
+    size_t op = 0;
+
+    while (true)
+    {
+        if (ip >= input.size())
+            return false;
+
+        unsigned char token = input[ip++];
+
+        size_t literal_length = token >> 4;
+        if (literal_length == 15 && !readLength(input, ip, literal_length))
+            return false;
+
+        if (literal_length > input.size() - ip || literal_length > original_size - op)
+            return false;
+
+        if (literal_length > 0)
+            memcpy(output.data() + op, input.data() + ip, literal_length);
+        ip += literal_length;
+        op += literal_length;
+
+        // the last sequence ends right after its literals
+        if (ip == input.size())
+            break;
+
+        if (input.size() - ip < 2)
+            return false;
+
+        size_t offset = input[ip] | (input[ip + 1] << 8);
+        ip += 2;
+        if (offset == 0 || offset > op)
+            return false;
+
+        size_t match_length = token & 0x0F;
+        if (match_length == 15 && !readLength(input, ip, match_length))
+            return false;
+        match_length += MIN_MATCH;
+
+        if (match_length > original_size - op)
+            return false;
+
+        // byte by byte copy since source and destination may overlap
+        for (size_t i = 0; i < match_length; i++, op++)
+            output[op] = output[op - offset];
+    }
+
+    return op == original_size;
+}
@@ -0,0 +1,22 @@
+#ifndef LZ4_H
+#define LZ4_H
+
+#include <cstddef>
+#include <vector>
+
+// Minimal LZ4 block format codec, wire compatible with the reference implementation
+// (see lz4_Block_format.md). Only raw blocks are handled, no frame format.
+namespace lz4
+{
+    // Worst case size of a compressed block for an input of input_size bytes
+    size_t compressBound(size_t input_size);
+
+    // Compress a whole block
+    std::vector<unsigned char> compress(const std::vector<unsigned char> &input);
+    std::vector<unsigned char> compress(const unsigned char *input, size_t input_size);
+
+    // Decompress a block whose original size is known, returns false on malformed input
+    bool decompress(const std::vector<unsigned char> &input, std::vector<unsigned char> &output, size_t original_size);
+}
+
+#endif // LZ4_H